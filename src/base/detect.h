@@ -152,6 +152,12 @@
 	#define CONF_ARCH_ENDIAN_LITTLE 1
 #endif
 
+/* instruction sets the compiler may use without checking the cpu, msvc
+   doesn't define __SSE2__ */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define CONF_SSE2 1
+#endif
+
 #ifndef CONF_FAMILY_STRING
 #define CONF_FAMILY_STRING "unknown"
 #endif
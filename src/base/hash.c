@@ -44,3 +44,61 @@ int sha256_comp(SHA256_DIGEST digest1, SHA256_DIGEST digest2)
 {
 	return mem_comp(digest1.data, digest2.data, sizeof(digest1.data));
 }
+
+static unsigned long long siphash_read64(const unsigned char *p)
+{
+	return (unsigned long long)p[0] | ((unsigned long long)p[1] << 8) |
+		((unsigned long long)p[2] << 16) | ((unsigned long long)p[3] << 24) |
+		((unsigned long long)p[4] << 32) | ((unsigned long long)p[5] << 40) |
+		((unsigned long long)p[6] << 48) | ((unsigned long long)p[7] << 56);
+}
+
+#define SIPHASH_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPHASH_ROUND(v0, v1, v2, v3) \
+	do \
+	{ \
+		v0 += v1; v1 = SIPHASH_ROTL(v1, 13); v1 ^= v0; v0 = SIPHASH_ROTL(v0, 32); \
+		v2 += v3; v3 = SIPHASH_ROTL(v3, 16); v3 ^= v2; \
+		v0 += v3; v3 = SIPHASH_ROTL(v3, 21); v3 ^= v0; \
+		v2 += v1; v1 = SIPHASH_ROTL(v1, 17); v1 ^= v2; v2 = SIPHASH_ROTL(v2, 32); \
+	} while(0)
+
+unsigned long long siphash24(const unsigned char *key, const void *message, size_t message_len)
+{
+	const unsigned char *data = (const unsigned char *)message;
+	const unsigned char *end = data + message_len - message_len % 8;
+	unsigned long long k0 = siphash_read64(key);
+	unsigned long long k1 = siphash_read64(key + 8);
+	unsigned long long v0 = k0 ^ 0x736f6d6570736575ULL;
+	unsigned long long v1 = k1 ^ 0x646f72616e646f6dULL;
+	unsigned long long v2 = k0 ^ 0x6c7967656e657261ULL;
+	unsigned long long v3 = k1 ^ 0x7465646279746573ULL;
+	unsigned long long b = (unsigned long long)message_len << 56;
+	int i;
+
+	for(; data != end; data += 8)
+	{
+		unsigned long long m = siphash_read64(data);
+		v3 ^= m;
+		SIPHASH_ROUND(v0, v1, v2, v3);
+		SIPHASH_ROUND(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+
+	// the remaining bytes go into the length block
+	for(i = 0; i < (int)(message_len % 8); i++)
+	{
+		b |= (unsigned long long)data[i] << (8 * i);
+	}
+	v3 ^= b;
+	SIPHASH_ROUND(v0, v1, v2, v3);
+	SIPHASH_ROUND(v0, v1, v2, v3);
+	v0 ^= b;
+
+	v2 ^= 0xff;
+	SIPHASH_ROUND(v0, v1, v2, v3);
+	SIPHASH_ROUND(v0, v1, v2, v3);
+	SIPHASH_ROUND(v0, v1, v2, v3);
+	SIPHASH_ROUND(v0, v1, v2, v3);
+	return v0 ^ v1 ^ v2 ^ v3;
+}
@@ -11,6 +11,8 @@ enum
 {
 	SHA256_DIGEST_LENGTH=256/8,
 	SHA256_MAXSTRSIZE=2*SHA256_DIGEST_LENGTH+1,
+
+	SIPHASH_KEY_LENGTH=16,
 };
 
 typedef struct
@@ -23,6 +25,10 @@ void sha256_str(SHA256_DIGEST digest, char *str, size_t max_len);
 int sha256_from_str(SHA256_DIGEST *out, const char *str);
 int sha256_comp(SHA256_DIGEST digest1, SHA256_DIGEST digest2);
 
+// SipHash-2-4, a keyed hash for short inputs. Not a replacement for a
+// cryptographic digest, but unpredictable without the key.
+unsigned long long siphash24(const unsigned char *key, const void *message, size_t message_len);
+
 static const SHA256_DIGEST SHA256_ZEROED = {{0}};
 
 #ifdef __cplusplus
@@ -31,6 +31,7 @@
 	#include <arpa/inet.h>
 
 	#include <dirent.h>
+	#include <sys/mman.h>
 
 	#if defined(CONF_PLATFORM_MACOSX)
 		// some lock and pthread functions are already defined in headers
@@ -56,6 +57,7 @@
 	#include <process.h>
 	#include <shellapi.h>
 	#include <wincrypt.h>
+	#include <io.h>
 #else
 	#error NOT IMPLEMENTED
 #endif
@@ -358,6 +360,48 @@ int io_close(IOHANDLE io)
 	return fclose((FILE*)io) != 0;
 }
 
+const void *io_map(IOHANDLE io, unsigned *size)
+{
+	long int length = io_length(io);
+	*size = 0;
+	if(length <= 0)
+		return 0;
+#if defined(CONF_FAMILY_WINDOWS)
+	{
+		HANDLE mapping = CreateFileMappingW((HANDLE)_get_osfhandle(_fileno((FILE*)io)), NULL, PAGE_READONLY, 0, 0, NULL);
+		void *data;
+		if(!mapping)
+			return 0;
+		data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		/* the view keeps the mapping alive */
+		CloseHandle(mapping);
+		if(!data)
+			return 0;
+		*size = length;
+		return data;
+	}
+#else
+	{
+		void *data = mmap(NULL, length, PROT_READ, MAP_SHARED, fileno((FILE*)io), 0);
+		if(data == MAP_FAILED)
+			return 0;
+		*size = length;
+		return data;
+	}
+#endif
+}
+
+void io_unmap(const void *data, unsigned size)
+{
+	if(!data)
+		return;
+#if defined(CONF_FAMILY_WINDOWS)
+	UnmapViewOfFile(data);
+#else
+	munmap((void *)data, size);
+#endif
+}
+
 int io_flush(IOHANDLE io)
 {
 	fflush((FILE*)io);
@@ -375,6 +419,9 @@ struct ASYNCIO
 	SEMAPHORE sphore;
 	void *thread;
 
+	AIO_FILTER filter;
+	void *filter_user;
+
 	unsigned char *buffer;
 	unsigned int buffer_size;
 	unsigned int read_pos;
@@ -449,6 +496,15 @@ static void aio_thread(void *user)
 		{
 			if(aio->finish != ASYNCIO_RUNNING)
 			{
+				if(aio->filter)
+				{
+					aio->filter(aio->io, 0, 0, 1, aio->filter_user);
+					io_flush(aio->io);
+					if(io_error(aio->io))
+					{
+						aio->error = io_error(aio->io);
+					}
+				}
 				if(aio->finish == ASYNCIO_CLOSE)
 				{
 					io_close(aio->io);
@@ -484,7 +540,14 @@ static void aio_thread(void *user)
 		aio->read_pos = (aio->read_pos + buffers.len1 + buffers.len2) % aio->buffer_size;
 		lock_unlock(aio->lock);
 
-		io_write(aio->io, local_buffer, local_buffer_len);
+		if(aio->filter)
+		{
+			aio->filter(aio->io, local_buffer, local_buffer_len, 0, aio->filter_user);
+		}
+		else
+		{
+			io_write(aio->io, local_buffer, local_buffer_len);
+		}
 		io_flush(aio->io);
 		result_io_error = io_error(aio->io);
 
@@ -494,6 +557,11 @@ static void aio_thread(void *user)
 }
 
 ASYNCIO *aio_new(IOHANDLE io)
+{
+	return aio_new_filter(io, 0, 0);
+}
+
+ASYNCIO *aio_new_filter(IOHANDLE io, AIO_FILTER filter, void *user)
 {
 	ASYNCIO *aio = malloc(sizeof(*aio));
 	if(!aio)
@@ -501,6 +569,8 @@ ASYNCIO *aio_new(IOHANDLE io)
 		return 0;
 	}
 	aio->io = io;
+	aio->filter = filter;
+	aio->filter_user = user;
 	aio->lock = lock_create();
 	sphore_init(&aio->sphore);
 	aio->thread = 0;
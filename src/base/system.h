@@ -297,6 +297,39 @@ long int io_length(IOHANDLE io);
 */
 int io_close(IOHANDLE io);
 
+/*
+	Function: io_map
+		Maps a whole file read-only into memory.
+
+	Parameters:
+		io - Handle to the file.
+		size - Pointer to receive the size of the file.
+
+	Returns:
+		Returns a pointer to the mapped file, 0 on failure or if the
+		file is empty.
+
+	Remarks:
+		- The mapping stays valid after the file is closed and has to
+		be released with <io_unmap>.
+		- Processes mapping the same file share the memory.
+		- The mapping is not a snapshot. If the file is overwritten in
+		place, the mapped data changes with it, and reading past a
+		truncated end raises SIGBUS. Files that may be mapped have to
+		be replaced by renaming a new file over them.
+*/
+const void *io_map(IOHANDLE io, unsigned *size);
+
+/*
+	Function: io_unmap
+		Releases a mapping created by <io_map>.
+
+	Parameters:
+		data - Pointer returned by <io_map>.
+		size - Size returned by <io_map>.
+*/
+void io_unmap(const void *data, unsigned size);
+
 /*
 	Function: io_flush
 		Empties all buffers and writes all pending data.
@@ -355,6 +388,27 @@ typedef struct ASYNCIO ASYNCIO;
 */
 ASYNCIO *aio_new(IOHANDLE io);
 
+typedef void (*AIO_FILTER)(IOHANDLE io, const void *data, unsigned size, int flush, void *user);
+
+/*
+	Function: aio_new_filter
+		Wraps a <IOHANDLE> for asynchronous writing, passing the data
+		through a filter that writes it to the file.
+
+	Parameters:
+		io - Handle to the file.
+		filter - Called on the writer thread with the queued data and
+			once with flush set before the file is closed.
+		user - Pointer passed to the filter.
+
+	Returns:
+		Returns the handle for asynchronous writing.
+
+	Remarks:
+		The filter must stay valid until <aio_wait> returned.
+*/
+ASYNCIO *aio_new_filter(IOHANDLE io, AIO_FILTER filter, void *user);
+
 /*
 	Function: aio_lock
 		Locks the ASYNCIO structure so it can't be written into by
@@ -75,9 +75,15 @@ class IDemoRecorder : public IInterface
 {
 	MACRO_INTERFACE("demorecorder", 0)
 public:
+	enum
+	{
+		STOPMODE_KEEP_FILE,
+		STOPMODE_REMOVE_FILE,
+	};
+
 	~IDemoRecorder() {}
 	virtual bool IsRecording() const = 0;
-	virtual int Stop() = 0;
+	virtual int Stop(int Mode = STOPMODE_KEEP_FILE, const char *pTargetFilename = "") = 0;
 	virtual int Length() const = 0;
 };
 
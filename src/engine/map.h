@@ -27,6 +27,10 @@ class IEngineMap : public IMap
 	MACRO_INTERFACE("enginemap", 0)
 public:
 	virtual bool Load(const char *pMapName) = 0;
+	// for maps that aren't registered in the kernel
+	virtual bool Load(class IStorage *pStorage, const char *pMapName) = 0;
+	// exchanges the loaded maps including their loaded data
+	virtual void Swap(IEngineMap *pOther) = 0;
 	virtual bool IsLoaded() = 0;
 	virtual void Unload() = 0;
 	virtual SHA256_DIGEST Sha256() = 0;
@@ -204,7 +204,10 @@ protected:
 public:
 	virtual void OnInit() = 0;
 	virtual void OnConsoleInit() = 0;
-	virtual void OnMapChange(char *pNewMapName, int MapNameSize) = 0;
+	// writes pMapName with the settings of its map config to a temporary
+	// file and points pNewMapName to it. Only uses the storage, the server
+	// calls it from the map preload thread
+	virtual void OnMapChange(const char *pMapName, char *pNewMapName, int MapNameSize) = 0;
 
 	// FullShutdown is true if the program is about to exit (not if the map is changed)
 	virtual void OnShutdown(bool FullShutdown = false) = 0;
@@ -0,0 +1,138 @@
+#include "dnsbl_cache.h"
+
+CDnsblCache::CDnsblCache()
+{
+	m_pfnStartLookup = 0;
+	m_pfnResult = 0;
+	m_pUser = 0;
+	m_aHost[0] = 0;
+	m_aKey[0] = 0;
+	m_aTtl[RESULT_BLACKLISTED] = 0;
+	m_aTtl[RESULT_WHITELISTED] = 0;
+	m_NextPrune = 0;
+}
+
+void CDnsblCache::Init(FStartLookup pfnStartLookup, FResult pfnResult, void *pUser)
+{
+	m_pfnStartLookup = pfnStartLookup;
+	m_pfnResult = pfnResult;
+	m_pUser = pUser;
+}
+
+unsigned CDnsblCache::Key(const NETADDR *pAddr)
+{
+	return (pAddr->ip[0]<<24) | (pAddr->ip[1]<<16) | (pAddr->ip[2]<<8) | pAddr->ip[3];
+}
+
+void CDnsblCache::Configure(const char *pHost, const char *pKey, int BlacklistedTtl, int WhitelistedTtl)
+{
+	m_aTtl[RESULT_BLACKLISTED] = BlacklistedTtl;
+	m_aTtl[RESULT_WHITELISTED] = WhitelistedTtl;
+	if(str_comp(m_aHost, pHost) == 0 && str_comp(m_aKey, pKey) == 0)
+		return;
+
+	str_copy(m_aHost, pHost, sizeof(m_aHost));
+	str_copy(m_aKey, pKey, sizeof(m_aKey));
+	Clear();
+}
+
+void CDnsblCache::Clear()
+{
+	// running lookups still have clients waiting for them
+	for(std::unordered_map<unsigned, CEntry>::iterator it = m_Entries.begin(); it != m_Entries.end();)
+	{
+		if(it->second.m_pLookup)
+			++it;
+		else
+			it = m_Entries.erase(it);
+	}
+}
+
+void CDnsblCache::Query(const NETADDR *pAddr, int ClientID, int64 Now)
+{
+	unsigned Key = CDnsblCache::Key(pAddr);
+	std::unordered_map<unsigned, CEntry>::iterator it = m_Entries.find(Key);
+	if(it != m_Entries.end())
+	{
+		CEntry *pEntry = &it->second;
+		if(pEntry->m_pLookup)
+		{
+			pEntry->m_aWaiters.push_back(ClientID);
+			return;
+		}
+		if(pEntry->m_Expires > Now)
+		{
+			CReady Ready = {ClientID, *pAddr, pEntry->m_Result};
+			m_aReady.push_back(Ready);
+			return;
+		}
+	}
+
+	// build dnsbl host lookup
+	char aBuf[256];
+	if(m_aKey[0] == '\0')
+	{
+		// without key
+		str_format(aBuf, sizeof(aBuf), "%d.%d.%d.%d.%s", pAddr->ip[3], pAddr->ip[2], pAddr->ip[1], pAddr->ip[0], m_aHost);
+	}
+	else
+	{
+		// with key
+		str_format(aBuf, sizeof(aBuf), "%s.%d.%d.%d.%d.%s", m_aKey, pAddr->ip[3], pAddr->ip[2], pAddr->ip[1], pAddr->ip[0], m_aHost);
+	}
+
+	CEntry *pEntry = &m_Entries[Key];
+	pEntry->m_Addr = *pAddr;
+	pEntry->m_Addr.port = 0;
+	pEntry->m_aWaiters.clear();
+	pEntry->m_aWaiters.push_back(ClientID);
+	pEntry->m_pLookup = m_pfnStartLookup(aBuf, m_pUser);
+	m_aPending.push_back(Key);
+}
+
+void CDnsblCache::Update(int64 Now)
+{
+	// hand out cached results
+	std::vector<CReady> aReady;
+	aReady.swap(m_aReady);
+	for(unsigned i = 0; i < aReady.size(); i++)
+		m_pfnResult(aReady[i].m_ClientID, &aReady[i].m_Addr, aReady[i].m_Result, m_pUser);
+
+	for(unsigned i = 0; i < m_aPending.size();)
+	{
+		CEntry *pEntry = &m_Entries[m_aPending[i]];
+		if(pEntry->m_pLookup->Status() != IJob::STATE_DONE)
+		{
+			i++;
+			continue;
+		}
+
+		// entry found -> blacklisted, not found -> whitelisted
+		int Result = pEntry->m_pLookup->m_Result == 0 ? RESULT_BLACKLISTED : RESULT_WHITELISTED;
+		pEntry->m_Result = Result;
+		pEntry->m_Expires = Now + m_aTtl[Result] * time_freq();
+		pEntry->m_pLookup = 0;
+		std::vector<int> aWaiters;
+		aWaiters.swap(pEntry->m_aWaiters);
+		NETADDR Addr = pEntry->m_Addr;
+		if(m_aTtl[Result] <= 0)
+			m_Entries.erase(m_aPending[i]);
+		m_aPending[i] = m_aPending.back();
+		m_aPending.pop_back();
+
+		for(unsigned w = 0; w < aWaiters.size(); w++)
+			m_pfnResult(aWaiters[w], &Addr, Result, m_pUser);
+	}
+
+	if(Now > m_NextPrune)
+	{
+		for(std::unordered_map<unsigned, CEntry>::iterator it = m_Entries.begin(); it != m_Entries.end();)
+		{
+			if(!it->second.m_pLookup && it->second.m_Expires <= Now)
+				it = m_Entries.erase(it);
+			else
+				++it;
+		}
+		m_NextPrune = Now + 60 * time_freq();
+	}
+}
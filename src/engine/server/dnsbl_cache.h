@@ -0,0 +1,76 @@
+#ifndef ENGINE_SERVER_DNSBL_CACHE_H
+#define ENGINE_SERVER_DNSBL_CACHE_H
+
+#include <base/system.h>
+
+#include <engine/engine.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// DNSBL results by IPv4 address. Clients asking for an address that is
+// being looked up wait for the same lookup, finished results are kept for
+// the configured time. Results are only handed out by `Update`, so only
+// running lookups get polled.
+class CDnsblCache
+{
+public:
+	enum
+	{
+		RESULT_BLACKLISTED=0,
+		RESULT_WHITELISTED,
+	};
+
+	// starts a lookup of the hostname, the result counts as blacklisted if
+	// `m_Result` of the finished lookup is 0
+	typedef std::shared_ptr<CHostLookup> (*FStartLookup)(const char *pHostname, void *pUser);
+	typedef void (*FResult)(int ClientID, const NETADDR *pAddr, int Result, void *pUser);
+
+	CDnsblCache();
+	void Init(FStartLookup pfnStartLookup, FResult pfnResult, void *pUser);
+
+	// TTLs in seconds, 0 doesn't keep the result. Changing the provider
+	// drops the cached results
+	void Configure(const char *pHost, const char *pKey, int BlacklistedTtl, int WhitelistedTtl);
+	void Query(const NETADDR *pAddr, int ClientID, int64 Now);
+	void Update(int64 Now);
+	void Clear();
+
+	int NumCached() const { return m_Entries.size() - m_aPending.size(); }
+	int NumPending() const { return m_aPending.size(); }
+
+private:
+	struct CEntry
+	{
+		NETADDR m_Addr;
+		int m_Result;
+		int64 m_Expires;
+		std::shared_ptr<CHostLookup> m_pLookup;
+		std::vector<int> m_aWaiters;
+	};
+
+	struct CReady
+	{
+		int m_ClientID;
+		NETADDR m_Addr;
+		int m_Result;
+	};
+
+	FStartLookup m_pfnStartLookup;
+	FResult m_pfnResult;
+	void *m_pUser;
+
+	char m_aHost[128];
+	char m_aKey[128];
+	int m_aTtl[2];
+
+	std::unordered_map<unsigned, CEntry> m_Entries;
+	std::vector<unsigned> m_aPending;
+	std::vector<CReady> m_aReady;
+	int64 m_NextPrune;
+
+	static unsigned Key(const NETADDR *pAddr);
+};
+
+#endif // ENGINE_SERVER_DNSBL_CACHE_H
@@ -33,8 +33,10 @@
 // DDRace
 #include <string.h>
 #include <vector>
+#include <zlib.h>
 #include <engine/shared/linereader.h>
 #include <game/extrainfo.h>
+#include <game/layers.h>
 
 #include "register.h"
 #include "server.h"
@@ -256,13 +258,15 @@ void CServer::CClient::Reset()
 	m_SnapRate = CClient::SNAPRATE_INIT;
 	m_Score = 0;
 	m_NextMapChunk = 0;
+	m_MapChunksSent = 0;
+	m_MapDownloadBudget = 0;
 }
 
 CServer::CServer()
 {
 	for(int i = 0; i < MAX_CLIENTS; i++)
-		m_aDemoRecorder[i] = CDemoRecorder(&m_SnapshotDelta, true);
-	m_aDemoRecorder[MAX_CLIENTS] = CDemoRecorder(&m_SnapshotDelta, false);
+		m_aDemoRecorder[i] = CDemoRecorder(&m_SnapshotDelta, &m_DemoWriter, true);
+	m_aDemoRecorder[MAX_CLIENTS] = CDemoRecorder(&m_SnapshotDelta, &m_DemoWriter, false);
 
 	m_TickSpeed = SERVER_TICK_SPEED;
 
@@ -273,6 +277,9 @@ CServer::CServer()
 
 	m_pCurrentMapData = 0;
 	m_CurrentMapSize = 0;
+	m_MapDownloadBudget = 0;
+	m_MapDownloadLastRefill = 0;
+	m_MapDownloadFirstClient = 0;
 
 	m_MapReload = 0;
 	m_ReloadedWhenEmpty = false;
@@ -651,14 +658,19 @@ int CServer::SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System)
 	{
 		if(ClientID == -1)
 		{
-			// broadcast
+			// broadcast, all clients keep the same copy for resending
+			CNetChunkData *pSharedData = 0;
+			if(Packet.m_Flags&NETSENDFLAG_VITAL && Packet.m_DataSize < NET_MAX_PAYLOAD)
+				pSharedData = CNetChunkData::Create(Packet.m_pData, Packet.m_DataSize);
 			int i;
 			for(i = 0; i < MAX_CLIENTS; i++)
 				if(m_aClients[i].m_State == CClient::STATE_INGAME)
 				{
 					Packet.m_ClientID = i;
-					m_NetServer.Send(&Packet);
+					m_NetServer.Send(&Packet, pSharedData);
 				}
+			if(pSharedData)
+				pSharedData->Release();
 		}
 		else
 			m_NetServer.Send(&Packet);
@@ -666,6 +678,16 @@ int CServer::SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System)
 	return 0;
 }
 
+const void *CServer::DemoSnapshot(const void *pData, int Size)
+{
+	// for antiping: if the projectile netobjects contains extra data, this is removed and the original content restored before recording demo
+	if(!SnapshotHasExtraInfo((const unsigned char *)pData))
+		return pData;
+	mem_copy(m_aDemoSnapshot, pData, Size);
+	SnapshotRemoveExtraInfo(m_aDemoSnapshot);
+	return m_aDemoSnapshot;
+}
+
 void CServer::DoSnapshot()
 {
 	GameServer()->OnPreSnap();
@@ -681,12 +703,8 @@ void CServer::DoSnapshot()
 		GameServer()->OnSnap(-1);
 		SnapshotSize = m_SnapshotBuilder.Finish(aData);
 
-		// for antiping: if the projectile netobjects contains extra data, this is removed and the original content restored before recording demo
-		unsigned char aExtraInfoRemoved[CSnapshot::MAX_SIZE];
-		mem_copy(aExtraInfoRemoved, aData, SnapshotSize);
-		SnapshotRemoveExtraInfo(aExtraInfoRemoved);
 		// write snapshot
-		m_aDemoRecorder[MAX_CLIENTS].RecordSnapshot(Tick(), aExtraInfoRemoved, SnapshotSize);
+		m_aDemoRecorder[MAX_CLIENTS].RecordSnapshot(Tick(), DemoSnapshot(aData, SnapshotSize), SnapshotSize);
 	}
 
 	// create snapshots for all clients
@@ -724,16 +742,6 @@ void CServer::DoSnapshot()
 			// finish snapshot
 			SnapshotSize = m_SnapshotBuilder.Finish(pData);
 
-			if(m_aDemoRecorder[i].IsRecording())
-			{
-				// for antiping: if the projectile netobjects contains extra data, this is removed and the original content restored before recording demo
-				unsigned char aExtraInfoRemoved[CSnapshot::MAX_SIZE];
-				mem_copy(aExtraInfoRemoved, aData, SnapshotSize);
-				SnapshotRemoveExtraInfo(aExtraInfoRemoved);
-				// write snapshot
-				m_aDemoRecorder[i].RecordSnapshot(Tick(), aExtraInfoRemoved, SnapshotSize);
-			}
-
 			Crc = pData->Crc();
 
 			// remove old snapshos
@@ -761,6 +769,16 @@ void CServer::DoSnapshot()
 			// create delta
 			DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, aDeltaData);
 
+			if(m_aDemoRecorder[i].IsRecording())
+			{
+				// the demo can use the network delta if nothing had to be removed
+				const void *pDemoData = DemoSnapshot(pData, SnapshotSize);
+				if(pDemoData == pData)
+					m_aDemoRecorder[i].RecordSnapshotShared(Tick(), pData, SnapshotSize, DeltaTick, aDeltaData, DeltaSize);
+				else
+					m_aDemoRecorder[i].RecordSnapshot(Tick(), pDemoData, SnapshotSize);
+			}
+
 			if(DeltaSize)
 			{
 				// compress it
@@ -844,6 +862,8 @@ int CServer::NewClientNoAuthCallback(int ClientID, void *pUser)
 	pThis->m_aClients[ClientID].m_AuthTries = 0;
 	pThis->m_aClients[ClientID].m_pRconCmdToSend = 0;
 	pThis->m_aClients[ClientID].Reset();
+	if(g_Config.m_SvDnsbl)
+		pThis->InitDnsbl(ClientID);
 
 	pThis->SendMap(ClientID);
 #if defined(CONF_FAMILY_UNIX)
@@ -869,6 +889,8 @@ int CServer::NewClientCallback(int ClientID, void *pUser)
 	pThis->m_aClients[ClientID].m_TrafficSince = 0;
 	memset(&pThis->m_aClients[ClientID].m_Addr, 0, sizeof(NETADDR));
 	pThis->m_aClients[ClientID].Reset();
+	if(g_Config.m_SvDnsbl)
+		pThis->InitDnsbl(ClientID);
 	pThis->GameServer()->OnClientEngineJoin(ClientID);
 
 #if defined(CONF_FAMILY_UNIX)
@@ -885,22 +907,86 @@ void CServer::InitDnsbl(int ClientID)
 	if(Addr.type != NETTYPE_IPV4)
 		return;
 
-	// build dnsbl host lookup
-	char aBuf[256];
-	if(g_Config.m_SvDnsblKey[0] == '\0')
+	// the result arrives through DnsblResultCallback, even if it's cached
+	m_DnsblCache.Configure(g_Config.m_SvDnsblHost, g_Config.m_SvDnsblKey, g_Config.m_SvDnsblBlacklistedTtl, g_Config.m_SvDnsblWhitelistedTtl);
+	m_DnsblCache.Query(&Addr, ClientID, time_get());
+	m_aClients[ClientID].m_DnsblState = CClient::DNSBL_STATE_PENDING;
+}
+
+void CServer::UpdateDnsbl()
+{
+	if(!g_Config.m_SvDnsbl)
 	{
-		// without key
-		str_format(aBuf, sizeof(aBuf), "%d.%d.%d.%d.%s", Addr.ip[3], Addr.ip[2], Addr.ip[1], Addr.ip[0], g_Config.m_SvDnsblHost);
+		m_DnsblEnabled = false;
+		return;
 	}
-	else
+
+	// catch up with clients that joined before it was turned on
+	if(!m_DnsblEnabled || (g_Config.m_SvDnsblBan && !m_DnsblBanEnabled))
 	{
-		// with key
-		str_format(aBuf, sizeof(aBuf), "%s.%d.%d.%d.%d.%s", g_Config.m_SvDnsblKey, Addr.ip[3], Addr.ip[2], Addr.ip[1], Addr.ip[0], g_Config.m_SvDnsblHost);
+		for(int ClientID = 0; ClientID < MAX_CLIENTS; ClientID++)
+		{
+			if(m_aClients[ClientID].m_State == CClient::STATE_EMPTY)
+				continue;
+
+			if(m_aClients[ClientID].m_DnsblState == CClient::DNSBL_STATE_NONE)
+				InitDnsbl(ClientID);
+			else if(m_aClients[ClientID].m_DnsblState == CClient::DNSBL_STATE_BLACKLISTED && g_Config.m_SvDnsblBan)
+				m_NetServer.NetBan()->BanAddr(m_NetServer.ClientAddr(ClientID), 60*10, "Blacklisted by DNSBL");
+		}
 	}
+	m_DnsblEnabled = true;
+	m_DnsblBanEnabled = g_Config.m_SvDnsblBan;
 
-	IEngine *pEngine = Kernel()->RequestInterface<IEngine>();
-	pEngine->AddJob(m_aClients[ClientID].m_pDnsblLookup = std::make_shared<CHostLookup>(aBuf, NETTYPE_IPV4));
-	m_aClients[ClientID].m_DnsblState = CClient::DNSBL_STATE_PENDING;
+	m_DnsblCache.Configure(g_Config.m_SvDnsblHost, g_Config.m_SvDnsblKey, g_Config.m_SvDnsblBlacklistedTtl, g_Config.m_SvDnsblWhitelistedTtl);
+	m_DnsblCache.Update(time_get());
+}
+
+void CServer::SetDnsblResult(int ClientID, int Result)
+{
+	if(Result == CDnsblCache::RESULT_WHITELISTED)
+	{
+		// entry not found -> whitelisted
+		m_aClients[ClientID].m_DnsblState = CClient::DNSBL_STATE_WHITELISTED;
+		return;
+	}
+
+	// entry found -> blacklisted
+	m_aClients[ClientID].m_DnsblState = CClient::DNSBL_STATE_BLACKLISTED;
+
+	// console output
+	char aAddrStr[NETADDR_MAXSTRSIZE];
+	net_addr_str(m_NetServer.ClientAddr(ClientID), aAddrStr, sizeof(aAddrStr), true);
+
+	char aBuf[256];
+
+	str_format(aBuf, sizeof(aBuf), "ClientID=%d addr=%s secure=%s blacklisted", ClientID, aAddrStr, m_NetServer.HasSecurityToken(ClientID)?"yes":"no");
+
+	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "dnsbl", aBuf);
+
+	if(g_Config.m_SvDnsblBan)
+		m_NetServer.NetBan()->BanAddr(m_NetServer.ClientAddr(ClientID), 60*10, "Blacklisted by DNSBL");
+}
+
+std::shared_ptr<CHostLookup> CServer::DnsblLookupCallback(const char *pHostname, void *pUser)
+{
+	CServer *pThis = (CServer *)pUser;
+	std::shared_ptr<CHostLookup> pLookup = std::make_shared<CHostLookup>(pHostname, NETTYPE_IPV4);
+	pThis->Kernel()->RequestInterface<IEngine>()->AddJob(pLookup);
+	return pLookup;
+}
+
+void CServer::DnsblResultCallback(int ClientID, const NETADDR *pAddr, int Result, void *pUser)
+{
+	CServer *pThis = (CServer *)pUser;
+
+	// the slot might belong to someone else by now
+	if(pThis->m_aClients[ClientID].m_State == CClient::STATE_EMPTY ||
+		pThis->m_aClients[ClientID].m_DnsblState != CClient::DNSBL_STATE_PENDING ||
+		net_addr_comp_noport(pThis->m_NetServer.ClientAddr(ClientID), pAddr) != 0)
+		return;
+
+	pThis->SetDnsblResult(ClientID, Result);
 }
 
 #ifdef CONF_FAMILY_UNIX
@@ -991,31 +1077,58 @@ void CServer::SendMap(int ClientID)
 	}
 
 	m_aClients[ClientID].m_NextMapChunk = 0;
+	m_aClients[ClientID].m_MapChunksSent = 0;
 }
 
-void CServer::SendMapData(int ClientID, int Chunk)
+void CServer::PrepareMapChunks()
 {
-	unsigned int ChunkSize = 1024-128;
-	unsigned int Offset = Chunk * ChunkSize;
-	int Last = 0;
+	// the chunk starting at the end of the map is sent as empty last chunk
+	int NumChunks = m_CurrentMapSize/MAP_CHUNK_SIZE + 1;
+	m_aMapChunkHeaders.resize(NumChunks);
+	for(int Chunk = 0; Chunk < NumChunks; Chunk++)
+	{
+		unsigned int Offset = Chunk * MAP_CHUNK_SIZE;
+		unsigned int ChunkSize = min((unsigned int)MAP_CHUNK_SIZE, m_CurrentMapSize-Offset);
+		int Last = Offset+MAP_CHUNK_SIZE >= m_CurrentMapSize;
 
+		CMsgPacker Msg(NETMSG_MAP_DATA);
+		Msg.AddInt(Last);
+		Msg.AddInt(m_CurrentMapCrc);
+		Msg.AddInt(Chunk);
+		Msg.AddInt(ChunkSize);
+
+		CMapChunkHeader *pHeader = &m_aMapChunkHeaders[Chunk];
+		dbg_assert(Msg.Size() <= (int)sizeof(pHeader->m_aData), "map chunk header too large");
+		mem_copy(pHeader->m_aData, Msg.Data(), Msg.Size());
+		pHeader->m_Size = Msg.Size();
+		// system message, see SendMsgEx
+		pHeader->m_aData[0] = (pHeader->m_aData[0]<<1) | 1;
+	}
+}
+
+void CServer::SendMapData(int ClientID, int Chunk)
+{
 	// drop faulty map data requests
-	if(Chunk < 0 || Offset > m_CurrentMapSize)
+	if(Chunk < 0 || Chunk >= (int)m_aMapChunkHeaders.size())
 		return;
 
-	if(Offset+ChunkSize >= m_CurrentMapSize)
-	{
-		ChunkSize = m_CurrentMapSize-Offset;
-		Last = 1;
-	}
+	const CMapChunkHeader *pHeader = &m_aMapChunkHeaders[Chunk];
+	unsigned int Offset = Chunk * MAP_CHUNK_SIZE;
+	unsigned int ChunkSize = min((unsigned int)MAP_CHUNK_SIZE, m_CurrentMapSize-Offset);
 
-	CMsgPacker Msg(NETMSG_MAP_DATA);
-	Msg.AddInt(Last);
-	Msg.AddInt(m_CurrentMapCrc);
-	Msg.AddInt(Chunk);
-	Msg.AddInt(ChunkSize);
-	Msg.AddRaw(&m_pCurrentMapData[Offset], ChunkSize);
-	SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, ClientID, true);
+	// the header is already packed, only the data has to be copied
+	unsigned char aData[MAP_CHUNK_HEADER_SIZE+MAP_CHUNK_SIZE];
+	mem_copy(aData, pHeader->m_aData, pHeader->m_Size);
+	mem_copy(aData+pHeader->m_Size, &m_pCurrentMapData[Offset], ChunkSize);
+
+	// demo players ignore system messages, so the map data isn't recorded
+	CNetChunk Packet;
+	mem_zero(&Packet, sizeof(CNetChunk));
+	Packet.m_ClientID = ClientID;
+	Packet.m_pData = aData;
+	Packet.m_DataSize = pHeader->m_Size+ChunkSize;
+	Packet.m_Flags = NETSENDFLAG_VITAL|NETSENDFLAG_FLUSH;
+	m_NetServer.Send(&Packet);
 
 	if(g_Config.m_Debug)
 	{
@@ -1025,6 +1138,69 @@ void CServer::SendMapData(int ClientID, int Chunk)
 	}
 }
 
+// budgets are kept in bytes times time_freq(), so no fraction of a byte
+// gets lost between two refills, however short the time between them
+static int64 RefillMapDownloadBudget(int64 Budget, int Rate, int64 Elapsed, int ChunkSize)
+{
+	// at most a quarter second of bandwidth can be saved up
+	int64 Max = max((int64)Rate*1024/4, (int64)ChunkSize)*time_freq();
+	return min(Budget + Elapsed*Rate*1024, Max);
+}
+
+void CServer::SendMapChunks()
+{
+	int64 Now = time_get();
+	int64 Elapsed = min(Now - m_MapDownloadLastRefill, time_freq());
+	m_MapDownloadLastRefill = Now;
+
+	int TotalRate = g_Config.m_SvMapDownloadTotalRate;
+	int ClientRate = g_Config.m_SvMapDownloadRate;
+	int64 ChunkCost = (int64)MAP_CHUNK_SIZE*time_freq();
+	if(TotalRate)
+		m_MapDownloadBudget = RefillMapDownloadBudget(m_MapDownloadBudget, TotalRate, Elapsed, MAP_CHUNK_SIZE);
+
+	int NumChunks = m_aMapChunkHeaders.size();
+	bool Downloading[MAX_CLIENTS];
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		CClient *pClient = &m_aClients[i];
+		// the first request starts the download, the client might have the map already
+		Downloading[i] = g_Config.m_SvFastDownload && pClient->m_State == CClient::STATE_CONNECTING && pClient->m_NextMapChunk > 0 && pClient->m_MapChunksSent < NumChunks;
+		if(Downloading[i] && ClientRate)
+			pClient->m_MapDownloadBudget = RefillMapDownloadBudget(pClient->m_MapDownloadBudget, ClientRate, Elapsed, MAP_CHUNK_SIZE);
+	}
+
+	// one chunk per client and round, so the total rate is shared fairly
+	bool Sent = true;
+	while(Sent)
+	{
+		Sent = false;
+		for(int n = 0; n < MAX_CLIENTS; n++)
+		{
+			int ClientID = (m_MapDownloadFirstClient + n) % MAX_CLIENTS;
+			CClient *pClient = &m_aClients[ClientID];
+			if(!Downloading[ClientID] || pClient->m_MapChunksSent >= min(pClient->m_NextMapChunk + g_Config.m_SvMapWindow, NumChunks))
+				continue;
+			if(TotalRate && m_MapDownloadBudget < ChunkCost)
+			{
+				// continue with this client next time
+				m_MapDownloadFirstClient = ClientID;
+				return;
+			}
+			if(ClientRate && pClient->m_MapDownloadBudget < ChunkCost)
+				continue;
+
+			SendMapData(ClientID, pClient->m_MapChunksSent);
+			pClient->m_MapChunksSent++;
+			if(TotalRate)
+				m_MapDownloadBudget -= ChunkCost;
+			if(ClientRate)
+				pClient->m_MapDownloadBudget -= ChunkCost;
+			Sent = true;
+		}
+	}
+}
+
 void CServer::SendConnectionReady(int ClientID)
 {
 	CMsgPacker Msg(NETMSG_CON_READY);
@@ -1186,14 +1362,7 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 				return;
 			}
 
-			if(Chunk == 0)
-			{
-				for(int i = 0; i < g_Config.m_SvMapWindow; i++)
-				{
-					SendMapData(ClientID, i);
-				}
-			}
-			SendMapData(ClientID, g_Config.m_SvMapWindow + m_aClients[ClientID].m_NextMapChunk);
+			// moves the window, SendMapChunks sends the chunks
 			m_aClients[ClientID].m_NextMapChunk++;
 		}
 		else if(Msg == NETMSG_READY)
@@ -1741,6 +1910,8 @@ void CServer::PumpNetwork()
 		}
 	}
 
+	SendMapChunks();
+
 	m_ServerBan.Update();
 	m_Econ.Update();
 }
@@ -1757,14 +1928,81 @@ char *CServer::GetMapName()
 	return pMapShortName;
 }
 
-int CServer::LoadMap(const char *pMapName)
+CMapPreload::CMapPreload(IStorage *pStorage, IGameServer *pGameServer, const char *pMapName)
+{
+	m_pStorage = pStorage;
+	m_pGameServer = pGameServer;
+	str_copy(m_aMapName, pMapName, sizeof(m_aMapName));
+	str_format(m_aFilename, sizeof(m_aFilename), "maps/%s.map", pMapName);
+	m_pMap = CreateEngineMap();
+	m_Loaded = false;
+}
+
+CMapPreload::~CMapPreload()
+{
+	delete m_pMap;
+
+	// the map config made a temporary copy of the map
+	char aBuf[MAX_PATH_LENGTH];
+	str_format(aBuf, sizeof(aBuf), "maps/%s.map", m_aMapName);
+	if(str_comp(aBuf, m_aFilename) != 0)
+		m_pStorage->RemoveFile(m_aFilename, IStorage::TYPE_SAVE);
+}
+
+void CMapPreload::Run()
+{
+	m_pGameServer->OnMapChange(m_aMapName, m_aFilename, sizeof(m_aFilename));
+	m_Loaded = m_pMap->Load(m_pStorage, m_aFilename);
+	if(!m_Loaded)
+		return;
+
+	// decompress everything CCollision needs, the data stays loaded after the swap
+	CLayers Layers;
+	Layers.Init(m_pMap);
+	if(!Layers.GameLayer())
+		return;
+	m_pMap->GetData(Layers.GameLayer()->m_Data);
+	if(Layers.TeleLayer())
+		m_pMap->GetData(Layers.TeleLayer()->m_Tele);
+	if(Layers.SpeedupLayer())
+		m_pMap->GetData(Layers.SpeedupLayer()->m_Speedup);
+	if(Layers.FrontLayer())
+		m_pMap->GetData(Layers.FrontLayer()->m_Front);
+	if(Layers.SwitchLayer())
+		m_pMap->GetData(Layers.SwitchLayer()->m_Switch);
+	if(Layers.TuneLayer())
+		m_pMap->GetData(Layers.TuneLayer()->m_Tune);
+}
+
+void CServer::StartMapPreload(const char *pMapName)
+{
+	// a preload that isn't needed anymore goes away once its job is done
+	IEngine *pEngine = Kernel()->RequestInterface<IEngine>();
+	pEngine->AddJob(m_pMapPreload = std::make_shared<CMapPreload>(Storage(), GameServer(), pMapName));
+}
+
+int CServer::LoadMap(const char *pMapName, CMapPreload *pPreload)
 {
 	char aBuf[512];
-	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
-	GameServer()->OnMapChange(aBuf, sizeof(aBuf));
+	if(pPreload)
+	{
+		// opened in the background already, take it over
+		if(!pPreload->m_Loaded)
+			return 0;
+		str_copy(aBuf, pPreload->m_aFilename, sizeof(aBuf));
+		m_pMap->Swap(pPreload->m_pMap);
+	}
+	else
+	{
+		str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
+		GameServer()->OnMapChange(pMapName, aBuf, sizeof(aBuf));
 
-	if(!m_pMap->Load(aBuf))
-		return 0;
+		if(!m_pMap->Load(aBuf))
+		{
+			RemoveTempMap(pMapName, aBuf);
+			return 0;
+		}
+	}
 
 	for (int i = 0; i < MAX_CLIENTS; i++)
 	{
@@ -1778,15 +2016,8 @@ int CServer::LoadMap(const char *pMapName)
 		if(!m_aDemoRecorder[i].IsRecording())
 			continue;
 
-		m_aDemoRecorder[i].Stop();
-
-		// remove tmp demos
-		if(i < MAX_CLIENTS)
-		{
-			char aPath[256];
-			str_format(aPath, sizeof(aPath), "demos/%s_%d_%d_tmp.demo", m_aCurrentMap, g_Config.m_SvPort, i);
-			Storage()->RemoveFile(aPath, IStorage::TYPE_SAVE);
-		}
+		// player demos are only kept when they get saved
+		m_aDemoRecorder[i].Stop(i < MAX_CLIENTS ? IDemoRecorder::STOPMODE_REMOVE_FILE : IDemoRecorder::STOPMODE_KEEP_FILE);
 	}
 
 	// reinit snapshot ids
@@ -1795,15 +2026,6 @@ int CServer::LoadMap(const char *pMapName)
 	// get the crc of the map
 	m_CurrentMapSha256 = m_pMap->Sha256();
 	m_CurrentMapCrc = m_pMap->Crc();
-	char aBufMsg[256];
-	char aSha256[SHA256_MAXSTRSIZE];
-	sha256_str(m_CurrentMapSha256, aSha256, sizeof(aSha256));
-	str_format(aBufMsg, sizeof(aBufMsg), "%s sha256 is %s", aBuf, aSha256);
-	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBufMsg);
-	str_format(aBufMsg, sizeof(aBufMsg), "%s crc is %08x", aBuf, m_CurrentMapCrc);
-	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBufMsg);
-
-	str_copy(m_aCurrentMap, pMapName, sizeof(m_aCurrentMap));
 
 	// load complete map into memory for download
 	{
@@ -1814,6 +2036,30 @@ int CServer::LoadMap(const char *pMapName)
 		io_read(File, m_pCurrentMapData, m_CurrentMapSize);
 		io_close(File);
 	}
+	if(crc32(0, m_pCurrentMapData, m_CurrentMapSize) != m_CurrentMapCrc)
+	{
+		// what clients download has to match what they're told
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "map file changed while loading it");
+		m_CurrentMapCrc = crc32(0, m_pCurrentMapData, m_CurrentMapSize);
+		m_CurrentMapSha256 = sha256(m_pCurrentMapData, m_CurrentMapSize);
+	}
+
+	char aBufMsg[256];
+	char aSha256[SHA256_MAXSTRSIZE];
+	sha256_str(m_CurrentMapSha256, aSha256, sizeof(aSha256));
+	str_format(aBufMsg, sizeof(aBufMsg), "%s sha256 is %s", aBuf, aSha256);
+	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBufMsg);
+	str_format(aBufMsg, sizeof(aBufMsg), "%s crc is %08x", aBuf, m_CurrentMapCrc);
+	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBufMsg);
+
+	str_copy(m_aCurrentMap, pMapName, sizeof(m_aCurrentMap));
+
+	PrepareMapChunks();
+
+	// the map stays readable after the temporary file is gone, a preload
+	// removes its own
+	if(!pPreload)
+		RemoveTempMap(pMapName, aBuf);
 
 	for(int i=0; i<MAX_CLIENTS; i++)
 		m_aPrevStates[i] = m_aClients[i].m_State;
@@ -1821,6 +2067,14 @@ int CServer::LoadMap(const char *pMapName)
 	return 1;
 }
 
+void CServer::RemoveTempMap(const char *pMapName, const char *pFilename)
+{
+	char aBuf[MAX_PATH_LENGTH];
+	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
+	if(str_comp(aBuf, pFilename) != 0)
+		Storage()->RemoveFile(pFilename, IStorage::TYPE_SAVE);
+}
+
 void CServer::InitRegister(CNetServer *pNetServer, IEngineMasterServer *pMasterServer, IConsole *pConsole)
 {
 	m_Register.Init(pNetServer, pMasterServer, pConsole);
@@ -1868,6 +2122,9 @@ int CServer::Run()
 	}
 
 	m_NetServer.SetCallbacks(NewClientCallback, NewClientNoAuthCallback, ClientRejoinCallback, DelClientCallback, this);
+	m_DnsblCache.Init(DnsblLookupCallback, DnsblResultCallback, this);
+	m_DnsblEnabled = false;
+	m_DnsblBanEnabled = false;
 
 	m_Econ.Init(Console(), &m_ServerBan);
 
@@ -1916,11 +2173,26 @@ int CServer::Run()
 
 			// load new map TODO: don't poll this
 			if(str_comp(g_Config.m_SvMap, m_aCurrentMap) != 0 || m_MapReload)
+			{
+				// keep the current map running while the new one loads
+				if(g_Config.m_SvMapPreload && (!m_pMapPreload || str_comp(m_pMapPreload->m_aMapName, g_Config.m_SvMap) != 0))
+					StartMapPreload(g_Config.m_SvMap);
+			}
+			else if(m_pMapPreload)
+			{
+				// changed back to the current map, don't keep the other one
+				m_pMapPreload.reset();
+			}
+			if((str_comp(g_Config.m_SvMap, m_aCurrentMap) != 0 || m_MapReload) && (!m_pMapPreload || m_pMapPreload->Status() == IJob::STATE_DONE))
 			{
 				m_MapReload = 0;
 
 				// load map
-				if(LoadMap(g_Config.m_SvMap))
+				std::shared_ptr<CMapPreload> pPreload = m_pMapPreload;
+				m_pMapPreload.reset();
+				if(pPreload && str_comp(pPreload->m_aMapName, g_Config.m_SvMap) != 0)
+					pPreload.reset();
+				if(LoadMap(g_Config.m_SvMap, pPreload.get()))
 				{
 					// new map loaded
 					GameServer()->OnShutdown();
@@ -1955,49 +2227,7 @@ int CServer::Run()
 			}
 
 			// handle dnsbl
-			if (g_Config.m_SvDnsbl)
-			{
-				for (int ClientID = 0; ClientID < MAX_CLIENTS; ClientID++)
-				{
-					if (m_aClients[ClientID].m_State == CClient::STATE_EMPTY)
-						continue;
-
-					if (m_aClients[ClientID].m_DnsblState == CClient::DNSBL_STATE_NONE)
-					{
-						// initiate dnsbl lookup
-						InitDnsbl(ClientID);
-					}
-					else if (m_aClients[ClientID].m_DnsblState == CClient::DNSBL_STATE_PENDING &&
-								m_aClients[ClientID].m_pDnsblLookup->Status() == IJob::STATE_DONE)
-					{
-
-						if (m_aClients[ClientID].m_pDnsblLookup->m_Result != 0)
-						{
-							// entry not found -> whitelisted
-							m_aClients[ClientID].m_DnsblState = CClient::DNSBL_STATE_WHITELISTED;
-						}
-						else
-						{
-							// entry found -> blacklisted
-							m_aClients[ClientID].m_DnsblState = CClient::DNSBL_STATE_BLACKLISTED;
-
-							// console output
-							char aAddrStr[NETADDR_MAXSTRSIZE];
-							net_addr_str(m_NetServer.ClientAddr(ClientID), aAddrStr, sizeof(aAddrStr), true);
-
-							char aBuf[256];
-
-							str_format(aBuf, sizeof(aBuf), "ClientID=%d addr=%s secure=%s blacklisted", ClientID, aAddrStr, m_NetServer.HasSecurityToken(ClientID)?"yes":"no");
-
-							Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "dnsbl", aBuf);
-						}
-					}
-
-					if (m_aClients[ClientID].m_DnsblState == CClient::DNSBL_STATE_BLACKLISTED &&
-							g_Config.m_SvDnsblBan)
-						m_NetServer.NetBan()->BanAddr(m_NetServer.ClientAddr(ClientID), 60*10, "Blacklisted by DNSBL");
-				}
-			}
+			UpdateDnsbl();
 
 			while(t > TickStartTime(m_CurrentGameTick+1))
 			{
@@ -2112,6 +2342,14 @@ int CServer::Run()
 	GameServer()->OnShutdown(true);
 	m_pMap->Unload();
 
+	// let the writer finish the demos before exiting
+	for(int i = 0; i < MAX_CLIENTS+1; i++)
+	{
+		if(m_aDemoRecorder[i].IsRecording())
+			m_aDemoRecorder[i].Stop(i < MAX_CLIENTS ? IDemoRecorder::STOPMODE_REMOVE_FILE : IDemoRecorder::STOPMODE_KEEP_FILE);
+	}
+	m_DemoWriter.Flush();
+
 	free(m_pCurrentMapData);
 
 #if defined (CONF_SQL)
@@ -2119,9 +2357,11 @@ int CServer::Run()
 	{
 		if (m_apSqlReadServers[i])
 			delete m_apSqlReadServers[i];
+		m_apSqlReadServers[i] = 0;
 
 		if (m_apSqlWriteServers[i])
 			delete m_apSqlWriteServers[i];
+		m_apSqlWriteServers[i] = 0;
 	}
 #endif
 
@@ -2211,6 +2451,33 @@ void CServer::ConDnsblStatus(IConsole::IResult *pResult, void *pUser)
 	StatusImpl(pResult, pUser, true);
 }
 
+void CServer::ConRateLimitStatus(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = (CServer *)pUser;
+	CNetRateLimit *pRateLimit = pThis->m_NetServer.RateLimit();
+	const CNetRateLimit::CStats &Stats = pRateLimit->Stats();
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "passed=%lld dropped=%lld evicted=%lld limited_sources=%d",
+		Stats.m_Passed, Stats.m_Dropped, Stats.m_Evicted, pRateLimit->NumTracked(time_get()));
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+
+	NETADDR Addr;
+	int Prefix;
+	int Dropped = pRateLimit->TopSource(&Addr, &Prefix);
+	if(Dropped)
+	{
+		char aAddrStr[NETADDR_MAXSTRSIZE];
+		net_addr_str(&Addr, aAddrStr, sizeof(aAddrStr), false);
+		str_format(aBuf, sizeof(aBuf), "most dropped: %s/%d dropped=%d", aAddrStr, Prefix, Dropped);
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+	}
+}
+
+void CServer::ConRateLimitReset(IConsole::IResult *pResult, void *pUser)
+{
+	((CServer *)pUser)->m_NetServer.RateLimit()->ResetStats();
+}
+
 static int GetAuthLevel(const char *pLevel)
 {
 	int Level = -1;
@@ -2513,14 +2780,10 @@ void CServer::SaveDemo(int ClientID, float Time)
 {
 	if(IsRecording(ClientID))
 	{
-		m_aDemoRecorder[ClientID].Stop();
-
-		// rename the demo
-		char aOldFilename[256];
+		// the writer renames the demo once it's complete
 		char aNewFilename[256];
-		str_format(aOldFilename, sizeof(aOldFilename), "demos/%s_%d_%d_tmp.demo", m_aCurrentMap, g_Config.m_SvPort, ClientID);
 		str_format(aNewFilename, sizeof(aNewFilename), "demos/%s_%s_%5.2f.demo", m_aCurrentMap, m_aClients[ClientID].m_aName, Time);
-		Storage()->RenameFile(aOldFilename, aNewFilename, IStorage::TYPE_SAVE);
+		m_aDemoRecorder[ClientID].Stop(IDemoRecorder::STOPMODE_KEEP_FILE, aNewFilename);
 	}
 }
 
@@ -2537,13 +2800,7 @@ void CServer::StartRecord(int ClientID)
 void CServer::StopRecord(int ClientID)
 {
 	if(IsRecording(ClientID))
-	{
-		m_aDemoRecorder[ClientID].Stop();
-
-		char aFilename[128];
-		str_format(aFilename, sizeof(aFilename), "demos/%s_%d_%d_tmp.demo", m_aCurrentMap, g_Config.m_SvPort, ClientID);
-		Storage()->RemoveFile(aFilename, IStorage::TYPE_SAVE);
-	}
+		m_aDemoRecorder[ClientID].Stop(IDemoRecorder::STOPMODE_REMOVE_FILE);
 }
 
 bool CServer::IsRecording(int ClientID)
@@ -2620,6 +2877,7 @@ void CServer::ConAddSqlServer(IConsole::IResult *pResult, void *pUserData)
 		if (!apSqlServers[i])
 		{
 			apSqlServers[i] = new CSqlServer(pResult->GetString(1), pResult->GetString(2), pResult->GetString(3), pResult->GetString(4), pResult->GetString(5), pResult->GetInteger(6), &pSelf->m_GlobalSqlLock, ReadOnly, SetUpDb);
+			ReadOnly ? CSqlServer::ms_NumReadServer++ : CSqlServer::ms_NumWriteServer++;
 
 			if(SetUpDb)
 			{
@@ -2869,6 +3127,8 @@ void CServer::RegisterCommands()
 #endif
 
 	Console()->Register("dnsbl_status", "", CFGFLAG_SERVER, ConDnsblStatus, this, "List blacklisted players");
+	Console()->Register("ratelimit_status", "", CFGFLAG_SERVER, ConRateLimitStatus, this, "Show the counters of the packet rate limit for addresses without a connection");
+	Console()->Register("ratelimit_reset", "", CFGFLAG_SERVER, ConRateLimitReset, this, "Reset the counters of the packet rate limit");
 
 	Console()->Register("auth_add", "s[ident] s[level] s[pw]", CFGFLAG_SERVER|CFGFLAG_NONTEEHISTORIC, ConAuthAdd, this, "Add a rcon key");
 	Console()->Register("auth_add_p", "s[ident] s[level] s[hash] s[salt]", CFGFLAG_SERVER|CFGFLAG_NONTEEHISTORIC, ConAuthAddHashed, this, "Add a prehashed rcon key");
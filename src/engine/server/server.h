@@ -23,7 +23,10 @@
 
 #include <base/tl/array.h>
 
+#include <vector>
+
 #include "authmanager.h"
+#include "dnsbl_cache.h"
 #include "name_ban.h"
 
 #if defined (CONF_SQL)
@@ -83,6 +86,23 @@ public:
 	static void ConBanExt(class IConsole::IResult *pResult, void *pUser);
 };
 
+// applies the map config, opens the map and decompresses its game layers
+// on a worker thread. Removes the temporary map file once it's released
+class CMapPreload : public IJob
+{
+	virtual void Run();
+
+public:
+	CMapPreload(class IStorage *pStorage, class IGameServer *pGameServer, const char *pMapName);
+	~CMapPreload();
+
+	class IStorage *m_pStorage;
+	class IGameServer *m_pGameServer;
+	char m_aMapName[MAX_PATH_LENGTH];
+	char m_aFilename[MAX_PATH_LENGTH];
+	IEngineMap *m_pMap;
+	bool m_Loaded;
+};
 
 class CServer : public IServer
 {
@@ -171,6 +191,9 @@ public:
 		int m_AuthKey;
 		int m_AuthTries;
 		int m_NextMapChunk;
+		// fast download: chunks sent so far and bytes (times time_freq()) that may still be sent
+		int m_MapChunksSent;
+		int64 m_MapDownloadBudget;
 
 		const IConsole::CCommandInfo *m_pRconCmdToSend;
 
@@ -184,7 +207,6 @@ public:
 
 		// DNSBL
 		int m_DnsblState;
-		std::shared_ptr<CHostLookup> m_pDnsblLookup;
 	};
 
 	CClient m_aClients[MAX_CLIENTS];
@@ -217,10 +239,38 @@ public:
 	char m_aCurrentMap[MAX_PATH_LENGTH];
 	SHA256_DIGEST m_CurrentMapSha256;
 	unsigned m_CurrentMapCrc;
+	// copy of the map file as it was when it got loaded
 	unsigned char *m_pCurrentMapData;
 	unsigned int m_CurrentMapSize;
 
+	enum
+	{
+		MAP_CHUNK_SIZE=1024-128,
+		MAP_CHUNK_HEADER_SIZE=32,
+	};
+	// NETMSG_MAP_DATA packed up to the chunk data, for each chunk of the
+	// current map
+	struct CMapChunkHeader
+	{
+		unsigned char m_aData[MAP_CHUNK_HEADER_SIZE];
+		int m_Size;
+	};
+	std::vector<CMapChunkHeader> m_aMapChunkHeaders;
+	// bytes (times time_freq()) all fast downloads together may still send
+	int64 m_MapDownloadBudget;
+	int64 m_MapDownloadLastRefill;
+	int m_MapDownloadFirstClient;
+
+	std::shared_ptr<CMapPreload> m_pMapPreload;
+
+	CDnsblCache m_DnsblCache;
+	bool m_DnsblEnabled;
+	bool m_DnsblBanEnabled;
+
+	CDemoWriter m_DemoWriter;
 	CDemoRecorder m_aDemoRecorder[MAX_CLIENTS+1];
+	// snapshot with the antiping extra info removed, for demo recording
+	unsigned char m_aDemoSnapshot[CSnapshot::MAX_SIZE];
 	CRegister m_Register;
 	CAuthManager m_AuthManager;
 
@@ -273,6 +323,7 @@ public:
 	virtual int SendMsg(CMsgPacker *pMsg, int Flags, int ClientID);
 	int SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System);
 
+	const void *DemoSnapshot(const void *pData, int Size);
 	void DoSnapshot();
 
 	static int NewClientCallback(int ClientID, void *pUser);
@@ -283,7 +334,9 @@ public:
 
 	void SendRconType(int ClientID, bool UsernameReq);
 	void SendMap(int ClientID);
+	void PrepareMapChunks();
 	void SendMapData(int ClientID, int Chunk);
+	void SendMapChunks();
 	void SendConnectionReady(int ClientID);
 	void SendRconLine(int ClientID, const char *pLine);
 	static void SendRconLineAuthed(const char *pLine, void *pUser, bool Highlighted = false);
@@ -301,7 +354,9 @@ public:
 	void PumpNetwork();
 
 	char *GetMapName();
-	int LoadMap(const char *pMapName);
+	void StartMapPreload(const char *pMapName);
+	int LoadMap(const char *pMapName, CMapPreload *pPreload = 0);
+	void RemoveTempMap(const char *pMapName, const char *pFilename);
 
 	void SaveDemo(int ClientID, float Time);
 	void StartRecord(int ClientID);
@@ -321,6 +376,8 @@ public:
 	static void ConMapReload(IConsole::IResult *pResult, void *pUser);
 	static void ConLogout(IConsole::IResult *pResult, void *pUser);
 	static void ConDnsblStatus(IConsole::IResult *pResult, void *pUser);
+	static void ConRateLimitStatus(IConsole::IResult *pResult, void *pUser);
+	static void ConRateLimitReset(IConsole::IResult *pResult, void *pUser);
 
 	static void ConAuthAdd(IConsole::IResult *pResult, void *pUser);
 	static void ConAuthAddHashed(IConsole::IResult *pResult, void *pUser);
@@ -380,6 +437,10 @@ public:
 	virtual int* GetIdMap(int ClientID);
 
 	void InitDnsbl(int ClientID);
+	void UpdateDnsbl();
+	void SetDnsblResult(int ClientID, int Result);
+	static std::shared_ptr<CHostLookup> DnsblLookupCallback(const char *pHostname, void *pUser);
+	static void DnsblResultCallback(int ClientID, const NETADDR *pAddr, int Result, void *pUser);
 	bool DnsblWhite(int ClientID)
 	{
 		return m_aClients[ClientID].m_DnsblState == CClient::DNSBL_STATE_NONE ||
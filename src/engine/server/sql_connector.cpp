@@ -7,11 +7,21 @@
 CSqlServer** CSqlConnector::ms_ppSqlReadServers = 0;
 CSqlServer** CSqlConnector::ms_ppSqlWriteServers = 0;
 
-int CSqlConnector::ms_ReachableReadServer = 0;
-int CSqlConnector::ms_ReachableWriteServer = 0;
+std::atomic<int> CSqlConnector::ms_ReachableReadServer(0);
+std::atomic<int> CSqlConnector::ms_ReachableWriteServer(0);
 
 CSqlConnector::CSqlConnector() :
 m_pSqlServer(0),
+m_ppSqlReadServers(ms_ppSqlReadServers),
+m_ppSqlWriteServers(ms_ppSqlWriteServers),
+m_NumReadRetries(0),
+m_NumWriteRetries(0)
+{}
+
+CSqlConnector::CSqlConnector(CSqlServer **ppReadServers, CSqlServer **ppWriteServers) :
+m_pSqlServer(0),
+m_ppSqlReadServers(ppReadServers),
+m_ppSqlWriteServers(ppWriteServers),
 m_NumReadRetries(0),
 m_NumWriteRetries(0)
 {}
@@ -19,10 +29,11 @@ m_NumWriteRetries(0)
 bool CSqlConnector::ConnectSqlServer(bool ReadOnly)
 {
 	ReadOnly ? ++m_NumReadRetries : ++m_NumWriteRetries;
-	int& ReachableServer = ReadOnly ? ms_ReachableReadServer : ms_ReachableWriteServer;
+	std::atomic<int> &ReachableServer = ReadOnly ? ms_ReachableReadServer : ms_ReachableWriteServer;
 	int NumServers = ReadOnly ? CSqlServer::ms_NumReadServer : CSqlServer::ms_NumWriteServer;
+	int FirstServer = ReachableServer;
 
-	for (int i = ReachableServer, ID = ReachableServer; i < ReachableServer + NumServers && SqlServer(i % NumServers, ReadOnly); i++, ID = i % NumServers)
+	for (int i = FirstServer, ID = FirstServer; i < FirstServer + NumServers && SqlServer(i % NumServers, ReadOnly); i++, ID = i % NumServers)
 	{
 		if (SqlServer(ID, ReadOnly) && SqlServer(ID, ReadOnly)->Connect())
 		{
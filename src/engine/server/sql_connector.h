@@ -1,6 +1,8 @@
 #ifndef ENGINE_SERVER_SQL_CONNECTOR_H
 #define ENGINE_SERVER_SQL_CONNECTOR_H
 
+#include <atomic>
+
 #include "sql_server.h"
 
 enum
@@ -13,8 +15,11 @@ class CSqlConnector
 {
 public:
 	CSqlConnector();
+	// uses the given servers instead of the ones added with add_sqlserver
+	CSqlConnector(CSqlServer **ppReadServers, CSqlServer **ppWriteServers);
 
-	CSqlServer* SqlServer(int i, bool ReadOnly = true) { return ReadOnly ? ms_ppSqlReadServers[i] : ms_ppSqlWriteServers[i]; }
+	CSqlServer* SqlServer(int i, bool ReadOnly = true) { return ReadOnly ? m_ppSqlReadServers[i] : m_ppSqlWriteServers[i]; }
+	static CSqlServer* GlobalSqlServer(int i, bool ReadOnly = true) { return ReadOnly ? ms_ppSqlReadServers[i] : ms_ppSqlWriteServers[i]; }
 
 	// always returns the last connected sql-server
 	CSqlServer* SqlServer() { return m_pSqlServer; }
@@ -31,14 +36,17 @@ public:
 private:
 
 	CSqlServer *m_pSqlServer;
+	CSqlServer **m_ppSqlReadServers;
+	CSqlServer **m_ppSqlWriteServers;
 	static CSqlServer **ms_ppSqlReadServers;
 	static CSqlServer **ms_ppSqlWriteServers;
 
 	static int ms_NumReadServer;
 	static int ms_NumWriteServer;
 
-	static int ms_ReachableReadServer;
-	static int ms_ReachableWriteServer;
+	// shared by all threads that connect
+	static std::atomic<int> ms_ReachableReadServer;
+	static std::atomic<int> ms_ReachableWriteServer;
 
 	int m_NumReadRetries;
 	int m_NumWriteRetries;
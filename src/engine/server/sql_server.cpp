@@ -12,6 +12,7 @@ int CSqlServer::ms_NumWriteServer = 0;
 
 CSqlServer::CSqlServer(const char *pDatabase, const char *pPrefix, const char *pUser, const char *pPass, const char *pIp, int Port, lock *pGlobalLock, bool ReadOnly, bool SetUpDb) :
 		m_Port(Port),
+		m_ReadOnly(ReadOnly),
 		m_SetUpDB(SetUpDb),
 		m_SqlLock(),
 		m_pGlobalLock(pGlobalLock)
@@ -26,8 +27,6 @@ CSqlServer::CSqlServer(const char *pDatabase, const char *pPrefix, const char *p
 	m_pConnection = 0;
 	m_pResults = 0;
 	m_pStatement = 0;
-
-	ReadOnly ? ms_NumReadServer++ : ms_NumWriteServer++;
 }
 
 CSqlServer::~CSqlServer()
@@ -35,8 +34,7 @@ CSqlServer::~CSqlServer()
 	scope_lock LockScope(&m_SqlLock);
 	try
 	{
-		if (m_pResults)
-			delete m_pResults;
+		ClearPreparedStatements();
 		if (m_pConnection)
 		{
 			delete m_pConnection;
@@ -62,6 +60,11 @@ CSqlServer::~CSqlServer()
 	}
 }
 
+CSqlServer *CSqlServer::Clone() const
+{
+	return new CSqlServer(m_aDatabase, m_aPrefix, m_aUser, m_aPass, m_aIp, m_Port, m_pGlobalLock, m_ReadOnly, false);
+}
+
 bool CSqlServer::Connect()
 {
 	m_SqlLock.take();
@@ -98,6 +101,7 @@ bool CSqlServer::Connect()
 
 	try
 	{
+		ClearPreparedStatements();
 		m_pDriver = 0;
 		m_pConnection = 0;
 		m_pStatement = 0;
@@ -188,6 +192,9 @@ void CSqlServer::CreateTables()
 		str_format(aBuf, sizeof(aBuf), "CREATE TABLE IF NOT EXISTS %s_points (Name VARCHAR(%d) BINARY NOT NULL, Points INT DEFAULT 0, UNIQUE KEY Name (Name)) CHARACTER SET utf8mb4;", m_aPrefix, MAX_NAME_LENGTH);
 		executeSql(aBuf);
 
+		str_format(aBuf, sizeof(aBuf), "CREATE TABLE IF NOT EXISTS %s_accounts (Username VARCHAR(32) NOT NULL, Password VARCHAR(192) NOT NULL, Port INT DEFAULT 0, LoggedIn INT DEFAULT 0, Disabled INT DEFAULT 0, ClientID INT DEFAULT -1, Level INT DEFAULT 0, XP INT DEFAULT 0, NeededXP INT DEFAULT 0, Money INT DEFAULT 0, Kills INT DEFAULT 0, Deaths INT DEFAULT 0, Items INT DEFAULT 0, PoliceLevel INT DEFAULT 0, PRIMARY KEY (Username)) CHARACTER SET utf8mb4;", m_aPrefix);
+		executeSql(aBuf);
+
 		dbg_msg("sql", "Tables were created successfully");
 	}
 	catch (sql::SQLException &e)
@@ -203,6 +210,60 @@ void CSqlServer::executeSql(const char *pCommand)
 	m_pStatement->execute(pCommand);
 }
 
+int CSqlServer::executeSqlUpdate(const char *pCommand)
+{
+	return m_pStatement->executeUpdate(pCommand);
+}
+
+sql::PreparedStatement *CSqlServer::prepareSql(const char *pQuery)
+{
+	std::map<std::string, sql::PreparedStatement *>::iterator it = m_PreparedStatements.find(pQuery);
+	if(it != m_PreparedStatements.end())
+		return it->second;
+
+	sql::PreparedStatement *pStatement = m_pConnection->prepareStatement(pQuery);
+	m_PreparedStatements[pQuery] = pStatement;
+	return pStatement;
+}
+
+void CSqlServer::executePreparedQuery(sql::PreparedStatement *pStatement)
+{
+	if (m_pResults)
+		delete m_pResults;
+
+	m_pResults = 0;
+	try
+	{
+		m_pResults = pStatement->executeQuery();
+	}
+	catch (sql::SQLException &e)
+	{
+		// the statements are gone if the connection was reestablished
+		ClearPreparedStatements();
+		throw;
+	}
+}
+
+void CSqlServer::ClearPreparedStatements()
+{
+	// results of a prepared statement must not outlive it
+	if (m_pResults)
+	{
+		delete m_pResults;
+		m_pResults = 0;
+	}
+
+	for(std::map<std::string, sql::PreparedStatement *>::iterator it = m_PreparedStatements.begin(); it != m_PreparedStatements.end(); ++it)
+	{
+		try
+		{
+			delete it->second;
+		}
+		catch (...) {}
+	}
+	m_PreparedStatements.clear();
+}
+
 void CSqlServer::executeSqlQuery(const char *pQuery)
 {
 	if (m_pResults)
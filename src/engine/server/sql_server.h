@@ -3,10 +3,14 @@
 
 #include <base/tl/threading.h>
 
+#include <map>
+#include <string>
+
 #include <mysql_connection.h>
 
 #include <cppconn/driver.h>
 #include <cppconn/exception.h>
+#include <cppconn/prepared_statement.h>
 #include <cppconn/statement.h>
 
 class CSqlServer
@@ -15,12 +19,22 @@ public:
 	CSqlServer(const char *pDatabase, const char *pPrefix, const char *pUser, const char *pPass, const char *pIp, int Port, lock *pGlobalLock, bool ReadOnly = true, bool SetUpDb = false);
 	~CSqlServer();
 
+	// new server object with the same settings and its own connection
+	CSqlServer *Clone() const;
+
 	bool Connect();
 	void Disconnect();
 	void CreateTables();
 
 	void executeSql(const char *pCommand);
 	void executeSqlQuery(const char *pQuery);
+	// returns the number of affected rows
+	int executeSqlUpdate(const char *pCommand);
+
+	// prepared statements are cached per connection, the returned statement
+	// stays valid until the connection is lost
+	sql::PreparedStatement *prepareSql(const char *pQuery);
+	void executePreparedQuery(sql::PreparedStatement *pStatement);
 
 	sql::ResultSet* GetResults() { return m_pResults; }
 
@@ -35,10 +49,13 @@ public:
 	static int ms_NumWriteServer;
 
 private:
+	void ClearPreparedStatements();
+
 	sql::Driver *m_pDriver;
 	sql::Connection *m_pConnection;
 	sql::Statement *m_pStatement;
 	sql::ResultSet *m_pResults;
+	std::map<std::string, sql::PreparedStatement *> m_PreparedStatements;
 
 	// copy of config vars
 	char m_aDatabase[64];
@@ -48,6 +65,7 @@ private:
 	char m_aIp[64];
 	int m_Port;
 
+	bool m_ReadOnly;
 	bool m_SetUpDB;
 
 	lock m_SqlLock;
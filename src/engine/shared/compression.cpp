@@ -4,6 +4,25 @@
 
 #include "compression.h"
 
+#if defined(CONF_SSE2)
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// index of the lowest set bit, Mask must not be 0
+static inline int LowestBit(unsigned Mask)
+{
+#if defined(_MSC_VER)
+	unsigned long Index;
+	_BitScanForward(&Index, Mask);
+	return Index;
+#else
+	return __builtin_ctz(Mask);
+#endif
+}
+#endif
+
 // Format: ESDDDDDD EDDDDDDD EDD... Extended, Data, Sign
 unsigned char *CVariableInt::Pack(unsigned char *pDst, int i)
 {
@@ -60,6 +79,43 @@ const unsigned char *CVariableInt::Unpack(const unsigned char *pSrc, int *pInOut
 }
 
 
+// Same as Pack, but always writes five bytes and decides the length without
+// branches. pDst must have room for that.
+static inline unsigned char *PackUnchecked(unsigned char *pDst, int i)
+{
+	unsigned Sign = (i>>25)&0x40;
+	unsigned Value = i^(i>>31);
+	int Extra = (Value >= 1u<<6) + (Value >= 1u<<13) + (Value >= 1u<<20) + (Value >= 1u<<27);
+
+	uint64 Bytes = Sign | (Value&0x3F) | (uint64)((Value>>6)&0x7F)<<8 | (uint64)((Value>>13)&0x7F)<<16 |
+		(uint64)((Value>>20)&0x7F)<<24 | (uint64)(Value>>27)<<32;
+	Bytes |= 0x80808080ull & (((uint64)1<<(Extra*8))-1); // extend bits
+	pDst[0] = Bytes;
+	pDst[1] = Bytes>>8;
+	pDst[2] = Bytes>>16;
+	pDst[3] = Bytes>>24;
+	pDst[4] = Bytes>>32;
+	return pDst + Extra + 1;
+}
+
+// Same as Unpack, but reads five bytes and decides the length without
+// branches. pSrc must have that many.
+static inline const unsigned char *UnpackUnchecked(const unsigned char *pSrc, int *pOut)
+{
+	uint64 Bytes = (uint64)pSrc[0] | ((uint64)pSrc[1]<<8) | ((uint64)pSrc[2]<<16) | ((uint64)pSrc[3]<<24) | ((uint64)pSrc[4]<<32);
+	int Extend0 = pSrc[0]>>7;
+	int Extend1 = Extend0 & (pSrc[1]>>7);
+	int Extend2 = Extend1 & (pSrc[2]>>7);
+	int Extend3 = Extend2 & (pSrc[3]>>7);
+	int Length = 1 + Extend0 + Extend1 + Extend2 + Extend3;
+
+	Bytes &= ((uint64)1<<(Length*8))-1;
+	unsigned Value = (Bytes&0x3F) | ((Bytes>>8)&0x7F)<<6 | ((Bytes>>16)&0x7F)<<13 | ((Bytes>>24)&0x7F)<<20 | ((Bytes>>32)&0x7F)<<27;
+	unsigned Sign = (Bytes>>6)&1;
+	*pOut = Value ^ -Sign;
+	return pSrc + Length;
+}
+
 long CVariableInt::Decompress(const void *pSrc_, int Size, void *pDst_, int DstSize)
 {
 	const unsigned char *pSrc = (unsigned char *)pSrc_;
@@ -68,9 +124,44 @@ long CVariableInt::Decompress(const void *pSrc_, int Size, void *pDst_, int DstS
 	int *pDstEnd = pDst + DstSize / 4;
 	while(pSrc < pEnd)
 	{
+#if defined(CONF_SSE2)
+		// snapshot deltas are mostly zeros and other small numbers that fit
+		// into one byte, decode the leading ones of the next 16 bytes at once
+		if(pEnd - pSrc >= 16 && pDstEnd - pDst >= 16)
+		{
+			__m128i Bytes = _mm_loadu_si128((const __m128i *)pSrc);
+			unsigned Extended = _mm_movemask_epi8(Bytes);
+			int Num = Extended ? LowestBit(Extended) : 16;
+			if(Num)
+			{
+				const __m128i Zero = _mm_setzero_si128();
+				const __m128i DataMask = _mm_set1_epi32(0x3F);
+				const __m128i SignMask = _mm_set1_epi32(0x40);
+				__m128i Low = _mm_unpacklo_epi8(Bytes, Zero);
+				__m128i High = _mm_unpackhi_epi8(Bytes, Zero);
+				__m128i aValues[4] = {
+					_mm_unpacklo_epi16(Low, Zero),
+					_mm_unpackhi_epi16(Low, Zero),
+					_mm_unpacklo_epi16(High, Zero),
+					_mm_unpackhi_epi16(High, Zero),
+				};
+				for(int i = 0; i < 4; i++)
+				{
+					__m128i Sign = _mm_cmpeq_epi32(_mm_and_si128(aValues[i], SignMask), SignMask);
+					_mm_storeu_si128((__m128i *)pDst + i, _mm_xor_si128(_mm_and_si128(aValues[i], DataMask), Sign));
+				}
+				pSrc += Num;
+				pDst += Num;
+				continue;
+			}
+		}
+#endif
 		if(pDst >= pDstEnd)
 			return -1;
-		pSrc = CVariableInt::Unpack(pSrc, pDst);
+		if(pEnd - pSrc >= 5)
+			pSrc = UnpackUnchecked(pSrc, pDst);
+		else
+			pSrc = CVariableInt::Unpack(pSrc, pDst);
 		pDst++;
 	}
 	return (long)((unsigned char *)pDst-(unsigned char *)pDst_);
@@ -78,16 +169,47 @@ long CVariableInt::Decompress(const void *pSrc_, int Size, void *pDst_, int DstS
 
 long CVariableInt::Compress(const void *pSrc_, int Size, void *pDst_, int DstSize)
 {
-	int *pSrc = (int *)pSrc_;
+	const int *pSrc = (int *)pSrc_;
+	const int *pEnd = pSrc + Size / 4;
 	unsigned char *pDst = (unsigned char *)pDst_;
 	unsigned char *pDstEnd = pDst + DstSize;
-	Size /= 4;
-	while(Size)
+	while(pSrc < pEnd)
 	{
+#if defined(CONF_SSE2)
+		// encode the leading ints of the next 16 that fit into one byte at
+		// once, the room is enough for the size check of each of them
+		if(pEnd - pSrc >= 16 && pDstEnd - pDst >= 16 + 5)
+		{
+			const __m128i DataMask = _mm_set1_epi32(0x3F);
+			const __m128i SignMask = _mm_set1_epi32(0x40);
+			__m128i aBytes[4];
+			__m128i aLarge[4];
+			for(int i = 0; i < 4; i++)
+			{
+				__m128i Value = _mm_loadu_si128((const __m128i *)pSrc + i);
+				__m128i Sign = _mm_srai_epi32(Value, 31);
+				Value = _mm_xor_si128(Value, Sign);
+				aLarge[i] = _mm_cmpgt_epi32(Value, DataMask);
+				aBytes[i] = _mm_or_si128(Value, _mm_and_si128(Sign, SignMask));
+			}
+			__m128i Large = _mm_packs_epi16(_mm_packs_epi32(aLarge[0], aLarge[1]), _mm_packs_epi32(aLarge[2], aLarge[3]));
+			unsigned LargeMask = _mm_movemask_epi8(Large);
+			int Num = LargeMask ? LowestBit(LargeMask) : 16;
+			if(Num)
+			{
+				// the bytes of large values are garbage, but get overwritten
+				__m128i Low = _mm_packs_epi32(aBytes[0], aBytes[1]);
+				__m128i High = _mm_packs_epi32(aBytes[2], aBytes[3]);
+				_mm_storeu_si128((__m128i *)pDst, _mm_packus_epi16(Low, High));
+				pSrc += Num;
+				pDst += Num;
+				continue;
+			}
+		}
+#endif
 		if(pDstEnd - pDst < 6)
 			return -1;
-		pDst = CVariableInt::Pack(pDst, *pSrc);
-		Size--;
+		pDst = PackUnchecked(pDst, *pSrc);
 		pSrc++;
 	}
 	return (long)(pDst-(unsigned char *)pDst_);
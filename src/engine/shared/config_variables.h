@@ -29,12 +29,16 @@ MACRO_CONFIG_INT(SvRconBantime, sv_rcon_bantime, 5, 0, 1440, CFGFLAG_SERVER, "Th
 MACRO_CONFIG_INT(SvAutoDemoRecord, sv_auto_demo_record, 0, 0, 1, CFGFLAG_SERVER, "Automatically record demos")
 MACRO_CONFIG_INT(SvAutoDemoMax, sv_auto_demo_max, 10, 0, 1000, CFGFLAG_SERVER, "Maximum number of automatically recorded demos (0 = no limit)")
 MACRO_CONFIG_INT(SvTeeHistorian, sv_tee_historian, 0, 0, 1, CFGFLAG_SERVER, "Activate the tee historian that writes complete gameplay data to disk (WARNING: This will use a lot of disk space)")
+MACRO_CONFIG_INT(SvTeeHistorianCompression, sv_tee_historian_compression, 0, 0, 9, CFGFLAG_SERVER, "Compress tee historian files with this zlib level (0 = uncompressed)")
+MACRO_CONFIG_INT(SvTeeHistorianIndex, sv_tee_historian_index, 10, 0, 3600, CFGFLAG_SERVER, "Seconds between keyframes of the seekable index written next to tee historian files (0 = no index)")
 MACRO_CONFIG_INT(SvVanillaAntiSpoof, sv_vanilla_antispoof, 1, 0, 1, CFGFLAG_SERVER, "Enable vanilla Antispoof")
 MACRO_CONFIG_INT(SvDnsbl, sv_dnsbl, 0, 0, 1, CFGFLAG_SERVER, "Enable DNSBL (DNS-based Blackhole List)")
 MACRO_CONFIG_STR(SvDnsblHost, sv_dnsbl_host, 128, "", CFGFLAG_SERVER, "Hostname of DNSBL provider to use for IP Verification")
 MACRO_CONFIG_STR(SvDnsblKey, sv_dnsbl_key, 128, "", CFGFLAG_SERVER|CFGFLAG_NONTEEHISTORIC, "Optional Authentication Key for the specified DNSBL provider")
 MACRO_CONFIG_INT(SvDnsblVote, sv_dnsbl_vote, 0, 0, 1, CFGFLAG_SERVER, "Block votes by blacklisted addresses")
 MACRO_CONFIG_INT(SvDnsblBan, sv_dnsbl_ban, 0, 0, 1, CFGFLAG_SERVER, "Automatically ban blacklisted addresses")
+MACRO_CONFIG_INT(SvDnsblBlacklistedTtl, sv_dnsbl_blacklisted_ttl, 3600, 0, 86400, CFGFLAG_SERVER, "Seconds to remember that an address is blacklisted (0 = look it up every time)")
+MACRO_CONFIG_INT(SvDnsblWhitelistedTtl, sv_dnsbl_whitelisted_ttl, 600, 0, 86400, CFGFLAG_SERVER, "Seconds to remember that an address isn't blacklisted (0 = look it up every time)")
 MACRO_CONFIG_INT(SvRconVote, sv_rcon_vote, 0, 0, 1, CFGFLAG_SERVER, "Only allow authed clients to call votes")
 
 MACRO_CONFIG_INT(SvPlayerDemoRecord, sv_player_demo_record, 0, 0, 1, CFGFLAG_SERVER, "Automatically record demos for each player")
@@ -95,8 +99,11 @@ MACRO_CONFIG_INT(SvSpectatorVotes, sv_spectator_votes, 1, 0, 1, CFGFLAG_SERVER,
 MACRO_CONFIG_INT(SvKillDelay, sv_kill_delay, 1, 0, 9999, CFGFLAG_SERVER, "The minimum time in seconds between kills")
 MACRO_CONFIG_INT(SvSuicidePenalty, sv_suicide_penalty, 0, 0, 9999, CFGFLAG_SERVER, "The minimum time in seconds between kill or /kills and respawn")
 
+MACRO_CONFIG_INT(SvMapPreload, sv_map_preload, 1, 0, 1, CFGFLAG_SERVER, "Load new maps in the background and only switch to them once they are ready")
 MACRO_CONFIG_INT(SvMapWindow, sv_map_window, 15, 0, 100, CFGFLAG_SERVER, "Map downloading send-ahead window")
 MACRO_CONFIG_INT(SvFastDownload, sv_fast_download, 1, 0, 1, CFGFLAG_SERVER, "Enables fast download of maps")
+MACRO_CONFIG_INT(SvMapDownloadRate, sv_map_download_rate, 0, 0, 100000, CFGFLAG_SERVER, "Maximum map download speed per client in KiB/s with fast download (0 = unlimited)")
+MACRO_CONFIG_INT(SvMapDownloadTotalRate, sv_map_download_total_rate, 0, 0, 1000000, CFGFLAG_SERVER, "Maximum map download speed of all clients together in KiB/s with fast download (0 = unlimited)")
 
 MACRO_CONFIG_INT(SvShotgunBulletSound, sv_shotgun_bullet_sound, 0, 0, 1, CFGFLAG_SERVER, "Crazy shotgun bullet sound on/off")
 
@@ -112,6 +119,10 @@ MACRO_CONFIG_INT(SvSaveGamesDelay, sv_savegames_delay, 60, 0, 10000, CFGFLAG_SER
 
 MACRO_CONFIG_STR(SvSqlFailureFile, sv_sql_failure_file, 64, "failed_sql.sql", CFGFLAG_SERVER, "File to store failed Sql-Inserts (ranks)")
 MACRO_CONFIG_INT(SvSqlQueriesDelay, sv_sql_queries_delay, 1, 0, 20, CFGFLAG_SERVER, "Delay in seconds between SQL queries of a single player")
+MACRO_CONFIG_INT(SvSqlWorkers, sv_sql_workers, 2, 1, 16, CFGFLAG_SERVER, "Number of threads (and connections per sqlserver) used for score queries, only read on startup")
+MACRO_CONFIG_INT(SvSqlQueueSize, sv_sql_queue_size, 64, 1, 1024, CFGFLAG_SERVER, "Maximum number of waiting score queries before requests are rejected, inserts are always queued")
+MACRO_CONFIG_INT(SvSqlCacheTime, sv_sql_cache_time, 60, 0, 3600, CFGFLAG_SERVER, "How many seconds results of rank and top commands are reused, 0 to disable")
+MACRO_CONFIG_INT(SvAccSql, sv_acc_sql, 0, 0, 1, CFGFLAG_SERVER, "Store accounts in the SQL database instead of .acc files")
 #endif
 
 MACRO_CONFIG_INT(SvDDRaceRules, sv_ddrace_rules, 1, 0, 1, CFGFLAG_SERVER, "Whether the default mod rules are displayed or not")
@@ -185,6 +196,11 @@ MACRO_CONFIG_INT(SvNetlimitAlpha, sv_netlimit_alpha, 50, 1, 100, CFGFLAG_SERVER,
 MACRO_CONFIG_INT(SvConnlimit, sv_connlimit, 4, 0, 100, CFGFLAG_SERVER, "Connlimit: Number of connections an IP is allowed to do in a timespan")
 MACRO_CONFIG_INT(SvConnlimitTime, sv_connlimit_time, 20, 0, 1000, CFGFLAG_SERVER, "Connlimit: Time in which IP's connections are counted")
 
+MACRO_CONFIG_INT(SvConnlessRate, sv_connless_rate, 20, 0, 100000, CFGFLAG_SERVER, "Packets per second an address without a connection may send (0 = unlimited)")
+MACRO_CONFIG_INT(SvConnlessBurst, sv_connless_burst, 50, 1, 100000, CFGFLAG_SERVER, "Packets an address without a connection may send at once")
+MACRO_CONFIG_INT(SvConnlessIpv4Prefix, sv_connless_ipv4_prefix, 32, 8, 32, CFGFLAG_SERVER, "Prefix length of the IPv4 addresses that share a sv_connless_rate limit")
+MACRO_CONFIG_INT(SvConnlessIpv6Prefix, sv_connless_ipv6_prefix, 64, 16, 128, CFGFLAG_SERVER, "Prefix length of the IPv6 addresses that share a sv_connless_rate limit")
+
 #if defined(CONF_FAMILY_UNIX)
 MACRO_CONFIG_STR(SvConnLoggingServer, sv_conn_logging_server, 128, "", CFGFLAG_SERVER, "Unix socket server for IP address logging")
 #endif
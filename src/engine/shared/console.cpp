@@ -35,6 +35,39 @@ float CConsole::CResult::GetFloat(unsigned Index)
 	return str_tofloat(m_apArgs[Index]);
 }
 
+unsigned CConsole::CommandHash(const char *pName)
+{
+	// FNV-1a over the lowercased name
+	unsigned Hash = 2166136261u;
+	for(; *pName; pName++)
+	{
+		unsigned char c = *pName;
+		if(c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		Hash = (Hash ^ c) * 16777619u;
+	}
+	return Hash % COMMAND_HASH_SIZE;
+}
+
+void CConsole::AddCommandHash(CCommand *pCommand)
+{
+	unsigned Hash = CommandHash(pCommand->m_pName);
+	pCommand->m_pNextHash = m_apCommandHash[Hash];
+	m_apCommandHash[Hash] = pCommand;
+}
+
+void CConsole::RemoveCommandHash(CCommand *pCommand)
+{
+	for(CCommand **ppEntry = &m_apCommandHash[CommandHash(pCommand->m_pName)]; *ppEntry; ppEntry = &(*ppEntry)->m_pNextHash)
+	{
+		if(*ppEntry == pCommand)
+		{
+			*ppEntry = pCommand->m_pNextHash;
+			break;
+		}
+	}
+}
+
 const IConsole::CCommandInfo *CConsole::CCommand::NextCommandInfo(int AccessLevel, int FlagMask) const
 {
 	const CCommand *pInfo = m_pNext;
@@ -326,8 +359,6 @@ void CConsole::ExecuteLineStroked(int Stroke, const char *pStr, int ClientID, bo
 	}
 	while(pStr && *pStr)
 	{
-		CResult Result;
-		Result.m_ClientID = ClientID;
 		const char *pEnd = pStr;
 		const char *pNextPart = 0;
 		int InString = 0;
@@ -355,6 +386,18 @@ void CConsole::ExecuteLineStroked(int Stroke, const char *pStr, int ClientID, bo
 			pEnd++;
 		}
 
+		// releasing only concerns stroke commands, don't parse the others twice
+		const char *pCommandStart = pStr;
+		while(*pCommandStart == ' ' || *pCommandStart == '\t' || *pCommandStart == '\n' || *pCommandStart == '\r')
+			pCommandStart++;
+		if(!Stroke && pCommandStart < pEnd && *pCommandStart != '+')
+		{
+			pStr = pNextPart;
+			continue;
+		}
+
+		CResult Result;
+		Result.m_ClientID = ClientID;
 		if(ParseStart(&Result, pStr, (pEnd-pStr) + 1) != 0)
 			return;
 
@@ -475,7 +518,7 @@ void CConsole::PossibleCommands(const char *pStr, int FlagMask, bool Temp, FPoss
 
 CConsole::CCommand *CConsole::FindCommand(const char *pName, int FlagMask)
 {
-	for(CCommand *pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+	for(CCommand *pCommand = m_apCommandHash[CommandHash(pName)]; pCommand; pCommand = pCommand->m_pNextHash)
 	{
 		if(pCommand->m_Flags&FlagMask)
 		{
@@ -811,6 +854,7 @@ CConsole::CConsole(int FlagMask)
 	m_paStrokeStr[1] = "1";
 	m_ExecutionQueue.Reset();
 	m_pFirstCommand = 0;
+	mem_zero(m_apCommandHash, sizeof(m_apCommandHash));
 	m_pFirstExec = 0;
 	mem_zero(m_aPrintCB, sizeof(m_aPrintCB));
 	m_NumPrintCB = 0;
@@ -893,6 +937,8 @@ void CConsole::ParseArguments(int NumArgs, const char **ppArguments)
 
 void CConsole::AddCommandSorted(CCommand *pCommand)
 {
+	AddCommandHash(pCommand);
+
 	if(!m_pFirstCommand || str_comp(pCommand->m_pName, m_pFirstCommand->m_pName) <= 0)
 	{
 		if(m_pFirstCommand && m_pFirstCommand->m_pNext)
@@ -1003,6 +1049,7 @@ void CConsole::DeregisterTemp(const char *pName)
 	// add to recycle list
 	if(pRemoved)
 	{
+		RemoveCommandHash(pRemoved);
 		pRemoved->m_pNext = m_pRecycleList;
 		m_pRecycleList = pRemoved;
 	}
@@ -1024,6 +1071,18 @@ void CConsole::DeregisterTempAll()
 		}
 	}
 
+	// remove temp entries from the index
+	for(int i = 0; i < COMMAND_HASH_SIZE; i++)
+	{
+		for(CCommand **ppEntry = &m_apCommandHash[i]; *ppEntry;)
+		{
+			if((*ppEntry)->m_Temp)
+				*ppEntry = (*ppEntry)->m_pNextHash;
+			else
+				ppEntry = &(*ppEntry)->m_pNextHash;
+		}
+	}
+
 	m_TempCommands.Reset();
 	m_pRecycleList = 0;
 }
@@ -1073,7 +1132,7 @@ void CConsole::StoreCommands(bool Store)
 
 const IConsole::CCommandInfo *CConsole::GetCommandInfo(const char *pName, int FlagMask, bool Temp)
 {
-	for(CCommand *pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+	for(CCommand *pCommand = m_apCommandHash[CommandHash(pName)]; pCommand; pCommand = pCommand->m_pNextHash)
 	{
 		if(pCommand->m_Flags&FlagMask && pCommand->m_Temp == Temp)
 		{
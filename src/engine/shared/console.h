@@ -14,6 +14,7 @@ class CConsole : public IConsole
 	{
 	public:
 		CCommand *m_pNext;
+		CCommand *m_pNextHash;
 		int m_Flags;
 		bool m_Temp;
 		FCommandCallback m_pfnCallback;
@@ -39,6 +40,17 @@ class CConsole : public IConsole
 	const char *m_paStrokeStr[2];
 	CCommand *m_pFirstCommand;
 
+	// case insensitive index over the command list, commands with the same
+	// name are chained newest first like in the sorted list
+	enum
+	{
+		COMMAND_HASH_SIZE=1024,
+	};
+	CCommand *m_apCommandHash[COMMAND_HASH_SIZE];
+	static unsigned CommandHash(const char *pName);
+	void AddCommandHash(CCommand *pCommand);
+	void RemoveCommandHash(CCommand *pCommand);
+
 	class CExecFile
 	{
 	public:
@@ -108,6 +108,9 @@ struct CDatafileInfo
 struct CDatafile
 {
 	IOHANDLE m_File;
+	// the whole file, if it could be mapped
+	const unsigned char *m_pMapped;
+	unsigned m_MappedSize;
 	SHA256_DIGEST m_Sha256;
 	unsigned m_Crc;
 	CDatafileInfo m_Info;
@@ -117,7 +120,7 @@ struct CDatafile
 	char *m_pData;
 };
 
-bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType)
+bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType, bool Map)
 {
 	dbg_msg("datafile", "loading. filename='%s'", pFilename);
 
@@ -129,9 +132,21 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	}
 
 
+	unsigned MappedSize = 0;
+	const unsigned char *pMapped = Map ? (const unsigned char *)io_map(File, &MappedSize) : 0;
+
 	// take the CRC of the file and store it
 	unsigned Crc = 0;
 	SHA256_DIGEST Sha256;
+	if(pMapped)
+	{
+		Crc = crc32(0, pMapped, MappedSize); // ignore_convention
+		SHA256_CTX Sha256Ctxt;
+		sha256_init(&Sha256Ctxt);
+		sha256_update(&Sha256Ctxt, pMapped, MappedSize);
+		Sha256 = sha256_finish(&Sha256Ctxt);
+	}
+	else
 	{
 		enum
 		{
@@ -161,6 +176,8 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	if (sizeof(Header) != io_read(File, &Header, sizeof(Header)))
 	{
 		dbg_msg("datafile", "couldn't load header");
+		io_unmap(pMapped, MappedSize);
+		io_close(File);
 		return 0;
 	}
 	if(Header.m_aID[0] != 'A' || Header.m_aID[1] != 'T' || Header.m_aID[2] != 'A' || Header.m_aID[3] != 'D')
@@ -168,6 +185,8 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 		if(Header.m_aID[0] != 'D' || Header.m_aID[1] != 'A' || Header.m_aID[2] != 'T' || Header.m_aID[3] != 'A')
 		{
 			dbg_msg("datafile", "wrong signature. %x %x %x %x", Header.m_aID[0], Header.m_aID[1], Header.m_aID[2], Header.m_aID[3]);
+			io_unmap(pMapped, MappedSize);
+			io_close(File);
 			return 0;
 		}
 	}
@@ -178,6 +197,8 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	if(Header.m_Version != 3 && Header.m_Version != 4)
 	{
 		dbg_msg("datafile", "wrong version. version=%x", Header.m_Version);
+		io_unmap(pMapped, MappedSize);
+		io_close(File);
 		return 0;
 	}
 
@@ -199,6 +220,8 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	pTmpDataFile->m_ppDataPtrs = (char **)(pTmpDataFile+1);
 	pTmpDataFile->m_pData = (char *)(pTmpDataFile+1)+Header.m_NumRawData*sizeof(char *);
 	pTmpDataFile->m_File = File;
+	pTmpDataFile->m_pMapped = pMapped;
+	pTmpDataFile->m_MappedSize = MappedSize;
 	pTmpDataFile->m_Sha256 = Sha256;
 	pTmpDataFile->m_Crc = Crc;
 
@@ -209,6 +232,7 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	unsigned ReadSize = io_read(File, pTmpDataFile->m_pData, Size);
 	if(ReadSize != Size)
 	{
+		io_unmap(pMapped, MappedSize);
 		io_close(pTmpDataFile->m_File);
 		free(pTmpDataFile);
 		pTmpDataFile = 0;
@@ -310,6 +334,16 @@ int CDataFileReader::GetDataSize(int Index)
 		return GetFileDataSize(Index);
 }
 
+const void *CDataFileReader::GetMappedData(int Index, int DataSize)
+{
+	if(!m_pDataFile->m_pMapped)
+		return 0;
+	unsigned Offset = m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index];
+	if(DataSize < 0 || Offset > m_pDataFile->m_MappedSize || (unsigned)DataSize > m_pDataFile->m_MappedSize-Offset)
+		return 0;
+	return m_pDataFile->m_pMapped+Offset;
+}
+
 void *CDataFileReader::GetDataImpl(int Index, int Swap)
 {
 	if(!m_pDataFile) { return 0; }
@@ -326,7 +360,7 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 		if(m_pDataFile->m_Header.m_Version == 4)
 		{
 			// v4 has compressed data
-			void *pTemp = malloc(DataSize);
+			void *pTemp = GetMappedData(Index, DataSize) ? 0 : malloc(DataSize);
 			unsigned long UncompressedSize = m_pDataFile->m_Info.m_pDataSizes[Index];
 			unsigned long s;
 
@@ -334,12 +368,17 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 			m_pDataFile->m_ppDataPtrs[Index] = (char *)malloc(UncompressedSize);
 
 			// read the compressed data
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, pTemp, DataSize);
+			const void *pCompressed = GetMappedData(Index, DataSize);
+			if(!pCompressed)
+			{
+				io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
+				io_read(m_pDataFile->m_File, pTemp, DataSize);
+				pCompressed = pTemp;
+			}
 
 			// decompress the data, TODO: check for errors
 			s = UncompressedSize;
-			uncompress((Bytef*)m_pDataFile->m_ppDataPtrs[Index], &s, (Bytef*)pTemp, DataSize); // ignore_convention
+			uncompress((Bytef*)m_pDataFile->m_ppDataPtrs[Index], &s, (const Bytef*)pCompressed, DataSize); // ignore_convention
 #if defined(CONF_ARCH_ENDIAN_BIG)
 			SwapSize = s;
 #endif
@@ -352,8 +391,14 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 			// load the data
 			dbg_msg("datafile", "loading data index=%d size=%d", Index, DataSize);
 			m_pDataFile->m_ppDataPtrs[Index] = (char *)malloc(DataSize);
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, m_pDataFile->m_ppDataPtrs[Index], DataSize);
+			const void *pMapped = GetMappedData(Index, DataSize);
+			if(pMapped)
+				mem_copy(m_pDataFile->m_ppDataPtrs[Index], pMapped, DataSize);
+			else
+			{
+				io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
+				io_read(m_pDataFile->m_File, m_pDataFile->m_ppDataPtrs[Index], DataSize);
+			}
 		}
 
 #if defined(CONF_ARCH_ENDIAN_BIG)
@@ -518,6 +563,7 @@ bool CDataFileReader::Close()
 	for(i = 0; i < m_pDataFile->m_Header.m_NumRawData; i++)
 		free(m_pDataFile->m_ppDataPtrs[i]);
 
+	io_unmap(m_pDataFile->m_pMapped, m_pDataFile->m_MappedSize);
 	io_close(m_pDataFile->m_File);
 	free(m_pDataFile);
 	m_pDataFile = 0;
@@ -556,6 +602,17 @@ IOHANDLE CDataFileReader::File()
 	return m_pDataFile->m_File;
 }
 
+const unsigned char *CDataFileReader::MappedFile(unsigned *pSize)
+{
+	if(!m_pDataFile || !m_pDataFile->m_pMapped)
+	{
+		*pSize = 0;
+		return 0;
+	}
+	*pSize = m_pDataFile->m_MappedSize;
+	return m_pDataFile->m_pMapped;
+}
+
 
 CDataFileWriter::CDataFileWriter()
 {
@@ -11,6 +11,7 @@ class CDataFileReader
 {
 	struct CDatafile *m_pDataFile;
 	void *GetDataImpl(int Index, int Swap);
+	const void *GetMappedData(int Index, int DataSize);
 	int GetFileDataSize(int Index);
 
 	int GetExternalItemType(int InternalType);
@@ -22,8 +23,11 @@ public:
 
 	bool IsOpen() const { return m_pDataFile != 0; }
 
-	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType);
+	// Map reads the data from a mapping of the file. Only for files that
+	// aren't overwritten in place while they are open, see io_map
+	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType, bool Map = true);
 	bool Close();
+	void Swap(CDataFileReader *pOther) { struct CDatafile *pTmp = m_pDataFile; m_pDataFile = pOther->m_pDataFile; pOther->m_pDataFile = pTmp; }
 
 	void *GetData(int Index);
 	void *GetDataSwapped(int Index); // makes sure that the data is 32bit LE ints when saved
@@ -42,6 +46,8 @@ public:
 	unsigned Crc();
 	int MapSize();
 	IOHANDLE File();
+	// the whole file, read-only, valid until Close. 0 if it isn't mapped
+	const unsigned char *MappedFile(unsigned *pSize);
 };
 
 // write access
@@ -14,6 +14,8 @@
 #include "network.h"
 #include "snapshot.h"
 
+#include <vector>
+
 static const unsigned char gs_aHeaderMarker[7] = {'T', 'W', 'D', 'E', 'M', 'O', 0};
 static const unsigned char gs_ActVersion = 5;
 static const unsigned char gs_OldVersion = 3;
@@ -22,9 +24,205 @@ static const int gs_LengthOffset = 152;
 static const int gs_NumMarkersOffset = 176;
 
 
-CDemoRecorder::CDemoRecorder(class CSnapshotDelta *pSnapshotDelta, bool NoMapData)
+CDemoWriter::CDemoWriter()
 {
-	m_File = 0;
+	m_Lock = lock_create();
+	sphore_init(&m_Semaphore);
+	sphore_init(&m_FlushSemaphore);
+	m_Writing = false;
+	m_Flushing = false;
+	m_Shutdown = false;
+	m_pThread = thread_init(WriterThread, this);
+}
+
+CDemoWriter::~CDemoWriter()
+{
+	Flush();
+
+	lock_wait(m_Lock);
+	m_Shutdown = true;
+	lock_unlock(m_Lock);
+	sphore_signal(&m_Semaphore);
+	thread_wait(m_pThread);
+
+	lock_destroy(m_Lock);
+	sphore_destroy(&m_Semaphore);
+	sphore_destroy(&m_FlushSemaphore);
+}
+
+void CDemoWriter::Queue(CFile *pFile, int Kind, const void *pData, unsigned Size, const void *pData2, unsigned Size2)
+{
+	CRecordHeader Header;
+	Header.m_pFile = pFile;
+	Header.m_Kind = Kind;
+	Header.m_Size = Size + Size2;
+
+	lock_wait(m_Lock);
+	// the writer takes the whole queue at once, it only needs a wakeup
+	// when it found the queue empty
+	bool Wakeup = m_aQueue.empty();
+	m_aQueue.insert(m_aQueue.end(), (const unsigned char *)&Header, (const unsigned char *)&Header + sizeof(Header));
+	m_aQueue.insert(m_aQueue.end(), (const unsigned char *)pData, (const unsigned char *)pData + Size);
+	if(Size2)
+		m_aQueue.insert(m_aQueue.end(), (const unsigned char *)pData2, (const unsigned char *)pData2 + Size2);
+	lock_unlock(m_Lock);
+	if(Wakeup)
+		sphore_signal(&m_Semaphore);
+}
+
+void CDemoWriter::Flush()
+{
+	lock_wait(m_Lock);
+	bool Done = m_aQueue.empty() && !m_Writing;
+	m_Flushing = !Done;
+	lock_unlock(m_Lock);
+
+	// the writer thread signals once it ran out of work
+	if(!Done)
+		sphore_wait(&m_FlushSemaphore);
+}
+
+void CDemoWriter::WriterThread(void *pUser)
+{
+	CDemoWriter *pSelf = (CDemoWriter *)pUser;
+
+	while(true)
+	{
+		sphore_wait(&pSelf->m_Semaphore);
+
+		lock_wait(pSelf->m_Lock);
+		if(pSelf->m_aQueue.empty() && pSelf->m_Shutdown)
+		{
+			lock_unlock(pSelf->m_Lock);
+			break;
+		}
+		// both keep their capacity, so this doesn't allocate once warmed up
+		pSelf->m_aBatch.swap(pSelf->m_aQueue);
+		pSelf->m_Writing = !pSelf->m_aBatch.empty();
+		lock_unlock(pSelf->m_Lock);
+
+		unsigned Pos = 0;
+		while(Pos < pSelf->m_aBatch.size())
+		{
+			CRecordHeader Header;
+			mem_copy(&Header, &pSelf->m_aBatch[Pos], sizeof(Header));
+			Pos += sizeof(Header);
+			pSelf->WriteRecord(Header.m_pFile, Header.m_Kind, Header.m_Size ? &pSelf->m_aBatch[Pos] : 0, Header.m_Size);
+			Pos += Header.m_Size;
+		}
+		pSelf->m_aBatch.clear();
+
+		lock_wait(pSelf->m_Lock);
+		pSelf->m_Writing = false;
+		bool Flushed = pSelf->m_Flushing && pSelf->m_aQueue.empty();
+		if(Flushed)
+			pSelf->m_Flushing = false;
+		lock_unlock(pSelf->m_Lock);
+		if(Flushed)
+			sphore_signal(&pSelf->m_FlushSemaphore);
+	}
+}
+
+void CDemoWriter::WriteRecord(CFile *pFile, int Kind, const unsigned char *pData, unsigned Size)
+{
+	if(Kind == RECORD_OPEN)
+	{
+		pFile->m_File = pFile->m_pStorage->OpenFile(pFile->m_aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+		if(!pFile->m_File)
+			dbg_msg("demo_recorder", "Unable to open '%s' for recording", pFile->m_aFilename);
+	}
+	else if(Kind == RECORD_CLOSE)
+	{
+		int Mode;
+		mem_copy(&Mode, pData, sizeof(Mode));
+		const char *pTargetFilename = (const char *)pData + sizeof(Mode);
+		if(pFile->m_File)
+		{
+			io_flush(pFile->m_File);
+			if(io_error(pFile->m_File))
+				pFile->m_Error = true;
+			io_close(pFile->m_File);
+			if(pFile->m_Error)
+				dbg_msg("demo_recorder", "Error writing demo '%s'", pFile->m_aFilename);
+
+			if(Mode == IDemoRecorder::STOPMODE_REMOVE_FILE)
+				pFile->m_pStorage->RemoveFile(pFile->m_aFilename, IStorage::TYPE_SAVE);
+			else if(pTargetFilename[0])
+				pFile->m_pStorage->RenameFile(pFile->m_aFilename, pTargetFilename, IStorage::TYPE_SAVE);
+		}
+		delete pFile;
+	}
+	else if(!pFile->m_File)
+	{
+		// couldn't be opened
+	}
+	else if(Kind == RECORD_RAW)
+	{
+		if(io_write(pFile->m_File, pData, Size) != Size)
+			pFile->m_Error = true;
+	}
+	else if(Kind == RECORD_CHUNK)
+	{
+		WriteChunk(pFile->m_File, pData[0], pData + 1, Size - 1);
+	}
+	else if(Kind == RECORD_PATCH)
+	{
+		int Offset;
+		mem_copy(&Offset, pData, sizeof(Offset));
+		io_seek(pFile->m_File, Offset, IOSEEK_START);
+		io_write(pFile->m_File, pData + sizeof(Offset), Size - sizeof(Offset));
+		io_seek(pFile->m_File, 0, IOSEEK_END);
+	}
+}
+
+void CDemoWriter::WriteChunk(IOHANDLE File, int Type, const void *pData, int Size)
+{
+	unsigned char aChunk[3];
+
+	/* pad the data with 0 so we get an alignment of 4,
+	else the compression won't work and miss some bytes */
+	mem_copy(m_aBuffer2, pData, Size);
+	while(Size&3)
+		m_aBuffer2[Size++] = 0;
+	Size = CVariableInt::Compress(m_aBuffer2, Size, m_aBuffer, sizeof(m_aBuffer)); // buffer2 -> buffer
+	if(Size < 0)
+		return;
+
+	Size = CNetBase::Compress(m_aBuffer, Size, m_aBuffer2, sizeof(m_aBuffer2)); // buffer -> buffer2
+	if(Size < 0)
+		return;
+
+
+	aChunk[0] = ((Type&0x3)<<5);
+	if(Size < 30)
+	{
+		aChunk[0] |= Size;
+		io_write(File, aChunk, 1);
+	}
+	else
+	{
+		if(Size < 256)
+		{
+			aChunk[0] |= 30;
+			aChunk[1] = Size&0xff;
+			io_write(File, aChunk, 2);
+		}
+		else
+		{
+			aChunk[0] |= 31;
+			aChunk[1] = Size&0xff;
+			aChunk[2] = Size>>8;
+			io_write(File, aChunk, 3);
+		}
+	}
+
+	io_write(File, m_aBuffer2, Size);
+}
+
+CDemoRecorder::CDemoRecorder(class CSnapshotDelta *pSnapshotDelta, CDemoWriter *pWriter, bool NoMapData)
+{
+	m_pFile = 0;
+	m_pWriter = pWriter;
 	m_pfnFilter = 0;
 	m_pUser = 0;
 	m_LastTickMarker = -1;
@@ -33,7 +231,7 @@ CDemoRecorder::CDemoRecorder(class CSnapshotDelta *pSnapshotDelta, bool NoMapDat
 }
 
 // Record
-int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetVersion, const char *pMap, SHA256_DIGEST Sha256, unsigned Crc, const char *pType, unsigned int MapSize, unsigned char *pMapData, IOHANDLE MapFile, DEMOFUNC_FILTER pfnFilter, void *pUser)
+int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetVersion, const char *pMap, SHA256_DIGEST Sha256, unsigned Crc, const char *pType, unsigned int MapSize, const unsigned char *pMapData, IOHANDLE MapFile, DEMOFUNC_FILTER pfnFilter, void *pUser)
 {
 	m_pfnFilter = pfnFilter;
 	m_pUser = pUser;
@@ -41,21 +239,10 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 	m_MapSize = MapSize;
 	m_pMapData = pMapData;
 
-	IOHANDLE DemoFile = pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
-	if(!DemoFile)
-	{
-		char aBuf[256];
-		str_format(aBuf, sizeof(aBuf), "Unable to open '%s' for recording", pFilename);
-		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
-		return -1;
-	}
-
 	CDemoHeader Header;
 	CTimelineMarkers TimelineMarkers;
-	if(m_File) {
-		io_close(DemoFile);
+	if(m_pFile)
 		return -1;
-	}
 
 	m_pConsole = pConsole;
 
@@ -96,6 +283,15 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 		CloseMapFile = true;
 	}
 
+	// the file is opened on the writer thread, so it can't clash with the
+	// removal or renaming of an earlier demo with the same name
+	m_pFile = new CDemoWriter::CFile;
+	m_pFile->m_pStorage = pStorage;
+	str_copy(m_pFile->m_aFilename, pFilename, sizeof(m_pFile->m_aFilename));
+	m_pFile->m_File = 0;
+	m_pFile->m_Error = false;
+	m_pWriter->Queue(m_pFile, CDemoWriter::RECORD_OPEN, 0, 0);
+
 	// write header
 	mem_zero(&Header, sizeof(Header));
 	mem_copy(Header.m_aMarker, gs_aHeaderMarker, sizeof(Header.m_aMarker));
@@ -113,15 +309,15 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 	str_copy(Header.m_aType, pType, sizeof(Header.m_aType));
 	// Header.m_Length - add this on stop
 	str_timestamp(Header.m_aTimestamp, sizeof(Header.m_aTimestamp));
-	io_write(DemoFile, &Header, sizeof(Header));
-	io_write(DemoFile, &TimelineMarkers, sizeof(TimelineMarkers)); // fill this on stop
+	m_pWriter->Queue(m_pFile, CDemoWriter::RECORD_RAW, &Header, sizeof(Header));
+	m_pWriter->Queue(m_pFile, CDemoWriter::RECORD_RAW, &TimelineMarkers, sizeof(TimelineMarkers)); // fill this on stop
 
 	if(m_NoMapData)
 	{
 	}
 	else if(pMapData)
 	{
-		io_write(DemoFile, pMapData, MapSize);
+		m_pWriter->Queue(m_pFile, CDemoWriter::RECORD_RAW, pMapData, MapSize);
 	}
 	else
 	{
@@ -132,7 +328,7 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 			int Bytes = io_read(MapFile, &aChunk, sizeof(aChunk));
 			if(Bytes <= 0)
 				break;
-			io_write(DemoFile, &aChunk, Bytes);
+			m_pWriter->Queue(m_pFile, CDemoWriter::RECORD_RAW, &aChunk, Bytes);
 		}
 		if(CloseMapFile)
 			io_close(MapFile);
@@ -141,6 +337,7 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 	}
 
 	m_LastKeyFrame = -1;
+	m_LastSharedTick = -1;
 	m_LastTickMarker = -1;
 	m_FirstTick = -1;
 	m_NumTimelineMarkers = 0;
@@ -148,7 +345,6 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "Recording to '%s'", pFilename);
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
-	m_File = DemoFile;
 
 	return 0;
 }
@@ -197,13 +393,13 @@ void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 		if(Keyframe)
 			aChunk[0] |= CHUNKTICKFLAG_KEYFRAME;
 
-		io_write(m_File, aChunk, sizeof(aChunk));
+		m_pWriter->Queue(m_pFile, CDemoWriter::RECORD_RAW, aChunk, sizeof(aChunk));
 	}
 	else
 	{
 		unsigned char aChunk[1];
 		aChunk[0] = CHUNKTYPEFLAG_TICKMARKER | CHUNKTICKFLAG_TICK_COMPRESSED | (Tick-m_LastTickMarker);
-		io_write(m_File, aChunk, sizeof(aChunk));
+		m_pWriter->Queue(m_pFile, CDemoWriter::RECORD_RAW, aChunk, sizeof(aChunk));
 	}
 
 	m_LastTickMarker = Tick;
@@ -213,57 +409,23 @@ void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 
 void CDemoRecorder::Write(int Type, const void *pData, int Size)
 {
-	char aBuffer[64*1024];
-	char aBuffer2[64*1024];
-	unsigned char aChunk[3];
-
-	if(!m_File)
+	if(!m_pFile)
 		return;
 
 	if(Size > 64*1024)
 		return;
 
-	/* pad the data with 0 so we get an alignment of 4,
-	else the compression won't work and miss some bytes */
-	mem_copy(aBuffer2, pData, Size);
-	while(Size&3)
-		aBuffer2[Size++] = 0;
-	Size = CVariableInt::Compress(aBuffer2, Size, aBuffer, sizeof(aBuffer)); // buffer2 -> buffer
-	if(Size < 0)
-		return;
-
-	Size = CNetBase::Compress(aBuffer, Size, aBuffer2, sizeof(aBuffer2)); // buffer -> buffer2
-	if(Size < 0)
-		return;
-
-
-	aChunk[0] = ((Type&0x3)<<5);
-	if(Size < 30)
-	{
-		aChunk[0] |= Size;
-		io_write(m_File, aChunk, 1);
-	}
-	else
-	{
-		if(Size < 256)
-		{
-			aChunk[0] |= 30;
-			aChunk[1] = Size&0xff;
-			io_write(m_File, aChunk, 2);
-		}
-		else
-		{
-			aChunk[0] |= 31;
-			aChunk[1] = Size&0xff;
-			aChunk[2] = Size>>8;
-			io_write(m_File, aChunk, 3);
-		}
-	}
-
-	io_write(m_File, aBuffer2, Size);
+	unsigned char ChunkType = Type;
+	m_pWriter->Queue(m_pFile, CDemoWriter::RECORD_CHUNK, &ChunkType, sizeof(ChunkType), pData, Size);
 }
 
 void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
+{
+	RecordSnapshotShared(Tick, pData, Size, -1, 0, 0);
+	m_LastSharedTick = -1;
+}
+
+void CDemoRecorder::RecordSnapshotShared(int Tick, const void *pData, int Size, int DeltaTick, const void *pDelta, int DeltaSize)
 {
 	if(m_LastKeyFrame == -1 || (Tick-m_LastKeyFrame) > SERVER_TICK_SPEED*5)
 	{
@@ -280,19 +442,24 @@ void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
 	{
 		// create delta, prepend tick
 		char aDeltaData[CSnapshot::MAX_SIZE+sizeof(int)];
-		int DeltaSize;
 
 		// write tickmarker
 		WriteTickMarker(Tick, 0);
 
-		DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, &aDeltaData);
+		// the network delta is against the same snapshot, no need to create another one
+		if(!pDelta || DeltaTick == -1 || DeltaTick != m_LastSharedTick)
+		{
+			DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, &aDeltaData);
+			pDelta = aDeltaData;
+		}
 		if(DeltaSize)
 		{
 			// record delta
-			Write(CHUNKTYPE_DELTA, aDeltaData, DeltaSize);
+			Write(CHUNKTYPE_DELTA, pDelta, DeltaSize);
 			mem_copy(m_aLastSnapshotData, pData, Size);
 		}
 	}
+	m_LastSharedTick = Tick;
 }
 
 void CDemoRecorder::RecordMessage(const void *pData, int Size)
@@ -307,42 +474,45 @@ void CDemoRecorder::RecordMessage(const void *pData, int Size)
 	Write(CHUNKTYPE_MESSAGE, pData, Size);
 }
 
-int CDemoRecorder::Stop()
+int CDemoRecorder::Stop(int Mode, const char *pTargetFilename)
 {
-	if(!m_File)
+	if(!m_pFile)
 		return -1;
 
 	// add the demo length to the header
-	io_seek(m_File, gs_LengthOffset, IOSEEK_START);
+	int Offset = gs_LengthOffset;
 	int DemoLength = Length();
 	char aLength[4];
 	aLength[0] = (DemoLength>>24)&0xff;
 	aLength[1] = (DemoLength>>16)&0xff;
 	aLength[2] = (DemoLength>>8)&0xff;
 	aLength[3] = (DemoLength)&0xff;
-	io_write(m_File, aLength, sizeof(aLength));
+	m_pWriter->Queue(m_pFile, CDemoWriter::RECORD_PATCH, &Offset, sizeof(Offset), aLength, sizeof(aLength));
 
 	// add the timeline markers to the header
-	io_seek(m_File, gs_NumMarkersOffset, IOSEEK_START);
-	char aNumMarkers[4];
-	aNumMarkers[0] = (m_NumTimelineMarkers>>24)&0xff;
-	aNumMarkers[1] = (m_NumTimelineMarkers>>16)&0xff;
-	aNumMarkers[2] = (m_NumTimelineMarkers>>8)&0xff;
-	aNumMarkers[3] = (m_NumTimelineMarkers)&0xff;
-	io_write(m_File, aNumMarkers, sizeof(aNumMarkers));
+	Offset = gs_NumMarkersOffset;
+	char aMarkers[4 + MAX_TIMELINE_MARKERS*4];
+	aMarkers[0] = (m_NumTimelineMarkers>>24)&0xff;
+	aMarkers[1] = (m_NumTimelineMarkers>>16)&0xff;
+	aMarkers[2] = (m_NumTimelineMarkers>>8)&0xff;
+	aMarkers[3] = (m_NumTimelineMarkers)&0xff;
 	for(int i = 0; i < m_NumTimelineMarkers; i++)
 	{
 		int Marker = m_aTimelineMarkers[i];
-		char aMarker[4];
-		aMarker[0] = (Marker>>24)&0xff;
-		aMarker[1] = (Marker>>16)&0xff;
-		aMarker[2] = (Marker>>8)&0xff;
-		aMarker[3] = (Marker)&0xff;
-		io_write(m_File, aMarker, sizeof(aMarker));
+		char *pMarker = aMarkers + 4 + i*4;
+		pMarker[0] = (Marker>>24)&0xff;
+		pMarker[1] = (Marker>>16)&0xff;
+		pMarker[2] = (Marker>>8)&0xff;
+		pMarker[3] = (Marker)&0xff;
 	}
-
-	io_close(m_File);
-	m_File = 0;
+	m_pWriter->Queue(m_pFile, CDemoWriter::RECORD_PATCH, &Offset, sizeof(Offset), aMarkers, 4 + m_NumTimelineMarkers*4);
+
+	// the writer closes the file and frees m_pFile
+	char aClose[sizeof(Mode) + MAX_PATH_LENGTH];
+	mem_copy(aClose, &Mode, sizeof(Mode));
+	str_copy(aClose + sizeof(Mode), pTargetFilename, MAX_PATH_LENGTH);
+	m_pWriter->Queue(m_pFile, CDemoWriter::RECORD_CLOSE, aClose, sizeof(Mode) + str_length(aClose + sizeof(Mode)) + 1);
+	m_pFile = 0;
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", "Stopped recording");
 
 	return 0;
@@ -720,8 +890,11 @@ int CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole, const
 
 		// save map
 		MapFile = pStorage->OpenFile(aMapFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
-		io_write(MapFile, pMapData, MapSize);
-		io_close(MapFile);
+		if(MapFile)
+		{
+			io_write(MapFile, pMapData, MapSize);
+			io_close(MapFile);
+		}
 
 		// free data
 		free(pMapData);
@@ -950,7 +1123,8 @@ void CDemoEditor::Init(const char *pNetVersion, class CSnapshotDelta *pSnapshotD
 void CDemoEditor::Slice(const char *pDemo, const char *pDst, int StartTick, int EndTick, DEMOFUNC_FILTER pfnFilter, void *pUser)
 {
 	class CDemoPlayer DemoPlayer(m_pSnapshotDelta);
-	class CDemoRecorder DemoRecorder(m_pSnapshotDelta);
+	CDemoWriter DemoWriter;
+	class CDemoRecorder DemoRecorder(m_pSnapshotDelta, &DemoWriter);
 
 	m_pDemoPlayer = &DemoPlayer;
 	m_pDemoRecorder = &DemoRecorder;
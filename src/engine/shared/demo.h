@@ -4,18 +4,94 @@
 #define ENGINE_SHARED_DEMO_H
 
 #include <base/hash.h>
+#include <base/system.h>
 
 #include <engine/demo.h>
+#include <engine/storage.h>
 #include <engine/shared/protocol.h>
 
 #include "snapshot.h"
 
+#include <vector>
+
+// Compresses and writes the chunks of all demo recorders using it on one
+// background thread. Demo files are opened, closed, renamed and removed on
+// that thread as well, so everything done to a filename happens in order.
+class CDemoWriter
+{
+public:
+	enum
+	{
+		// opens the file
+		RECORD_OPEN,
+		// written as is
+		RECORD_RAW,
+		// chunk type followed by the uncompressed chunk data
+		RECORD_CHUNK,
+		// file offset followed by data to overwrite there
+		RECORD_PATCH,
+		// stop mode followed by the filename to move the file to, closes the file
+		RECORD_CLOSE,
+	};
+
+	// a demo file, only touched by the writer thread after it got queued
+	struct CFile
+	{
+		class IStorage *m_pStorage;
+		char m_aFilename[MAX_PATH_LENGTH];
+		IOHANDLE m_File;
+		bool m_Error;
+	};
+
+	CDemoWriter();
+	// writes everything that is queued, then stops the thread
+	~CDemoWriter();
+
+	void Queue(CFile *pFile, int Kind, const void *pData, unsigned Size, const void *pData2 = 0, unsigned Size2 = 0);
+
+	// blocks until everything queued so far has been written
+	void Flush();
+
+private:
+	struct CRecordHeader
+	{
+		CFile *m_pFile;
+		int m_Kind;
+		unsigned m_Size;
+	};
+
+	void *m_pThread;
+	LOCK m_Lock;
+	SEMAPHORE m_Semaphore;
+	SEMAPHORE m_FlushSemaphore;
+
+	// records as a CRecordHeader followed by the data, guarded by m_Lock
+	std::vector<unsigned char> m_aQueue;
+	bool m_Writing;
+	bool m_Flushing;
+	bool m_Shutdown;
+
+	// only used by the writer thread
+	std::vector<unsigned char> m_aBatch;
+	char m_aBuffer[64*1024];
+	char m_aBuffer2[64*1024];
+
+	static void WriterThread(void *pUser);
+	void WriteRecord(CFile *pFile, int Kind, const unsigned char *pData, unsigned Size);
+	void WriteChunk(IOHANDLE File, int Type, const void *pData, int Size);
+};
+
 class CDemoRecorder : public IDemoRecorder
 {
 	class IConsole *m_pConsole;
-	IOHANDLE m_File;
+	// compression and file io happen on the writer thread
+	CDemoWriter *m_pWriter;
+	CDemoWriter::CFile *m_pFile;
 	int m_LastTickMarker;
 	int m_LastKeyFrame;
+	// tick of the last snapshot given to RecordSnapshotShared, -1 if the
+	// last recorded snapshot didn't come from there
+	int m_LastSharedTick;
 	int m_FirstTick;
 	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
 	class CSnapshotDelta *m_pSnapshotDelta;
@@ -23,7 +99,7 @@ class CDemoRecorder : public IDemoRecorder
 	int m_aTimelineMarkers[MAX_TIMELINE_MARKERS];
 	bool m_NoMapData;
 	unsigned int m_MapSize;
-	unsigned char *m_pMapData;
+	const unsigned char *m_pMapData;
 
 	DEMOFUNC_FILTER m_pfnFilter;
 	void *m_pUser;
@@ -31,17 +107,23 @@ class CDemoRecorder : public IDemoRecorder
 	void WriteTickMarker(int Tick, int Keyframe);
 	void Write(int Type, const void *pData, int Size);
 public:
-	CDemoRecorder(class CSnapshotDelta *pSnapshotDelta, bool NoMapData = false);
+	CDemoRecorder(class CSnapshotDelta *pSnapshotDelta, CDemoWriter *pWriter, bool NoMapData = false);
 	CDemoRecorder() {}
 
-	int Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetversion, const char *pMap, SHA256_DIGEST Sha256, unsigned MapCrc, const char *pType, unsigned int MapSize, unsigned char *pMapData, IOHANDLE MapFile = 0, DEMOFUNC_FILTER pfnFilter = 0, void *pUser = 0);
-	int Stop();
+	int Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetversion, const char *pMap, SHA256_DIGEST Sha256, unsigned MapCrc, const char *pType, unsigned int MapSize, const unsigned char *pMapData, IOHANDLE MapFile = 0, DEMOFUNC_FILTER pfnFilter = 0, void *pUser = 0);
+	// doesn't wait for the writer, the file is only complete after
+	// CDemoWriter::Flush(), pTargetFilename is where it is moved to then
+	int Stop(int Mode = STOPMODE_KEEP_FILE, const char *pTargetFilename = "");
 	void AddDemoMarker();
 
 	void RecordSnapshot(int Tick, const void *pData, int Size);
+	// for a snapshot the caller also sends over the network: pDelta is the
+	// delta from the caller's snapshot of DeltaTick to pData and is recorded
+	// as is if that snapshot was the last one given to this function
+	void RecordSnapshotShared(int Tick, const void *pData, int Size, int DeltaTick, const void *pDelta, int DeltaSize);
 	void RecordMessage(const void *pData, int Size);
 
-	bool IsRecording() const { return m_File != 0; }
+	bool IsRecording() const { return m_pFile != 0; }
 
 	int Length() const { return (m_LastTickMarker - m_FirstTick)/SERVER_TICK_SPEED; }
 };
@@ -96,106 +96,84 @@ void CHuffman::ConstructTree(const unsigned *pFrequencies)
 
 void CHuffman::Init(const unsigned *pFrequencies)
 {
-	int i;
-
 	// make sure to cleanout every thing
 	mem_zero(this, sizeof(*this));
 
 	// construct the tree
 	ConstructTree(pFrequencies);
 
-	// build decode LUT
-	for(i = 0; i < HUFFMAN_LUTSIZE; i++)
+	// build decode LUT, the leaves are the first nodes so their index is the symbol
+	for(int i = 0; i < HUFFMAN_LUTSIZE; i++)
 	{
 		unsigned Bits = i;
-		int k;
 		CNode *pNode = m_pStartNode;
-		for(k = 0; k < HUFFMAN_LUTBITS; k++)
+		int k;
+		for(k = 1; k <= HUFFMAN_LUTBITS; k++)
 		{
 			pNode = &m_aNodes[pNode->m_aLeafs[Bits&1]];
 			Bits >>= 1;
 
-			if(!pNode)
-				break;
-
 			if(pNode->m_NumBits)
-			{
-				m_apDecodeLut[i] = pNode;
 				break;
-			}
 		}
 
-		if(k == HUFFMAN_LUTBITS)
-			m_apDecodeLut[i] = pNode;
+		if(k <= HUFFMAN_LUTBITS)
+			m_aDecodeLut[i] = (k<<HUFFMAN_LUT_NUMBITS_SHIFT) | (int)(pNode - m_aNodes);
+		else
+			m_aDecodeLut[i] = HUFFMAN_LUT_NODE | (int)(pNode - m_aNodes);
 	}
-
 }
 
 //***************************************************************
 int CHuffman::Compress(const void *pInput, int InputSize, void *pOutput, int OutputSize)
 {
-	// this macro loads a symbol for a byte into bits and bitcount
-#define HUFFMAN_MACRO_LOADSYMBOL(Sym) \
-	Bits |= m_aNodes[Sym].m_Bits << Bitcount; \
-	Bitcount += m_aNodes[Sym].m_NumBits;
-
-	// this macro writes the symbol stored in bits and bitcount to the dst pointer
-#define HUFFMAN_MACRO_WRITE() \
-	while(Bitcount >= 8) \
-	{ \
-		*pDst++ = (unsigned char)(Bits&0xff); \
-		if(pDst == pDstEnd) \
-			return -1; \
-		Bits >>= 8; \
-		Bitcount -= 8; \
-	}
-
 	// setup buffer pointers
 	const unsigned char *pSrc = (const unsigned char *)pInput;
 	const unsigned char *pSrcEnd = pSrc + InputSize;
 	unsigned char *pDst = (unsigned char *)pOutput;
 	unsigned char *pDstEnd = pDst + OutputSize;
 
-	// symbol variables
-	unsigned Bits = 0;
+	// codes are at most 32 bits, so there's always room for one more
+	uint64 Bits = 0;
 	unsigned Bitcount = 0;
 
-	// make sure that we have data that we want to compress
-	if(InputSize)
+	while(pSrc != pSrcEnd)
 	{
-		// {A} load the first symbol
-		int Symbol = *pSrc++;
+		const CNode *pNode = &m_aNodes[*pSrc++];
+		Bits |= (uint64)pNode->m_Bits << Bitcount;
+		Bitcount += pNode->m_NumBits;
 
-		while(pSrc != pSrcEnd)
+		if(Bitcount >= 32)
 		{
-			// {B} load the symbol
-			HUFFMAN_MACRO_LOADSYMBOL(Symbol)
-
-			// {C} fetch next symbol, this is done here because it will reduce dependency in the code
-			Symbol = *pSrc++;
-
-			// {B} write the symbol loaded at
-			HUFFMAN_MACRO_WRITE()
+			// the last byte must still fit after the full ones
+			if(pDstEnd - pDst <= 4)
+				return -1;
+			pDst[0] = Bits;
+			pDst[1] = Bits >> 8;
+			pDst[2] = Bits >> 16;
+			pDst[3] = Bits >> 24;
+			pDst += 4;
+			Bits >>= 32;
+			Bitcount -= 32;
 		}
-
-		// write the last symbol loaded from {C} or {A} in the case of only 1 byte input buffer
-		HUFFMAN_MACRO_LOADSYMBOL(Symbol)
-		HUFFMAN_MACRO_WRITE()
 	}
 
 	// write EOF symbol
-	HUFFMAN_MACRO_LOADSYMBOL(HUFFMAN_EOF_SYMBOL)
-	HUFFMAN_MACRO_WRITE()
-
-	// write out the last bits
-	*pDst++ = Bits;
+	Bits |= (uint64)m_aNodes[HUFFMAN_EOF_SYMBOL].m_Bits << Bitcount;
+	Bitcount += m_aNodes[HUFFMAN_EOF_SYMBOL].m_NumBits;
+
+	// write out the full bytes and the last bits, which might be none
+	int Size = Bitcount / 8 + 1;
+	if(pDstEnd - pDst < Size)
+		return -1;
+	for(int i = 0; i < Size; i++)
+	{
+		*pDst++ = Bits;
+		Bits >>= 8;
+	}
 
 	// return the size of the output
 	return (int)(pDst - (const unsigned char *)pOutput);
-
-	// remove macros
-#undef HUFFMAN_MACRO_LOADSYMBOL
-#undef HUFFMAN_MACRO_WRITE
 }
 
 //***************************************************************
@@ -203,78 +181,75 @@ int CHuffman::Decompress(const void *pInput, int InputSize, void *pOutput, int O
 {
 	// setup buffer pointers
 	unsigned char *pDst = (unsigned char *)pOutput;
-	unsigned char *pSrc = (unsigned char *)pInput;
+	const unsigned char *pSrc = (const unsigned char *)pInput;
 	unsigned char *pDstEnd = pDst + OutputSize;
-	unsigned char *pSrcEnd = pSrc + InputSize;
+	const unsigned char *pSrcEnd = pSrc + InputSize;
 
-	unsigned Bits = 0;
+	uint64 Bits = 0;
 	unsigned Bitcount = 0;
 
-	CNode *pEof = &m_aNodes[HUFFMAN_EOF_SYMBOL];
-	CNode *pNode = 0;
-
 	while(1)
 	{
-		// {A} try to load a node now, this will reduce dependency at location {D}
-		pNode = 0;
-		if(Bitcount >= HUFFMAN_LUTBITS)
-			pNode = m_apDecodeLut[Bits&HUFFMAN_LUTMASK];
-
-		// {B} fill with new bits
-		while(Bitcount < 24 && pSrc != pSrcEnd)
+		// keep at least 32 bits around while there is input
+		if(Bitcount < 32)
 		{
-			Bits |= (*pSrc++) << Bitcount;
-			Bitcount += 8;
+			if(pSrcEnd - pSrc >= 8)
+			{
+				// read 8 bytes at once, keep the whole ones that fit
+				uint64 Next = (uint64)pSrc[0] | ((uint64)pSrc[1] << 8) | ((uint64)pSrc[2] << 16) | ((uint64)pSrc[3] << 24) |
+					((uint64)pSrc[4] << 32) | ((uint64)pSrc[5] << 40) | ((uint64)pSrc[6] << 48) | ((uint64)pSrc[7] << 56);
+				Bits |= Next << Bitcount;
+				pSrc += (63 - Bitcount) >> 3;
+				Bitcount |= 56;
+			}
+			else
+			{
+				while(Bitcount <= 56 && pSrc != pSrcEnd)
+				{
+					Bits |= (uint64)(*pSrc++) << Bitcount;
+					Bitcount += 8;
+				}
+			}
 		}
 
-		// {C} load symbol now if we didn't that earlier at location {A}
-		if(!pNode)
-			pNode = m_apDecodeLut[Bits&HUFFMAN_LUTMASK];
-
-		if(!pNode)
-			return -1;
-
-		// {D} check if we hit a symbol already
-		if(pNode->m_NumBits)
+		unsigned Entry = m_aDecodeLut[Bits&HUFFMAN_LUTMASK];
+		unsigned Symbol;
+		unsigned NumBits;
+		if(!(Entry&HUFFMAN_LUT_NODE))
 		{
-			// remove the bits for that symbol
-			Bits >>= pNode->m_NumBits;
-			Bitcount -= pNode->m_NumBits;
+			Symbol = Entry&HUFFMAN_LUT_SYMBOL_MASK;
+			NumBits = Entry>>HUFFMAN_LUT_NUMBITS_SHIFT;
 		}
 		else
 		{
-			// remove the bits that the lut checked up for us
-			Bits >>= HUFFMAN_LUTBITS;
-			Bitcount -= HUFFMAN_LUTBITS;
-
-			// walk the tree bit by bit
-			while(1)
+			// walk the rest of the tree bit by bit
+			const CNode *pNode = &m_aNodes[Entry&~HUFFMAN_LUT_NODE];
+			uint64 Rest = Bits >> HUFFMAN_LUTBITS;
+			NumBits = HUFFMAN_LUTBITS;
+			do
 			{
-				// traverse tree
-				pNode = &m_aNodes[pNode->m_aLeafs[Bits&1]];
-
-				// remove bit
-				Bitcount--;
-				Bits >>= 1;
-
-				// check if we hit a symbol
-				if(pNode->m_NumBits)
-					break;
-
-				// no more bits, decoding error
-				if(Bitcount == 0)
-					return -1;
+				pNode = &m_aNodes[pNode->m_aLeafs[Rest&1]];
+				Rest >>= 1;
+				NumBits++;
 			}
+			while(!pNode->m_NumBits);
+			Symbol = pNode - m_aNodes;
 		}
 
+		// the code doesn't end within the input
+		if(NumBits > Bitcount)
+			return -1;
+		Bits >>= NumBits;
+		Bitcount -= NumBits;
+
 		// check for eof
-		if(pNode == pEof)
+		if(Symbol == HUFFMAN_EOF_SYMBOL)
 			break;
 
 		// output character
 		if(pDst == pDstEnd)
 			return -1;
-		*pDst++ = pNode->m_Symbol;
+		*pDst++ = Symbol;
 	}
 
 	// return the size of the decompressed buffer
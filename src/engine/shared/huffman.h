@@ -14,9 +14,15 @@ class CHuffman
 		HUFFMAN_MAX_SYMBOLS=HUFFMAN_EOF_SYMBOL+1,
 		HUFFMAN_MAX_NODES=HUFFMAN_MAX_SYMBOLS*2-1,
 
-		HUFFMAN_LUTBITS = 10,
+		HUFFMAN_LUTBITS = 12,
 		HUFFMAN_LUTSIZE = (1<<HUFFMAN_LUTBITS),
-		HUFFMAN_LUTMASK = (HUFFMAN_LUTSIZE-1)
+		HUFFMAN_LUTMASK = (HUFFMAN_LUTSIZE-1),
+
+		// decode LUT entries are either a symbol with its code length or,
+		// for longer codes, the tree node reached after HUFFMAN_LUTBITS bits
+		HUFFMAN_LUT_NODE = 0x8000,
+		HUFFMAN_LUT_NUMBITS_SHIFT = 9,
+		HUFFMAN_LUT_SYMBOL_MASK = (1<<HUFFMAN_LUT_NUMBITS_SHIFT)-1,
 	};
 
 	struct CNode
@@ -33,7 +39,7 @@ class CHuffman
 	};
 
 	CNode m_aNodes[HUFFMAN_MAX_NODES];
-	CNode *m_apDecodeLut[HUFFMAN_LUTSIZE];
+	unsigned short m_aDecodeLut[HUFFMAN_LUTSIZE];
 	CNode *m_pStartNode;
 	int m_NumNodes;
 
@@ -31,7 +31,19 @@ public:
 		IStorage *pStorage = Kernel()->RequestInterface<IStorage>();
 		if(!pStorage)
 			return false;
-		return m_DataFile.Open(pStorage, pMapName, IStorage::TYPE_ALL);
+		return Load(pStorage, pMapName);
+	}
+
+	virtual bool Load(IStorage *pStorage, const char *pMapName)
+	{
+		// read, not mapped. The map stays open as long as it's played and
+		// an admin may overwrite it in place, a mapping would crash then
+		return m_DataFile.Open(pStorage, pMapName, IStorage::TYPE_ALL, false);
+	}
+
+	virtual void Swap(IEngineMap *pOther)
+	{
+		m_DataFile.Swap(&static_cast<CMap *>(pOther)->m_DataFile);
 	}
 
 	virtual bool IsLoaded()
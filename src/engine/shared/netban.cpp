@@ -3,6 +3,7 @@
 #include <engine/console.h>
 #include <engine/storage.h>
 #include <engine/shared/config.h>
+#include <engine/shared/linereader.h>
 
 #include "netban.h"
 
@@ -197,6 +198,7 @@ void CNetBan::UnbanAll()
 {
 	m_BanAddrPool.Reset();
 	m_BanRangePool.Reset();
+	m_BanList.Clear();
 }
 
 template<class T, int HashCount>
@@ -234,6 +236,20 @@ typename CNetBan::CBan<T> *CNetBan::CBanPool<T, HashCount>::Get(int Index) const
 }
 
 
+void CNetBan::MakeExpiryInfo(const char *pWhat, int Expires, const char *pReason, char *pBuf, unsigned BuffSize) const
+{
+	if(Expires != CBanInfo::EXPIRES_NEVER)
+	{
+		int Mins = ((Expires-time_timestamp()) + 59) / 60;
+		if(Mins <= 1)
+			str_format(pBuf, BuffSize, "%s for 1 minute (%s)", pWhat, pReason);
+		else
+			str_format(pBuf, BuffSize, "%s for %d minutes (%s)", pWhat, Mins, pReason);
+	}
+	else
+		str_format(pBuf, BuffSize, "%s for life (%s)", pWhat, pReason);
+}
+
 template<class T>
 int CNetBan::Ban(T *pBanPool, const typename T::CDataType *pData, int Seconds, const char *pReason)
 {
@@ -302,6 +318,7 @@ void CNetBan::Init(IConsole *pConsole, IStorage *pStorage)
 	m_pStorage = pStorage;
 	m_BanAddrPool.Reset();
 	m_BanRangePool.Reset();
+	m_BanList.Clear();
 
 	net_host_lookup("localhost", &m_LocalhostIPV4, NETTYPE_IPV4);
 	net_host_lookup("localhost", &m_LocalhostIPV6, NETTYPE_IPV6);
@@ -313,6 +330,12 @@ void CNetBan::Init(IConsole *pConsole, IStorage *pStorage)
 	Console()->Register("unban_all", "", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConUnbanAll, this, "Unban all entries");
 	Console()->Register("bans", "", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConBans, this, "Show banlist");
 	Console()->Register("bans_save", "s[file]", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConBansSave, this, "Save banlist in a file");
+	Console()->Register("ban_list_add", "s[ip/prefix] ?i[minutes] r[reason]", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConBanListAdd, this, "Ban an address prefix for x minutes (0 = for life)");
+	Console()->Register("ban_list_remove", "s[ip/prefix]", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConBanListRemove, this, "Unban an address prefix");
+	Console()->Register("ban_list_import", "s[file] ?i[minutes] r[reason]", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConBanListImport, this, "Ban the addresses and prefixes of a text file, one per line, for x minutes (0 = for life)");
+	Console()->Register("ban_list_load", "s[file]", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConBanListLoad, this, "Load prefix bans saved with ban_list_save");
+	Console()->Register("ban_list_save", "s[file]", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConBanListSave, this, "Save the prefix bans in a compact file");
+	Console()->Register("ban_list_clear", "", CFGFLAG_SERVER|CFGFLAG_MASTER|CFGFLAG_STORE, ConBanListClear, this, "Remove all prefix bans");
 }
 
 void CNetBan::Update()
@@ -333,6 +356,13 @@ void CNetBan::Update()
 		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
 		m_BanRangePool.Remove(m_BanRangePool.First());
 	}
+
+	int NumExpired = m_BanList.Update(Now);
+	if(NumExpired)
+	{
+		str_format(aBuf, sizeof(aBuf), "%d prefix %s expired", NumExpired, NumExpired==1?"ban":"bans");
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+	}
 }
 
 int CNetBan::BanAddr(const NETADDR *pAddr, int Seconds, const char *pReason)
@@ -427,9 +457,37 @@ bool CNetBan::IsBanned(const NETADDR *pOrigAddr, char *pBuf, unsigned BufferSize
 		}
 	}
 
+	// check prefix bans
+	const CNetBanTrie::CEntry *pEntry = m_BanList.Find(pAddr);
+	if(pEntry)
+	{
+		if(pBuf)
+			MakeExpiryInfo("You have been banned", pEntry->m_Expires, m_BanList.Reason(pEntry), pBuf, BufferSize);
+		return true;
+	}
+
 	return false;
 }
 
+bool CNetBan::CoversLocalhost(const NETADDR *pAddr, int Prefix) const
+{
+	return CNetBanTrie::Contains(pAddr, Prefix, &m_LocalhostIPV4) || CNetBanTrie::Contains(pAddr, Prefix, &m_LocalhostIPV6);
+}
+
+bool CNetBan::BanListAdd(const NETADDR *pAddr, int Prefix, int Expires, const char *pReason)
+{
+	// do not ban localhost
+	if(CoversLocalhost(pAddr, Prefix))
+		return false;
+	return m_BanList.Add(pAddr, Prefix, Expires, pReason);
+}
+
+bool CNetBan::BanListLoadFilter(const NETADDR *pAddr, int Prefix, void *pUser)
+{
+	// do not ban localhost, ban files can be edited or come from elsewhere
+	return !static_cast<CNetBan *>(pUser)->CoversLocalhost(pAddr, Prefix);
+}
+
 void CNetBan::ConBan(IConsole::IResult *pResult, void *pUser)
 {
 	CNetBan *pThis = static_cast<CNetBan *>(pUser);
@@ -520,6 +578,11 @@ void CNetBan::ConBans(IConsole::IResult *pResult, void *pUser)
 	}
 	str_format(aMsg, sizeof(aMsg), "%d %s", Count, Count==1?"ban":"bans");
 	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aMsg);
+	if(pThis->m_BanList.Num())
+	{
+		str_format(aMsg, sizeof(aMsg), "%d prefix %s", pThis->m_BanList.Num(), pThis->m_BanList.Num()==1?"ban":"bans");
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aMsg);
+	}
 }
 
 void CNetBan::ConBansSave(IConsole::IResult *pResult, void *pUser)
@@ -559,3 +622,145 @@ void CNetBan::ConBansSave(IConsole::IResult *pResult, void *pUser)
 	str_format(aBuf, sizeof(aBuf), "saved banlist to '%s'", pResult->GetString(0));
 	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
 }
+
+void CNetBan::ConBanListAdd(IConsole::IResult *pResult, void *pUser)
+{
+	CNetBan *pThis = static_cast<CNetBan *>(pUser);
+
+	const char *pStr = pResult->GetString(0);
+	int Minutes = pResult->NumArguments()>1 ? clamp(pResult->GetInteger(1), 0, 44640) : 0;
+	const char *pReason = pResult->NumArguments()>2 ? pResult->GetString(2) : "No reason given";
+
+	NETADDR Addr;
+	int Prefix;
+	char aBuf[256], aPrefix[NETADDR_MAXSTRSIZE+8];
+	if(CNetBanTrie::ParsePrefix(pStr, &Addr, &Prefix) != 0)
+	{
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "ban error (invalid prefix)");
+		return;
+	}
+	if(!pThis->BanListAdd(&Addr, Prefix, Minutes ? time_timestamp()+Minutes*60 : CBanInfo::EXPIRES_NEVER, pReason))
+	{
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "ban failed (localhost)");
+		return;
+	}
+
+	CNetBanTrie::PrefixToString(&Addr, Prefix, aPrefix, sizeof(aPrefix));
+	str_format(aBuf, sizeof(aBuf), "banned prefix '%s'", aPrefix);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+}
+
+void CNetBan::ConBanListRemove(IConsole::IResult *pResult, void *pUser)
+{
+	CNetBan *pThis = static_cast<CNetBan *>(pUser);
+
+	NETADDR Addr;
+	int Prefix;
+	if(CNetBanTrie::ParsePrefix(pResult->GetString(0), &Addr, &Prefix) != 0)
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "unban error (invalid prefix)");
+	else if(!pThis->m_BanList.Remove(&Addr, Prefix))
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "unban failed (invalid entry)");
+	else
+	{
+		char aBuf[256], aPrefix[NETADDR_MAXSTRSIZE+8];
+		CNetBanTrie::PrefixToString(&Addr, Prefix, aPrefix, sizeof(aPrefix));
+		str_format(aBuf, sizeof(aBuf), "unbanned prefix '%s'", aPrefix);
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+	}
+}
+
+void CNetBan::ConBanListImport(IConsole::IResult *pResult, void *pUser)
+{
+	CNetBan *pThis = static_cast<CNetBan *>(pUser);
+
+	const char *pFilename = pResult->GetString(0);
+	int Minutes = pResult->NumArguments()>1 ? clamp(pResult->GetInteger(1), 0, 44640) : 0;
+	const char *pReason = pResult->NumArguments()>2 ? pResult->GetString(2) : "No reason given";
+	int Expires = Minutes ? time_timestamp()+Minutes*60 : CBanInfo::EXPIRES_NEVER;
+
+	char aBuf[256];
+	IOHANDLE File = pThis->Storage()->OpenFile(pFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
+	{
+		str_format(aBuf, sizeof(aBuf), "failed to open '%s'", pFilename);
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+		return;
+	}
+
+	CLineReader LineReader;
+	LineReader.Init(File);
+	int NumAdded = 0, NumInvalid = 0;
+	char *pLine;
+	while((pLine = LineReader.Get()))
+	{
+		// first token of the line, the rest is a comment
+		pLine = str_skip_whitespaces(pLine);
+		if(!*pLine || *pLine == '#' || *pLine == ';')
+			continue;
+		char *pEnd = str_skip_to_whitespace(pLine);
+		*pEnd = 0;
+
+		NETADDR Addr;
+		int Prefix;
+		if(CNetBanTrie::ParsePrefix(pLine, &Addr, &Prefix) == 0 && pThis->BanListAdd(&Addr, Prefix, Expires, pReason))
+			NumAdded++;
+		else
+			NumInvalid++;
+	}
+	io_close(File);
+
+	str_format(aBuf, sizeof(aBuf), "imported %d prefix bans from '%s', skipped %d invalid lines", NumAdded, pFilename, NumInvalid);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+}
+
+void CNetBan::ConBanListLoad(IConsole::IResult *pResult, void *pUser)
+{
+	CNetBan *pThis = static_cast<CNetBan *>(pUser);
+
+	char aBuf[256];
+	IOHANDLE File = pThis->Storage()->OpenFile(pResult->GetString(0), IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
+	{
+		str_format(aBuf, sizeof(aBuf), "failed to open '%s'", pResult->GetString(0));
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+		return;
+	}
+	int NumLoaded = pThis->m_BanList.Load(File, time_timestamp(), BanListLoadFilter, pThis);
+	io_close(File);
+
+	if(NumLoaded < 0)
+		str_format(aBuf, sizeof(aBuf), "failed to load prefix bans from '%s' (invalid file)", pResult->GetString(0));
+	else
+		str_format(aBuf, sizeof(aBuf), "loaded %d prefix bans from '%s'", NumLoaded, pResult->GetString(0));
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+}
+
+void CNetBan::ConBanListSave(IConsole::IResult *pResult, void *pUser)
+{
+	CNetBan *pThis = static_cast<CNetBan *>(pUser);
+
+	char aBuf[256];
+	IOHANDLE File = pThis->Storage()->OpenFile(pResult->GetString(0), IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+	{
+		str_format(aBuf, sizeof(aBuf), "failed to save prefix bans to '%s'", pResult->GetString(0));
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+		return;
+	}
+	int NumSaved = pThis->m_BanList.Save(File, time_timestamp());
+	io_close(File);
+
+	if(NumSaved < 0)
+		str_format(aBuf, sizeof(aBuf), "failed to save prefix bans to '%s'", pResult->GetString(0));
+	else
+		str_format(aBuf, sizeof(aBuf), "saved %d prefix bans to '%s'", NumSaved, pResult->GetString(0));
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", aBuf);
+}
+
+void CNetBan::ConBanListClear(IConsole::IResult *pResult, void *pUser)
+{
+	CNetBan *pThis = static_cast<CNetBan *>(pUser);
+
+	pThis->m_BanList.Clear();
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "net_ban", "removed all prefix bans");
+}
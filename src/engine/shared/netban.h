@@ -3,6 +3,8 @@
 
 #include <base/system.h>
 
+#include "netban_trie.h"
+
 inline int NetComp(const NETADDR *pAddr1, const NETADDR *pAddr2)
 {
 	return mem_comp(pAddr1, pAddr2, pAddr1->type==NETTYPE_IPV4 ? 8 : 20);
@@ -142,6 +144,7 @@ protected:
 	typedef CBan<NETADDR> CBanAddr;
 	typedef CBan<CNetRange> CBanRange;
 
+	void MakeExpiryInfo(const char *pWhat, int Expires, const char *pReason, char *pBuf, unsigned BuffSize) const;
 	template<class T> void MakeBanInfo(const CBan<T> *pBan, char *pBuf, unsigned BuffSize, int Type) const;
 	template<class T> int Ban(T *pBanPool, const typename T::CDataType *pData, int Seconds, const char *pReason);
 	template<class T> int Unban(T *pBanPool, const typename T::CDataType *pData);
@@ -150,8 +153,14 @@ protected:
 	class IStorage *m_pStorage;
 	CBanAddrPool m_BanAddrPool;
 	CBanRangePool m_BanRangePool;
+	// imported address lists, too large for the pools
+	CNetBanTrie m_BanList;
 	NETADDR m_LocalhostIPV4, m_LocalhostIPV6;
 
+	bool CoversLocalhost(const NETADDR *pAddr, int Prefix) const;
+	bool BanListAdd(const NETADDR *pAddr, int Prefix, int Expires, const char *pReason);
+	static bool BanListLoadFilter(const NETADDR *pAddr, int Prefix, void *pUser);
+
 public:
 	enum
 	{
@@ -183,6 +192,12 @@ public:
 	static void ConUnbanAll(class IConsole::IResult *pResult, void *pUser);
 	static void ConBans(class IConsole::IResult *pResult, void *pUser);
 	static void ConBansSave(class IConsole::IResult *pResult, void *pUser);
+	static void ConBanListAdd(class IConsole::IResult *pResult, void *pUser);
+	static void ConBanListRemove(class IConsole::IResult *pResult, void *pUser);
+	static void ConBanListImport(class IConsole::IResult *pResult, void *pUser);
+	static void ConBanListLoad(class IConsole::IResult *pResult, void *pUser);
+	static void ConBanListSave(class IConsole::IResult *pResult, void *pUser);
+	static void ConBanListClear(class IConsole::IResult *pResult, void *pUser);
 };
 
 
@@ -217,16 +232,7 @@ void CNetBan::MakeBanInfo(const CBan<T> *pBan, char *pBuf, unsigned BuffSize, in
 	}
 
 	// add info part
-	if(pBan->m_Info.m_Expires != CBanInfo::EXPIRES_NEVER)
-	{
-		int Mins = ((pBan->m_Info.m_Expires-time_timestamp()) + 59) / 60;
-		if(Mins <= 1)
-			str_format(pBuf, BuffSize, "%s for 1 minute (%s)", aBuf, pBan->m_Info.m_aReason);
-		else
-			str_format(pBuf, BuffSize, "%s for %d minutes (%s)", aBuf, Mins, pBan->m_Info.m_aReason);
-	}
-	else
-		str_format(pBuf, BuffSize, "%s for life (%s)", aBuf, pBan->m_Info.m_aReason);
+	MakeExpiryInfo(aBuf, pBan->m_Info.m_Expires, pBan->m_Info.m_aReason, pBuf, BuffSize);
 }
 
 #endif
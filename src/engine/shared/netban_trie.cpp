@@ -0,0 +1,512 @@
+#include <base/math.h>
+
+#include "netban_trie.h"
+
+static const unsigned char BANLIST_MAGIC[4] = {'T', 'W', 'B', 'L'};
+enum
+{
+	BANLIST_VERSION=1,
+};
+
+static int AddrBits(const NETADDR *pAddr)
+{
+	return pAddr->type == NETTYPE_IPV4 ? 32 : 128;
+}
+
+static void MaskKey(unsigned char *pKey, int Prefix)
+{
+	for(int i = 0; i < 16; i++)
+	{
+		int Keep = clamp(Prefix - i*8, 0, 8);
+		pKey[i] &= (0xff00>>Keep)&0xff;
+	}
+}
+
+static void WriteInt(std::vector<unsigned char> *paData, int Value)
+{
+	paData->push_back(Value>>24);
+	paData->push_back(Value>>16);
+	paData->push_back(Value>>8);
+	paData->push_back(Value);
+}
+
+static int ReadInt(const unsigned char *pData)
+{
+	return (pData[0]<<24) | (pData[1]<<16) | (pData[2]<<8) | pData[3];
+}
+
+CNetBanTrie::CNetBanTrie()
+{
+	Clear();
+}
+
+void CNetBanTrie::Clear()
+{
+	m_aNodes.clear();
+	m_aEntries.clear();
+	m_aReasons.clear();
+	m_FirstFreeNode = -1;
+	m_FirstFreeEntry = -1;
+	m_NumEntries = 0;
+	m_aRoots[0] = m_aRoots[1] = -1;
+	for(int i = 0; i < WHEEL_SIZE; i++)
+		m_aWheel[i] = -1;
+	m_WheelTime = 0;
+}
+
+int CNetBanTrie::CommonPrefix(const unsigned char *pKey1, const unsigned char *pKey2, int MaxLength)
+{
+	int Length = 0;
+	while(Length + 8 <= MaxLength && pKey1[Length>>3] == pKey2[Length>>3])
+		Length += 8;
+	while(Length < MaxLength && Bit(pKey1, Length) == Bit(pKey2, Length))
+		Length++;
+	return Length;
+}
+
+int CNetBanTrie::NewNode(const unsigned char *pKey, int Length, int Parent)
+{
+	int Node;
+	if(m_FirstFreeNode >= 0)
+	{
+		Node = m_FirstFreeNode;
+		m_FirstFreeNode = m_aNodes[Node].m_aChildren[0];
+	}
+	else
+	{
+		Node = m_aNodes.size();
+		m_aNodes.push_back(CNode());
+	}
+
+	CNode *pNode = &m_aNodes[Node];
+	mem_copy(pNode->m_aKey, pKey, sizeof(pNode->m_aKey));
+	MaskKey(pNode->m_aKey, Length);
+	pNode->m_Length = Length;
+	pNode->m_Parent = Parent;
+	pNode->m_aChildren[0] = pNode->m_aChildren[1] = -1;
+	pNode->m_Entry = -1;
+	return Node;
+}
+
+void CNetBanTrie::FreeNode(int Node)
+{
+	m_aNodes[Node].m_Length = -1;
+	m_aNodes[Node].m_aChildren[0] = m_FirstFreeNode;
+	m_FirstFreeNode = Node;
+}
+
+int *CNetBanTrie::Link(int Node)
+{
+	int Parent = m_aNodes[Node].m_Parent;
+	if(Parent < 0)
+		return m_aRoots[0] == Node ? &m_aRoots[0] : &m_aRoots[1];
+	return m_aNodes[Parent].m_aChildren[0] == Node ? &m_aNodes[Parent].m_aChildren[0] : &m_aNodes[Parent].m_aChildren[1];
+}
+
+int CNetBanTrie::AddReason(const char *pReason)
+{
+	// bans are usually added in bulk with the same reason
+	for(int i = (int)m_aReasons.size() - 1; i >= 0; i--)
+	{
+		if(str_comp(m_aReasons[i].m_aReason, pReason) == 0)
+			return i;
+	}
+
+	CReason Reason;
+	str_copy(Reason.m_aReason, pReason, sizeof(Reason.m_aReason));
+	m_aReasons.push_back(Reason);
+	return m_aReasons.size() - 1;
+}
+
+void CNetBanTrie::TimerLink(int Entry)
+{
+	CEntry *pEntry = &m_aEntries[Entry];
+	pEntry->m_TimerPrev = pEntry->m_TimerNext = -1;
+	if(pEntry->m_Expires == EXPIRES_NEVER)
+		return;
+
+	int *pSlot = &m_aWheel[pEntry->m_Expires % WHEEL_SIZE];
+	pEntry->m_TimerNext = *pSlot;
+	if(*pSlot >= 0)
+		m_aEntries[*pSlot].m_TimerPrev = Entry;
+	*pSlot = Entry;
+}
+
+void CNetBanTrie::TimerUnlink(int Entry)
+{
+	CEntry *pEntry = &m_aEntries[Entry];
+	if(pEntry->m_Expires == EXPIRES_NEVER)
+		return;
+
+	if(pEntry->m_TimerNext >= 0)
+		m_aEntries[pEntry->m_TimerNext].m_TimerPrev = pEntry->m_TimerPrev;
+	if(pEntry->m_TimerPrev >= 0)
+		m_aEntries[pEntry->m_TimerPrev].m_TimerNext = pEntry->m_TimerNext;
+	else
+		m_aWheel[pEntry->m_Expires % WHEEL_SIZE] = pEntry->m_TimerNext;
+	pEntry->m_TimerPrev = pEntry->m_TimerNext = -1;
+}
+
+bool CNetBanTrie::Add(const NETADDR *pAddr, int Prefix, int Expires, const char *pReason)
+{
+	return AddEntry(pAddr, Prefix, Expires, AddReason(pReason));
+}
+
+bool CNetBanTrie::AddEntry(const NETADDR *pAddr, int Prefix, int Expires, int Reason)
+{
+	if((pAddr->type != NETTYPE_IPV4 && pAddr->type != NETTYPE_IPV6) || Prefix < 0 || Prefix > AddrBits(pAddr))
+		return false;
+
+	// the wheel already passed this second
+	if(Expires != EXPIRES_NEVER && Expires <= m_WheelTime)
+	{
+		Remove(pAddr, Prefix);
+		return true;
+	}
+
+	unsigned char aKey[16] = {0};
+	mem_copy(aKey, pAddr->ip, AddrBits(pAddr)/8);
+	MaskKey(aKey, Prefix);
+
+	int Root = CNetBanTrie::Root(pAddr);
+	int Parent = -1;
+	int Slot = 0;
+	int Node = m_aRoots[Root];
+	int Found;
+	while(1)
+	{
+		int Insert;
+		if(Node < 0)
+		{
+			Found = Insert = NewNode(aKey, Prefix, Parent);
+		}
+		else
+		{
+			int Length = m_aNodes[Node].m_Length;
+			int Common = CommonPrefix(m_aNodes[Node].m_aKey, aKey, min(Length, Prefix));
+			if(Common == Length)
+			{
+				if(Common == Prefix)
+				{
+					Found = Node;
+					break;
+				}
+				Parent = Node;
+				Slot = Bit(aKey, Common);
+				Node = m_aNodes[Node].m_aChildren[Slot];
+				continue;
+			}
+
+			if(Common == Prefix)
+			{
+				// the new prefix contains this node
+				Found = Insert = NewNode(aKey, Prefix, Parent);
+				m_aNodes[Found].m_aChildren[Bit(m_aNodes[Node].m_aKey, Prefix)] = Node;
+			}
+			else
+			{
+				// the prefixes diverge inside this node
+				Insert = NewNode(aKey, Common, Parent);
+				Found = NewNode(aKey, Prefix, Insert);
+				m_aNodes[Insert].m_aChildren[Bit(aKey, Common)] = Found;
+				m_aNodes[Insert].m_aChildren[Bit(m_aNodes[Node].m_aKey, Common)] = Node;
+			}
+			m_aNodes[Node].m_Parent = Insert;
+		}
+
+		if(Parent < 0)
+			m_aRoots[Root] = Insert;
+		else
+			m_aNodes[Parent].m_aChildren[Slot] = Insert;
+		break;
+	}
+
+	int Entry = m_aNodes[Found].m_Entry;
+	if(Entry >= 0)
+		TimerUnlink(Entry);
+	else
+	{
+		if(m_FirstFreeEntry >= 0)
+		{
+			Entry = m_FirstFreeEntry;
+			m_FirstFreeEntry = m_aEntries[Entry].m_TimerNext;
+		}
+		else
+		{
+			Entry = m_aEntries.size();
+			m_aEntries.push_back(CEntry());
+		}
+		m_aNodes[Found].m_Entry = Entry;
+		m_NumEntries++;
+	}
+
+	CEntry *pEntry = &m_aEntries[Entry];
+	mem_zero(&pEntry->m_Addr, sizeof(pEntry->m_Addr));
+	pEntry->m_Addr.type = pAddr->type;
+	mem_copy(pEntry->m_Addr.ip, aKey, AddrBits(pAddr)/8);
+	pEntry->m_Prefix = Prefix;
+	pEntry->m_Expires = Expires;
+	pEntry->m_Reason = Reason;
+	pEntry->m_Node = Found;
+	TimerLink(Entry);
+	return true;
+}
+
+bool CNetBanTrie::Remove(const NETADDR *pAddr, int Prefix)
+{
+	if((pAddr->type != NETTYPE_IPV4 && pAddr->type != NETTYPE_IPV6) || Prefix < 0 || Prefix > AddrBits(pAddr))
+		return false;
+
+	unsigned char aKey[16] = {0};
+	mem_copy(aKey, pAddr->ip, AddrBits(pAddr)/8);
+	MaskKey(aKey, Prefix);
+
+	int Node = m_aRoots[Root(pAddr)];
+	while(Node >= 0)
+	{
+		const CNode *pNode = &m_aNodes[Node];
+		if(pNode->m_Length > Prefix || CommonPrefix(pNode->m_aKey, aKey, pNode->m_Length) < pNode->m_Length)
+			return false;
+		if(pNode->m_Length == Prefix)
+		{
+			if(pNode->m_Entry < 0)
+				return false;
+			RemoveEntry(pNode->m_Entry);
+			return true;
+		}
+		Node = pNode->m_aChildren[Bit(aKey, pNode->m_Length)];
+	}
+	return false;
+}
+
+void CNetBanTrie::RemoveEntry(int Entry)
+{
+	TimerUnlink(Entry);
+	int Node = m_aEntries[Entry].m_Node;
+	m_aEntries[Entry].m_Node = -1;
+	m_aEntries[Entry].m_TimerNext = m_FirstFreeEntry;
+	m_FirstFreeEntry = Entry;
+	m_NumEntries--;
+	m_aNodes[Node].m_Entry = -1;
+
+	// drop nodes that don't branch anymore
+	while(Node >= 0)
+	{
+		const CNode *pNode = &m_aNodes[Node];
+		if(pNode->m_Entry >= 0 || (pNode->m_aChildren[0] >= 0 && pNode->m_aChildren[1] >= 0))
+			break;
+
+		int Child = pNode->m_aChildren[0] >= 0 ? pNode->m_aChildren[0] : pNode->m_aChildren[1];
+		int Parent = pNode->m_Parent;
+		*Link(Node) = Child;
+		FreeNode(Node);
+		if(Child >= 0)
+		{
+			m_aNodes[Child].m_Parent = Parent;
+			break;
+		}
+		Node = Parent;
+	}
+}
+
+const CNetBanTrie::CEntry *CNetBanTrie::Find(const NETADDR *pAddr) const
+{
+	if(pAddr->type != NETTYPE_IPV4 && pAddr->type != NETTYPE_IPV6)
+		return 0;
+
+	int Bits = AddrBits(pAddr);
+	unsigned char aKey[16] = {0};
+	mem_copy(aKey, pAddr->ip, Bits/8);
+
+	int Node = m_aRoots[Root(pAddr)];
+	while(Node >= 0)
+	{
+		const CNode *pNode = &m_aNodes[Node];
+		if(CommonPrefix(pNode->m_aKey, aKey, pNode->m_Length) < pNode->m_Length)
+			return 0;
+		if(pNode->m_Entry >= 0)
+			return &m_aEntries[pNode->m_Entry];
+		if(pNode->m_Length >= Bits)
+			return 0;
+		Node = pNode->m_aChildren[Bit(aKey, pNode->m_Length)];
+	}
+	return 0;
+}
+
+int CNetBanTrie::Update(int Now)
+{
+	int Removed = 0;
+	int Start = max(m_WheelTime + 1, Now - WHEEL_SIZE);
+	for(int Time = Start; Time < Now; Time++)
+	{
+		// the slot also holds bans expiring in later rounds
+		for(int Entry = m_aWheel[Time % WHEEL_SIZE]; Entry >= 0;)
+		{
+			int Next = m_aEntries[Entry].m_TimerNext;
+			if(m_aEntries[Entry].m_Expires <= Time)
+			{
+				RemoveEntry(Entry);
+				Removed++;
+			}
+			Entry = Next;
+		}
+	}
+	m_WheelTime = max(m_WheelTime, Now - 1);
+	return Removed;
+}
+
+void CNetBanTrie::ForEach(FEntryCallback pfnCallback, void *pUser) const
+{
+	for(unsigned i = 0; i < m_aEntries.size(); i++)
+	{
+		if(m_aEntries[i].m_Node >= 0)
+			pfnCallback(&m_aEntries[i], pUser);
+	}
+}
+
+int CNetBanTrie::ParsePrefix(const char *pStr, NETADDR *pAddr, int *pPrefix)
+{
+	char aAddr[NETADDR_MAXSTRSIZE];
+	const char *pSlash = str_find(pStr, "/");
+	int Length = pSlash ? pSlash - pStr : str_length(pStr);
+	if(Length <= 0 || Length > (int)sizeof(aAddr) - 3)
+		return -1;
+
+	// IPv6 addresses from lists usually come without brackets
+	const char *pColon = str_find(pStr, ":");
+	if(pStr[0] != '[' && pColon && pColon < pStr + Length && str_find(pColon + 1, ":"))
+		str_format(aAddr, sizeof(aAddr), "[%.*s]", Length, pStr);
+	else
+		str_format(aAddr, sizeof(aAddr), "%.*s", Length, pStr);
+
+	if(net_addr_from_str(pAddr, aAddr) != 0)
+		return -1;
+	pAddr->port = 0;
+
+	int Bits = AddrBits(pAddr);
+	if(!pSlash)
+	{
+		*pPrefix = Bits;
+		return 0;
+	}
+	if(!pSlash[1] || !str_isallnum(pSlash + 1) || str_length(pSlash + 1) > 3)
+		return -1;
+	*pPrefix = str_toint(pSlash + 1);
+	return *pPrefix <= Bits ? 0 : -1;
+}
+
+bool CNetBanTrie::Contains(const NETADDR *pAddr, int Prefix, const NETADDR *pOther)
+{
+	return pAddr->type == pOther->type && CommonPrefix(pAddr->ip, pOther->ip, min(Prefix, AddrBits(pAddr))) == min(Prefix, AddrBits(pAddr));
+}
+
+void CNetBanTrie::PrefixToString(const NETADDR *pAddr, int Prefix, char *pBuf, int BufferSize)
+{
+	char aAddr[NETADDR_MAXSTRSIZE];
+	net_addr_str(pAddr, aAddr, sizeof(aAddr), false);
+	if(Prefix < AddrBits(pAddr))
+		str_format(pBuf, BufferSize, "%s/%d", aAddr, Prefix);
+	else
+		str_copy(pBuf, aAddr, BufferSize);
+}
+
+int CNetBanTrie::Save(IOHANDLE File, int Now) const
+{
+	std::vector<unsigned char> aData(BANLIST_MAGIC, BANLIST_MAGIC + sizeof(BANLIST_MAGIC));
+	aData.push_back(BANLIST_VERSION);
+
+	WriteInt(&aData, m_aReasons.size());
+	for(unsigned i = 0; i < m_aReasons.size(); i++)
+	{
+		int Length = str_length(m_aReasons[i].m_aReason);
+		aData.push_back(Length);
+		aData.insert(aData.end(), m_aReasons[i].m_aReason, m_aReasons[i].m_aReason + Length);
+	}
+
+	int NumSaved = 0;
+	int NumPos = aData.size();
+	WriteInt(&aData, 0);
+	for(unsigned i = 0; i < m_aEntries.size(); i++)
+	{
+		const CEntry *pEntry = &m_aEntries[i];
+		if(pEntry->m_Node < 0 || (pEntry->m_Expires != EXPIRES_NEVER && pEntry->m_Expires < Now))
+			continue;
+		aData.push_back(pEntry->m_Addr.type == NETTYPE_IPV4 ? 4 : 6);
+		aData.push_back(pEntry->m_Prefix);
+		aData.insert(aData.end(), pEntry->m_Addr.ip, pEntry->m_Addr.ip + AddrBits(&pEntry->m_Addr)/8);
+		WriteInt(&aData, pEntry->m_Expires);
+		WriteInt(&aData, pEntry->m_Reason);
+		NumSaved++;
+	}
+	aData[NumPos] = NumSaved>>24;
+	aData[NumPos+1] = NumSaved>>16;
+	aData[NumPos+2] = NumSaved>>8;
+	aData[NumPos+3] = NumSaved;
+
+	if(io_write(File, &aData[0], aData.size()) != aData.size())
+		return -1;
+	return NumSaved;
+}
+
+int CNetBanTrie::Load(IOHANDLE File, int Now, FFilterCallback pfnFilter, void *pUser)
+{
+	long int Size = io_length(File);
+	if(Size < (int)sizeof(BANLIST_MAGIC) + 1 + 8)
+		return -1;
+	std::vector<unsigned char> aData(Size);
+	if(io_read(File, &aData[0], Size) != (unsigned)Size)
+		return -1;
+	if(mem_comp(&aData[0], BANLIST_MAGIC, sizeof(BANLIST_MAGIC)) != 0 || aData[sizeof(BANLIST_MAGIC)] != BANLIST_VERSION)
+		return -1;
+
+	const unsigned char *pData = &aData[sizeof(BANLIST_MAGIC) + 1];
+	const unsigned char *pEnd = &aData[0] + Size;
+
+	if(pEnd - pData < 4)
+		return -1;
+	int NumReasons = ReadInt(pData);
+	pData += 4;
+	if(NumReasons < 0 || NumReasons > pEnd - pData)
+		return -1;
+	std::vector<int> aReasons;
+	for(int i = 0; i < NumReasons; i++)
+	{
+		if(pData >= pEnd || pEnd - pData - 1 < *pData)
+			return -1;
+		char aReason[REASON_LENGTH];
+		str_format(aReason, sizeof(aReason), "%.*s", *pData, (const char *)pData + 1);
+		aReasons.push_back(AddReason(aReason));
+		pData += 1 + *pData;
+	}
+
+	if(pEnd - pData < 4)
+		return -1;
+	int NumEntries = ReadInt(pData);
+	pData += 4;
+	int NumLoaded = 0;
+	for(int i = 0; i < NumEntries; i++)
+	{
+		if(pEnd - pData < 2)
+			return -1;
+		NETADDR Addr = {0};
+		Addr.type = pData[0] == 4 ? NETTYPE_IPV4 : NETTYPE_IPV6;
+		int Prefix = pData[1];
+		int AddrSize = AddrBits(&Addr)/8;
+		if((pData[0] != 4 && pData[0] != 6) || pEnd - pData < 2 + AddrSize + 8)
+			return -1;
+		mem_copy(Addr.ip, pData + 2, AddrSize);
+		pData += 2 + AddrSize;
+		int Expires = ReadInt(pData);
+		int Reason = ReadInt(pData + 4);
+		pData += 8;
+		if(Reason < 0 || Reason >= NumReasons)
+			return -1;
+		if(Expires != EXPIRES_NEVER && Expires < Now)
+			continue;
+		if(pfnFilter && !pfnFilter(&Addr, Prefix, pUser))
+			continue;
+		if(AddEntry(&Addr, Prefix, Expires, aReasons[Reason]))
+			NumLoaded++;
+	}
+	return NumLoaded;
+}
@@ -0,0 +1,109 @@
+#ifndef ENGINE_SHARED_NETBAN_TRIE_H
+#define ENGINE_SHARED_NETBAN_TRIE_H
+
+#include <base/system.h>
+
+#include <vector>
+
+// Bans of address prefixes (CIDR blocks) in a path compressed binary trie,
+// one per address family, so lookups only depend on the address length and
+// not on the number of bans. Expiring bans are kept in a hashed timer wheel
+// with one slot per second, `Update` only looks at the slots that passed.
+class CNetBanTrie
+{
+public:
+	enum
+	{
+		EXPIRES_NEVER=-1,
+		REASON_LENGTH=64,
+	};
+
+	struct CEntry
+	{
+		NETADDR m_Addr; // bits beyond the prefix are zero
+		int m_Prefix;
+		int m_Expires;
+		int m_Reason;
+
+		int m_Node;
+		int m_TimerNext;
+		int m_TimerPrev;
+	};
+
+	CNetBanTrie();
+
+	// returns false for prefixes that don't fit the address type
+	bool Add(const NETADDR *pAddr, int Prefix, int Expires, const char *pReason);
+	bool Remove(const NETADDR *pAddr, int Prefix);
+	void Clear();
+	// returns a ban whose prefix contains the address
+	const CEntry *Find(const NETADDR *pAddr) const;
+	// removes bans that expired before `Now`, returns how many
+	int Update(int Now);
+
+	int Num() const { return m_NumEntries; }
+	const char *Reason(const CEntry *pEntry) const { return m_aReasons[pEntry->m_Reason].m_aReason; }
+
+	// calls `pfnCallback` for every ban, in no particular order
+	typedef void (*FEntryCallback)(const CEntry *pEntry, void *pUser);
+	void ForEach(FEntryCallback pfnCallback, void *pUser) const;
+
+	// "1.2.3.0/24", "[2001:db8::]/32" or a single address, returns 0 on success
+	static int ParsePrefix(const char *pStr, NETADDR *pAddr, int *pPrefix);
+	static bool Contains(const NETADDR *pAddr, int Prefix, const NETADDR *pOther);
+	static void PrefixToString(const NETADDR *pAddr, int Prefix, char *pBuf, int BufferSize);
+
+	// compact binary format: "TWBL", a version byte, the reasons and the
+	// bans, all integers big endian
+	int Save(IOHANDLE File, int Now) const;
+	// bans `pfnFilter` returns false for are left out
+	typedef bool (*FFilterCallback)(const NETADDR *pAddr, int Prefix, void *pUser);
+	// returns the number of loaded bans or -1 if the file is damaged
+	int Load(IOHANDLE File, int Now, FFilterCallback pfnFilter = 0, void *pUser = 0);
+
+private:
+	enum
+	{
+		WHEEL_SIZE=4096,
+	};
+
+	struct CNode
+	{
+		unsigned char m_aKey[16];
+		int m_Length;
+		int m_Parent;
+		int m_aChildren[2];
+		int m_Entry;
+	};
+
+	struct CReason
+	{
+		char m_aReason[REASON_LENGTH];
+	};
+
+	std::vector<CNode> m_aNodes;
+	std::vector<CEntry> m_aEntries;
+	std::vector<CReason> m_aReasons;
+	int m_FirstFreeNode;
+	int m_FirstFreeEntry;
+	int m_NumEntries;
+	int m_aRoots[2];
+
+	int m_aWheel[WHEEL_SIZE];
+	int m_WheelTime;
+
+	static int Bit(const unsigned char *pKey, int Index) { return (pKey[Index>>3]>>(7-(Index&7)))&1; }
+	static int CommonPrefix(const unsigned char *pKey1, const unsigned char *pKey2, int MaxLength);
+	static int Root(const NETADDR *pAddr) { return pAddr->type == NETTYPE_IPV4 ? 0 : 1; }
+
+	int NewNode(const unsigned char *pKey, int Length, int Parent);
+	void FreeNode(int Node);
+	int *Link(int Node);
+	int AddReason(const char *pReason);
+	bool AddEntry(const NETADDR *pAddr, int Prefix, int Expires, int Reason);
+	void TimerLink(int Entry);
+	void TimerUnlink(int Entry);
+	void RemoveEntry(int Entry);
+};
+
+#endif // ENGINE_SHARED_NETBAN_TRIE_H
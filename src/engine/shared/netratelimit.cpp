@@ -0,0 +1,131 @@
+#include "netratelimit.h"
+
+#include <base/math.h>
+
+void CNetRateLimit::Init()
+{
+	secure_random_fill(m_aHashKey, sizeof(m_aHashKey));
+	m_Interval = 0;
+	m_Tolerance = 0;
+	m_aPrefix[0] = 32;
+	m_aPrefix[1] = 128;
+	Clear();
+	ResetStats();
+}
+
+void CNetRateLimit::Clear()
+{
+	mem_zero(m_aaEntries, sizeof(m_aaEntries));
+}
+
+void CNetRateLimit::Configure(int Rate, int Burst, int Ipv4Prefix, int Ipv6Prefix)
+{
+	Ipv4Prefix = clamp(Ipv4Prefix, 0, 32);
+	Ipv6Prefix = clamp(Ipv6Prefix, 0, 128);
+	if(Ipv4Prefix != m_aPrefix[0] || Ipv6Prefix != m_aPrefix[1])
+	{
+		// the buckets belong to other groups of addresses now
+		m_aPrefix[0] = Ipv4Prefix;
+		m_aPrefix[1] = Ipv6Prefix;
+		Clear();
+	}
+
+	if(Rate <= 0)
+	{
+		m_Interval = 0;
+		return;
+	}
+	m_Interval = max(time_freq() / Rate, (int64)1);
+	m_Tolerance = m_Interval * max(Burst, 1);
+}
+
+bool CNetRateLimit::Allow(const NETADDR *pAddr, int64 Now)
+{
+	if(!m_Interval)
+	{
+		m_Stats.m_Passed++;
+		return true;
+	}
+
+	// address bits of the prefix plus the family
+	unsigned char aKey[17] = {0};
+	int Family = pAddr->type == NETTYPE_IPV6 ? 1 : 0;
+	int Prefix = m_aPrefix[Family];
+	mem_copy(aKey, pAddr->ip, Prefix / 8);
+	if(Prefix % 8)
+		aKey[Prefix / 8] = pAddr->ip[Prefix / 8] & (0xff << (8 - Prefix % 8));
+	aKey[16] = Family;
+
+	CEntry *pSet = m_aaEntries[siphash24(m_aHashKey, aKey, sizeof(aKey)) % NUM_SETS];
+	CEntry *pEntry = 0;
+	CEntry *pVictim = &pSet[0];
+	for(int i = 0; i < NUM_WAYS; i++)
+	{
+		if(pSet[i].m_Used && pSet[i].m_Type == Family && mem_comp(pSet[i].m_aKey, aKey, 16) == 0)
+		{
+			pEntry = &pSet[i];
+			break;
+		}
+		if(pVictim->m_Used && (!pSet[i].m_Used || pSet[i].m_Full < pVictim->m_Full))
+			pVictim = &pSet[i];
+	}
+
+	if(!pEntry)
+	{
+		if(pVictim->m_Used && pVictim->m_Full > Now)
+			m_Stats.m_Evicted++;
+		pEntry = pVictim;
+		mem_copy(pEntry->m_aKey, aKey, 16);
+		pEntry->m_Type = Family;
+		pEntry->m_Used = 1;
+		pEntry->m_Full = Now;
+		pEntry->m_Dropped = 0;
+	}
+
+	int64 Full = max(pEntry->m_Full, Now) + m_Interval;
+	if(Full - Now > m_Tolerance)
+	{
+		pEntry->m_Dropped++;
+		m_Stats.m_Dropped++;
+		return false;
+	}
+	pEntry->m_Full = Full;
+	m_Stats.m_Passed++;
+	return true;
+}
+
+int CNetRateLimit::NumTracked(int64 Now) const
+{
+	int Num = 0;
+	for(int s = 0; s < NUM_SETS; s++)
+	{
+		for(int i = 0; i < NUM_WAYS; i++)
+		{
+			if(m_aaEntries[s][i].m_Used && m_aaEntries[s][i].m_Full > Now)
+				Num++;
+		}
+	}
+	return Num;
+}
+
+int CNetRateLimit::TopSource(NETADDR *pAddr, int *pPrefix) const
+{
+	const CEntry *pTop = 0;
+	for(int s = 0; s < NUM_SETS; s++)
+	{
+		for(int i = 0; i < NUM_WAYS; i++)
+		{
+			const CEntry *pEntry = &m_aaEntries[s][i];
+			if(pEntry->m_Used && pEntry->m_Dropped > 0 && (!pTop || pEntry->m_Dropped > pTop->m_Dropped))
+				pTop = pEntry;
+		}
+	}
+	if(!pTop)
+		return 0;
+
+	mem_zero(pAddr, sizeof(*pAddr));
+	pAddr->type = pTop->m_Type ? NETTYPE_IPV6 : NETTYPE_IPV4;
+	mem_copy(pAddr->ip, pTop->m_aKey, sizeof(pTop->m_aKey));
+	*pPrefix = m_aPrefix[pTop->m_Type];
+	return pTop->m_Dropped;
+}
@@ -0,0 +1,63 @@
+#ifndef ENGINE_SHARED_NETRATELIMIT_H
+#define ENGINE_SHARED_NETRATELIMIT_H
+
+#include <base/hash.h>
+#include <base/system.h>
+
+// Token buckets for packets of sources that aren't connected, in a table of
+// fixed size. Addresses are grouped by a configurable prefix per address
+// family. When a set of the table is full, the source whose bucket gets full
+// the earliest is forgotten, which loses the least information.
+//
+// A bucket is kept as the time at which it is full again: a packet costs
+// one interval of 1/Rate seconds and is dropped if the bucket wouldn't
+// be full again within Burst intervals.
+class CNetRateLimit
+{
+public:
+	enum
+	{
+		NUM_WAYS=4,
+		NUM_SETS=2048,
+	};
+
+	struct CStats
+	{
+		int64 m_Passed;
+		int64 m_Dropped;
+		int64 m_Evicted;
+	};
+
+	void Init();
+	// Rate in packets per second, 0 lets everything pass
+	void Configure(int Rate, int Burst, int Ipv4Prefix, int Ipv6Prefix);
+	bool Allow(const NETADDR *pAddr, int64 Now);
+
+	const CStats &Stats() const { return m_Stats; }
+	void ResetStats() { mem_zero(&m_Stats, sizeof(m_Stats)); }
+	// sources with a bucket that isn't full
+	int NumTracked(int64 Now) const;
+	// the source that dropped the most packets, returns its count
+	int TopSource(NETADDR *pAddr, int *pPrefix) const;
+
+private:
+	struct CEntry
+	{
+		unsigned char m_aKey[16];
+		unsigned char m_Type;
+		unsigned char m_Used;
+		int64 m_Full;
+		int m_Dropped;
+	};
+
+	CEntry m_aaEntries[NUM_SETS][NUM_WAYS];
+	unsigned char m_aHashKey[SIPHASH_KEY_LENGTH];
+	int64 m_Interval;
+	int64 m_Tolerance;
+	int m_aPrefix[2];
+	CStats m_Stats;
+
+	void Clear();
+};
+
+#endif // ENGINE_SHARED_NETRATELIMIT_H
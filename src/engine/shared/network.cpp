@@ -112,7 +112,10 @@ void CNetBase::SendPacketConnless(NETSOCKET Socket, NETADDR *pAddr, const void *
 
 void CNetBase::SendPacket(NETSOCKET Socket, NETADDR *pAddr, CNetPacketConstruct *pPacket, SECURITY_TOKEN SecurityToken)
 {
+	static_assert(offsetof(CNetPacketConstruct, m_aChunkData) == offsetof(CNetPacketConstruct, m_aHeader) + NET_PACKETHEADERSIZE, "header must be right in front of the data");
+
 	unsigned char aBuffer[NET_MAX_PACKETSIZE];
+	unsigned char *pRaw = aBuffer;
 	int CompressedSize = -1;
 	int FinalSize = -1;
 
@@ -147,9 +150,9 @@ void CNetBase::SendPacket(NETSOCKET Socket, NETADDR *pAddr, CNetPacketConstruct
 	else
 #endif
 	{
-		// use uncompressed data
+		// use uncompressed data, sent along with the header in front of it
 		FinalSize = pPacket->m_DataSize;
-		mem_copy(&aBuffer[3], pPacket->m_aChunkData, pPacket->m_DataSize);
+		pRaw = pPacket->m_aHeader;
 		pPacket->m_Flags &= ~NET_PACKETFLAG_COMPRESSION;
 	}
 
@@ -157,10 +160,10 @@ void CNetBase::SendPacket(NETSOCKET Socket, NETADDR *pAddr, CNetPacketConstruct
 	if(FinalSize >= 0)
 	{
 		FinalSize += NET_PACKETHEADERSIZE;
-		aBuffer[0] = ((pPacket->m_Flags<<4)&0xf0)|((pPacket->m_Ack>>8)&0xf);
-		aBuffer[1] = pPacket->m_Ack&0xff;
-		aBuffer[2] = pPacket->m_NumChunks;
-		net_udp_send(Socket, pAddr, aBuffer, FinalSize);
+		pRaw[0] = ((pPacket->m_Flags<<4)&0xf0)|((pPacket->m_Ack>>8)&0xf);
+		pRaw[1] = pPacket->m_Ack&0xff;
+		pRaw[2] = pPacket->m_NumChunks;
+		net_udp_send(Socket, pAddr, pRaw, FinalSize);
 
 		// log raw socket data
 		if(ms_DataLogSent)
@@ -168,7 +171,7 @@ void CNetBase::SendPacket(NETSOCKET Socket, NETADDR *pAddr, CNetPacketConstruct
 			int Type = 0;
 			io_write(ms_DataLogSent, &Type, sizeof(Type));
 			io_write(ms_DataLogSent, &FinalSize, sizeof(FinalSize));
-			io_write(ms_DataLogSent, aBuffer, FinalSize);
+			io_write(ms_DataLogSent, pRaw, FinalSize);
 			io_flush(ms_DataLogSent);
 		}
 	}
@@ -301,6 +304,49 @@ unsigned char *CNetChunkHeader::Unpack(unsigned char *pData)
 	return pData + 2;
 }
 
+CNetChunkData *CNetChunkData::ms_apFree[NUM_SIZE_CLASSES] = {0};
+int CNetChunkData::ms_aNumFree[NUM_SIZE_CLASSES] = {0};
+
+CNetChunkData *CNetChunkData::Create(const void *pData, int DataSize)
+{
+	int SizeClass = 0;
+	while(SizeClass < NUM_SIZE_CLASSES - 1 && (64 << SizeClass) < DataSize)
+		SizeClass++;
+	dbg_assert(DataSize <= (64 << SizeClass), "chunk too big");
+
+	CNetChunkData *pChunkData = ms_apFree[SizeClass];
+	if(pChunkData)
+	{
+		ms_apFree[SizeClass] = pChunkData->m_pNextFree;
+		ms_aNumFree[SizeClass]--;
+	}
+	else
+	{
+		pChunkData = (CNetChunkData *)malloc(sizeof(CNetChunkData) + (64 << SizeClass));
+		pChunkData->m_SizeClass = SizeClass;
+	}
+	pChunkData->m_RefCount = 1;
+	pChunkData->m_DataSize = DataSize;
+	mem_copy(pChunkData->Data(), pData, DataSize);
+	return pChunkData;
+}
+
+void CNetChunkData::Release()
+{
+	if(--m_RefCount > 0)
+		return;
+
+	// keep some for the next chunks, but don't hold on to a burst forever
+	if(ms_aNumFree[m_SizeClass] >= MAX_FREE)
+	{
+		free(this);
+		return;
+	}
+	m_pNextFree = ms_apFree[m_SizeClass];
+	ms_apFree[m_SizeClass] = this;
+	ms_aNumFree[m_SizeClass]++;
+}
+
 
 int CNetBase::IsSeqInBackroom(int Seq, int Ack)
 {
@@ -5,7 +5,10 @@
 
 #include "ringbuffer.h"
 #include "huffman.h"
+#include "netratelimit.h"
+#include "timerwheel.h"
 
+#include <base/hash.h>
 #include <base/math.h>
 
 #include <engine/message.h>
@@ -88,6 +91,10 @@ enum
 
 	NET_CONNLIMIT_IPS=16,
 
+	// seconds a security token seed is used, tokens of the previous seed
+	// are accepted for as long
+	NET_TOKEN_SEED_LIFETIME=60,
+
 	NET_ENUM_TERMINATOR
 };
 
@@ -132,12 +139,43 @@ public:
 	unsigned char *Unpack(unsigned char *pData);
 };
 
+// Data of a vital chunk, kept until every connection it was queued on got
+// it acked. A message sent to several clients shares one of these between
+// their resend buffers. Freed ones go back to a pool, so this is only used
+// from the thread doing the networking.
+class CNetChunkData
+{
+	enum
+	{
+		// sizes of 64 << i bytes, the last one fits NET_MAX_PAYLOAD
+		NUM_SIZE_CLASSES=6,
+		MAX_FREE=256,
+	};
+
+	static CNetChunkData *ms_apFree[NUM_SIZE_CLASSES];
+	static int ms_aNumFree[NUM_SIZE_CLASSES];
+
+	int m_RefCount;
+	int m_SizeClass;
+	CNetChunkData *m_pNextFree;
+
+public:
+	int m_DataSize;
+
+	unsigned char *Data() { return (unsigned char *)(this + 1); }
+
+	// the caller holds the only reference
+	static CNetChunkData *Create(const void *pData, int DataSize);
+	void AddRef() { m_RefCount++; }
+	void Release();
+};
+
 class CNetChunkResend
 {
 public:
 	int m_Flags;
-	int m_DataSize;
-	unsigned char *m_pData;
+	// holds a reference
+	CNetChunkData *m_pData;
 
 	int m_Sequence;
 	int64 m_LastSendTime;
@@ -151,8 +189,13 @@ public:
 	int m_Ack;
 	int m_NumChunks;
 	int m_DataSize;
+	// the header goes right in front of the data, so packets that don't
+	// get compressed can be sent from here without another copy
+	unsigned char m_aHeader[NET_PACKETHEADERSIZE];
 	unsigned char m_aChunkData[NET_MAX_PAYLOAD];
 	unsigned char m_aExtraData[4];
+
+	void Clear() { m_Flags = 0; m_Ack = 0; m_NumChunks = 0; m_DataSize = 0; }
 };
 
 
@@ -175,6 +218,9 @@ private:
 	bool m_UnknownSeq;
 
 	TStaticRingBuffer<CNetChunkResend, NET_CONN_BUFFERSIZE> m_Buffer;
+	// size of the entries in m_Buffer plus the chunk data they reference,
+	// limited to NET_CONN_BUFFERSIZE
+	int m_BufferSize;
 
 	int64 m_LastUpdateTime;
 	int64 m_LastRecvTime;
@@ -192,8 +238,9 @@ private:
 	void ResetStats();
 	void SetError(const char *pString);
 	void AckChunks(int Ack);
+	void ClearResendBuffer();
 
-	int QueueChunkEx(int Flags, int DataSize, const void *pData, int Sequence);
+	int QueueChunkEx(int Flags, int DataSize, const void *pData, int Sequence, CNetChunkData *pSharedData = 0);
 	void SendControl(int ControlMsg, const void *pExtra, int ExtraSize);
 	void ResendChunk(CNetChunkResend *pResend);
 	void Resend();
@@ -204,16 +251,24 @@ public:
 	bool m_TimeoutProtected;
 	bool m_TimeoutSituation;
 
+	CNetConnection() : m_BufferSize(0) {}
+	~CNetConnection() { ClearResendBuffer(); }
+
 	void Reset(bool Rejoin=false);
 	void Init(NETSOCKET Socket, bool BlockCloseMsg);
 	int Connect(NETADDR *pAddr);
 	void Disconnect(const char *pReason);
 
-	int Update();
+	int Update(int64 Now);
+	int Update() { return Update(time_get()); }
+	// earliest time at which Update has something to do, -1 for never
+	int64 NextUpdate();
 	int Flush();
 
 	int Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr, SECURITY_TOKEN SecurityToken = NET_SECURITY_TOKEN_UNSUPPORTED);
-	int QueueChunk(int Flags, int DataSize, const void *pData);
+	// pSharedData, if given, holds pData and is referenced instead of copied
+	// for resending
+	int QueueChunk(int Flags, int DataSize, const void *pData, CNetChunkData *pSharedData = 0);
 
 	const char *ErrorString();
 	void SignalResend();
@@ -230,9 +285,10 @@ public:
 	int AckSequence() const { return m_Ack; }
 	int SeqSequence() const { return m_Sequence; }
 	int SecurityToken() const { return m_SecurityToken; }
-	TStaticRingBuffer<CNetChunkResend, NET_CONN_BUFFERSIZE> *ResendBuffer() { return &m_Buffer; };
+	void SetSecurityToken(SECURITY_TOKEN SecurityToken) { m_SecurityToken = SecurityToken; }
 
-	void SetTimedOut(const NETADDR *pAddr, int Sequence, int Ack, SECURITY_TOKEN SecurityToken, TStaticRingBuffer<CNetChunkResend, NET_CONN_BUFFERSIZE> *pResendBuffer);
+	// takes over the chunks pOrig still has to resend
+	void SetTimedOut(const NETADDR *pAddr, int Sequence, int Ack, SECURITY_TOKEN SecurityToken, CNetConnection *pOrig);
 
 	// anti spoof
 	void DirectInit(NETADDR &Addr, SECURITY_TOKEN SecurityToken);
@@ -325,7 +381,8 @@ class CNetServer
 
 	int m_NumConAttempts; // log flooding attacks
 	int64 m_TimeNumConAttempts;
-	unsigned char m_SecurityTokenSeed[16];
+	unsigned char m_aaSecurityTokenSeeds[2][SIPHASH_KEY_LENGTH]; // current, previous
+	int64 m_SecurityTokenSeedTime;
 
 	// vanilla connect flood detection
 	bool m_VConnHighLoad;
@@ -334,6 +391,13 @@ class CNetServer
 
 	CSpamConn m_aSpamConns[NET_CONNLIMIT_IPS];
 
+	// packets of addresses without a slot
+	CNetRateLimit m_RateLimit;
+
+	// next update of each slot
+	CTimerWheel m_UpdateWheel;
+	void ScheduleUpdate(int ClientID);
+
 	CNetRecvUnpacker m_RecvUnpacker;
 
 	void OnTokenCtrlMsg(NETADDR &Addr, int ControlMsg, const CNetPacketConstruct &Packet);
@@ -358,7 +422,9 @@ public:
 
 	//
 	int Recv(CNetChunk *pChunk);
-	int Send(CNetChunk *pChunk);
+	// pSharedData, if given, holds the chunk's data and is shared by the
+	// resend buffers of all clients it is sent to
+	int Send(CNetChunk *pChunk, CNetChunkData *pSharedData = 0);
 	int Update();
 
 	//
@@ -369,6 +435,7 @@ public:
 	bool HasSecurityToken(int ClientID) const { return m_aSlots[ClientID].m_Connection.SecurityToken() != NET_SECURITY_TOKEN_UNSUPPORTED; }
 	NETSOCKET Socket() const { return m_Socket; }
 	class CNetBan *NetBan() const { return m_pNetBan; }
+	CNetRateLimit *RateLimit() { return &m_RateLimit; }
 	int NetType() const { return m_Socket.type; }
 	int MaxClients() const { return m_MaxClients; }
 
@@ -382,9 +449,14 @@ public:
 	const char *ErrorString(int ClientID);
 
 	// anti spoof
-	SECURITY_TOKEN GetToken(const NETADDR &Addr);
+	static SECURITY_TOKEN CalcToken(const unsigned char *pSeed, const NETADDR &Addr);
+	SECURITY_TOKEN GetToken(const NETADDR &Addr) { return CalcToken(m_aaSecurityTokenSeeds[0], Addr); }
 	// vanilla token/gametick shouldn't be negative
 	SECURITY_TOKEN GetVanillaToken(const NETADDR &Addr) { return absolute(GetToken(Addr)); }
+	bool IsValidToken(const NETADDR &Addr, SECURITY_TOKEN Token);
+	// done every NET_TOKEN_SEED_LIFETIME seconds by Update
+	void RotateSecurityTokenSeed();
+	bool IsValidVanillaToken(const NETADDR &Addr, SECURITY_TOKEN Token);
 
 	void BotInit(int BotID);
 	void BotDelete(int BotID);
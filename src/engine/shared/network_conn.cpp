@@ -40,7 +40,7 @@ void CNetConnection::Reset(bool Rejoin)
 	//mem_zero(&m_PeerAddr, sizeof(m_PeerAddr));
 	m_UnknownSeq = false;
 
-	m_Buffer.Init();
+	ClearResendBuffer();
 
 	mem_zero(&m_Construct, sizeof(m_Construct));
 }
@@ -74,12 +74,29 @@ void CNetConnection::AckChunks(int Ack)
 			break;
 
 		if(CNetBase::IsSeqInBackroom(pResend->m_Sequence, Ack))
+		{
+			m_BufferSize -= sizeof(CNetChunkResend) + pResend->m_pData->m_DataSize;
+			pResend->m_pData->Release();
 			m_Buffer.PopFirst();
+		}
 		else
 			break;
 	}
 }
 
+void CNetConnection::ClearResendBuffer()
+{
+	// the whole connection might have been zeroed, then there is nothing
+	// in the buffer but it can't be walked either
+	if(m_BufferSize)
+	{
+		for(CNetChunkResend *pResend = m_Buffer.First(); pResend; pResend = m_Buffer.Next(pResend))
+			pResend->m_pData->Release();
+	}
+	m_Buffer.Init();
+	m_BufferSize = 0;
+}
+
 void CNetConnection::SignalResend()
 {
 	m_Construct.m_Flags |= NET_PACKETFLAG_RESEND;
@@ -98,12 +115,13 @@ int CNetConnection::Flush()
 	// update send times
 	m_LastSendTime = time_get();
 
-	// clear construct so we can start building a new package
-	mem_zero(&m_Construct, sizeof(m_Construct));
+	// clear construct so we can start building a new package, the data
+	// only counts up to m_DataSize
+	m_Construct.Clear();
 	return NumChunks;
 }
 
-int CNetConnection::QueueChunkEx(int Flags, int DataSize, const void *pData, int Sequence)
+int CNetConnection::QueueChunkEx(int Flags, int DataSize, const void *pData, int Sequence, CNetChunkData *pSharedData)
 {
 	if (m_State == NET_CONNSTATE_OFFLINE || m_State == NET_CONNSTATE_ERROR)
 		return -1;
@@ -133,16 +151,23 @@ int CNetConnection::QueueChunkEx(int Flags, int DataSize, const void *pData, int
 	if(Flags&NET_CHUNKFLAG_VITAL && !(Flags&NET_CHUNKFLAG_RESEND))
 	{
 		// save packet if we need to resend
-		CNetChunkResend *pResend = m_Buffer.Allocate(sizeof(CNetChunkResend)+DataSize);
+		CNetChunkResend *pResend = 0;
+		if(m_BufferSize + (int)sizeof(CNetChunkResend) + DataSize <= NET_CONN_BUFFERSIZE)
+			pResend = m_Buffer.Allocate(sizeof(CNetChunkResend));
 		if(pResend)
 		{
 			pResend->m_Sequence = Sequence;
 			pResend->m_Flags = Flags;
-			pResend->m_DataSize = DataSize;
-			pResend->m_pData = (unsigned char *)(pResend+1);
+			if(pSharedData)
+			{
+				pSharedData->AddRef();
+				pResend->m_pData = pSharedData;
+			}
+			else
+				pResend->m_pData = CNetChunkData::Create(pData, DataSize);
 			pResend->m_FirstSendTime = time_get();
 			pResend->m_LastSendTime = pResend->m_FirstSendTime;
-			mem_copy(pResend->m_pData, pData, DataSize);
+			m_BufferSize += sizeof(CNetChunkResend) + DataSize;
 		}
 		else
 		{
@@ -154,11 +179,11 @@ int CNetConnection::QueueChunkEx(int Flags, int DataSize, const void *pData, int
 	return 0;
 }
 
-int CNetConnection::QueueChunk(int Flags, int DataSize, const void *pData)
+int CNetConnection::QueueChunk(int Flags, int DataSize, const void *pData, CNetChunkData *pSharedData)
 {
 	if(Flags&NET_CHUNKFLAG_VITAL)
 		m_Sequence = (m_Sequence+1)%NET_MAX_SEQUENCE;
-	return QueueChunkEx(Flags, DataSize, pData, m_Sequence);
+	return QueueChunkEx(Flags, DataSize, pData, m_Sequence, pSharedData);
 }
 
 void CNetConnection::SendControl(int ControlMsg, const void *pExtra, int ExtraSize)
@@ -170,7 +195,7 @@ void CNetConnection::SendControl(int ControlMsg, const void *pExtra, int ExtraSi
 
 void CNetConnection::ResendChunk(CNetChunkResend *pResend)
 {
-	QueueChunkEx(pResend->m_Flags|NET_CHUNKFLAG_RESEND, pResend->m_DataSize, pResend->m_pData, pResend->m_Sequence);
+	QueueChunkEx(pResend->m_Flags|NET_CHUNKFLAG_RESEND, pResend->m_pData->m_DataSize, pResend->m_pData->Data(), pResend->m_Sequence);
 	pResend->m_LastSendTime = time_get();
 }
 
@@ -392,10 +417,8 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr, SECURITY_
 	return 1;
 }
 
-int CNetConnection::Update()
+int CNetConnection::Update(int64 Now)
 {
-	int64 Now = time_get();
-
 	if(State() == NET_CONNSTATE_ERROR && m_TimeoutSituation && (Now-m_LastRecvTime) > time_freq()*g_Config.m_ConnTimeoutProtection)
 	{
 		m_TimeoutSituation = false;
@@ -443,31 +466,55 @@ int CNetConnection::Update()
 	// send keep alives if nothing has happened for 250ms
 	if(State() == NET_CONNSTATE_ONLINE)
 	{
-		if(time_get()-m_LastSendTime > time_freq()/2) // flush connection after 500ms if needed
+		if(Now-m_LastSendTime > time_freq()/2) // flush connection after 500ms if needed
 		{
 			int NumFlushedChunks = Flush();
 			if(NumFlushedChunks && g_Config.m_Debug)
 				dbg_msg("connection", "flushed connection due to timeout. %d chunks.", NumFlushedChunks);
 		}
 
-		if(time_get()-m_LastSendTime > time_freq())
+		if(Now-m_LastSendTime > time_freq())
 			SendControl(NET_CTRLMSG_KEEPALIVE, 0, 0);
 	}
 	else if(State() == NET_CONNSTATE_CONNECT)
 	{
-		if(time_get()-m_LastSendTime > time_freq()/2) // send a new connect every 500ms
+		if(Now-m_LastSendTime > time_freq()/2) // send a new connect every 500ms
 			SendControl(NET_CTRLMSG_CONNECT, SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC));
 	}
 	else if(State() == NET_CONNSTATE_PENDING)
 	{
-		if(time_get()-m_LastSendTime > time_freq()/2) // send a new connect/accept every 500ms
+		if(Now-m_LastSendTime > time_freq()/2) // send a new connect/accept every 500ms
 			SendControl(NET_CTRLMSG_CONNECTACCEPT, SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC));
 	}
 
 	return 0;
 }
 
-void CNetConnection::SetTimedOut(const NETADDR *pAddr, int Sequence, int Ack, SECURITY_TOKEN SecurityToken, TStaticRingBuffer<CNetChunkResend, NET_CONN_BUFFERSIZE> *pResendBuffer)
+int64 CNetConnection::NextUpdate()
+{
+	// the checks of Update trigger once the times are exceeded
+	if(State() == NET_CONNSTATE_ERROR && m_TimeoutSituation)
+		return m_LastRecvTime + time_freq()*g_Config.m_ConnTimeoutProtection + 1;
+	if(State() == NET_CONNSTATE_OFFLINE || State() == NET_CONNSTATE_ERROR || State() == NET_CONNSTATE_BOT)
+		return -1;
+
+	int64 Next;
+	if(State() == NET_CONNSTATE_ONLINE)
+		Next = m_LastSendTime + (m_Construct.m_NumChunks || m_Construct.m_Flags ? time_freq()/2 : time_freq());
+	else
+		Next = m_LastSendTime + time_freq()/2;
+
+	if(State() != NET_CONNSTATE_CONNECT)
+		Next = min(Next, m_LastRecvTime + time_freq()*g_Config.m_ConnTimeout);
+
+	CNetChunkResend *pResend = m_Buffer.First();
+	if(pResend)
+		Next = min(Next, min(pResend->m_FirstSendTime + time_freq()*g_Config.m_ConnTimeout, pResend->m_LastSendTime + time_freq()));
+
+	return Next + 1;
+}
+
+void CNetConnection::SetTimedOut(const NETADDR *pAddr, int Sequence, int Ack, SECURITY_TOKEN SecurityToken, CNetConnection *pOrig)
 {
 	int64 Now = time_get();
 
@@ -483,17 +530,19 @@ void CNetConnection::SetTimedOut(const NETADDR *pAddr, int Sequence, int Ack, SE
 	m_LastUpdateTime = Now;
 	m_SecurityToken = SecurityToken;
 
-	// copy resend buffer
-	m_Buffer.Init();
-	while (pResendBuffer->First())
+	// move the resend buffer over, the references go with the entries
+	ClearResendBuffer();
+	while (pOrig->m_Buffer.First())
 	{
-		CNetChunkResend *First = pResendBuffer->First();
+		CNetChunkResend *First = pOrig->m_Buffer.First();
 
-		CNetChunkResend *pResend = m_Buffer.Allocate(sizeof(CNetChunkResend)+First->m_DataSize);
-		mem_copy(pResend, First, sizeof(CNetChunkResend)+First->m_DataSize);
+		CNetChunkResend *pResend = m_Buffer.Allocate(sizeof(CNetChunkResend));
+		mem_copy(pResend, First, sizeof(CNetChunkResend));
+		m_BufferSize += sizeof(CNetChunkResend) + First->m_pData->m_DataSize;
 
-		pResendBuffer->PopFirst();
+		pOrig->m_Buffer.PopFirst();
 	}
+	pOrig->m_BufferSize = 0;
 }
 
 
@@ -7,7 +7,6 @@
 #include "config.h"
 #include "netban.h"
 #include "network.h"
-#include <engine/external/md5/md5.h>
 #include <engine/message.h>
 #include <engine/shared/protocol.h>
 
@@ -75,7 +74,12 @@ bool CNetServer::Open(NETADDR BindAddr, CNetBan *pNetBan, int MaxClients, int Ma
 	m_VConnNum = 0;
 	m_VConnFirst = 0;
 
-	secure_random_fill(m_SecurityTokenSeed, sizeof(m_SecurityTokenSeed));
+	secure_random_fill(m_aaSecurityTokenSeeds[0], sizeof(m_aaSecurityTokenSeeds[0]));
+	mem_copy(m_aaSecurityTokenSeeds[1], m_aaSecurityTokenSeeds[0], sizeof(m_aaSecurityTokenSeeds[1]));
+	m_SecurityTokenSeedTime = time_get();
+
+	m_RateLimit.Init();
+	m_UpdateWheel.Init(time_get(), time_freq() / 1000);
 
 	for(int i = 0; i < NET_MAX_CLIENTS; i++)
 		m_aSlots[i].m_Connection.Init(m_Socket, true);
@@ -123,38 +127,60 @@ int CNetServer::Drop(int ClientID, const char *pReason)
 		m_pfnDelClient(ClientID, pReason, m_UserPtr);
 
 	m_aSlots[ClientID].m_Connection.Disconnect(pReason);
+	m_UpdateWheel.Cancel(ClientID);
 
 	return 0;
 }
 
+void CNetServer::ScheduleUpdate(int ClientID)
+{
+	CNetConnection *pConnection = &m_aSlots[ClientID].m_Connection;
+	int64 Next = pConnection->NextUpdate();
+	// errors get dropped with the next update
+	if(pConnection->State() == NET_CONNSTATE_ERROR &&
+		(!pConnection->m_TimeoutProtected || !pConnection->m_TimeoutSituation))
+		Next = 0;
+	if(Next >= 0)
+		m_UpdateWheel.ScheduleEarlier(ClientID, Next);
+}
+
 int CNetServer::Update()
 {
-	for(int i = 0; i < MaxClients(); i++)
+	int64 Now = time_get();
+	if(Now > m_SecurityTokenSeedTime + NET_TOKEN_SEED_LIFETIME * time_freq())
+		RotateSecurityTokenSeed();
+
+	m_RateLimit.Configure(g_Config.m_SvConnlessRate, g_Config.m_SvConnlessBurst, g_Config.m_SvConnlessIpv4Prefix, g_Config.m_SvConnlessIpv6Prefix);
+
+	// only the connections with a timeout, resend or keepalive due
+	int aDue[CTimerWheel::MAX_TIMERS];
+	int NumDue = m_UpdateWheel.Advance(Now, aDue);
+	for(int j = 0; j < NumDue; j++)
 	{
-		m_aSlots[i].m_Connection.Update();
+		int i = aDue[j];
+		m_aSlots[i].m_Connection.Update(Now);
 		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_ERROR &&
 			(!m_aSlots[i].m_Connection.m_TimeoutProtected ||
 			 !m_aSlots[i].m_Connection.m_TimeoutSituation))
 		{
 			Drop(i, m_aSlots[i].m_Connection.ErrorString());
 		}
+		ScheduleUpdate(i);
 	}
 
 	return 0;
 }
 
-SECURITY_TOKEN CNetServer::GetToken(const NETADDR &Addr)
+SECURITY_TOKEN CNetServer::CalcToken(const unsigned char *pSeed, const NETADDR &Addr)
 {
-	md5_state_t md5;
-	md5_byte_t digest[16];
-	SECURITY_TOKEN SecurityToken;
-	md5_init(&md5);
-
-	md5_append(&md5, (unsigned char*)m_SecurityTokenSeed, sizeof(m_SecurityTokenSeed));
-	md5_append(&md5, (unsigned char*)&Addr, sizeof(Addr));
+	// only the parts of the address that identify the peer
+	unsigned char aData[sizeof(Addr.ip) + 3];
+	mem_copy(aData, Addr.ip, sizeof(Addr.ip));
+	aData[sizeof(Addr.ip)] = Addr.port & 0xff;
+	aData[sizeof(Addr.ip) + 1] = Addr.port >> 8;
+	aData[sizeof(Addr.ip) + 2] = Addr.type;
 
-	md5_finish(&md5, digest);
-	SecurityToken = ToSecurityToken(digest);
+	SECURITY_TOKEN SecurityToken = (SECURITY_TOKEN)siphash24(pSeed, aData, sizeof(aData));
 
 	if (SecurityToken == NET_SECURITY_TOKEN_UNKNOWN ||
 		SecurityToken == NET_SECURITY_TOKEN_UNSUPPORTED)
@@ -163,6 +189,26 @@ SECURITY_TOKEN CNetServer::GetToken(const NETADDR &Addr)
 	return SecurityToken;
 }
 
+void CNetServer::RotateSecurityTokenSeed()
+{
+	// handshakes that got a token just before stay valid with the old seed
+	mem_copy(m_aaSecurityTokenSeeds[1], m_aaSecurityTokenSeeds[0], sizeof(m_aaSecurityTokenSeeds[1]));
+	secure_random_fill(m_aaSecurityTokenSeeds[0], sizeof(m_aaSecurityTokenSeeds[0]));
+	m_SecurityTokenSeedTime = time_get();
+}
+
+bool CNetServer::IsValidToken(const NETADDR &Addr, SECURITY_TOKEN Token)
+{
+	return Token == CalcToken(m_aaSecurityTokenSeeds[0], Addr) ||
+		Token == CalcToken(m_aaSecurityTokenSeeds[1], Addr);
+}
+
+bool CNetServer::IsValidVanillaToken(const NETADDR &Addr, SECURITY_TOKEN Token)
+{
+	return Token == absolute(CalcToken(m_aaSecurityTokenSeeds[0], Addr)) ||
+		Token == absolute(CalcToken(m_aaSecurityTokenSeeds[1], Addr));
+}
+
 void CNetServer::SendControl(NETADDR &Addr, int ControlMsg, const void *pExtra, int ExtraSize, SECURITY_TOKEN SecurityToken)
 {
 	CNetBase::SendControlMsg(m_Socket, &Addr, 0, ControlMsg, pExtra, ExtraSize, SecurityToken);
@@ -257,6 +303,7 @@ int CNetServer::TryAcceptClient(NETADDR &Addr, SECURITY_TOKEN SecurityToken, boo
 
 	// init connection slot
 	m_aSlots[Slot].m_Connection.DirectInit(Addr, SecurityToken);
+	ScheduleUpdate(Slot);
 
 	if (VanillaAuth)
 	{
@@ -450,7 +497,7 @@ void CNetServer::OnPreConnMsg(NETADDR &Addr, CNetPacketConstruct &Packet)
 		if (Msg == NETMSG_INPUT)
 		{
 			SECURITY_TOKEN SecurityToken = Unpacker.GetInt();
-			if (SecurityToken == GetVanillaToken(Addr))
+			if (IsValidVanillaToken(Addr, SecurityToken))
 			{
 				if (g_Config.m_Debug)
 					dbg_msg("security", "new client (vanilla handshake)");
@@ -483,8 +530,11 @@ void CNetServer::OnConnCtrlMsg(NETADDR &Addr, int ClientID, int ControlMsg, cons
 
 		if (SupportsToken)
 		{
-			// response connection request with token
-			SECURITY_TOKEN Token = GetToken(Addr);
+			// keep the token of the session, the seed it was made
+			// with may have been rotated out since
+			SECURITY_TOKEN Token = m_aSlots[ClientID].m_Connection.SecurityToken();
+			if (Token == NET_SECURITY_TOKEN_UNKNOWN || Token == NET_SECURITY_TOKEN_UNSUPPORTED)
+				Token = GetToken(Addr);
 			SendControl(Addr, NET_CTRLMSG_CONNECTACCEPT, SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC), Token);
 		}
 
@@ -494,15 +544,19 @@ void CNetServer::OnConnCtrlMsg(NETADDR &Addr, int ClientID, int ControlMsg, cons
 	else if (ControlMsg == NET_CTRLMSG_ACCEPT && Packet.m_DataSize == 1 + sizeof(SECURITY_TOKEN))
 	{
 		SECURITY_TOKEN Token = ToSecurityToken(&Packet.m_aChunkData[1]);
-		if (Token == GetToken(Addr))
+		bool SessionToken = Token != NET_SECURITY_TOKEN_UNKNOWN && Token != NET_SECURITY_TOKEN_UNSUPPORTED &&
+			Token == m_aSlots[ClientID].m_Connection.SecurityToken();
+		if (SessionToken || IsValidToken(Addr, Token))
 		{
 			// correct token
 			// try to accept client
 			if (g_Config.m_Debug)
 				dbg_msg("security", "client %d reconnect", ClientID);
 
-			// reset netconn and process rejoin
+			// reset netconn and process rejoin, the client uses the
+			// token it just got from now on
 			m_aSlots[ClientID].m_Connection.Reset(true);
+			m_aSlots[ClientID].m_Connection.SetSecurityToken(Token);
 			m_pfnClientRejoin(ClientID, m_UserPtr);
 		}
 	}
@@ -530,7 +584,7 @@ void CNetServer::OnTokenCtrlMsg(NETADDR &Addr, int ControlMsg, const CNetPacketC
 	else if(ControlMsg == NET_CTRLMSG_ACCEPT)
 	{
 		SECURITY_TOKEN Token = ToSecurityToken(&Packet.m_aChunkData[1]);
-		if(Token == GetToken(Addr))
+		if(IsValidToken(Addr, Token))
 		{
 			// correct token
 			// try to accept client
@@ -598,8 +652,12 @@ int CNetServer::Recv(CNetChunk *pChunk)
 		NETADDR Addr;
 
 		// check for a chunk
+		bool Unpacking = m_RecvUnpacker.m_Valid;
 		if(m_RecvUnpacker.FetchChunk(pChunk))
 			return 1;
+		// the chunks may have asked for a resend
+		if(Unpacking && m_RecvUnpacker.m_ClientID >= 0)
+			ScheduleUpdate(m_RecvUnpacker.m_ClientID);
 
 		// TODO: empty the recvinfo
 		unsigned char *pData;
@@ -609,6 +667,11 @@ int CNetServer::Recv(CNetChunk *pChunk)
 		if(Bytes <= 0)
 			break;
 
+		// drop floods of addresses without a slot before doing any work
+		int Slot = GetClientSlot(Addr);
+		if(Slot == -1 && !m_RateLimit.Allow(&Addr, time_get()))
+			continue;
+
 		// check if we just should drop the packet
 		char aBuf[128];
 		if(NetBan() && NetBan()->IsBanned(&Addr, aBuf, sizeof(aBuf)))
@@ -641,9 +704,7 @@ int CNetServer::Recv(CNetChunk *pChunk)
 						m_RecvUnpacker.m_Data.m_DataSize == 0)
 					continue;
 
-				// normal packet, find matching slot
-				int Slot = GetClientSlot(Addr);
-
+				// normal packet, matching slot
 				if (Slot != -1)
 				{
 					// found
@@ -657,6 +718,7 @@ int CNetServer::Recv(CNetChunk *pChunk)
 						if(m_RecvUnpacker.m_Data.m_DataSize)
 							m_RecvUnpacker.Start(&Addr, &m_aSlots[Slot].m_Connection, Slot);
 					}
+					ScheduleUpdate(Slot);
 				}
 				else
 				{
@@ -675,7 +737,7 @@ int CNetServer::Recv(CNetChunk *pChunk)
 	return 0;
 }
 
-int CNetServer::Send(CNetChunk *pChunk)
+int CNetServer::Send(CNetChunk *pChunk, CNetChunkData *pSharedData)
 {
 	if(pChunk->m_DataSize >= NET_MAX_PAYLOAD)
 	{
@@ -703,7 +765,7 @@ int CNetServer::Send(CNetChunk *pChunk)
 		if(pChunk->m_Flags&NETSENDFLAG_VITAL)
 			Flags = NET_CHUNKFLAG_VITAL;
 
-		if(m_aSlots[pChunk->m_ClientID].m_Connection.QueueChunk(Flags, pChunk->m_DataSize, pChunk->m_pData) == 0)
+		if(m_aSlots[pChunk->m_ClientID].m_Connection.QueueChunk(Flags, pChunk->m_DataSize, pChunk->m_pData, pSharedData) == 0)
 		{
 			if(pChunk->m_Flags&NETSENDFLAG_FLUSH)
 				m_aSlots[pChunk->m_ClientID].m_Connection.Flush();
@@ -712,6 +774,8 @@ int CNetServer::Send(CNetChunk *pChunk)
 		{
 			//Drop(pChunk->m_ClientID, "Error sending data");
 		}
+		// queued chunks need a flush
+		ScheduleUpdate(pChunk->m_ClientID);
 	}
 	return 0;
 }
@@ -743,8 +807,9 @@ bool CNetServer::SetTimedOut(int ClientID, int OrigID)
 	if (m_aSlots[ClientID].m_Connection.State() != NET_CONNSTATE_ERROR)
 		return false;
 
-	m_aSlots[ClientID].m_Connection.SetTimedOut(ClientAddr(OrigID), m_aSlots[OrigID].m_Connection.SeqSequence(), m_aSlots[OrigID].m_Connection.AckSequence(), m_aSlots[OrigID].m_Connection.SecurityToken(), m_aSlots[OrigID].m_Connection.ResendBuffer());
+	m_aSlots[ClientID].m_Connection.SetTimedOut(ClientAddr(OrigID), m_aSlots[OrigID].m_Connection.SeqSequence(), m_aSlots[OrigID].m_Connection.AckSequence(), m_aSlots[OrigID].m_Connection.SecurityToken(), &m_aSlots[OrigID].m_Connection);
 	m_aSlots[OrigID].m_Connection.Reset();
+	ScheduleUpdate(ClientID);
 	return true;
 }
 
@@ -1,7 +1,7 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include "snapshot.h"
-#include "compression.h"
+#include "snapshot_simd.h"
 #include "uuid_manager.h"
 
 // CSnapshot
@@ -58,16 +58,22 @@ int CSnapshot::GetItemIndex(int Key)
 
 int CSnapshot::Crc()
 {
-	int Crc = 0;
-
+	// the items are stored back to back, so sum all of them at once and
+	// take the keys out again. needs all items to be whole ints
+	const int *pData = (const int *)DataStart();
+	int Misaligned = m_DataSize;
+	unsigned Keys = 0;
 	for(int i = 0; i < m_NumItems; i++)
 	{
-		CSnapshotItem *pItem = GetItem(i);
-		int Size = GetItemSize(i);
-
-		for(int b = 0; b < Size/4; b++)
-			Crc += pItem->Data()[b];
+		Misaligned |= Offsets()[i];
+		Keys += GetItem(i)->Key();
 	}
+	if(!(Misaligned&3))
+		return (unsigned)CSnapshotSimd::Sum(pData, m_DataSize/4) - Keys;
+
+	unsigned Crc = 0;
+	for(int i = 0; i < m_NumItems; i++)
+		Crc += CSnapshotSimd::Sum(GetItem(i)->Data(), GetItemSize(i)/4);
 	return Crc;
 }
 
@@ -131,40 +137,12 @@ static int GetItemIndexHashed(int Key, const CItemList *pHashlist)
 
 int CSnapshotDelta::DiffItem(int *pPast, int *pCurrent, int *pOut, int Size)
 {
-	int Needed = 0;
-	while(Size)
-	{
-		*pOut = *pCurrent-*pPast;
-		Needed |= *pOut;
-		pOut++;
-		pPast++;
-		pCurrent++;
-		Size--;
-	}
-
-	return Needed;
+	return CSnapshotSimd::Diff(pPast, pCurrent, pOut, Size);
 }
 
 void CSnapshotDelta::UndiffItem(int *pPast, int *pDiff, int *pOut, int Size)
 {
-	while(Size)
-	{
-		*pOut = *pPast+*pDiff;
-
-		if(*pDiff == 0)
-			m_aSnapshotDataRate[m_SnapshotCurrent] += 1;
-		else
-		{
-			unsigned char aBuf[16];
-			unsigned char *pEnd = CVariableInt::Pack(aBuf, *pDiff);
-			m_aSnapshotDataRate[m_SnapshotCurrent] += (int)(pEnd - (unsigned char*)aBuf) * 8;
-		}
-
-		pOut++;
-		pPast++;
-		pDiff++;
-		Size--;
-	}
+	m_aSnapshotDataRate[m_SnapshotCurrent] += CSnapshotSimd::Undiff(pPast, pDiff, pOut, Size);
 }
 
 CSnapshotDelta::CSnapshotDelta()
@@ -243,6 +221,10 @@ int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData
 
 			pPastItem = pFrom->GetItem(PastIndex);
 
+			// most items don't change, skip them before diffing
+			if(mem_comp(pPastItem->Data(), pCurItem->Data(), ItemSize) == 0)
+				continue;
+
 			if(m_aItemSizes[pCurItem->Type()])
 				pItemDataDst = pData+2;
 
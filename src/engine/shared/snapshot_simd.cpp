@@ -0,0 +1,223 @@
+#include "snapshot_simd.h"
+
+#include <base/detect.h>
+#include <base/math.h>
+
+#if defined(CONF_SSE2)
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(_MSC_VER)
+#include <immintrin.h>
+#define SNAPSHOT_SIMD_AVX2 1
+#endif
+#endif
+
+#if defined(SNAPSHOT_SIMD_AVX2)
+#if defined(_MSC_VER)
+#include <intrin.h>
+// msvc takes the intrinsics of every instruction set without flags
+#define AVX2_FUNCTION
+#else
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
+static bool CpuSupportsAvx2()
+{
+#if defined(_MSC_VER)
+	int aInfo[4];
+	__cpuid(aInfo, 0);
+	if(aInfo[0] < 7)
+		return false;
+	// AVX and OSXSAVE, the system has to save the ymm registers as well
+	__cpuid(aInfo, 1);
+	if((aInfo[2] & (3<<27)) != (3<<27) || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(aInfo, 7, 0);
+	return (aInfo[1] & (1<<5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+enum
+{
+	AVX2_MIN_DIFF_SIZE=64,
+};
+
+// scalar versions, also for the ints the vector loops leave over
+
+static int SumScalar(const int *pData, int Num)
+{
+	unsigned Sum = 0;
+	for(int i = 0; i < Num; i++)
+		Sum += pData[i];
+	return Sum;
+}
+
+static int DiffScalar(const int *pPast, const int *pCurrent, int *pOut, int Num)
+{
+	int Needed = 0;
+	for(int i = 0; i < Num; i++)
+	{
+		pOut[i] = (unsigned)pCurrent[i] - (unsigned)pPast[i];
+		Needed |= pOut[i];
+	}
+	return Needed;
+}
+
+static int UndiffScalar(const int *pPast, const int *pDiff, int *pOut, int Num)
+{
+	int Bits = 0;
+	for(int i = 0; i < Num; i++)
+	{
+		pOut[i] = (unsigned)pPast[i] + (unsigned)pDiff[i];
+		if(pDiff[i] == 0)
+		{
+			Bits += 1;
+		}
+		else
+		{
+			// the length CVariableInt::Pack gives it
+			unsigned Value = pDiff[i] ^ (pDiff[i] >> 31);
+			Bits += 8 * (1 + (Value >= 1u<<6) + (Value >= 1u<<13) + (Value >= 1u<<20) + (Value >= 1u<<27));
+		}
+	}
+	return Bits;
+}
+
+#if defined(CONF_SSE2)
+static inline int HorizontalSum(__m128i Vec)
+{
+	Vec = _mm_add_epi32(Vec, _mm_shuffle_epi32(Vec, _MM_SHUFFLE(1, 0, 3, 2)));
+	Vec = _mm_add_epi32(Vec, _mm_shuffle_epi32(Vec, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(Vec);
+}
+
+static inline int HorizontalOr(__m128i Vec)
+{
+	Vec = _mm_or_si128(Vec, _mm_shuffle_epi32(Vec, _MM_SHUFFLE(1, 0, 3, 2)));
+	Vec = _mm_or_si128(Vec, _mm_shuffle_epi32(Vec, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(Vec);
+}
+
+static int SumSse2(const int *pData, int Num)
+{
+	__m128i Sum = _mm_setzero_si128();
+	int i = 0;
+	for(; i + 4 <= Num; i += 4)
+		Sum = _mm_add_epi32(Sum, _mm_loadu_si128((const __m128i *)(pData + i)));
+	return (unsigned)HorizontalSum(Sum) + (unsigned)SumScalar(pData + i, Num - i);
+}
+
+static int DiffSse2(const int *pPast, const int *pCurrent, int *pOut, int Num)
+{
+	__m128i Needed = _mm_setzero_si128();
+	int i = 0;
+	for(; i + 4 <= Num; i += 4)
+	{
+		__m128i Diff = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(pCurrent + i)), _mm_loadu_si128((const __m128i *)(pPast + i)));
+		_mm_storeu_si128((__m128i *)(pOut + i), Diff);
+		Needed = _mm_or_si128(Needed, Diff);
+	}
+	return HorizontalOr(Needed) | DiffScalar(pPast + i, pCurrent + i, pOut + i, Num - i);
+}
+
+static int UndiffSse2(const int *pPast, const int *pDiff, int *pOut, int Num)
+{
+	const __m128i Zero = _mm_setzero_si128();
+	const __m128i One = _mm_set1_epi32(1);
+	const __m128i Limit1 = _mm_set1_epi32((1<<6) - 1);
+	const __m128i Limit2 = _mm_set1_epi32((1<<13) - 1);
+	const __m128i Limit3 = _mm_set1_epi32((1<<20) - 1);
+	const __m128i Limit4 = _mm_set1_epi32((1<<27) - 1);
+	__m128i Bits = _mm_setzero_si128();
+	int i = 0;
+	for(; i + 4 <= Num; i += 4)
+	{
+		__m128i Diff = _mm_loadu_si128((const __m128i *)(pDiff + i));
+		_mm_storeu_si128((__m128i *)(pOut + i), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(pPast + i)), Diff));
+
+		// one byte plus one for every limit it's above, the compares give -1
+		__m128i Value = _mm_xor_si128(Diff, _mm_srai_epi32(Diff, 31));
+		__m128i Length = _mm_sub_epi32(One, _mm_cmpgt_epi32(Value, Limit1));
+		Length = _mm_sub_epi32(Length, _mm_cmpgt_epi32(Value, Limit2));
+		Length = _mm_sub_epi32(Length, _mm_cmpgt_epi32(Value, Limit3));
+		Length = _mm_sub_epi32(Length, _mm_cmpgt_epi32(Value, Limit4));
+		__m128i Unchanged = _mm_cmpeq_epi32(Diff, Zero);
+		Bits = _mm_add_epi32(Bits, _mm_or_si128(_mm_and_si128(Unchanged, One), _mm_andnot_si128(Unchanged, _mm_slli_epi32(Length, 3))));
+	}
+	return HorizontalSum(Bits) + UndiffScalar(pPast + i, pDiff + i, pOut + i, Num - i);
+}
+#endif
+
+#if defined(SNAPSHOT_SIMD_AVX2)
+AVX2_FUNCTION static int DiffAvx2(const int *pPast, const int *pCurrent, int *pOut, int Num)
+{
+	__m256i Needed = _mm256_setzero_si256();
+	int i = 0;
+	for(; i + 8 <= Num; i += 8)
+	{
+		__m256i Diff = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(pCurrent + i)), _mm256_loadu_si256((const __m256i *)(pPast + i)));
+		_mm256_storeu_si256((__m256i *)(pOut + i), Diff);
+		Needed = _mm256_or_si256(Needed, Diff);
+	}
+	__m128i Half = _mm_or_si128(_mm256_castsi256_si128(Needed), _mm256_extracti128_si256(Needed, 1));
+	// the rest often fills another half vector
+	return HorizontalOr(Half) | DiffSse2(pPast + i, pCurrent + i, pOut + i, Num - i);
+}
+#endif
+
+int CSnapshotSimd::SupportedLevel()
+{
+#if defined(SNAPSHOT_SIMD_AVX2)
+	if(CpuSupportsAvx2())
+		return LEVEL_AVX2;
+#endif
+#if defined(CONF_SSE2)
+	return LEVEL_SSE2;
+#else
+	return LEVEL_SCALAR;
+#endif
+}
+
+int CSnapshotSimd::ms_Level = CSnapshotSimd::SupportedLevel();
+
+void CSnapshotSimd::SetLevel(int Level)
+{
+	ms_Level = clamp(Level, (int)LEVEL_SCALAR, SupportedLevel());
+}
+
+int CSnapshotSimd::Sum(const int *pData, int Num)
+{
+	// an AVX2 version was slower than SSE2 on the snapshots of a real server
+#if defined(CONF_SSE2)
+	if(ms_Level >= LEVEL_SSE2)
+		return SumSse2(pData, Num);
+#endif
+	return SumScalar(pData, Num);
+}
+
+int CSnapshotSimd::Diff(const int *pPast, const int *pCurrent, int *pOut, int Num)
+{
+#if defined(SNAPSHOT_SIMD_AVX2)
+	// only faster from about 64 ints on, most items are shorter
+	if(ms_Level >= LEVEL_AVX2 && Num >= AVX2_MIN_DIFF_SIZE)
+		return DiffAvx2(pPast, pCurrent, pOut, Num);
+#endif
+#if defined(CONF_SSE2)
+	if(ms_Level >= LEVEL_SSE2)
+		return DiffSse2(pPast, pCurrent, pOut, Num);
+#endif
+	return DiffScalar(pPast, pCurrent, pOut, Num);
+}
+
+int CSnapshotSimd::Undiff(const int *pPast, const int *pDiff, int *pOut, int Num)
+{
+	// only done by clients and demo players, AVX2 isn't worth it here
+#if defined(CONF_SSE2)
+	if(ms_Level >= LEVEL_SSE2)
+		return UndiffSse2(pPast, pDiff, pOut, Num);
+#endif
+	return UndiffScalar(pPast, pDiff, pOut, Num);
+}
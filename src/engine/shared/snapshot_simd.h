@@ -0,0 +1,34 @@
+#ifndef ENGINE_SHARED_SNAPSHOT_SIMD_H
+#define ENGINE_SHARED_SNAPSHOT_SIMD_H
+
+// The loops over the ints of snapshot items, with SSE2 versions and an AVX2
+// one for diffing long items. The best one the CPU supports is picked at
+// startup, the level can be lowered to compare the versions.
+class CSnapshotSimd
+{
+public:
+	enum
+	{
+		LEVEL_SCALAR=0,
+		LEVEL_SSE2,
+		LEVEL_AVX2,
+	};
+
+	static int SupportedLevel();
+	static int Level() { return ms_Level; }
+	// can't go above the supported level
+	static void SetLevel(int Level);
+
+	// sum of the ints, wrapping around
+	static int Sum(const int *pData, int Num);
+	// pOut = pCurrent - pPast, returns all differences or'ed together
+	static int Diff(const int *pPast, const int *pCurrent, int *pOut, int Num);
+	// pOut = pPast + pDiff, returns the bits the differences take as
+	// variable ints, counting unchanged ints as one bit
+	static int Undiff(const int *pPast, const int *pDiff, int *pOut, int Num);
+
+private:
+	static int ms_Level;
+};
+
+#endif // ENGINE_SHARED_SNAPSHOT_SIMD_H
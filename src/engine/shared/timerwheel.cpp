@@ -0,0 +1,116 @@
+#include "timerwheel.h"
+
+void CTimerWheel::Init(int64 Now, int64 TickLength)
+{
+	mem_zero(m_aTimers, sizeof(m_aTimers));
+	mem_zero(m_aBuckets, sizeof(m_aBuckets));
+	m_TickLength = TickLength > 0 ? TickLength : 1;
+	m_Tick = Now / m_TickLength;
+}
+
+void CTimerWheel::Insert(int Timer, int64 Tick)
+{
+	int64 Delta = Tick - m_Tick;
+	int Bucket;
+	if(Delta < LEVEL0_SIZE)
+	{
+		Bucket = Tick & (LEVEL0_SIZE - 1);
+	}
+	else if(Delta < (int64)LEVEL0_SIZE << LEVEL_BITS)
+	{
+		Bucket = LEVEL0_SIZE + ((Tick >> LEVEL0_BITS) & (LEVEL_SIZE - 1));
+	}
+	else
+	{
+		int64 MaxDelta = ((int64)LEVEL0_SIZE << (2 * LEVEL_BITS)) - 1;
+		if(Delta > MaxDelta)
+			Tick = m_Tick + MaxDelta;
+		Bucket = LEVEL0_SIZE + LEVEL_SIZE + ((Tick >> (LEVEL0_BITS + LEVEL_BITS)) & (LEVEL_SIZE - 1));
+	}
+
+	CTimer *pTimer = &m_aTimers[Timer];
+	pTimer->m_Tick = Tick;
+	pTimer->m_Bucket = Bucket + 1;
+	pTimer->m_Prev = 0;
+	pTimer->m_Next = m_aBuckets[Bucket];
+	if(pTimer->m_Next)
+		m_aTimers[pTimer->m_Next - 1].m_Prev = Timer + 1;
+	m_aBuckets[Bucket] = Timer + 1;
+}
+
+void CTimerWheel::Unlink(int Timer)
+{
+	CTimer *pTimer = &m_aTimers[Timer];
+	if(pTimer->m_Prev)
+		m_aTimers[pTimer->m_Prev - 1].m_Next = pTimer->m_Next;
+	else
+		m_aBuckets[pTimer->m_Bucket - 1] = pTimer->m_Next;
+	if(pTimer->m_Next)
+		m_aTimers[pTimer->m_Next - 1].m_Prev = pTimer->m_Prev;
+	pTimer->m_Bucket = 0;
+	pTimer->m_Next = 0;
+	pTimer->m_Prev = 0;
+}
+
+void CTimerWheel::Schedule(int Timer, int64 Time)
+{
+	// round up so timers never fire before their time
+	int64 Tick = (Time + m_TickLength - 1) / m_TickLength;
+	if(Tick <= m_Tick)
+		Tick = m_Tick + 1;
+	if(Scheduled(Timer))
+		Unlink(Timer);
+	Insert(Timer, Tick);
+}
+
+void CTimerWheel::ScheduleEarlier(int Timer, int64 Time)
+{
+	if(Scheduled(Timer) && (Time + m_TickLength - 1) / m_TickLength >= m_aTimers[Timer].m_Tick)
+		return;
+	Schedule(Timer, Time);
+}
+
+void CTimerWheel::Cancel(int Timer)
+{
+	if(Scheduled(Timer))
+		Unlink(Timer);
+}
+
+void CTimerWheel::Cascade(int Bucket)
+{
+	// the timers of a higher level slot are now close enough for a lower one
+	int Timer = m_aBuckets[Bucket];
+	m_aBuckets[Bucket] = 0;
+	while(Timer)
+	{
+		int Next = m_aTimers[Timer - 1].m_Next;
+		Insert(Timer - 1, m_aTimers[Timer - 1].m_Tick);
+		Timer = Next;
+	}
+}
+
+int CTimerWheel::Advance(int64 Now, int *pTimers)
+{
+	int NumFired = 0;
+	int64 NowTick = Now / m_TickLength;
+	while(m_Tick < NowTick)
+	{
+		m_Tick++;
+		int Index = m_Tick & (LEVEL0_SIZE - 1);
+		if(Index == 0)
+		{
+			int Index1 = (m_Tick >> LEVEL0_BITS) & (LEVEL_SIZE - 1);
+			if(Index1 == 0)
+				Cascade(LEVEL0_SIZE + LEVEL_SIZE + ((m_Tick >> (LEVEL0_BITS + LEVEL_BITS)) & (LEVEL_SIZE - 1)));
+			Cascade(LEVEL0_SIZE + Index1);
+		}
+
+		while(m_aBuckets[Index])
+		{
+			int Timer = m_aBuckets[Index] - 1;
+			Unlink(Timer);
+			pTimers[NumFired++] = Timer;
+		}
+	}
+	return NumFired;
+}
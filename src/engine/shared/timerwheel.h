@@ -0,0 +1,63 @@
+#ifndef ENGINE_SHARED_TIMERWHEEL_H
+#define ENGINE_SHARED_TIMERWHEEL_H
+
+#include <base/system.h>
+
+// Hierarchical timer wheel for a fixed number of timers, identified by
+// their index. The first level has a slot per tick, the higher levels
+// cover 256 and 16384 ticks per slot and get moved down as time passes.
+// Timers further away than the last level are put into its last slot and
+// fire early.
+//
+// Plain data without constructor, so it can live in classes that get
+// zeroed with mem_zero.
+class CTimerWheel
+{
+public:
+	enum
+	{
+		MAX_TIMERS=256, // a timer per client slot
+
+		LEVEL0_BITS=8,
+		LEVEL_BITS=6,
+		NUM_LEVELS=3,
+		LEVEL0_SIZE=1<<LEVEL0_BITS,
+		LEVEL_SIZE=1<<LEVEL_BITS,
+		NUM_BUCKETS=LEVEL0_SIZE+(NUM_LEVELS-1)*LEVEL_SIZE,
+	};
+
+	// TickLength in time_get units
+	void Init(int64 Now, int64 TickLength);
+
+	// schedules the timer, replacing its previous time
+	void Schedule(int Timer, int64 Time);
+	// only schedules the timer if that makes it fire earlier
+	void ScheduleEarlier(int Timer, int64 Time);
+	void Cancel(int Timer);
+	bool Scheduled(int Timer) const { return m_aTimers[Timer].m_Bucket != 0; }
+
+	// fires the timers that are due, returns how many got written to
+	// pTimers, which must hold MAX_TIMERS
+	int Advance(int64 Now, int *pTimers);
+
+private:
+	// buckets and timers are stored plus one, so zero means none
+	struct CTimer
+	{
+		int64 m_Tick;
+		short m_Bucket;
+		short m_Next;
+		short m_Prev;
+	};
+
+	CTimer m_aTimers[MAX_TIMERS];
+	short m_aBuckets[NUM_BUCKETS]; // first timer
+	int64 m_TickLength;
+	int64 m_Tick; // all timers up to here fired
+
+	void Insert(int Timer, int64 Tick);
+	void Unlink(int Timer);
+	void Cascade(int Level);
+};
+
+#endif // ENGINE_SHARED_TIMERWHEEL_H
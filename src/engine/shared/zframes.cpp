@@ -0,0 +1,140 @@
+#include "zframes.h"
+
+#include <base/math.h>
+
+#include <zlib.h>
+
+const unsigned char ZFRAMES_MAGIC[ZFRAMES_MAGIC_SIZE] = {'T', 'W', 'Z', '1'};
+
+static void WriteUint32(unsigned char *pBuf, unsigned Value)
+{
+	pBuf[0] = Value >> 24;
+	pBuf[1] = Value >> 16;
+	pBuf[2] = Value >> 8;
+	pBuf[3] = Value;
+}
+
+static unsigned ReadUint32(const unsigned char *pBuf)
+{
+	return (pBuf[0] << 24) | (pBuf[1] << 16) | (pBuf[2] << 8) | pBuf[3];
+}
+
+CZFrameWriter::CZFrameWriter(int Level, int FlushDelay)
+{
+	m_pStream = new z_stream();
+	if(deflateInit(m_pStream, Level) != Z_OK)
+	{
+		dbg_msg("zframes", "deflateInit failed");
+		delete m_pStream;
+		m_pStream = 0;
+	}
+	m_WroteMagic = false;
+	m_FlushDelay = FlushDelay;
+	m_DataSize = 0;
+	m_DataStart = 0;
+	m_aCompressed.resize(ZFRAMES_HEADER_SIZE + compressBound(sizeof(m_aData)));
+}
+
+CZFrameWriter::~CZFrameWriter()
+{
+	if(m_pStream)
+	{
+		deflateEnd(m_pStream);
+		delete m_pStream;
+	}
+}
+
+void CZFrameWriter::AioFilter(IOHANDLE File, const void *pData, unsigned Size, int Flush, void *pUser)
+{
+	((CZFrameWriter *)pUser)->Write(File, pData, Size, Flush);
+}
+
+void CZFrameWriter::Write(IOHANDLE File, const void *pData, unsigned Size, bool Flush)
+{
+	const unsigned char *pBytes = (const unsigned char *)pData;
+	while(Size > 0)
+	{
+		if(m_DataSize == 0)
+			m_DataStart = time_get();
+
+		unsigned Copy = min(Size, (unsigned)(sizeof(m_aData) - m_DataSize));
+		mem_copy(m_aData + m_DataSize, pBytes, Copy);
+		m_DataSize += Copy;
+		pBytes += Copy;
+		Size -= Copy;
+
+		if(m_DataSize == (int)sizeof(m_aData))
+			WriteFrame(File);
+	}
+
+	// don't keep data of a quiet server in memory for too long
+	if(m_DataSize && (Flush || time_get() > m_DataStart + m_FlushDelay * time_freq()))
+		WriteFrame(File);
+}
+
+void CZFrameWriter::WriteFrame(IOHANDLE File)
+{
+	if(!m_WroteMagic)
+	{
+		io_write(File, ZFRAMES_MAGIC, sizeof(ZFRAMES_MAGIC));
+		m_WroteMagic = true;
+	}
+
+	unsigned char *pFrame = &m_aCompressed[0];
+	unsigned CompressedSize = 0;
+	if(m_pStream && deflateReset(m_pStream) == Z_OK)
+	{
+		m_pStream->next_in = m_aData;
+		m_pStream->avail_in = m_DataSize;
+		m_pStream->next_out = pFrame + ZFRAMES_HEADER_SIZE;
+		m_pStream->avail_out = m_aCompressed.size() - ZFRAMES_HEADER_SIZE;
+		if(deflate(m_pStream, Z_FINISH) == Z_STREAM_END)
+			CompressedSize = m_pStream->total_out;
+	}
+
+	if(CompressedSize == 0)
+	{
+		// losing the data would be worse than storing it uncompressed
+		dbg_msg("zframes", "compressing frame failed");
+		WriteUint32(pFrame, 0);
+		WriteUint32(pFrame + 4, m_DataSize);
+		io_write(File, pFrame, ZFRAMES_HEADER_SIZE);
+		io_write(File, m_aData, m_DataSize);
+	}
+	else
+	{
+		WriteUint32(pFrame, CompressedSize);
+		WriteUint32(pFrame + 4, m_DataSize);
+		io_write(File, pFrame, ZFRAMES_HEADER_SIZE + CompressedSize);
+	}
+	m_DataSize = 0;
+}
+
+bool CZFrameReader::CheckMagic(IOHANDLE File)
+{
+	unsigned char aMagic[ZFRAMES_MAGIC_SIZE];
+	return io_read(File, aMagic, sizeof(aMagic)) == sizeof(aMagic) && mem_comp(aMagic, ZFRAMES_MAGIC, sizeof(aMagic)) == 0;
+}
+
+bool CZFrameReader::ReadFrame(IOHANDLE File, std::vector<unsigned char> *paData)
+{
+	unsigned char aHeader[ZFRAMES_HEADER_SIZE];
+	if(io_read(File, aHeader, sizeof(aHeader)) != sizeof(aHeader))
+		return false;
+
+	unsigned CompressedSize = ReadUint32(aHeader);
+	unsigned DataSize = ReadUint32(aHeader + 4);
+	if(DataSize == 0 || DataSize > ZFRAMES_MAX_FRAME_SIZE || CompressedSize > compressBound(ZFRAMES_MAX_FRAME_SIZE))
+		return false;
+
+	paData->resize(DataSize);
+	if(CompressedSize == 0)
+		return io_read(File, &(*paData)[0], DataSize) == DataSize;
+
+	std::vector<unsigned char> aCompressed(CompressedSize);
+	if(io_read(File, &aCompressed[0], CompressedSize) != CompressedSize)
+		return false;
+
+	uLongf Size = DataSize;
+	return uncompress(&(*paData)[0], &Size, &aCompressed[0], CompressedSize) == Z_OK && Size == DataSize;
+}
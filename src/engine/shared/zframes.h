@@ -0,0 +1,59 @@
+#ifndef ENGINE_SHARED_ZFRAMES_H
+#define ENGINE_SHARED_ZFRAMES_H
+
+#include <base/system.h>
+
+#include <vector>
+
+struct z_stream_s;
+
+// A file of zlib compressed frames that can be decompressed independently,
+// so a truncated file only loses its last frame. The file starts with
+// ZFRAMES_MAGIC, each frame with its compressed and uncompressed size as
+// big endian 32 bit integers.
+
+enum
+{
+	ZFRAMES_MAGIC_SIZE=4,
+	ZFRAMES_HEADER_SIZE=8,
+	ZFRAMES_MAX_FRAME_SIZE=64*1024,
+};
+
+extern const unsigned char ZFRAMES_MAGIC[ZFRAMES_MAGIC_SIZE];
+
+// Collects data into frames, meant to be used as filter of an ASYNCIO.
+class CZFrameWriter
+{
+public:
+	CZFrameWriter(int Level, int FlushDelay);
+	~CZFrameWriter();
+
+	void Write(IOHANDLE File, const void *pData, unsigned Size, bool Flush);
+	// matches AIO_FILTER
+	static void AioFilter(IOHANDLE File, const void *pData, unsigned Size, int Flush, void *pUser);
+
+private:
+	z_stream_s *m_pStream;
+	bool m_WroteMagic;
+	// seconds data may wait for a frame to fill up
+	int m_FlushDelay;
+
+	unsigned char m_aData[ZFRAMES_MAX_FRAME_SIZE];
+	int m_DataSize;
+	int64 m_DataStart;
+	std::vector<unsigned char> m_aCompressed;
+
+	void WriteFrame(IOHANDLE File);
+};
+
+class CZFrameReader
+{
+public:
+	// returns false if the file doesn't start with ZFRAMES_MAGIC
+	static bool CheckMagic(IOHANDLE File);
+	// replaces *paData with the next frame. Returns false at the end of the
+	// file and on a truncated or damaged frame
+	static bool ReadFrame(IOHANDLE File, std::vector<unsigned char> *paData);
+};
+
+#endif // ENGINE_SHARED_ZFRAMES_H
@@ -48,6 +48,18 @@ void ExtractExtraInfo(const CNetObj_Projectile *pProj, int *Owner, bool *Explosi
 		*Freeze = (Data>>13) & 1;
 }
 
+bool SnapshotHasExtraInfo(const unsigned char *pData)
+{
+	CSnapshot *pSnap = (CSnapshot*) pData;
+	for(int Index = 0; Index < pSnap->NumItems(); Index++)
+	{
+		CSnapshotItem *pItem = pSnap->GetItem(Index);
+		if(pItem->Type() == NETOBJTYPE_PROJECTILE && UseExtraInfo((const CNetObj_Projectile*) ((void*)pItem->Data())))
+			return true;
+	}
+	return false;
+}
+
 void SnapshotRemoveExtraInfo(unsigned char *pData)
 {
 	CSnapshot *pSnap = (CSnapshot*) pData;
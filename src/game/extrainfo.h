@@ -8,6 +8,7 @@
 bool UseExtraInfo(const CNetObj_Projectile *pProj);
 void ExtractInfo(const CNetObj_Projectile *pProj, vec2 *StartPos, vec2 *StartVel);
 void ExtractExtraInfo(const CNetObj_Projectile *pProj, int *Owner, bool *Explosive, int *Bouncing, bool *Freeze);
+bool SnapshotHasExtraInfo(const unsigned char *pData);
 void SnapshotRemoveExtraInfo(unsigned char *pData);
 
 #endif
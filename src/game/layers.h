@@ -19,6 +19,7 @@ class CLayers
 public:
 	CLayers();
 	void Init(class IKernel *pKernel);
+	void Init(class IMap *pMap);
 	void InitBackground(class IMap *pMap);
 	int NumGroups() const { return m_GroupsNum; };
 	class IMap *Map() const { return m_pMap; };
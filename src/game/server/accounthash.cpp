@@ -0,0 +1,167 @@
+#include "accounthash.h"
+
+#include <base/hash_ctxt.h>
+#include <base/system.h>
+
+#include <stdlib.h>
+
+static const char s_aPrefix[] = "$pbkdf2-sha256$";
+
+struct CHmacSha256
+{
+	SHA256_CTX m_Inner;
+	SHA256_CTX m_Outer;
+
+	CHmacSha256(const void *pKey, int KeyLen)
+	{
+		unsigned char aKey[64] = {0};
+		if(KeyLen > (int)sizeof(aKey))
+		{
+			SHA256_DIGEST Digest = sha256(pKey, KeyLen);
+			mem_copy(aKey, Digest.data, sizeof(Digest.data));
+		}
+		else
+			mem_copy(aKey, pKey, KeyLen);
+
+		unsigned char aPad[64];
+		for(unsigned i = 0; i < sizeof(aPad); i++)
+			aPad[i] = aKey[i] ^ 0x36;
+		sha256_init(&m_Inner);
+		sha256_update(&m_Inner, aPad, sizeof(aPad));
+		for(unsigned i = 0; i < sizeof(aPad); i++)
+			aPad[i] = aKey[i] ^ 0x5c;
+		sha256_init(&m_Outer);
+		sha256_update(&m_Outer, aPad, sizeof(aPad));
+	}
+
+	// the padded key blocks are hashed once, every message only costs
+	// two more compressions
+	SHA256_DIGEST Hash(const void *pData, int DataLen, const void *pData2 = 0, int Data2Len = 0) const
+	{
+		SHA256_CTX Ctxt = m_Inner;
+		sha256_update(&Ctxt, pData, DataLen);
+		if(pData2)
+			sha256_update(&Ctxt, pData2, Data2Len);
+		SHA256_DIGEST Inner = sha256_finish(&Ctxt);
+
+		Ctxt = m_Outer;
+		sha256_update(&Ctxt, Inner.data, sizeof(Inner.data));
+		return sha256_finish(&Ctxt);
+	}
+};
+
+SHA256_DIGEST Pbkdf2Sha256(const void *pPassword, int PasswordLen, const void *pSalt, int SaltLen, int Rounds)
+{
+	CHmacSha256 Hmac(pPassword, PasswordLen);
+
+	// the derived key is exactly one block long, so the block index is always 1
+	static const unsigned char s_aBlockIndex[4] = {0, 0, 0, 1};
+	SHA256_DIGEST U = Hmac.Hash(pSalt, SaltLen, s_aBlockIndex, sizeof(s_aBlockIndex));
+	SHA256_DIGEST Result = U;
+	for(int i = 1; i < Rounds; i++)
+	{
+		U = Hmac.Hash(U.data, sizeof(U.data));
+		for(unsigned k = 0; k < sizeof(Result.data); k++)
+			Result.data[k] ^= U.data[k];
+	}
+	return Result;
+}
+
+static void FormatHash(char *pOut, int OutSize, int Rounds, const SHA256_DIGEST &Salt, const SHA256_DIGEST &Hash)
+{
+	char aSalt[SHA256_MAXSTRSIZE];
+	char aHash[SHA256_MAXSTRSIZE];
+	sha256_str(Salt, aSalt, sizeof(aSalt));
+	sha256_str(Hash, aHash, sizeof(aHash));
+	str_format(pOut, OutSize, "%s%d$%s$%s", s_aPrefix, Rounds, aSalt, aHash);
+}
+
+static bool ParseHash(const char *pStored, int *pRounds, SHA256_DIGEST *pSalt, SHA256_DIGEST *pHash)
+{
+	const char *pRest = str_startswith(pStored, s_aPrefix);
+	if(!pRest)
+		return false;
+
+	char *pEnd;
+	long Rounds = strtol(pRest, &pEnd, 10);
+	if(pEnd == pRest || *pEnd != '$' || Rounds <= 0)
+		return false;
+	pRest = pEnd + 1;
+
+	char aSalt[SHA256_MAXSTRSIZE];
+	if(str_length(pRest) != 2 * (SHA256_MAXSTRSIZE - 1) + 1 || pRest[SHA256_MAXSTRSIZE - 1] != '$')
+		return false;
+	str_copy(aSalt, pRest, sizeof(aSalt));
+	if(sha256_from_str(pSalt, aSalt) || sha256_from_str(pHash, pRest + SHA256_MAXSTRSIZE))
+		return false;
+
+	*pRounds = Rounds;
+	return true;
+}
+
+static bool SafeCompare(const void *pA, const void *pB, int Size)
+{
+	const unsigned char *pa = (const unsigned char *)pA;
+	const unsigned char *pb = (const unsigned char *)pB;
+	unsigned char Diff = 0;
+	for(int i = 0; i < Size; i++)
+		Diff |= pa[i] ^ pb[i];
+	return Diff == 0;
+}
+
+void AccountHashPassword(char *pOut, int OutSize, const char *pPassword, int Rounds)
+{
+	SHA256_DIGEST Salt;
+	secure_random_fill(Salt.data, sizeof(Salt.data));
+	SHA256_DIGEST Hash = Pbkdf2Sha256(pPassword, str_length(pPassword), Salt.data, sizeof(Salt.data), Rounds);
+	FormatHash(pOut, OutSize, Rounds, Salt, Hash);
+}
+
+bool AccountCheckPassword(const char *pStored, const char *pPassword, int Rounds, bool *pNeedsRehash)
+{
+	int StoredRounds;
+	SHA256_DIGEST Salt;
+	SHA256_DIGEST StoredHash;
+	if(!ParseHash(pStored, &StoredRounds, &Salt, &StoredHash))
+	{
+		// cleartext password from an old .acc file
+		*pNeedsRehash = true;
+		int Length = str_length(pStored);
+		return Length == str_length(pPassword) && SafeCompare(pStored, pPassword, Length);
+	}
+
+	*pNeedsRehash = StoredRounds != Rounds;
+	SHA256_DIGEST Hash = Pbkdf2Sha256(pPassword, str_length(pPassword), Salt.data, sizeof(Salt.data), StoredRounds);
+	return SafeCompare(Hash.data, StoredHash.data, sizeof(Hash.data));
+}
+
+CAccountPasswordJob::CAccountPasswordJob(const char *pPassword, const char *pStored, int Rounds)
+{
+	m_AccID = 0;
+	m_aUsername[0] = 0;
+	m_WaitingForDatabase = false;
+	str_copy(m_aPassword, pPassword, sizeof(m_aPassword));
+	str_copy(m_aStored, pStored, sizeof(m_aStored));
+	m_Rounds = Rounds;
+	m_Match = false;
+	m_aNewHash[0] = 0;
+}
+
+CAccountPasswordJob::~CAccountPasswordJob()
+{
+	mem_zero(m_aPassword, sizeof(m_aPassword));
+}
+
+void CAccountPasswordJob::Run()
+{
+	bool NeedsRehash = true;
+	if(m_aStored[0])
+		m_Match = AccountCheckPassword(m_aStored, m_aPassword, m_Rounds, &NeedsRehash);
+	else
+		m_Match = true;
+
+	if(m_Match && NeedsRehash)
+		AccountHashPassword(m_aNewHash, sizeof(m_aNewHash), m_aPassword, m_Rounds);
+
+	mem_zero(m_aPassword, sizeof(m_aPassword));
+}
@@ -0,0 +1,51 @@
+#ifndef GAME_SERVER_ACCOUNTHASH_H
+#define GAME_SERVER_ACCOUNTHASH_H
+
+#include <base/hash.h>
+#include <engine/shared/jobs.h>
+
+enum
+{
+	// "$pbkdf2-sha256$<rounds>$<salt>$<hash>"
+	ACCOUNT_PASSWORD_MAXSTRSIZE=192,
+	ACCOUNT_PASSWORD_MAX_INPUT=128,
+};
+
+SHA256_DIGEST Pbkdf2Sha256(const void *pPassword, int PasswordLen, const void *pSalt, int SaltLen, int Rounds);
+
+// Hashes the password with a fresh random salt.
+void AccountHashPassword(char *pOut, int OutSize, const char *pPassword, int Rounds);
+
+// Checks the password against a stored hash or, for accounts that were
+// created before passwords were hashed, a cleartext password. *pNeedsRehash
+// is set if the stored password should be replaced by a hash with the
+// given number of rounds.
+bool AccountCheckPassword(const char *pStored, const char *pPassword, int Rounds, bool *pNeedsRehash);
+
+// Hashes or verifies an account password on the job pool. Leave
+// m_aStored empty to hash a new password.
+class CAccountPasswordJob : public IJob
+{
+	virtual void Run();
+
+public:
+	CAccountPasswordJob(const char *pPassword, const char *pStored, int Rounds);
+	virtual ~CAccountPasswordJob();
+
+	// input, not touched by Run()
+	int m_AccID;
+	char m_aUsername[32];
+	// set while the finished job waits for the account database
+	bool m_WaitingForDatabase;
+
+	char m_aPassword[ACCOUNT_PASSWORD_MAX_INPUT];
+	char m_aStored[ACCOUNT_PASSWORD_MAXSTRSIZE];
+	int m_Rounds;
+
+	// output
+	bool m_Match;
+	// empty unless the stored password has to be replaced
+	char m_aNewHash[ACCOUNT_PASSWORD_MAXSTRSIZE];
+};
+
+#endif // GAME_SERVER_ACCOUNTHASH_H
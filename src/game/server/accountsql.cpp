@@ -0,0 +1,376 @@
+#if defined(CONF_SQL)
+#include <base/system.h>
+#include <engine/server/sql_string_helpers.h>
+#include <engine/shared/config.h>
+
+#include "accountsql.h"
+
+std::vector<CAccountSql *> CAccountSql::ms_apRetired;
+
+CAccountSql::CAccountSql()
+{
+	m_Lock = lock_create();
+	sphore_init(&m_Semaphore);
+	mem_zero(m_apSqlWriteServers, sizeof(m_apSqlWriteServers));
+	m_Busy = false;
+	m_Shutdown = false;
+	m_Finished = false;
+	m_ResetLogins = true;
+	UpdateServers();
+	m_pThread = thread_init(WorkerThread, this);
+	sphore_signal(&m_Semaphore);
+}
+
+CAccountSql::~CAccountSql()
+{
+	for(unsigned i = 0; i < m_Requests.size(); i++)
+		delete m_Requests[i];
+	for(unsigned i = 0; i < m_Results.size(); i++)
+		delete m_Results[i];
+	for(int i = 0; i < MAX_SQLSERVERS; i++)
+		delete m_apSqlWriteServers[i];
+
+	lock_destroy(m_Lock);
+	sphore_destroy(&m_Semaphore);
+}
+
+void CAccountSql::Load(int ClientID, const char *pUsername, std::shared_ptr<CAccountPasswordJob> pJob)
+{
+	CRequest *pRequest = new CRequest();
+	pRequest->m_Type = REQUEST_LOAD;
+	pRequest->m_ClientID = ClientID;
+	str_copy(pRequest->m_aUsername, pUsername, sizeof(pRequest->m_aUsername));
+	pRequest->m_aPassword[0] = 0;
+	pRequest->m_Error = false;
+	pRequest->m_Success = false;
+	pRequest->m_Claimed = false;
+	pRequest->m_pJob = pJob;
+
+	UpdateServers();
+	lock_wait(m_Lock);
+	m_Requests.push_back(pRequest);
+	lock_unlock(m_Lock);
+	sphore_signal(&m_Semaphore);
+}
+
+void CAccountSql::Register(int ClientID, const char *pUsername, const char *pPasswordHash, std::shared_ptr<CAccountPasswordJob> pJob)
+{
+	CRequest *pRequest = new CRequest();
+	pRequest->m_Type = REQUEST_REGISTER;
+	pRequest->m_ClientID = ClientID;
+	str_copy(pRequest->m_aUsername, pUsername, sizeof(pRequest->m_aUsername));
+	str_copy(pRequest->m_aPassword, pPasswordHash, sizeof(pRequest->m_aPassword));
+	pRequest->m_Error = false;
+	pRequest->m_Success = false;
+	pRequest->m_Claimed = false;
+	pRequest->m_pJob = pJob;
+
+	UpdateServers();
+	lock_wait(m_Lock);
+	m_Requests.push_back(pRequest);
+	lock_unlock(m_Lock);
+	sphore_signal(&m_Semaphore);
+}
+
+void CAccountSql::Save(const CGameContext::AccountInfo &Account)
+{
+	UpdateServers();
+	lock_wait(m_Lock);
+	m_PendingSaves[Account.m_Username] = Account;
+	lock_unlock(m_Lock);
+	sphore_signal(&m_Semaphore);
+}
+
+void CAccountSql::GetResults(std::vector<CRequest *> *pResults)
+{
+	lock_wait(m_Lock);
+	pResults->swap(m_Results);
+	lock_unlock(m_Lock);
+}
+
+void CAccountSql::UpdateServers()
+{
+	// sqlservers can be added at any time with add_sqlserver
+	lock_wait(m_Lock);
+	for(int i = 0; i < MAX_SQLSERVERS; i++)
+		if(!m_apSqlWriteServers[i] && CSqlConnector::GlobalSqlServer(i, false))
+			m_apSqlWriteServers[i] = CSqlConnector::GlobalSqlServer(i, false)->Clone();
+	lock_unlock(m_Lock);
+}
+
+void CAccountSql::Shutdown(int64 Timeout, bool Wait)
+{
+	int64 End = time_get() + Timeout;
+	bool Done;
+	while(true)
+	{
+		lock_wait(m_Lock);
+		Done = m_PendingSaves.empty() && m_Requests.empty() && !m_Busy;
+		lock_unlock(m_Lock);
+		if(Done || time_get() >= End)
+			break;
+		thread_sleep(10000);
+	}
+
+	lock_wait(m_Lock);
+	m_Shutdown = true;
+	lock_unlock(m_Lock);
+	sphore_signal(&m_Semaphore);
+
+	ReapRetired(false);
+	if(!Done && !Wait)
+	{
+		// the database thread makes its last try on its own
+		dbg_msg("sql", "accounts aren't saved yet, leaving them to the database thread");
+		ms_apRetired.push_back(this);
+		return;
+	}
+
+	thread_wait(m_pThread);
+	delete this;
+}
+
+void CAccountSql::WaitRetired()
+{
+	ReapRetired(true);
+}
+
+void CAccountSql::ReapRetired(bool Wait)
+{
+	for(unsigned i = 0; i < ms_apRetired.size(); )
+	{
+		CAccountSql *pRetired = ms_apRetired[i];
+		lock_wait(pRetired->m_Lock);
+		bool Finished = pRetired->m_Finished;
+		lock_unlock(pRetired->m_Lock);
+		if(!Finished && !Wait)
+		{
+			i++;
+			continue;
+		}
+
+		thread_wait(pRetired->m_pThread);
+		delete pRetired;
+		ms_apRetired.erase(ms_apRetired.begin() + i);
+	}
+}
+
+bool CAccountSql::ResetLogins(CSqlServer *pSqlServer)
+{
+	try
+	{
+		// a crash leaves the accounts that were in use marked as logged in
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "UPDATE %s_accounts SET LoggedIn=0, ClientID=-1 WHERE Port=%d AND LoggedIn=1;", pSqlServer->GetPrefix(), g_Config.m_SvPort);
+		int NumReset = pSqlServer->executeSqlUpdate(aBuf);
+		if(NumReset > 0)
+			dbg_msg("sql", "reset %d accounts left logged in on port %d", NumReset, g_Config.m_SvPort);
+		return true;
+	}
+	catch (sql::SQLException &e)
+	{
+		dbg_msg("sql", "MySQL Error: %s", e.what());
+		dbg_msg("sql", "ERROR: Could not reset logged in accounts");
+	}
+	return false;
+}
+
+bool CAccountSql::SaveBatch(CSqlServer *pSqlServer, std::map<std::string, CGameContext::AccountInfo> &Batch)
+{
+	static const char *s_apColumns[] = {"Password", "Disabled", "ClientID", "Level", "XP", "NeededXP", "Money", "Kills", "Deaths", "Items", "PoliceLevel",
+		// LoggedIn and Port come last, later assignments see the updated values
+		"LoggedIn", "Port"};
+
+	try
+	{
+		// another server owns the accounts it marked as logged in
+		std::string Update = " ON DUPLICATE KEY UPDATE ";
+		for(unsigned i = 0; i < sizeof(s_apColumns) / sizeof(s_apColumns[0]); i++)
+		{
+			char aColumn[128];
+			str_format(aColumn, sizeof(aColumn), "%s%s=IF(LoggedIn=0 OR Port=VALUES(Port), VALUES(%s), %s)", i ? ", " : "", s_apColumns[i], s_apColumns[i], s_apColumns[i]);
+			Update += aColumn;
+		}
+		Update += ";";
+
+		while(!Batch.empty())
+		{
+			char aBuf[512];
+			str_format(aBuf, sizeof(aBuf), "INSERT INTO %s_accounts (Username, Password, Port, LoggedIn, Disabled, ClientID, Level, XP, NeededXP, Money, Kills, Deaths, Items, PoliceLevel) VALUES ", pSqlServer->GetPrefix());
+			std::string Query = aBuf;
+
+			std::map<std::string, CGameContext::AccountInfo>::iterator it = Batch.begin();
+			for(int i = 0; i < MAX_BATCH_SIZE && it != Batch.end(); i++, ++it)
+			{
+				const CGameContext::AccountInfo *pAccount = &it->second;
+				sqlstr::CSqlString<32> Username(pAccount->m_Username);
+				sqlstr::CSqlString<ACCOUNT_PASSWORD_MAXSTRSIZE> Password(pAccount->m_Password);
+				int Items = 0;
+				for(int k = 0; k < NUM_ITEMS; k++)
+					if(pAccount->m_aHasItem[k])
+						Items |= 1<<k;
+
+				str_format(aBuf, sizeof(aBuf), "%s('%s', '%s', %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d)",
+					i ? ", " : "", Username.ClrStr(), Password.ClrStr(), g_Config.m_SvPort, pAccount->m_LoggedIn,
+					pAccount->m_Disabled, pAccount->m_ClientID, pAccount->m_Level, pAccount->m_XP, pAccount->m_NeededXP,
+					pAccount->m_Money, pAccount->m_Kills, pAccount->m_Deaths, Items, pAccount->m_PoliceLevel);
+				Query += aBuf;
+			}
+			Query += Update;
+
+			pSqlServer->executeSql(Query.c_str());
+			Batch.erase(Batch.begin(), it);
+		}
+		return true;
+	}
+	catch (sql::SQLException &e)
+	{
+		dbg_msg("sql", "MySQL Error: %s", e.what());
+		dbg_msg("sql", "ERROR: Could not save accounts");
+	}
+	return false;
+}
+
+bool CAccountSql::HandleRequest(CSqlServer *pSqlServer, CRequest *pRequest)
+{
+	try
+	{
+		char aBuf[768];
+		sqlstr::CSqlString<32> Username(pRequest->m_aUsername);
+
+		if(pRequest->m_Type == REQUEST_REGISTER)
+		{
+			sqlstr::CSqlString<ACCOUNT_PASSWORD_MAXSTRSIZE> Password(pRequest->m_aPassword);
+			str_format(aBuf, sizeof(aBuf), "INSERT IGNORE INTO %s_accounts (Username, Password) VALUES ('%s', '%s');", pSqlServer->GetPrefix(), Username.ClrStr(), Password.ClrStr());
+			pRequest->m_Success = pSqlServer->executeSqlUpdate(aBuf) > 0;
+			return true;
+		}
+
+		// claim the account first, two servers must not log in the same
+		// account. A retry after an error keeps the claim it already made
+		if(!pRequest->m_Claimed)
+		{
+			str_format(aBuf, sizeof(aBuf), "UPDATE %s_accounts SET LoggedIn=1, Port=%d, ClientID=%d WHERE Username='%s' AND LoggedIn=0;", pSqlServer->GetPrefix(), g_Config.m_SvPort, pRequest->m_ClientID, Username.ClrStr());
+			pRequest->m_Claimed = pSqlServer->executeSqlUpdate(aBuf) > 0;
+		}
+
+		str_format(aBuf, sizeof(aBuf), "SELECT * FROM %s_accounts WHERE Username='%s';", pSqlServer->GetPrefix(), Username.ClrStr());
+		pSqlServer->executeSqlQuery(aBuf);
+		pRequest->m_Success = pSqlServer->GetResults()->next();
+		if(pRequest->m_Claimed && pRequest->m_Success)
+		{
+			sql::ResultSet *pResults = pSqlServer->GetResults();
+			CGameContext::AccountInfo *pAccount = &pRequest->m_Account;
+			str_copy(pAccount->m_Username, pResults->getString("Username").c_str(), sizeof(pAccount->m_Username));
+			str_copy(pAccount->m_Password, pResults->getString("Password").c_str(), sizeof(pAccount->m_Password));
+			pAccount->m_Port = pResults->getInt("Port");
+			pAccount->m_LoggedIn = pResults->getInt("LoggedIn");
+			pAccount->m_Disabled = pResults->getInt("Disabled");
+			pAccount->m_ClientID = pResults->getInt("ClientID");
+			pAccount->m_Level = pResults->getInt("Level");
+			pAccount->m_XP = pResults->getInt("XP");
+			pAccount->m_NeededXP = pResults->getInt("NeededXP");
+			pAccount->m_Money = pResults->getInt("Money");
+			pAccount->m_Kills = pResults->getInt("Kills");
+			pAccount->m_Deaths = pResults->getInt("Deaths");
+			int Items = pResults->getInt("Items");
+			for(int k = 0; k < NUM_ITEMS; k++)
+				pAccount->m_aHasItem[k] = Items & (1<<k);
+			pAccount->m_PoliceLevel = pResults->getInt("PoliceLevel");
+		}
+		return true;
+	}
+	catch (sql::SQLException &e)
+	{
+		dbg_msg("sql", "MySQL Error: %s", e.what());
+		dbg_msg("sql", "ERROR: Could not %s account '%s'", pRequest->m_Type == REQUEST_LOAD ? "load" : "register", pRequest->m_aUsername);
+	}
+	return false;
+}
+
+void CAccountSql::WorkerThread(void *pUser)
+{
+	CAccountSql *pSelf = (CAccountSql *)pUser;
+
+	while(true)
+	{
+		sphore_wait(&pSelf->m_Semaphore);
+
+		std::vector<CRequest *> Requests;
+		std::map<std::string, CGameContext::AccountInfo> Saves;
+		lock_wait(pSelf->m_Lock);
+		bool Shutdown = pSelf->m_Shutdown;
+		bool Reset = pSelf->m_ResetLogins && !Shutdown;
+		if(Shutdown && pSelf->m_Requests.empty() && pSelf->m_PendingSaves.empty())
+		{
+			lock_unlock(pSelf->m_Lock);
+			break;
+		}
+		Requests.swap(pSelf->m_Requests);
+		Saves.swap(pSelf->m_PendingSaves);
+		pSelf->m_Busy = Reset || !Requests.empty() || !Saves.empty();
+		lock_unlock(pSelf->m_Lock);
+
+		if(!Reset && Requests.empty() && Saves.empty())
+			continue;
+
+		CSqlServer *apSqlWriteServers[MAX_SQLSERVERS];
+		lock_wait(pSelf->m_Lock);
+		mem_copy(apSqlWriteServers, pSelf->m_apSqlWriteServers, sizeof(apSqlWriteServers));
+		lock_unlock(pSelf->m_Lock);
+
+		// accounts are read from the write servers as well, so a login
+		// always sees what another server instance saved last
+		CSqlConnector Connector(apSqlWriteServers, apSqlWriteServers);
+		unsigned NumHandled = 0;
+		while((Reset || !Saves.empty() || NumHandled < Requests.size()) && !Connector.MaxTriesReached(false) && Connector.ConnectSqlServer(false))
+		{
+			if(Reset && ResetLogins(Connector.SqlServer()))
+				Reset = false;
+			// write saves first, a login right after a logout has to read the
+			// new state. Claims need the logins left by a crash reset as well
+			if(!Reset && SaveBatch(Connector.SqlServer(), Saves))
+				while(NumHandled < Requests.size() && HandleRequest(Connector.SqlServer(), Requests[NumHandled]))
+					NumHandled++;
+
+			Connector.SqlServer()->Disconnect();
+		}
+
+		for(unsigned i = NumHandled; i < Requests.size(); i++)
+			Requests[i]->m_Error = true;
+
+		lock_wait(pSelf->m_Lock);
+		pSelf->m_Results.insert(pSelf->m_Results.end(), Requests.begin(), Requests.end());
+		if(!Saves.empty())
+		{
+			if(Shutdown)
+				dbg_msg("sql", "ERROR: Dropping %d unsaved accounts", (int)Saves.size());
+			else
+			{
+				// retry later, newer saves of the same account take precedence
+				for(std::map<std::string, CGameContext::AccountInfo>::iterator it = Saves.begin(); it != Saves.end(); ++it)
+					pSelf->m_PendingSaves.insert(*it);
+			}
+		}
+		pSelf->m_ResetLogins = Reset;
+		pSelf->m_Busy = false;
+		lock_unlock(pSelf->m_Lock);
+
+		if((Reset || !Saves.empty()) && !Shutdown)
+		{
+			thread_sleep(1000000);
+			sphore_signal(&pSelf->m_Semaphore);
+		}
+		else if(Shutdown)
+		{
+			// that was the last try, quit with the next round
+			sphore_signal(&pSelf->m_Semaphore);
+		}
+	}
+
+	lock_wait(pSelf->m_Lock);
+	pSelf->m_Finished = true;
+	lock_unlock(pSelf->m_Lock);
+}
+
+#endif
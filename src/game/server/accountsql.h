@@ -0,0 +1,103 @@
+#ifndef GAME_SERVER_ACCOUNTSQL_H
+#define GAME_SERVER_ACCOUNTSQL_H
+
+#include <engine/server/sql_connector.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gamecontext.h"
+
+// Stores accounts in the <prefix>_accounts table of the sql write servers.
+// All queries run on a background thread; finished loads and registrations
+// are picked up by the game thread with GetResults(). Lives as long as the
+// server, so saves that are still pending survive map changes. The thread
+// connects through its own copies of the write servers, the ones added with
+// add_sqlserver are only read by the game thread.
+class CAccountSql
+{
+public:
+	enum
+	{
+		REQUEST_LOAD=0,
+		REQUEST_REGISTER,
+	};
+
+	struct CRequest
+	{
+		int m_Type;
+		int m_ClientID;
+		char m_aUsername[32];
+		char m_aPassword[ACCOUNT_PASSWORD_MAXSTRSIZE];
+
+		// set by the database thread
+		bool m_Error;
+		bool m_Success;
+		// a load marks the account as logged in on this server, only then
+		// m_Account is loaded. The game thread has to save it again if the
+		// login doesn't go through
+		bool m_Claimed;
+		CGameContext::AccountInfo m_Account;
+
+		// only touched by the game thread
+		std::shared_ptr<CAccountPasswordJob> m_pJob;
+	};
+
+	CAccountSql();
+
+	void Load(int ClientID, const char *pUsername, std::shared_ptr<CAccountPasswordJob> pJob);
+	void Register(int ClientID, const char *pUsername, const char *pPasswordHash, std::shared_ptr<CAccountPasswordJob> pJob);
+	// saves are coalesced per account and written in batches. Accounts that
+	// are logged in on another server are left alone
+	void Save(const CGameContext::AccountInfo &Account);
+
+	// moves the finished requests to pResults, the caller has to delete them
+	void GetResults(std::vector<CRequest *> *pResults);
+
+	// waits up to Timeout for the queued saves, lets the worker make a last
+	// try at the rest and frees the object. With Wait unset a busy worker is
+	// left running and only joined by the next Shutdown() or by WaitRetired()
+	void Shutdown(int64 Timeout, bool Wait);
+	// joins the workers left running by Shutdown(), call before the sql
+	// servers are removed
+	static void WaitRetired();
+
+private:
+	~CAccountSql();
+
+	enum
+	{
+		MAX_BATCH_SIZE=32,
+	};
+
+	void *m_pThread;
+	LOCK m_Lock;
+	// copies of the global write servers, guarded by m_Lock. They are only
+	// ever added and live as long as the object
+	CSqlServer *m_apSqlWriteServers[MAX_SQLSERVERS];
+	SEMAPHORE m_Semaphore;
+
+	// guarded by m_Lock
+	std::vector<CRequest *> m_Requests;
+	std::vector<CRequest *> m_Results;
+	std::map<std::string, CGameContext::AccountInfo> m_PendingSaves;
+	bool m_Busy;
+	bool m_Shutdown;
+	bool m_Finished;
+	// accounts still marked as logged in by an earlier run on this port
+	bool m_ResetLogins;
+
+	// workers still making their last try, only touched by the game thread
+	static std::vector<CAccountSql *> ms_apRetired;
+	static void ReapRetired(bool Wait);
+
+	void UpdateServers();
+	static void WorkerThread(void *pUser);
+	static bool ResetLogins(CSqlServer *pSqlServer);
+	static bool SaveBatch(CSqlServer *pSqlServer, std::map<std::string, CGameContext::AccountInfo> &Batch);
+	static bool HandleRequest(CSqlServer *pSqlServer, CRequest *pRequest);
+};
+
+#endif // GAME_SERVER_ACCOUNTSQL_H
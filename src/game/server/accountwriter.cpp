@@ -0,0 +1,118 @@
+#include "accountwriter.h"
+
+CAccountWriter::CAccountWriter()
+{
+	m_Lock = lock_create();
+	sphore_init(&m_Semaphore);
+	sphore_init(&m_FlushSemaphore);
+	m_Writing = false;
+	m_Flushing = false;
+	m_Shutdown = false;
+	m_pThread = thread_init(WriterThread, this);
+}
+
+CAccountWriter::~CAccountWriter()
+{
+	Flush();
+
+	lock_wait(m_Lock);
+	m_Shutdown = true;
+	lock_unlock(m_Lock);
+	sphore_signal(&m_Semaphore);
+	thread_wait(m_pThread);
+
+	lock_destroy(m_Lock);
+	sphore_destroy(&m_Semaphore);
+	sphore_destroy(&m_FlushSemaphore);
+}
+
+void CAccountWriter::Queue(const char *pFilename, const std::string &Data)
+{
+	lock_wait(m_Lock);
+	m_Pending[pFilename] = Data;
+	lock_unlock(m_Lock);
+	sphore_signal(&m_Semaphore);
+}
+
+void CAccountWriter::GetFailed(std::vector<std::string> *pFilenames)
+{
+	lock_wait(m_Lock);
+	pFilenames->insert(pFilenames->end(), m_Failed.begin(), m_Failed.end());
+	m_Failed.clear();
+	lock_unlock(m_Lock);
+}
+
+void CAccountWriter::Flush()
+{
+	lock_wait(m_Lock);
+	bool Done = m_Pending.empty() && !m_Writing;
+	m_Flushing = !Done;
+	lock_unlock(m_Lock);
+
+	// the writer thread signals once it ran out of work
+	if(!Done)
+		sphore_wait(&m_FlushSemaphore);
+}
+
+bool CAccountWriter::WriteFile(const char *pFilename, const std::string &Data)
+{
+	char aTmp[512];
+	str_format(aTmp, sizeof(aTmp), "%s.tmp", pFilename);
+
+	IOHANDLE File = io_open(aTmp, IOFLAG_WRITE);
+	if(!File)
+		return false;
+
+	bool Success = io_write(File, Data.c_str(), Data.size()) == Data.size();
+	io_close(File);
+
+	if(!Success || fs_rename(aTmp, pFilename) != 0)
+	{
+		fs_remove(aTmp);
+		return false;
+	}
+	return true;
+}
+
+void CAccountWriter::WriterThread(void *pUser)
+{
+	CAccountWriter *pSelf = (CAccountWriter *)pUser;
+
+	while(true)
+	{
+		sphore_wait(&pSelf->m_Semaphore);
+
+		std::map<std::string, std::string> Batch;
+		lock_wait(pSelf->m_Lock);
+		if(pSelf->m_Pending.empty() && pSelf->m_Shutdown)
+		{
+			lock_unlock(pSelf->m_Lock);
+			break;
+		}
+		Batch.swap(pSelf->m_Pending);
+		pSelf->m_Writing = !Batch.empty();
+		lock_unlock(pSelf->m_Lock);
+
+		std::vector<std::string> Failed;
+		for(std::map<std::string, std::string>::const_iterator it = Batch.begin(); it != Batch.end(); ++it)
+		{
+			if(WriteFile(it->first.c_str(), it->second))
+				dbg_msg("acc", "saved acc file '%s'", it->first.c_str());
+			else
+			{
+				dbg_msg("acc", "failed to write acc file '%s'", it->first.c_str());
+				Failed.push_back(it->first);
+			}
+		}
+
+		lock_wait(pSelf->m_Lock);
+		pSelf->m_Failed.insert(pSelf->m_Failed.end(), Failed.begin(), Failed.end());
+		pSelf->m_Writing = false;
+		bool Flushed = pSelf->m_Flushing && pSelf->m_Pending.empty();
+		if(Flushed)
+			pSelf->m_Flushing = false;
+		lock_unlock(pSelf->m_Lock);
+		if(Flushed)
+			sphore_signal(&pSelf->m_FlushSemaphore);
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef GAME_SERVER_ACCOUNTWRITER_H
+#define GAME_SERVER_ACCOUNTWRITER_H
+
+#include <base/system.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Writes account files on a background thread. Queued writes to the same
+// file are coalesced, so only the newest content of a file hits the disk.
+// Every file is written to a temporary file first and then renamed over the
+// old one, so a crash never leaves a half-written account behind.
+class CAccountWriter
+{
+	void *m_pThread;
+	LOCK m_Lock;
+	SEMAPHORE m_Semaphore;
+	SEMAPHORE m_FlushSemaphore;
+
+	// filename -> content, guarded by m_Lock
+	std::map<std::string, std::string> m_Pending;
+	std::vector<std::string> m_Failed;
+	bool m_Writing;
+	bool m_Flushing;
+	bool m_Shutdown;
+
+	static void WriterThread(void *pUser);
+	static bool WriteFile(const char *pFilename, const std::string &Data);
+
+public:
+	CAccountWriter();
+	~CAccountWriter();
+
+	void Queue(const char *pFilename, const std::string &Data);
+
+	// moves the names of the files that couldn't be written to pFilenames
+	void GetFailed(std::vector<std::string> *pFilenames);
+
+	// blocks until all queued writes have been written to disk
+	void Flush();
+};
+
+#endif // GAME_SERVER_ACCOUNTWRITER_H
@@ -7,6 +7,7 @@
 #include <game/server/gamemodes/DDRace.h>
 #include <game/version.h>
 #if defined(CONF_SQL)
+#include <game/server/accountsql.h>
 #include <game/server/score/sql_score.h>
 #endif
 
@@ -1286,6 +1287,12 @@ void CGameContext::ConRegister(IConsole::IResult * pResult, void * pUserData)
 		return;
 	}
 
+	if (pSelf->m_apAccountJobs[pResult->m_ClientID])
+	{
+		pSelf->SendChatTarget(pResult->m_ClientID, "Please wait, your last account request is still being processed");
+		return;
+	}
+
 	char aUsername[32];
 	char aPassword[32];
 	char aPassword2[32];
@@ -1339,20 +1346,16 @@ void CGameContext::ConRegister(IConsole::IResult * pResult, void * pUserData)
 		return;
 	}
 
-	for (unsigned int i = 1; i < pSelf->m_Accounts.size(); i++)
-		if (!str_comp_nocase(pSelf->m_Accounts[i].m_Username, aUsername))
-		{
-			pSelf->SendChatTarget(pResult->m_ClientID, "Username already exsists");
-			return;
-		}
-
-	int ID = pSelf->AddAccount();
-	str_copy(pSelf->m_Accounts[ID].m_Password, aPassword, sizeof(pSelf->m_Accounts[ID].m_Password));
-	str_copy(pSelf->m_Accounts[ID].m_Username, aUsername, sizeof(pSelf->m_Accounts[ID].m_Username));
-	pSelf->WriteAccountStats(ID);
+	if (pSelf->GetAccount(aUsername))
+	{
+		pSelf->SendChatTarget(pResult->m_ClientID, "Username already exsists");
+		return;
+	}
 
-	pSelf->SendChatTarget(pResult->m_ClientID, "Successfully registered an account, you can login now");
-	dbg_msg("acc", "account created, file '%s/%s.acc'", g_Config.m_SvAccFilePath, aUsername);
+	// the account is created once the password is hashed, see OnAccountJobDone()
+	std::shared_ptr<CAccountPasswordJob> pJob = std::make_shared<CAccountPasswordJob>(aPassword, "", g_Config.m_SvAccHashRounds);
+	str_copy(pJob->m_aUsername, aUsername, sizeof(pJob->m_aUsername));
+	pSelf->AddAccountJob(pResult->m_ClientID, pJob);
 }
 
 void CGameContext::ConLogin(IConsole::IResult * pResult, void * pUserData)
@@ -1383,14 +1386,24 @@ void CGameContext::ConLogin(IConsole::IResult * pResult, void * pUserData)
 		return;
 	}
 
-	int ID = 0;
-	for (unsigned int i = 1; i < pSelf->m_Accounts.size(); i++)
-		if (!str_comp_nocase(pSelf->m_Accounts[i].m_Username, aUsername))
-		{
-			ID = i;
-			break;
-		}
+	if (pSelf->m_apAccountJobs[pResult->m_ClientID])
+	{
+		pSelf->SendChatTarget(pResult->m_ClientID, "Please wait, your last account request is still being processed");
+		return;
+	}
+
+#if defined(CONF_SQL)
+	if (pSelf->m_pAccountSql)
+	{
+		// the password is verified once the account is loaded, see HandleAccountSqlResults()
+		std::shared_ptr<CAccountPasswordJob> pJob = std::make_shared<CAccountPasswordJob>(aPassword, "", g_Config.m_SvAccHashRounds);
+		pSelf->m_apAccountJobs[pResult->m_ClientID] = pJob;
+		pSelf->m_pAccountSql->Load(pResult->m_ClientID, aUsername, pJob);
+		return;
+	}
+#endif
 
+	int ID = pSelf->GetAccount(aUsername);
 	if (ID == 0)
 	{
 		pSelf->SendChatTarget(pResult->m_ClientID, "That account doesnt exist, please register first");
@@ -1409,18 +1422,10 @@ void CGameContext::ConLogin(IConsole::IResult * pResult, void * pUserData)
 		return;
 	}
 
-	if (str_comp(pSelf->m_Accounts[ID].m_Password, aPassword))
-	{
-		pSelf->SendChatTarget(pResult->m_ClientID, "Wrong password");
-		return;
-	}
-
-	pSelf->m_Accounts[ID].m_Port = g_Config.m_SvPort;
-	pSelf->m_Accounts[ID].m_LoggedIn = true;
-	pSelf->m_Accounts[ID].m_ClientID = pResult->m_ClientID;
-	pSelf->WriteAccountStats(ID);
-
-	pSelf->SendChatTarget(pResult->m_ClientID, "Successfully logged in");
+	// the login completes once the password is verified, see OnAccountJobDone()
+	std::shared_ptr<CAccountPasswordJob> pJob = std::make_shared<CAccountPasswordJob>(aPassword, pSelf->m_Accounts[ID].m_Password, g_Config.m_SvAccHashRounds);
+	pJob->m_AccID = ID;
+	pSelf->AddAccountJob(pResult->m_ClientID, pJob);
 }
 
 void CGameContext::ConLogout(IConsole::IResult * pResult, void * pUserData)
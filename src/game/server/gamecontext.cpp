@@ -11,6 +11,7 @@
 #include <engine/server/server.h>
 #include <engine/shared/datafile.h>
 #include <engine/shared/linereader.h>
+#include <engine/shared/zframes.h>
 #include <engine/storage.h>
 #include "gamecontext.h"
 #include <game/version.h>
@@ -21,11 +22,14 @@
 #include "score.h"
 #include "score/file_score.h"
 #if defined(CONF_SQL)
+#include "accountsql.h"
 #include "score/sql_score.h"
 #endif
+#include <atomic>
 #include <fstream>
 #include <limits>
 #include <string>
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -58,8 +62,12 @@ void CGameContext::Construct(int Resetting)
 		m_NumVoteMutes = 0;
 	}
 	m_ChatResponseTargetID = -1;
-	m_aDeleteTempfile[0] = 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		m_aClientAccID[i] = 0;
+	m_pAccountSql = 0;
 	m_TeeHistorianActive = false;
+	m_pTeeHistorianCompressor = 0;
+	m_pTeeHistorianIndexFile = 0;
 }
 
 CGameContext::CGameContext(int Resetting)
@@ -81,6 +89,11 @@ CGameContext::~CGameContext()
 
 	if(m_pScore)
 		delete m_pScore;
+#if defined(CONF_SQL)
+	// normally already done by OnShutdown()
+	if(!m_Resetting && m_pAccountSql)
+		m_pAccountSql->Shutdown(3 * time_freq(), true);
+#endif
 }
 
 void CGameContext::Clear()
@@ -90,6 +103,7 @@ void CGameContext::Clear()
 	CVoteOptionServer *pVoteOptionLast = m_pVoteOptionLast;
 	int NumVoteOptions = m_NumVoteOptions;
 	CTuningParams Tuning = m_Tuning;
+	class CAccountSql *pAccountSql = m_pAccountSql;
 
 	m_Resetting = true;
 	this->~CGameContext();
@@ -101,6 +115,7 @@ void CGameContext::Clear()
 	m_pVoteOptionLast = pVoteOptionLast;
 	m_NumVoteOptions = NumVoteOptions;
 	m_Tuning = Tuning;
+	m_pAccountSql = pAccountSql;
 }
 
 
@@ -110,6 +125,12 @@ void CGameContext::TeeHistorianWrite(const void *pData, int DataSize, void *pUse
 	aio_write(pSelf->m_pTeeHistorianFile, pData, DataSize);
 }
 
+void CGameContext::TeeHistorianIndexWrite(const void *pData, int DataSize, void *pUser)
+{
+	CGameContext *pSelf = (CGameContext *)pUser;
+	aio_write(pSelf->m_pTeeHistorianIndexFile, pData, DataSize);
+}
+
 void CGameContext::CommandCallback(int ClientID, int FlagMask, const char *pCmd, IConsole::IResult *pResult, void *pUser)
 {
 	CGameContext *pSelf = (CGameContext *)pUser;
@@ -934,9 +955,15 @@ void CGameContext::OnTick()
 			}
 		}
 
-	if (Server()->Tick() % 100000 == 0) // save all accounts every ~ 30 minutes
-		for (unsigned int i = 1; i < m_Accounts.size(); i++)
-			Logout(i);
+	for (int i = 0; i < MAX_CLIENTS; i++)
+		if (m_apAccountJobs[i] && m_apAccountJobs[i]->Status() == IJob::STATE_DONE && !m_apAccountJobs[i]->m_WaitingForDatabase)
+			OnAccountJobDone(i);
+	HandleAccountSqlResults();
+	HandleAccountWriteFailures();
+	Score()->OnTick();
+
+	if (Server()->Tick() % 100000 == 0) // save all changed accounts every ~ 30 minutes
+		SaveAccounts();
 
 #ifdef CONF_DEBUG
 	if(g_Config.m_DbgDummies)
@@ -1154,6 +1181,10 @@ void CGameContext::OnClientDrop(int ClientID, const char *pReason)
 {
 	if (m_apPlayers[ClientID]->GetAccID() > 0)
 		Logout(m_apPlayers[ClientID]->GetAccID());
+	// a login that is still verifying the password
+	if (m_apAccountJobs[ClientID] && m_apAccountJobs[ClientID]->m_AccID)
+		ReleaseAccount(m_apAccountJobs[ClientID]->m_AccID);
+	m_apAccountJobs[ClientID] = nullptr;
 	AbortVoteKickOnDisconnect(ClientID);
 	m_apPlayers[ClientID]->OnDisconnect(pReason);
 	delete m_apPlayers[ClientID];
@@ -2677,8 +2708,6 @@ void CGameContext::OnInit()
 	m_GameUuid = RandomUuid();
 	Console()->SetTeeHistorianCommandCallback(CommandCallback, this);
 
-	DeleteTempfile();
-
 	for(int i = 0; i < NUM_NETOBJTYPES; i++)
 		Server()->SnapSetStaticsize(i, m_NetObjHandler.GetObjSize(i));
 
@@ -2777,8 +2806,8 @@ void CGameContext::OnInit()
 		char aGameUuid[UUID_MAXSTRSIZE];
 		FormatUuid(m_GameUuid, aGameUuid, sizeof(aGameUuid));
 
-		char aFilename[64];
-		str_format(aFilename, sizeof(aFilename), "teehistorian/%s.teehistorian", aGameUuid);
+		char aFilename[128];
+		str_format(aFilename, sizeof(aFilename), "teehistorian/%s.teehistorian%s", aGameUuid, g_Config.m_SvTeeHistorianCompression ? ".z" : "");
 
 		IOHANDLE File = Storage()->OpenFile(aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
 		if(!File)
@@ -2791,7 +2820,13 @@ void CGameContext::OnInit()
 		{
 			dbg_msg("teehistorian", "recording to '%s'", aFilename);
 		}
-		m_pTeeHistorianFile = aio_new(File);
+		if(g_Config.m_SvTeeHistorianCompression)
+		{
+			m_pTeeHistorianCompressor = new CZFrameWriter(g_Config.m_SvTeeHistorianCompression, 5);
+			m_pTeeHistorianFile = aio_new_filter(File, CZFrameWriter::AioFilter, m_pTeeHistorianCompressor);
+		}
+		else
+			m_pTeeHistorianFile = aio_new(File);
 
 		char aVersion[128];
 		str_format(aVersion, sizeof(aVersion), "%s", GAME_VERSION);
@@ -2816,6 +2851,22 @@ void CGameContext::OnInit()
 
 		m_TeeHistorian.Reset(&GameInfo, TeeHistorianWrite, this);
 
+		if(g_Config.m_SvTeeHistorianIndex)
+		{
+			// offsets in the index refer to the uncompressed data
+			str_format(aFilename, sizeof(aFilename), "teehistorian/%s.teehistorian.index", aGameUuid);
+			IOHANDLE IndexFile = Storage()->OpenFile(aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+			if(IndexFile)
+			{
+				m_pTeeHistorianIndexFile = aio_new(IndexFile);
+				m_TeeHistorian.EnableIndex(TeeHistorianIndexWrite, this, g_Config.m_SvTeeHistorianIndex * Server()->TickSpeed());
+			}
+			else
+			{
+				dbg_msg("teehistorian", "failed to open '%s', recording without index", aFilename);
+			}
+		}
+
 		for(int i = 0; i < MAX_CLIENTS; i++)
 		{
 			int Level = Server()->GetAuthedState(i);
@@ -2965,25 +3016,34 @@ void CGameContext::OnInit()
 	}
 #endif
 
-	AddAccount();
-	Storage()->ListDirectory(IStorage::TYPE_ALL, g_Config.m_SvAccFilePath, AccountsListdirCallback, this);
-}
-
-void CGameContext::DeleteTempfile()
-{
-	if(m_aDeleteTempfile[0] != 0)
+	AddAccount("");
+#if defined(CONF_SQL)
+	// accounts are loaded from the database when someone logs in, the
+	// database connection is kept over map changes
+	if(!g_Config.m_SvAccSql && m_pAccountSql)
+	{
+		m_pAccountSql->Shutdown(0, false);
+		m_pAccountSql = 0;
+	}
+	if(g_Config.m_SvAccSql)
 	{
-		Storage()->RemoveFile(m_aDeleteTempfile, IStorage::TYPE_SAVE);
-		m_aDeleteTempfile[0] = 0;
+		if(!m_pAccountSql)
+			m_pAccountSql = new CAccountSql();
 	}
+	else
+#endif
+		Storage()->ListDirectory(IStorage::TYPE_ALL, g_Config.m_SvAccFilePath, AccountsListdirCallback, this);
 }
 
-void CGameContext::OnMapChange(char *pNewMapName, int MapNameSize)
+void CGameContext::OnMapChange(const char *pMapName, char *pNewMapName, int MapNameSize)
 {
+	// an abandoned preload of the same map may still be writing its file
+	static std::atomic<int> s_TempCount(0);
+
 	char aConfig[128];
 	char aTemp[128];
-	str_format(aConfig, sizeof(aConfig), "maps/%s.cfg", g_Config.m_SvMap);
-	str_format(aTemp, sizeof(aTemp), "%s.temp.%d", pNewMapName, pid());
+	str_format(aConfig, sizeof(aConfig), "maps/%s.cfg", pMapName);
+	str_format(aTemp, sizeof(aTemp), "%s.temp.%d.%d", pNewMapName, pid(), s_TempCount++);
 
 	IOHANDLE File = Storage()->OpenFile(aConfig, IOFLAG_READ, IStorage::TYPE_ALL);
 	if(!File)
@@ -3018,7 +3078,7 @@ void CGameContext::OnMapChange(char *pNewMapName, int MapNameSize)
 	}
 
 	CDataFileReader Reader;
-	Reader.Open(Storage(), pNewMapName, IStorage::TYPE_ALL);
+	Reader.Open(Storage(), pNewMapName, IStorage::TYPE_ALL, false);
 
 	CDataFileWriter Writer;
 	Writer.Init();
@@ -3046,6 +3106,7 @@ void CGameContext::OnMapChange(char *pNewMapName, int MapNameSize)
 					if(DataSize == TotalLength && mem_comp(pSettings, pMapSettings, DataSize) == 0)
 					{
 						// Configs coincide, no need to update map.
+						free(pSettings);
 						return;
 					}
 					Reader.UnloadData(pInfo->m_Settings);
@@ -3098,9 +3159,9 @@ void CGameContext::OnMapChange(char *pNewMapName, int MapNameSize)
 	Reader.Close();
 	Writer.OpenFile(Storage(), aTemp);
 	Writer.Finish();
+	free(pSettings);
 
 	str_copy(pNewMapName, aTemp, MapNameSize);
-	str_copy(m_aDeleteTempfile, aTemp, sizeof(m_aDeleteTempfile));
 }
 
 void CGameContext::OnShutdown(bool FullShutdown)
@@ -3120,12 +3181,41 @@ void CGameContext::OnShutdown(bool FullShutdown)
 			Server()->SetErrorShutdown("teehistorian close error");
 		}
 		aio_free(m_pTeeHistorianFile);
+		delete m_pTeeHistorianCompressor;
+		m_pTeeHistorianCompressor = 0;
+
+		if(m_pTeeHistorianIndexFile)
+		{
+			// a broken index only makes seeking impossible
+			aio_close(m_pTeeHistorianIndexFile);
+			aio_wait(m_pTeeHistorianIndexFile);
+			if(aio_error(m_pTeeHistorianIndexFile))
+			{
+				dbg_msg("teehistorian", "error closing index file, err=%d", aio_error(m_pTeeHistorianIndexFile));
+			}
+			aio_free(m_pTeeHistorianIndexFile);
+			m_pTeeHistorianIndexFile = 0;
+		}
 	}
 
 	for (unsigned int i = 1; i < m_Accounts.size(); i++)
 		Logout(i);
+	for (int i = 0; i < MAX_CLIENTS; i++)
+		if (m_apAccountJobs[i] && m_apAccountJobs[i]->m_AccID)
+			ReleaseAccount(m_apAccountJobs[i]->m_AccID);
+	m_AccountWriter.Flush();
+#if defined(CONF_SQL)
+	// gets a few seconds to write the last saves, the server removes the
+	// sql servers right after this
+	if (FullShutdown)
+	{
+		if (m_pAccountSql)
+			m_pAccountSql->Shutdown(3 * time_freq(), true);
+		m_pAccountSql = 0;
+		CAccountSql::WaitRetired();
+	}
+#endif
 
-	DeleteTempfile();
 	Console()->ResetServerGameSettings();
 	Collision()->Dest();
 	delete m_pController;
@@ -3677,7 +3767,7 @@ int CGameContext::AccountsListdirCallback(const char *pName, int IsDir, int Stor
 		char aUsername[32];
 		str_copy(aUsername, pName, str_length(pName) - 3);
 
-		int ID = pSelf->AddAccount();
+		int ID = pSelf->AddAccount(aUsername);
 		pSelf->ReadAccountStats(ID, aUsername);
 
 		std::string data;
@@ -3703,7 +3793,15 @@ int CGameContext::AccountsListdirCallback(const char *pName, int IsDir, int Stor
 	return 0;
 }
 
-int CGameContext::AddAccount()
+static std::string AccountKey(const char *pUsername)
+{
+	std::string Key(pUsername);
+	for (unsigned int i = 0; i < Key.size(); i++)
+		Key[i] = tolower((unsigned char)Key[i]);
+	return Key;
+}
+
+int CGameContext::AddAccount(const char *pUsername)
 {
 	m_Accounts.push_back(AccountInfo());
 
@@ -3712,7 +3810,7 @@ int CGameContext::AddAccount()
 	m_Accounts[ID].m_LoggedIn = 0;
 	m_Accounts[ID].m_Disabled = 0;
 	m_Accounts[ID].m_Password[0] = 0;
-	m_Accounts[ID].m_Username[0] = 0;
+	str_copy(m_Accounts[ID].m_Username, pUsername, sizeof(m_Accounts[ID].m_Username));
 	m_Accounts[ID].m_ClientID = -1;
 	m_Accounts[ID].m_Level = 0;
 	m_Accounts[ID].m_XP = 0;
@@ -3724,13 +3822,40 @@ int CGameContext::AddAccount()
 		m_Accounts[ID].m_aHasItem[i] = false;
 	m_Accounts[ID].m_PoliceLevel = 0;
 
+	if (pUsername[0])
+		m_AccountsByName[AccountKey(pUsername)] = ID;
+
 	return ID;
 }
 
+int CGameContext::GetAccount(const char *pUsername)
+{
+	std::unordered_map<std::string, int>::const_iterator it = m_AccountsByName.find(AccountKey(pUsername));
+	return it == m_AccountsByName.end() ? 0 : it->second;
+}
+
+void CGameContext::Login(int ID, int ClientID)
+{
+	m_Accounts[ID].m_Port = g_Config.m_SvPort;
+	m_Accounts[ID].m_LoggedIn = true;
+	m_Accounts[ID].m_ClientID = ClientID;
+	m_aClientAccID[ClientID] = ID;
+	WriteAccountStats(ID);
+}
+
+void CGameContext::ReleaseAccount(int ID)
+{
+#if defined(CONF_SQL)
+	// the saved state isn't logged in, written even if nothing else changed
+	if (m_pAccountSql && !m_Accounts[ID].m_LoggedIn)
+		m_pAccountSql->Save(m_Accounts[ID]);
+#endif
+}
+
 void CGameContext::ReadAccountStats(int ID, char *pName)
 {
 	std::string data;
-	char aData[32];
+	char aData[ACCOUNT_PASSWORD_MAXSTRSIZE];
 	char aBuf[128];
 	str_format(aBuf, sizeof(aBuf), "%s/%s.acc", g_Config.m_SvAccFilePath, pName);
 	std::fstream AccFile(aBuf);
@@ -3752,6 +3877,7 @@ void CGameContext::ReadAccountStats(int ID, char *pName)
 	str_copy(m_Accounts[ID].m_Password, aData, sizeof(m_Accounts[ID].m_Password));
 
 	getline(AccFile, data);
+	str_copy(aData, data.c_str(), sizeof(aData));
 	str_copy(m_Accounts[ID].m_Username, aData, sizeof(m_Accounts[ID].m_Username));
 
 	getline(AccFile, data);
@@ -3792,42 +3918,252 @@ void CGameContext::ReadAccountStats(int ID, char *pName)
 	getline(AccFile, data);
 	str_copy(aData, data.c_str(), sizeof(aData));
 	m_Accounts[ID].m_PoliceLevel = atoi(aData);
+
+	// what we just read is what is on disk, only write it again once it changed
+	FormatAccountStats(ID, &m_Accounts[ID].m_LastSaved);
+}
+
+void CGameContext::FormatAccountStats(int ID, std::string *pOut)
+{
+	AccountInfo *pAccount = &m_Accounts[ID];
+	char aBuf[512];
+
+	str_format(aBuf, sizeof(aBuf), "%d\n%d\n%d\n%s\n%s\n%d\n%d\n%d\n%d\n%d\n%d\n%d\n",
+		g_Config.m_SvPort, pAccount->m_LoggedIn, pAccount->m_Disabled, pAccount->m_Password, pAccount->m_Username,
+		pAccount->m_ClientID, pAccount->m_Level, pAccount->m_XP, pAccount->m_NeededXP, pAccount->m_Money,
+		pAccount->m_Kills, pAccount->m_Deaths);
+	*pOut = aBuf;
+
+	for (int i = 0; i < NUM_ITEMS; i++)
+	{
+		str_format(aBuf, sizeof(aBuf), "%d\n", pAccount->m_aHasItem[i]);
+		*pOut += aBuf;
+	}
+
+	str_format(aBuf, sizeof(aBuf), "%d\n", pAccount->m_PoliceLevel);
+	*pOut += aBuf;
 }
 
 void CGameContext::WriteAccountStats(int ID)
 {
-	std::string data;
+	std::string Data;
+	FormatAccountStats(ID, &Data);
+
+	// unchanged accounts don't need to be written again. Failed file writes
+	// clear this again, see HandleAccountWriteFailures(), the database
+	// retries failed saves itself
+	if (Data == m_Accounts[ID].m_LastSaved)
+		return;
+	m_Accounts[ID].m_LastSaved = Data;
+
+#if defined(CONF_SQL)
+	if (m_pAccountSql)
+	{
+		m_pAccountSql->Save(m_Accounts[ID]);
+		return;
+	}
+#endif
+
 	char aBuf[128];
 	str_format(aBuf, sizeof(aBuf), "%s/%s.acc", g_Config.m_SvAccFilePath, m_Accounts[ID].m_Username);
-	std::ofstream AccFile(aBuf);
+	m_AccountWriter.Queue(aBuf, Data);
+}
 
-	if (AccFile.is_open())
+void CGameContext::HandleAccountWriteFailures()
+{
+	std::vector<std::string> Failed;
+	m_AccountWriter.GetFailed(&Failed);
+	for (unsigned int i = 0; i < Failed.size(); i++)
 	{
-		AccFile << g_Config.m_SvPort << "\n";
-		AccFile << m_Accounts[ID].m_LoggedIn << "\n";
-		AccFile << m_Accounts[ID].m_Disabled << "\n";
-		AccFile << m_Accounts[ID].m_Password << "\n";
-		AccFile << m_Accounts[ID].m_Username << "\n";
-		AccFile << m_Accounts[ID].m_ClientID << "\n";
-		AccFile << m_Accounts[ID].m_Level << "\n";
-		AccFile << m_Accounts[ID].m_XP << "\n";
-		AccFile << m_Accounts[ID].m_NeededXP << "\n";
-		AccFile << m_Accounts[ID].m_Money << "\n";
-		AccFile << m_Accounts[ID].m_Kills << "\n";
-		AccFile << m_Accounts[ID].m_Deaths << "\n";
-		for (int i = 0; i < NUM_ITEMS; i++)
-			AccFile << m_Accounts[ID].m_aHasItem[i] << "\n";
-		AccFile << m_Accounts[ID].m_PoliceLevel << "\n";
+		for (unsigned int ID = 1; ID < m_Accounts.size(); ID++)
+		{
+			char aBuf[128];
+			str_format(aBuf, sizeof(aBuf), "%s/%s.acc", g_Config.m_SvAccFilePath, m_Accounts[ID].m_Username);
+			if (Failed[i] == aBuf)
+			{
+				// written again with the next save
+				m_Accounts[ID].m_LastSaved.clear();
+				break;
+			}
+		}
+	}
+}
+
+void CGameContext::SaveAccounts()
+{
+	for (unsigned int i = 1; i < m_Accounts.size(); i++)
+		WriteAccountStats(i);
+}
+
+void CGameContext::AddAccountJob(int ClientID, std::shared_ptr<CAccountPasswordJob> pJob)
+{
+	m_apAccountJobs[ClientID] = pJob;
+	m_pEngine->AddJob(pJob);
+}
+
+void CGameContext::OnAccountJobDone(int ClientID)
+{
+	std::shared_ptr<CAccountPasswordJob> pJob = m_apAccountJobs[ClientID];
+	m_apAccountJobs[ClientID] = nullptr;
+
+	if (!pJob->m_AccID)
+	{
+#if defined(CONF_SQL)
+		if (m_pAccountSql)
+		{
+			// the database decides whether the name is still free, see HandleAccountSqlResults()
+			pJob->m_WaitingForDatabase = true;
+			m_apAccountJobs[ClientID] = pJob;
+			m_pAccountSql->Register(ClientID, pJob->m_aUsername, pJob->m_aNewHash, pJob);
+			return;
+		}
+#endif
 
-		dbg_msg("acc", "saved acc '%s'", m_Accounts[ID].m_Username);
+		// someone else might have taken the name while the password was hashed
+		if (GetAccount(pJob->m_aUsername))
+		{
+			SendChatTarget(ClientID, "Username already exsists");
+			return;
+		}
+
+		int ID = AddAccount(pJob->m_aUsername);
+		str_copy(m_Accounts[ID].m_Password, pJob->m_aNewHash, sizeof(m_Accounts[ID].m_Password));
+		WriteAccountStats(ID);
+
+		SendChatTarget(ClientID, "Successfully registered an account, you can login now");
+		dbg_msg("acc", "account created, file '%s/%s.acc'", g_Config.m_SvAccFilePath, pJob->m_aUsername);
+		return;
+	}
+
+	int ID = pJob->m_AccID;
+	if (GetAccID(ClientID) > 0)
+	{
+		SendChatTarget(ClientID, "You are already logged in");
+		ReleaseAccount(ID);
+		return;
 	}
-	AccFile.close();
+
+	if (m_Accounts[ID].m_LoggedIn)
+	{
+		SendChatTarget(ClientID, "This account is already logged in");
+		return;
+	}
+
+	if (!pJob->m_Match)
+	{
+		SendChatTarget(ClientID, "Wrong password");
+		ReleaseAccount(ID);
+		return;
+	}
+
+	// upgrade cleartext passwords and hashes with an outdated cost
+	if (pJob->m_aNewHash[0])
+		str_copy(m_Accounts[ID].m_Password, pJob->m_aNewHash, sizeof(m_Accounts[ID].m_Password));
+
+	Login(ID, ClientID);
+
+	SendChatTarget(ClientID, "Successfully logged in");
+}
+
+void CGameContext::HandleAccountSqlResults()
+{
+#if defined(CONF_SQL)
+	if (!m_pAccountSql)
+		return;
+
+	std::vector<CAccountSql::CRequest *> Results;
+	m_pAccountSql->GetResults(&Results);
+	for (unsigned int i = 0; i < Results.size(); i++)
+	{
+		CAccountSql::CRequest *pRequest = Results[i];
+		int ClientID = pRequest->m_ClientID;
+
+		int ID = 0;
+		if (pRequest->m_Claimed && pRequest->m_Success)
+		{
+			ID = GetAccount(pRequest->m_aUsername);
+			if (!ID)
+				ID = AddAccount(pRequest->m_Account.m_Username);
+
+			// accounts in use on this server are newer than what the database knows
+			if (!m_Accounts[ID].m_LoggedIn)
+			{
+				AccountInfo *pAccount = &m_Accounts[ID];
+				*pAccount = pRequest->m_Account;
+				// the claim only becomes a login once the password is verified
+				pAccount->m_LoggedIn = false;
+				pAccount->m_ClientID = -1;
+				FormatAccountStats(ID, &pAccount->m_LastSaved);
+			}
+		}
+		else if (pRequest->m_Claimed)
+			dbg_msg("acc", "account '%s' stays claimed until the next start, it couldn't be loaded", pRequest->m_aUsername);
+
+		// the player left in the meantime
+		if (m_apAccountJobs[ClientID] != pRequest->m_pJob)
+		{
+			if (ID)
+				ReleaseAccount(ID);
+			delete pRequest;
+			continue;
+		}
+
+		if (pRequest->m_Error)
+		{
+			m_apAccountJobs[ClientID] = nullptr;
+			SendChatTarget(ClientID, "The account database is unavailable, please try again later");
+		}
+		else if (pRequest->m_Type == CAccountSql::REQUEST_REGISTER)
+		{
+			m_apAccountJobs[ClientID] = nullptr;
+			if (pRequest->m_Success)
+			{
+				SendChatTarget(ClientID, "Successfully registered an account, you can login now");
+				dbg_msg("acc", "account created in database, name '%s'", pRequest->m_aUsername);
+			}
+			else
+				SendChatTarget(ClientID, "Username already exsists");
+		}
+		else if (!pRequest->m_Success)
+		{
+			m_apAccountJobs[ClientID] = nullptr;
+			SendChatTarget(ClientID, "That account doesnt exist, please register first");
+		}
+		else if (!ID || m_Accounts[ID].m_LoggedIn)
+		{
+			// claimed by another server or by another player of this one
+			m_apAccountJobs[ClientID] = nullptr;
+			SendChatTarget(ClientID, "This account is already logged in");
+		}
+		else if (m_Accounts[ID].m_Disabled)
+		{
+			m_apAccountJobs[ClientID] = nullptr;
+			SendChatTarget(ClientID, "This account is disabled");
+			ReleaseAccount(ID);
+		}
+		else
+		{
+			// now that the account is loaded, verify the password
+			std::shared_ptr<CAccountPasswordJob> pJob = m_apAccountJobs[ClientID];
+			pJob->m_AccID = ID;
+			str_copy(pJob->m_aStored, m_Accounts[ID].m_Password, sizeof(pJob->m_aStored));
+			m_pEngine->AddJob(pJob);
+		}
+
+		delete pRequest;
+	}
+#endif
 }
 
 void CGameContext::Logout(int ID)
 {
-	if (m_Accounts[ID].m_ClientID >= 0)
-		SendChatTarget(m_Accounts[ID].m_ClientID, "Successfully logged out");
+	int ClientID = m_Accounts[ID].m_ClientID;
+	if (ClientID >= 0)
+	{
+		SendChatTarget(ClientID, "Successfully logged out");
+		if (ClientID < MAX_CLIENTS && m_aClientAccID[ClientID] == ID)
+			m_aClientAccID[ClientID] = 0;
+	}
 	m_Accounts[ID].m_LoggedIn = false;
 	m_Accounts[ID].m_ClientID = -1;
 	WriteAccountStats(ID);
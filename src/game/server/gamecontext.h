@@ -11,8 +11,13 @@
 #include <game/mapbugs.h>
 #include <game/voting.h>
 
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "accounthash.h"
+#include "accountwriter.h"
 #include "eventhandler.h"
 #include "gamecontroller.h"
 #include "gameworld.h"
@@ -91,11 +96,15 @@ class CGameContext : public IGameServer
 	bool m_TeeHistorianActive;
 	CTeeHistorian m_TeeHistorian;
 	ASYNCIO *m_pTeeHistorianFile;
+	// compresses on the writer thread of m_pTeeHistorianFile
+	class CZFrameWriter *m_pTeeHistorianCompressor;
+	ASYNCIO *m_pTeeHistorianIndexFile;
 	CUuid m_GameUuid;
 	CMapBugs m_MapBugs;
 
 	static void CommandCallback(int ClientID, int FlagMask, const char *pCmd, IConsole::IResult *pResult, void *pUser);
 	static void TeeHistorianWrite(const void *pData, int DataSize, void *pUser);
+	static void TeeHistorianIndexWrite(const void *pData, int DataSize, void *pUser);
 
 	static void ConTuneParam(IConsole::IResult *pResult, void *pUserData);
 	static void ConToggleTuneParam(IConsole::IResult *pResult, void *pUserData);
@@ -177,8 +186,6 @@ public:
 	char m_aaZoneEnterMsg[NUM_TUNEZONES][256]; // 0 is used for switching from or to area without tunings
 	char m_aaZoneLeaveMsg[NUM_TUNEZONES][256];
 
-	char m_aDeleteTempfile[128];
-	void DeleteTempfile();
 
 	enum
 	{
@@ -233,7 +240,7 @@ public:
 	// engine events
 	virtual void OnInit();
 	virtual void OnConsoleInit();
-	virtual void OnMapChange(char *pNewMapName, int MapNameSize);
+	virtual void OnMapChange(const char *pMapName, char *pNewMapName, int MapNameSize);
 	virtual void OnShutdown(bool FullShutdown = false);
 
 	virtual void OnTick();
@@ -285,16 +292,28 @@ public:
 	**************************************************/
 
 	static int AccountsListdirCallback(const char *pName, int IsDir, int StorageType, void *pUser);
-	int AddAccount();
+	int AddAccount(const char *pUsername);
+	// returns 0 if there is no account with that name
+	int GetAccount(const char *pUsername);
+	int GetAccID(int ClientID) { return m_aClientAccID[ClientID]; }
+	void Login(int ID, int ClientID);
+	// gives up the database claim of a login that didn't go through
+	void ReleaseAccount(int ID);
+	void AddAccountJob(int ClientID, std::shared_ptr<CAccountPasswordJob> pJob);
+	void OnAccountJobDone(int ClientID);
+	void HandleAccountSqlResults();
 	void ReadAccountStats(int ID, char *pName);
+	void FormatAccountStats(int ID, std::string *pOut);
 	void WriteAccountStats(int ID);
+	void HandleAccountWriteFailures();
+	void SaveAccounts();
 	void Logout(int ID);
 	struct AccountInfo
 	{
 		int m_Port;
 		bool m_LoggedIn;
 		bool m_Disabled;
-		char m_Password[32];
+		char m_Password[ACCOUNT_PASSWORD_MAXSTRSIZE];
 		char m_Username[32];
 		int m_ClientID;
 		int m_Level;
@@ -305,8 +324,20 @@ public:
 		int m_Deaths;
 		bool m_aHasItem[NUM_ITEMS];
 		int m_PoliceLevel;
+
+		// content of the .acc file as it was last written or read
+		std::string m_LastSaved;
 	};
 	std::vector<AccountInfo> m_Accounts;
+	// lowercase username -> account ID
+	std::unordered_map<std::string, int> m_AccountsByName;
+	// account ID of each logged in client, 0 if not logged in
+	int m_aClientAccID[MAX_CLIENTS];
+	// pending login or register of each client
+	std::shared_ptr<CAccountPasswordJob> m_apAccountJobs[MAX_CLIENTS];
+	// only set if accounts are stored in the sql database
+	class CAccountSql *m_pAccountSql;
+	CAccountWriter m_AccountWriter;
 
 	void FixMotd();
 	char m_aMotd[900];
@@ -49,12 +49,14 @@ void CGameControllerDDRace::Snap(int SnappingClient)
 	if (!pGameDataObj)
 		return;
 
-	CPlayer* pSnap = GameServer()->m_apPlayers[SnappingClient];
+	// no player for the server demo
+	CPlayer* pSnap = SnappingClient > -1 ? GameServer()->m_apPlayers[SnappingClient] : 0;
+	bool SnapFix = pSnap && (pSnap->m_SnapFixDDNet || pSnap->m_SnapFixVanilla);
 
 	bool FlagPosFix[2];
 	FlagPosFix[TEAM_RED] = false;
 	FlagPosFix[TEAM_BLUE] = false;
-	if (pSnap->m_SnapFixDDNet || pSnap->m_SnapFixVanilla)
+	if (SnapFix)
 		for (int i = 0; i < 2; i++)
 			if (
 				m_apFlags[i]
@@ -69,7 +71,7 @@ void CGameControllerDDRace::Snap(int SnappingClient)
 			pGameDataObj->m_FlagCarrierRed = FLAG_ATSTAND;
 		else if (m_apFlags[TEAM_RED]->GetCarrier() && m_apFlags[TEAM_RED]->GetCarrier()->GetPlayer())
 		{
-			if (!pSnap->m_SnapFixDDNet && !pSnap->m_SnapFixVanilla)
+			if (!SnapFix)
 				pGameDataObj->m_FlagCarrierRed = m_apFlags[TEAM_RED]->GetCarrier()->GetPlayer()->GetCID();
 			else if (FlagPosFix[TEAM_RED])
 				pGameDataObj->m_FlagCarrierRed = 0;
@@ -87,7 +89,7 @@ void CGameControllerDDRace::Snap(int SnappingClient)
 			pGameDataObj->m_FlagCarrierBlue = FLAG_ATSTAND;
 		else if (m_apFlags[TEAM_BLUE]->GetCarrier() && m_apFlags[TEAM_BLUE]->GetCarrier()->GetPlayer())
 		{
-			if (!pSnap->m_SnapFixDDNet && !pSnap->m_SnapFixVanilla)
+			if (!SnapFix)
 				pGameDataObj->m_FlagCarrierBlue = m_apFlags[TEAM_BLUE]->GetCarrier()->GetPlayer()->GetCID();
 			else if (FlagPosFix[TEAM_BLUE])
 				pGameDataObj->m_FlagCarrierBlue = 0;
@@ -330,7 +330,7 @@ void CPlayer::Snap(int SnappingClient)
 	if(!pClientInfo)
 		return;
 
-	CPlayer *pSnapping = GameServer()->m_apPlayers[SnappingClient];
+	CPlayer *pSnapping = SnappingClient > -1 ? GameServer()->m_apPlayers[SnappingClient] : 0;
 
 	StrToInts(&pClientInfo->m_Name0, 4, Server()->ClientName(m_ClientID));
 	pClientInfo->m_Country = Server()->ClientCountry(m_ClientID);
@@ -461,7 +461,7 @@ void CPlayer::Snap(int SnappingClient)
 	// send 0 if times of others are not shown
 	if(SnappingClient != m_ClientID && g_Config.m_SvHideScore)
 		pPlayerInfo->m_Score = -9999;
-	else if (pSnapping->m_DisplayScore != SCORE_TIME) // race time
+	else if (pSnapping && pSnapping->m_DisplayScore != SCORE_TIME) // race time
 	{
 		if (pSnapping->m_DisplayScore == SCORE_LEVEL) // level
 		{
@@ -961,10 +961,7 @@ void CPlayer::FixForNoName(int ID)
 
 int CPlayer::GetAccID()
 {
-	for (unsigned int i = 1; i < GameServer()->m_Accounts.size(); i++)
-		if (GameServer()->m_Accounts[i].m_ClientID == m_ClientID)
-			return i;
-	return 0;
+	return GameServer()->GetAccID(m_ClientID);
 }
 
 void CPlayer::CheckLevel()
@@ -66,6 +66,9 @@ public:
 	virtual void SaveTeam(int Team, const char *pCode, int ClientID, const char *pServer) = 0;
 	virtual void LoadTeam(const char *pCode, int ClientID) = 0;
 
+	// delivers the results of threaded queries
+	virtual void OnTick() {}
+
 	// called when the server is shut down but not on mapchange/reload
 	virtual void OnShutdown() = 0;
 };
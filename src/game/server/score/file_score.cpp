@@ -1,57 +1,30 @@
 /* (c) Shereef Marzouk. See "licence DDRace.txt" and the readme.txt in the root of the distribution for more information. */
 /* Based on Race mod stuff and tweaked by GreYFoX@GTi and others to fit our DDRace needs. */
 /* copyright (c) 2008 rajh and gregwar. Score stuff */
-#include <base/tl/sorted_array.h>
-
+#include <engine/engine.h>
 #include <engine/shared/config.h>
-#include <sstream>
-#include <fstream>
 #include <string.h>
 #include "../gamemodes/DDRace.h"
 #include "file_score.h"
 #include <engine/shared/console.h>
 
-static LOCK gs_ScoreLock = 0;
-
-CFileScore::CPlayerScore::CPlayerScore(const char *pName, float Score,
-		float aCpTime[NUM_CHECKPOINTS])
-{
-	str_copy(m_aName, pName, sizeof(m_aName));
-	m_Score = Score;
-	for (int i = 0; i < NUM_CHECKPOINTS; i++)
-		m_aCpTime[i] = aCpTime[i];
-}
-
 CFileScore::CFileScore(CGameContext *pGameServer) :
 				m_pGameServer(pGameServer), m_pServer(pGameServer->Server())
 {
-	if (gs_ScoreLock == 0)
-		gs_ScoreLock = lock_create();
-
+	m_pLog = 0;
+	m_NumLogRecords = 0;
 	Init();
 }
 
 CFileScore::~CFileScore()
 {
-	lock_wait(gs_ScoreLock);
-
-	// clear list
-	m_Top.clear();
-
-	lock_unlock(gs_ScoreLock);
-}
-
-std::string SaveFile()
-{
-	std::ostringstream oss;
-	char aBuf[256];
-	str_copy(aBuf, g_Config.m_SvMap, sizeof(aBuf));
-	for(int i = 0; i < 256; i++) if(aBuf[i] == '/') aBuf[i] = '-';
-	if (g_Config.m_SvScoreFolder[0])
-		oss << g_Config.m_SvScoreFolder << "/" << aBuf << "_record.dtb";
-	else
-		oss << g_Config.m_SvMap << "_record.dtb";
-	return oss.str();
+	if(m_pCompactJob)
+	{
+		// the next map could start to rewrite the same file
+		sphore_wait(&m_pCompactJob->m_Done);
+		FinishCompaction();
+	}
+	CloseLog();
 }
 
 void CFileScore::MapInfo(int ClientID, const char* MapName)
@@ -64,147 +37,165 @@ void CFileScore::MapVote(int ClientID, const char* MapName)
 	// TODO: implement
 }
 
-void CFileScore::SaveScoreThread(void *pUser)
+CFileScore::CCompactJob::CCompactJob()
 {
-	CFileScore *pSelf = (CFileScore *) pUser;
-	lock_wait(gs_ScoreLock);
-	std::fstream f;
-	f.open(SaveFile().c_str(), std::ios::out);
-	if (f.fail())
-	{
-		dbg_msg("filescore", "opening '%s' for writing failed", SaveFile().c_str());
-	}
-	else
-	{
-		int t = 0;
-		for (sorted_array<CPlayerScore>::range r = pSelf->m_Top.all();
-				!r.empty(); r.pop_front())
-		{
-			f << r.front().m_aName << std::endl << r.front().m_Score
-					<< std::endl;
-			if (g_Config.m_SvCheckpointSave)
-			{
-				for (int c = 0; c < NUM_CHECKPOINTS; c++)
-					f << r.front().m_aCpTime[c] << " ";
-				f << std::endl;
-			}
-			t++;
-			if (t % 50 == 0)
-				thread_sleep(1000);
-		}
-	}
-	f.close();
-	lock_unlock(gs_ScoreLock);
+	m_Success = false;
+	sphore_init(&m_Done);
 }
 
-void CFileScore::Save()
+CFileScore::CCompactJob::~CCompactJob()
 {
-	void *pSaveThread = thread_init(SaveScoreThread, this);
-	thread_detach(pSaveThread);
+	sphore_destroy(&m_Done);
 }
 
-void CFileScore::Init()
+void CFileScore::CCompactJob::Run()
 {
-	lock_wait(gs_ScoreLock);
+	IOHANDLE File = io_open(m_aFilename, IOFLAG_WRITE);
+	if(!File)
+	{
+		dbg_msg("filescore", "opening '%s' for writing failed", m_aFilename);
+		sphore_signal(&m_Done);
+		return;
+	}
 
+	char aBuf[1024];
+	for(unsigned i = 0; i < m_aRecords.size(); i++)
+		io_write(File, aBuf, FileScoreFormatRecord(aBuf, sizeof(aBuf), &m_aRecords[i], m_Checkpoints));
+	io_close(File);
+	m_Success = true;
+	sphore_signal(&m_Done);
+}
+
+void CFileScore::Init()
+{
 	// create folder if not exist
 	if (g_Config.m_SvScoreFolder[0])
 		fs_makedir(g_Config.m_SvScoreFolder);
 
-	std::fstream f;
-	f.open(SaveFile().c_str(), std::ios::in);
+	char aMap[256];
+	str_copy(aMap, g_Config.m_SvMap, sizeof(aMap));
+	for(char *p = aMap; *p; p++) if(*p == '/') *p = '-';
+	if (g_Config.m_SvScoreFolder[0])
+		str_format(m_aFilename, sizeof(m_aFilename), "%s/%s_record.dtb", g_Config.m_SvScoreFolder, aMap);
+	else
+		str_format(m_aFilename, sizeof(m_aFilename), "%s_record.dtb", g_Config.m_SvMap);
+	str_format(m_aTmpFilename, sizeof(m_aTmpFilename), "%s.tmp", m_aFilename);
+	m_Checkpoints = g_Config.m_SvCheckpointSave;
 
-	if (f.fail())
+	bool Clean = true;
+	IOHANDLE File = io_open(m_aFilename, IOFLAG_READ);
+	if (!File)
 	{
-		dbg_msg("filescore", "opening '%s' for reading failed", SaveFile().c_str());
+		dbg_msg("filescore", "opening '%s' for reading failed", m_aFilename);
 	}
-	while (!f.eof() && !f.fail())
+	else
 	{
-		std::string TmpName, TmpScore, TmpCpLine;
-		std::getline(f, TmpName);
-		if (!f.eof() && TmpName != "")
-		{
-			std::getline(f, TmpScore);
-			float aTmpCpTime[NUM_CHECKPOINTS] =
-			{ 0 };
-			if (g_Config.m_SvCheckpointSave)
-			{
-				std::getline(f, TmpCpLine);
-
-				std::istringstream iss(TmpCpLine);
-				int i = 0;
-				for(std::string p; std::getline(iss, p, ' '); i++)
-					aTmpCpTime[i] = std::stof(p, NULL);
-			}
-			m_Top.add(
-					*new CPlayerScore(TmpName.c_str(), atof(TmpScore.c_str()),
-							aTmpCpTime));
-		}
+		CFileScoreParser Parser(m_Checkpoints, LoadRecord, this);
+		char aBuf[64 * 1024];
+		unsigned Size;
+		while((Size = io_read(File, aBuf, sizeof(aBuf))) > 0)
+			Parser.Feed(aBuf, Size);
+		Parser.Finish();
+		io_close(File);
+		Clean = Parser.Clean();
 	}
-	f.close();
-	lock_unlock(gs_ScoreLock);
+
+	OpenLog();
+	// the next record has to start on a new line
+	if(!Clean && m_pLog)
+		aio_write_newline(m_pLog);
+	if(!Clean || m_NumLogRecords - m_Index.Num() > max((int)COMPACT_MIN_OUTDATED, m_Index.Num()))
+		StartCompaction();
 
 	// save the current best score
-	if (m_Top.size())
+	if (m_Index.Num())
 		((CGameControllerDDRace*) GameServer()->m_pController)->m_CurrentRecord =
-				m_Top[0].m_Score;
+				m_Index.Get(m_Index.Select(1))->m_Time;
+}
+
+void CFileScore::LoadRecord(const CFileScoreRecord *pRecord, void *pUser)
+{
+	CFileScore *pSelf = (CFileScore *)pUser;
+	pSelf->m_Index.Set(*pRecord);
+	pSelf->m_NumLogRecords++;
 }
 
-CFileScore::CPlayerScore *CFileScore::SearchName(const char *pName,
-		int *pPosition, bool NoCase)
+void CFileScore::OpenLog()
 {
-	CPlayerScore *pPlayer = 0;
-	int Pos = 1;
-	int Found = 0;
-	for (sorted_array<CPlayerScore>::range r = m_Top.all(); !r.empty();
-			r.pop_front())
+	IOHANDLE File = io_open(m_aFilename, IOFLAG_APPEND);
+	if(!File)
 	{
-		if (str_find_nocase(r.front().m_aName, pName))
-		{
-			if (pPosition)
-				*pPosition = Pos;
-			if (NoCase)
-			{
-				Found++;
-				pPlayer = &r.front();
-			}
-			if (!strcmp(r.front().m_aName, pName))
-				return &r.front();
-		}
-		Pos++;
+		dbg_msg("filescore", "opening '%s' for writing failed", m_aFilename);
+		return;
 	}
-	if (Found > 1)
+	m_pLog = aio_new(File);
+}
+
+void CFileScore::CloseLog()
+{
+	if(!m_pLog)
+		return;
+	aio_close(m_pLog);
+	aio_wait(m_pLog);
+	aio_free(m_pLog);
+	m_pLog = 0;
+}
+
+void CFileScore::Append(int ID)
+{
+	if(m_pCompactJob)
+		m_aCompactPending.push_back(ID);
+
+	if(m_pLog)
 	{
-		if (pPosition)
-			*pPosition = -1;
-		return 0;
+		char aBuf[1024];
+		aio_write(m_pLog, aBuf, FileScoreFormatRecord(aBuf, sizeof(aBuf), m_Index.Get(ID), m_Checkpoints));
+		m_NumLogRecords++;
 	}
-	return pPlayer;
+
+	if(m_NumLogRecords - m_Index.Num() > max((int)COMPACT_MIN_OUTDATED, m_Index.Num()))
+		StartCompaction();
 }
 
-void CFileScore::UpdatePlayer(int ID, float Score,
-		float aCpTime[NUM_CHECKPOINTS])
+void CFileScore::StartCompaction()
 {
-	const char *pName = Server()->ClientName(ID);
+	if(m_pCompactJob)
+		return;
 
-	lock_wait(gs_ScoreLock);
-	CPlayerScore *pPlayer = SearchScore(ID, 0);
+	std::shared_ptr<CCompactJob> pJob = std::make_shared<CCompactJob>();
+	str_copy(pJob->m_aFilename, m_aTmpFilename, sizeof(pJob->m_aFilename));
+	pJob->m_Checkpoints = m_Checkpoints;
+	pJob->m_aRecords.reserve(m_Index.Num());
+	for(int Rank = 1; Rank <= m_Index.Num(); Rank++)
+		pJob->m_aRecords.push_back(*m_Index.Get(m_Index.Select(Rank)));
 
-	if (pPlayer)
-	{
-		for (int c = 0; c < NUM_CHECKPOINTS; c++)
-			pPlayer->m_aCpTime[c] = aCpTime[c];
+	m_pCompactJob = pJob;
+	m_aCompactPending.clear();
+	GameServer()->Engine()->AddJob(pJob);
+}
 
-		pPlayer->m_Score = Score;
-		str_copy(pPlayer->m_aName, pName, sizeof(pPlayer->m_aName));
+void CFileScore::FinishCompaction()
+{
+	std::shared_ptr<CCompactJob> pJob = m_pCompactJob;
+	m_pCompactJob = 0;
+	if(!pJob->m_Success)
+		return;
 
-		sort(m_Top.all());
+	// finishes since the snapshot only went to the old file
+	CloseLog();
+	if(fs_rename(m_aTmpFilename, m_aFilename))
+	{
+		dbg_msg("filescore", "replacing '%s' failed", m_aFilename);
+		fs_remove(m_aTmpFilename);
+		OpenLog();
+		return;
 	}
-	else
-		m_Top.add(*new CPlayerScore(pName, Score, aCpTime));
+	OpenLog();
 
-	lock_unlock(gs_ScoreLock);
-	Save();
+	m_NumLogRecords = pJob->m_aRecords.size();
+	for(unsigned i = 0; i < m_aCompactPending.size(); i++)
+		Append(m_aCompactPending[i]);
+	m_aCompactPending.clear();
 }
 
 void CFileScore::CheckBirthday(int ClientID)
@@ -214,18 +205,15 @@ void CFileScore::CheckBirthday(int ClientID)
 
 void CFileScore::LoadScore(int ClientID)
 {
-	CPlayerScore *pPlayer = SearchScore(ClientID, 0);
-	if (pPlayer)
-	{
-		lock_wait(gs_ScoreLock);
-		lock_unlock(gs_ScoreLock);
-		Save();
-	}
+	int ID = m_Index.Find(Server()->ClientName(ClientID));
 
 	// set score
-	if (pPlayer)
+	if (ID >= 0)
 	{
-		PlayerData(ClientID)->Set(pPlayer->m_Score, pPlayer->m_aCpTime);
+		const CFileScoreRecord *pRecord = m_Index.Get(ID);
+		float aCpTime[NUM_CHECKPOINTS];
+		mem_copy(aCpTime, pRecord->m_aCpTime, sizeof(aCpTime));
+		PlayerData(ClientID)->Set(pRecord->m_Time, aCpTime);
 		GameServer()->m_apPlayers[ClientID]->m_HasFinishScore = true;
 	}
 }
@@ -239,8 +227,15 @@ void CFileScore::SaveScore(int ClientID, float Time,
 		float CpTime[NUM_CHECKPOINTS], bool NotEligible)
 {
 	CConsole* pCon = (CConsole*) GameServer()->Console();
-	if (!pCon->m_Cheated || g_Config.m_SvRankCheats)
-		UpdatePlayer(ClientID, Time, CpTime);
+	if (pCon->m_Cheated && !g_Config.m_SvRankCheats)
+		return;
+
+	CFileScoreRecord Record;
+	str_copy(Record.m_aName, Server()->ClientName(ClientID), sizeof(Record.m_aName));
+	Record.m_Time = Time;
+	for (int c = 0; c < NUM_CHECKPOINTS; c++)
+		Record.m_aCpTime[c] = CpTime[c];
+	Append(m_Index.Set(Record));
 }
 
 void CFileScore::ShowTop5(IConsole::IResult *pResult, int ClientID,
@@ -248,17 +243,18 @@ void CFileScore::ShowTop5(IConsole::IResult *pResult, int ClientID,
 {
 	CGameContext *pSelf = (CGameContext *) pUserData;
 	char aBuf[512];
-	Debut = max(1, Debut < 0 ? m_Top.size() + Debut - 3 : Debut);
+	Debut = max(1, Debut < 0 ? m_Index.Num() + Debut - 3 : Debut);
 	pSelf->SendChatTarget(ClientID, "----------- Top 5 -----------");
 	for (int i = 0; i < 5; i++)
 	{
-		if (i + Debut > m_Top.size())
+		int ID = m_Index.Select(i + Debut);
+		if (ID < 0)
 			break;
-		CPlayerScore *r = &m_Top[i + Debut - 1];
+		const CFileScoreRecord *r = m_Index.Get(ID);
 		str_format(aBuf, sizeof(aBuf),
 				"%d. %s Time: %d minute(s) %5.2f second(s)", i + Debut,
-				r->m_aName, (int)r->m_Score / 60,
-				r->m_Score - ((int)r->m_Score / 60 * 60));
+				r->m_aName, (int)r->m_Time / 60,
+				r->m_Time - ((int)r->m_Time / 60 * 60));
 		pSelf->SendChatTarget(ClientID, aBuf);
 	}
 	pSelf->SendChatTarget(ClientID, "------------------------------");
@@ -266,25 +262,24 @@ void CFileScore::ShowTop5(IConsole::IResult *pResult, int ClientID,
 
 void CFileScore::ShowRank(int ClientID, const char* pName, bool Search)
 {
-	CPlayerScore *pScore;
-	int Pos = -1;
 	char aBuf[512];
-
+	int ID;
 	if (!Search)
-		pScore = SearchScore(ClientID, &Pos);
+		ID = m_Index.Find(Server()->ClientName(ClientID));
 	else
-		pScore = SearchName(pName, &Pos, 1);
+		ID = m_Index.Search(pName);
 
-	if (pScore && Pos > -1)
+	if (ID >= 0)
 	{
-		float Time = pScore->m_Score;
+		const CFileScoreRecord *pScore = m_Index.Get(ID);
+		float Time = pScore->m_Time;
 		if (g_Config.m_SvHideScore)
 			str_format(aBuf, sizeof(aBuf),
 					"Your time: %d minute(s) %5.2f second(s)", (int)Time / 60,
 					Time - ((int)Time / 60 * 60));
 		else
 			str_format(aBuf, sizeof(aBuf),
-					"%d. %s Time: %d minute(s) %5.2f second(s), requested by (%s)", Pos,
+					"%d. %s Time: %d minute(s) %5.2f second(s), requested by (%s)", m_Index.Rank(ID),
 					pScore->m_aName, (int)Time / 60,
 					Time - ((int)Time / 60 * 60), Server()->ClientName(ClientID));
 		if (!Search)
@@ -293,7 +288,7 @@ void CFileScore::ShowRank(int ClientID, const char* pName, bool Search)
 			GameServer()->SendChatTarget(ClientID, aBuf);
 		return;
 	}
-	else if (Pos == -1)
+	else if (ID == -2)
 		str_format(aBuf, sizeof(aBuf), "Several players were found.");
 	else
 		str_format(aBuf, sizeof(aBuf), "%s is not ranked",
@@ -358,6 +353,12 @@ void CFileScore::LoadTeam(const char* Code, int ClientID)
 	GameServer()->SendChatTarget(ClientID, aBuf);
 }
 
+void CFileScore::OnTick()
+{
+	if(m_pCompactJob && m_pCompactJob->Status() == IJob::STATE_DONE)
+		FinishCompaction();
+}
+
 void CFileScore::OnShutdown()
 {
 	;
@@ -4,36 +4,58 @@
 #ifndef GAME_SERVER_SCORE_FILE_SCORE_H
 #define GAME_SERVER_SCORE_FILE_SCORE_H
 
-#include <base/tl/sorted_array.h>
+#include <memory>
+#include <vector>
+
+#include <engine/shared/jobs.h>
 
 #include "../score.h"
+#include "file_score_index.h"
 
+// Keeps the best times of the map in memory. Finishes are appended to the
+// score file, which is rewritten in the background once most of its records
+// are outdated.
 class CFileScore: public IScore
 {
 	CGameContext *m_pGameServer;
 	IServer *m_pServer;
 
-	class CPlayerScore
+	enum
+	{
+		// outdated records that are always tolerated in the file
+		COMPACT_MIN_OUTDATED=128,
+	};
+
+	class CCompactJob : public IJob
 	{
+		virtual void Run();
+
 	public:
-		char m_aName[MAX_NAME_LENGTH];
-		float m_Score;
-		float m_aCpTime[NUM_CHECKPOINTS];
-
-		CPlayerScore()
-		{
-		}
-		;
-		CPlayerScore(const char *pName, float Score,
-				float aCpTime[NUM_CHECKPOINTS]);
-
-		bool operator<(const CPlayerScore& other)
-		{
-			return (this->m_Score < other.m_Score);
-		}
+		CCompactJob();
+		virtual ~CCompactJob();
+
+		char m_aFilename[512];
+		bool m_Checkpoints;
+		// in the order of the ranks
+		std::vector<CFileScoreRecord> m_aRecords;
+
+		bool m_Success;
+		// signaled when the file is written
+		SEMAPHORE m_Done;
 	};
 
-	sorted_array<CPlayerScore> m_Top;
+	CFileScoreIndex m_Index;
+	char m_aFilename[512];
+	char m_aTmpFilename[512];
+	bool m_Checkpoints;
+
+	ASYNCIO *m_pLog;
+	// records in the score file, including outdated ones
+	int m_NumLogRecords;
+
+	std::shared_ptr<CCompactJob> m_pCompactJob;
+	// players that finished while the file was rewritten
+	std::vector<int> m_aCompactPending;
 
 	CGameContext *GameServer()
 	{
@@ -44,18 +66,13 @@ class CFileScore: public IScore
 		return m_pServer;
 	}
 
-	CPlayerScore *SearchScore(int ID, int *pPosition)
-	{
-		return SearchName(Server()->ClientName(ID), pPosition, 0);
-	}
-	;
-
-	CPlayerScore *SearchName(const char *pName, int *pPosition, bool MatchCase);
-	void UpdatePlayer(int ID, float Score, float aCpTime[NUM_CHECKPOINTS]);
-
 	void Init();
-	void Save();
-	static void SaveScoreThread(void *pUser);
+	static void LoadRecord(const CFileScoreRecord *pRecord, void *pUser);
+	void OpenLog();
+	void CloseLog();
+	void Append(int ID);
+	void StartCompaction();
+	void FinishCompaction();
 
 public:
 
@@ -85,6 +102,7 @@ public:
 	virtual void SaveTeam(int Team, const char* Code, int ClientID, const char* Server);
 	virtual void LoadTeam(const char* Code, int ClientID);
 
+	virtual void OnTick();
 	virtual void OnShutdown();
 };
 
@@ -0,0 +1,277 @@
+#include "file_score_index.h"
+
+CFileScoreIndex::CFileScoreIndex() :
+m_Root(-1),
+m_Seed(0x9e3779b9)
+{
+}
+
+int CFileScoreIndex::Set(const CFileScoreRecord &Record)
+{
+	int ID = Find(Record.m_aName);
+	if(ID >= 0)
+	{
+		// the time is part of the key, reinsert the player at the new position
+		Erase(ID);
+		m_aRecords[ID] = Record;
+		Insert(ID);
+		return ID;
+	}
+
+	ID = m_aRecords.size();
+	m_aRecords.push_back(Record);
+	m_aNodes.push_back(CNode());
+	m_Names[Record.m_aName] = ID;
+	Insert(ID);
+	return ID;
+}
+
+int CFileScoreIndex::Find(const char *pName) const
+{
+	std::unordered_map<std::string, int>::const_iterator It = m_Names.find(pName);
+	return It == m_Names.end() ? -1 : It->second;
+}
+
+int CFileScoreIndex::Search(const char *pName) const
+{
+	int ID = Find(pName);
+	if(ID >= 0)
+		return ID;
+
+	for(int i = 0; i < Num(); i++)
+	{
+		if(!str_find_nocase(m_aRecords[i].m_aName, pName))
+			continue;
+		if(ID >= 0)
+			return -2;
+		ID = i;
+	}
+	return ID;
+}
+
+int CFileScoreIndex::Rank(int ID) const
+{
+	return CountLess(ID) + 1;
+}
+
+int CFileScoreIndex::Select(int Rank) const
+{
+	if(Rank < 1 || Rank > Num())
+		return -1;
+
+	int Count = Rank - 1;
+	int Node = m_Root;
+	while(Node >= 0)
+	{
+		int LeftSize = Size(m_aNodes[Node].m_Left);
+		if(Count < LeftSize)
+			Node = m_aNodes[Node].m_Left;
+		else if(Count == LeftSize)
+			return Node;
+		else
+		{
+			Count -= LeftSize + 1;
+			Node = m_aNodes[Node].m_Right;
+		}
+	}
+	return -1;
+}
+
+bool CFileScoreIndex::Less(int A, int B) const
+{
+	// equal times keep the order in which they were set
+	if(m_aRecords[A].m_Time != m_aRecords[B].m_Time)
+		return m_aRecords[A].m_Time < m_aRecords[B].m_Time;
+	return A < B;
+}
+
+void CFileScoreIndex::Update(int Node)
+{
+	m_aNodes[Node].m_Size = Size(m_aNodes[Node].m_Left) + Size(m_aNodes[Node].m_Right) + 1;
+}
+
+int CFileScoreIndex::Merge(int A, int B)
+{
+	if(A < 0)
+		return B;
+	if(B < 0)
+		return A;
+
+	if(m_aNodes[A].m_Priority > m_aNodes[B].m_Priority)
+	{
+		m_aNodes[A].m_Right = Merge(m_aNodes[A].m_Right, B);
+		Update(A);
+		return A;
+	}
+	m_aNodes[B].m_Left = Merge(A, m_aNodes[B].m_Left);
+	Update(B);
+	return B;
+}
+
+void CFileScoreIndex::Split(int Node, int Count, int *pA, int *pB)
+{
+	if(Node < 0)
+	{
+		*pA = -1;
+		*pB = -1;
+		return;
+	}
+
+	int LeftSize = Size(m_aNodes[Node].m_Left);
+	if(Count <= LeftSize)
+	{
+		Split(m_aNodes[Node].m_Left, Count, pA, &m_aNodes[Node].m_Left);
+		*pB = Node;
+	}
+	else
+	{
+		Split(m_aNodes[Node].m_Right, Count - LeftSize - 1, &m_aNodes[Node].m_Right, pB);
+		*pA = Node;
+	}
+	Update(Node);
+}
+
+int CFileScoreIndex::CountLess(int ID) const
+{
+	int Count = 0;
+	int Node = m_Root;
+	while(Node >= 0)
+	{
+		if(Less(Node, ID))
+		{
+			Count += Size(m_aNodes[Node].m_Left) + 1;
+			Node = m_aNodes[Node].m_Right;
+		}
+		else
+			Node = m_aNodes[Node].m_Left;
+	}
+	return Count;
+}
+
+void CFileScoreIndex::Insert(int ID)
+{
+	// xorshift, the priorities only have to be independent of the times
+	m_Seed ^= m_Seed << 13;
+	m_Seed ^= m_Seed >> 17;
+	m_Seed ^= m_Seed << 5;
+
+	CNode *pNode = &m_aNodes[ID];
+	pNode->m_Left = -1;
+	pNode->m_Right = -1;
+	pNode->m_Size = 1;
+	pNode->m_Priority = m_Seed;
+
+	int A, B;
+	Split(m_Root, CountLess(ID), &A, &B);
+	m_Root = Merge(Merge(A, ID), B);
+}
+
+void CFileScoreIndex::Erase(int ID)
+{
+	int A, B, Node, C;
+	Split(m_Root, CountLess(ID), &A, &B);
+	Split(B, 1, &Node, &C);
+	dbg_assert(Node == ID, "score index out of order");
+	m_Root = Merge(A, C);
+}
+
+CFileScoreParser::CFileScoreParser(bool Checkpoints, FRecordCallback pfnCallback, void *pUser) :
+m_Checkpoints(Checkpoints),
+m_pfnCallback(pfnCallback),
+m_pUser(pUser),
+m_LineLength(0),
+m_Field(0),
+m_Clean(true)
+{
+}
+
+void CFileScoreParser::Feed(const char *pData, int Size)
+{
+	for(int i = 0; i < Size; i++)
+	{
+		if(pData[i] == '\n')
+		{
+			OnLine();
+			m_LineLength = 0;
+		}
+		else if(m_LineLength < MAX_LINE_LENGTH - 1)
+			m_aLine[m_LineLength++] = pData[i];
+	}
+}
+
+void CFileScoreParser::Finish()
+{
+	m_Clean = m_LineLength == 0 && m_Field == 0;
+	if(m_LineLength)
+	{
+		OnLine();
+		m_LineLength = 0;
+	}
+
+	// a record without checkpoint line still has a time
+	if(m_Field == 2)
+		m_pfnCallback(&m_Record, m_pUser);
+	m_Field = 0;
+}
+
+void CFileScoreParser::OnLine()
+{
+	// files written on windows
+	if(m_LineLength && m_aLine[m_LineLength - 1] == '\r')
+		m_LineLength--;
+	m_aLine[m_LineLength] = 0;
+
+	if(m_Field == 0)
+	{
+		if(!m_aLine[0])
+			return;
+		mem_zero(&m_Record, sizeof(m_Record));
+		str_copy(m_Record.m_aName, m_aLine, sizeof(m_Record.m_aName));
+		m_Field = 1;
+	}
+	else if(m_Field == 1)
+	{
+		m_Record.m_Time = str_tofloat(m_aLine);
+		if(m_Checkpoints)
+			m_Field = 2;
+		else
+		{
+			m_pfnCallback(&m_Record, m_pUser);
+			m_Field = 0;
+		}
+	}
+	else
+	{
+		// space separated, with a trailing space
+		char *pTime = m_aLine;
+		for(int i = 0; i < NUM_CHECKPOINTS && *pTime; i++)
+		{
+			char *pEnd = pTime;
+			while(*pEnd && *pEnd != ' ')
+				pEnd++;
+			bool Last = !*pEnd;
+			*pEnd = 0;
+			m_Record.m_aCpTime[i] = str_tofloat(pTime);
+			pTime = Last ? pEnd : pEnd + 1;
+		}
+		m_pfnCallback(&m_Record, m_pUser);
+		m_Field = 0;
+	}
+}
+
+int FileScoreFormatRecord(char *pBuf, int BufSize, const CFileScoreRecord *pRecord, bool Checkpoints)
+{
+	str_format(pBuf, BufSize, "%s\n%g\n", pRecord->m_aName, pRecord->m_Time);
+	int Length = str_length(pBuf);
+	if(Checkpoints)
+	{
+		for(int i = 0; i < NUM_CHECKPOINTS; i++)
+		{
+			str_format(pBuf + Length, BufSize - Length, "%g ", pRecord->m_aCpTime[i]);
+			Length += str_length(pBuf + Length);
+		}
+		str_append(pBuf + Length, "\n", BufSize - Length);
+		Length += str_length(pBuf + Length);
+	}
+	return Length;
+}
@@ -0,0 +1,110 @@
+#ifndef GAME_SERVER_SCORE_FILE_SCORE_INDEX_H
+#define GAME_SERVER_SCORE_FILE_SCORE_INDEX_H
+
+#include <base/system.h>
+#include <engine/shared/protocol.h>
+#include <game/server/score.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CFileScoreRecord
+{
+	char m_aName[MAX_NAME_LENGTH];
+	float m_Time;
+	float m_aCpTime[NUM_CHECKPOINTS];
+};
+
+// Best times of one map. Players are looked up by name in a hash map and
+// ranked by a treap that keeps subtree sizes, so updates, ranks and pages
+// of the top list don't touch the other players.
+class CFileScoreIndex
+{
+public:
+	CFileScoreIndex();
+
+	int Num() const { return m_aRecords.size(); }
+	const CFileScoreRecord *Get(int ID) const { return &m_aRecords[ID]; }
+
+	// adds the player or replaces the previous time, returns the id
+	int Set(const CFileScoreRecord &Record);
+	// returns the id of the player with exactly this name or -1
+	int Find(const char *pName) const;
+	// players whose name contains pName, ignoring case. Returns the id of
+	// the exact match or the only match, -1 if there is none and -2 if
+	// there are several
+	int Search(const char *pName) const;
+
+	// 1 for the fastest player
+	int Rank(int ID) const;
+	// id of the player at the given rank or -1
+	int Select(int Rank) const;
+
+private:
+	struct CNode
+	{
+		int m_Left;
+		int m_Right;
+		int m_Size;
+		unsigned m_Priority;
+	};
+
+	std::vector<CFileScoreRecord> m_aRecords;
+	std::vector<CNode> m_aNodes;
+	std::unordered_map<std::string, int> m_Names;
+	int m_Root;
+	unsigned m_Seed;
+
+	bool Less(int A, int B) const;
+	int Size(int Node) const { return Node < 0 ? 0 : m_aNodes[Node].m_Size; }
+	void Update(int Node);
+	int Merge(int A, int B);
+	// the first Count nodes go to *pA, the rest to *pB
+	void Split(int Node, int Count, int *pA, int *pB);
+	// number of players faster than ID
+	int CountLess(int ID) const;
+	void Insert(int ID);
+	void Erase(int ID);
+};
+
+// Reads score files in arbitrary chunks. A record is the name, the time and,
+// if checkpoints are saved, a line with the checkpoint times.
+class CFileScoreParser
+{
+public:
+	typedef void (*FRecordCallback)(const CFileScoreRecord *pRecord, void *pUser);
+
+	CFileScoreParser(bool Checkpoints, FRecordCallback pfnCallback, void *pUser);
+
+	void Feed(const char *pData, int Size);
+	// handles a last line without line break
+	void Finish();
+
+	// whether the data ended with a complete record, valid after Finish()
+	bool Clean() const { return m_Clean; }
+
+private:
+	enum
+	{
+		// longer lines are cut off
+		MAX_LINE_LENGTH=1024,
+	};
+
+	bool m_Checkpoints;
+	FRecordCallback m_pfnCallback;
+	void *m_pUser;
+
+	char m_aLine[MAX_LINE_LENGTH];
+	int m_LineLength;
+	int m_Field;
+	bool m_Clean;
+	CFileScoreRecord m_Record;
+
+	void OnLine();
+};
+
+// returns the length of the record in the file format
+int FileScoreFormatRecord(char *pBuf, int BufSize, const CFileScoreRecord *pRecord, bool Checkpoints);
+
+#endif // GAME_SERVER_SCORE_FILE_SCORE_INDEX_H
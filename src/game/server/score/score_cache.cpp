@@ -0,0 +1,149 @@
+#include "score_cache.h"
+
+CScoreCache::CScoreCache() :
+m_Epoch(0),
+m_PendingWrites(0)
+{
+}
+
+const CScoreCache::CEntry *CScoreCache::Find(const CKey &Key, int64 Now, int CacheTime) const
+{
+	CEntries::const_iterator It = m_Entries.find(Key);
+	if(It == m_Entries.end() || It->second.m_Fetching)
+		return 0;
+	if(Now >= It->second.m_Fetched + CacheTime * time_freq())
+		return 0;
+	return &It->second;
+}
+
+bool CScoreCache::Request(const CKey &Key, const CWaiter &Waiter)
+{
+	CEntry &Entry = m_Entries[Key];
+	Entry.m_aWaiters.push_back(Waiter);
+	if(Entry.m_Fetching)
+		return false;
+
+	Entry.m_Fetching = true;
+	Entry.m_FetchEpoch = m_Epoch;
+	return true;
+}
+
+void CScoreCache::Complete(const CKey &Key, const std::vector<CRow> &aRows, int64 Now, std::vector<CWaiter> *pWaiters)
+{
+	CEntries::iterator It = m_Entries.find(Key);
+	if(It == m_Entries.end())
+		return;
+
+	pWaiters->swap(It->second.m_aWaiters);
+	It->second.m_aWaiters.clear();
+	It->second.m_Fetching = false;
+
+	// a finish might have been written after the query read the table
+	if(It->second.m_FetchEpoch != m_Epoch || m_PendingWrites)
+	{
+		m_Entries.erase(It);
+		return;
+	}
+
+	It->second.m_aRows = aRows;
+	It->second.m_Fetched = Now;
+
+	if((int)m_Entries.size() > MAX_ENTRIES)
+		Prune(Key);
+}
+
+void CScoreCache::Cancel(const CKey &Key, std::vector<CWaiter> *pWaiters)
+{
+	CEntries::iterator It = m_Entries.find(Key);
+	if(It == m_Entries.end())
+		return;
+
+	pWaiters->swap(It->second.m_aWaiters);
+	m_Entries.erase(It);
+}
+
+bool CScoreCache::PageAffected(const CEntry &Entry, int Page, float Time)
+{
+	// a page of the fastest times only changes if the new time beats its last row,
+	// pages counted from the end and the last page shift with every new finisher
+	return Page < 0 || Entry.m_aRows.size() < 5 || Time <= Entry.m_aRows.back().m_Time;
+}
+
+void CScoreCache::Invalidate(CEntries::iterator It)
+{
+	// running queries are discarded through the epoch
+	if(!It->second.m_Fetching)
+		m_Entries.erase(It);
+}
+
+void CScoreCache::OnFinish(const char *pName, float Time)
+{
+	m_Epoch++;
+
+	for(CEntries::iterator It = m_Entries.begin(); It != m_Entries.end();)
+	{
+		CEntries::iterator Cur = It++;
+		const CKey &Key = Cur->first;
+		const CEntry &Entry = Cur->second;
+
+		bool Affected = false;
+		switch(Key.m_Type)
+		{
+		case RANK:
+			// only slower players lose a rank
+			Affected = Key.m_Name == pName || (!Entry.m_aRows.empty() && Entry.m_aRows[0].m_Time > Time);
+			break;
+		case TOP5:
+			Affected = PageAffected(Entry, Key.m_Page, Time);
+			break;
+		case TIMES:
+			Affected = Key.m_Name.empty() || Key.m_Name == pName;
+			break;
+		case POINTS:
+		case TOPPOINTS:
+			// points of a first finish move everyone's rank, which finish
+			// is the first one is only known to the database
+			Affected = true;
+			break;
+		}
+
+		if(Affected)
+			Invalidate(Cur);
+	}
+}
+
+void CScoreCache::OnTeamFinish(const char *const *ppNames, int NumNames, float Time)
+{
+	m_Epoch++;
+
+	for(CEntries::iterator It = m_Entries.begin(); It != m_Entries.end();)
+	{
+		CEntries::iterator Cur = It++;
+		const CKey &Key = Cur->first;
+		const CEntry &Entry = Cur->second;
+
+		bool Affected = false;
+		if(Key.m_Type == TEAMRANK)
+		{
+			Affected = !Entry.m_aRows.empty() && Entry.m_aRows[0].m_Time > Time;
+			for(int i = 0; i < NumNames && !Affected; i++)
+				Affected = Key.m_Name == ppNames[i];
+		}
+		else if(Key.m_Type == TEAMTOP5)
+			Affected = PageAffected(Entry, Key.m_Page, Time);
+
+		if(Affected)
+			Invalidate(Cur);
+	}
+}
+
+void CScoreCache::Prune(const CKey &Keep)
+{
+	for(CEntries::iterator It = m_Entries.begin(); It != m_Entries.end();)
+	{
+		CEntries::iterator Cur = It++;
+		bool IsKept = !(Cur->first < Keep) && !(Keep < Cur->first);
+		if(!Cur->second.m_Fetching && !IsKept)
+			m_Entries.erase(Cur);
+	}
+}
@@ -0,0 +1,117 @@
+#ifndef GAME_SERVER_SCORE_SCORE_CACHE_H
+#define GAME_SERVER_SCORE_SCORE_CACHE_H
+
+#include <base/system.h>
+#include <engine/shared/protocol.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Results of the rank and top commands of one map. Identical requests
+// that arrive while a query is running wait for the same result. Local
+// finishes only drop the entries they can change, finishes on other
+// servers show up once an entry expired.
+class CScoreCache
+{
+public:
+	enum
+	{
+		RANK=0,
+		TEAMRANK,
+		TOP5,
+		TEAMTOP5,
+		TIMES,
+		POINTS,
+		TOPPOINTS,
+
+		MAX_ENTRIES=1024,
+	};
+
+	struct CKey
+	{
+		CKey() : m_Type(RANK), m_Page(0) {}
+		CKey(int Type, int Page, const char *pName) : m_Type(Type), m_Page(Page), m_Name(pName) {}
+
+		int m_Type;
+		int m_Page;
+		// player of RANK, TEAMRANK, POINTS and TIMES, empty for the times of the whole map
+		std::string m_Name;
+
+		bool operator<(const CKey &Other) const
+		{
+			if(m_Type != Other.m_Type)
+				return m_Type < Other.m_Type;
+			if(m_Page != Other.m_Page)
+				return m_Page < Other.m_Page;
+			return m_Name < Other.m_Name;
+		}
+	};
+
+	struct CRow
+	{
+		CRow() : m_Rank(0), m_Time(0.0f), m_Points(0), m_Ago(0), m_Stamp(0) {}
+
+		int m_Rank;
+		// player or team members
+		std::string m_Name;
+		float m_Time;
+		int m_Points;
+		// seconds, relative to the fetch of the entry
+		int m_Ago;
+		int m_Stamp;
+	};
+
+	struct CWaiter
+	{
+		int m_ClientID;
+		char m_aRequestingPlayer[MAX_NAME_LENGTH];
+	};
+
+	struct CEntry
+	{
+		CEntry() : m_Fetched(0), m_Fetching(false), m_FetchEpoch(0) {}
+
+		std::vector<CRow> m_aRows;
+		int64 m_Fetched;
+
+		// set while a query for this entry is running
+		bool m_Fetching;
+		int m_FetchEpoch;
+		std::vector<CWaiter> m_aWaiters;
+	};
+
+	CScoreCache();
+
+	// returns the entry if it is loaded and younger than CacheTime seconds
+	const CEntry *Find(const CKey &Key, int64 Now, int CacheTime) const;
+
+	// returns true if a query has to be started, false if one is running already
+	bool Request(const CKey &Key, const CWaiter &Waiter);
+	// stores the rows of a finished query, pWaiters receives the requests to answer
+	void Complete(const CKey &Key, const std::vector<CRow> &aRows, int64 Now, std::vector<CWaiter> *pWaiters);
+	// the query failed or couldn't be started
+	void Cancel(const CKey &Key, std::vector<CWaiter> *pWaiters);
+
+	void OnFinish(const char *pName, float Time);
+	void OnTeamFinish(const char *const *ppNames, int NumNames, float Time);
+
+	// results aren't stored while local finishes wait to be written
+	void BeginWrite() { m_PendingWrites++; }
+	void EndWrite() { m_PendingWrites--; m_Epoch++; }
+
+	int NumEntries() const { return m_Entries.size(); }
+
+private:
+	typedef std::map<CKey, CEntry> CEntries;
+
+	static bool PageAffected(const CEntry &Entry, int Page, float Time);
+	void Invalidate(CEntries::iterator It);
+	void Prune(const CKey &Keep);
+
+	CEntries m_Entries;
+	int m_Epoch;
+	int m_PendingWrites;
+};
+
+#endif // GAME_SERVER_SCORE_SCORE_CACHE_H
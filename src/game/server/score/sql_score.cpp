@@ -20,12 +20,197 @@ IServer* CSqlData::ms_pServer = 0;
 CPlayerData* CSqlData::ms_pPlayerData = 0;
 const char* CSqlData::ms_pMap = 0;
 const char* CSqlData::ms_pGameUuid = 0;
+CSqlWorkerPool* CSqlData::ms_pPool = 0;
 
 bool CSqlData::ms_GameContextAvailable = false;
 int CSqlData::ms_Instance = 0;
 
 volatile int CSqlExecData::ms_InstanceCount = 0;
 
+void CSqlData::SendChatTarget(int To, const char *pText) const
+{
+	CSqlResult *pResult = new CSqlResult();
+	pResult->m_Type = CSqlResult::CHAT_TARGET;
+	pResult->m_ClientID = To;
+	pResult->m_Message = pText;
+	AddResult(pResult);
+}
+
+void CSqlData::SendChat(int SpamProtectionClientID, const char *pText) const
+{
+	CSqlResult *pResult = new CSqlResult();
+	pResult->m_Type = CSqlResult::CHAT_ALL;
+	pResult->m_ClientID = SpamProtectionClientID;
+	pResult->m_Message = pText;
+	AddResult(pResult);
+}
+
+void CSqlData::SendChatTeam(int Team, const char *pText) const
+{
+	CSqlResult *pResult = new CSqlResult();
+	pResult->m_Type = CSqlResult::CHAT_TEAM;
+	pResult->m_ClientID = Team;
+	pResult->m_Message = pText;
+	AddResult(pResult);
+}
+
+void CSqlData::SendBroadcast(const char *pText, int ClientID) const
+{
+	CSqlResult *pResult = new CSqlResult();
+	pResult->m_Type = CSqlResult::BROADCAST;
+	pResult->m_ClientID = ClientID;
+	pResult->m_Message = pText;
+	AddResult(pResult);
+}
+
+void CSqlData::AddResult(CSqlResult *pResult) const
+{
+	pResult->m_Instance = m_Instance;
+	ms_pPool->AddResult(pResult);
+}
+
+CSqlWorkerPool::CSqlWorkerPool(int NumWorkers, int MaxQueued) :
+m_MaxQueued(MaxQueued),
+m_Shutdown(false)
+{
+	m_Lock = lock_create();
+	sphore_init(&m_Semaphore);
+
+	for(int i = 0; i < NumWorkers; i++)
+	{
+		CWorker *pWorker = new CWorker();
+		pWorker->m_pPool = this;
+		mem_zero(pWorker->m_apSqlReadServers, sizeof(pWorker->m_apSqlReadServers));
+		mem_zero(pWorker->m_apSqlWriteServers, sizeof(pWorker->m_apSqlWriteServers));
+		pWorker->m_pThread = thread_init(WorkerThread, pWorker);
+		m_apWorkers.push_back(pWorker);
+	}
+}
+
+CSqlWorkerPool::~CSqlWorkerPool()
+{
+	lock_wait(m_Lock);
+	m_Shutdown = true;
+	lock_unlock(m_Lock);
+
+	for(unsigned i = 0; i < m_apWorkers.size(); i++)
+		sphore_signal(&m_Semaphore);
+
+	for(unsigned i = 0; i < m_apWorkers.size(); i++)
+	{
+		thread_wait(m_apWorkers[i]->m_pThread);
+		for(int k = 0; k < MAX_SQLSERVERS; k++)
+		{
+			delete m_apWorkers[i]->m_apSqlReadServers[k];
+			delete m_apWorkers[i]->m_apSqlWriteServers[k];
+		}
+		delete m_apWorkers[i];
+	}
+
+	for(unsigned i = 0; i < m_Results.size(); i++)
+		delete m_Results[i];
+
+	lock_destroy(m_Lock);
+	sphore_destroy(&m_Semaphore);
+}
+
+bool CSqlWorkerPool::Queue(CSqlExecData *pData)
+{
+	lock_wait(m_Lock);
+	if(pData->m_ReadOnly && (int)m_Queue.size() >= m_MaxQueued)
+	{
+		lock_unlock(m_Lock);
+		return false;
+	}
+	m_Queue.push_back(pData);
+	lock_unlock(m_Lock);
+	sphore_signal(&m_Semaphore);
+	return true;
+}
+
+void CSqlWorkerPool::AddResult(CSqlResult *pResult)
+{
+	lock_wait(m_Lock);
+	m_Results.push_back(pResult);
+	lock_unlock(m_Lock);
+}
+
+void CSqlWorkerPool::GetResults(std::vector<CSqlResult *> *pResults)
+{
+	lock_wait(m_Lock);
+	pResults->swap(m_Results);
+	lock_unlock(m_Lock);
+}
+
+void CSqlWorkerPool::UpdateServers(CSqlServer **ppServers, bool ReadOnly)
+{
+	// sqlservers can be added at any time with add_sqlserver
+	for(int i = 0; i < MAX_SQLSERVERS; i++)
+		if(!ppServers[i] && CSqlConnector::GlobalSqlServer(i, ReadOnly))
+			ppServers[i] = CSqlConnector::GlobalSqlServer(i, ReadOnly)->Clone();
+}
+
+void CSqlWorkerPool::Execute(CSqlExecData *pData, CSqlConnector *pConnector)
+{
+	bool Success = false;
+
+	try {
+		// try to connect to a working databaseserver
+		while (!Success && !pConnector->MaxTriesReached(pData->m_ReadOnly) && pConnector->ConnectSqlServer(pData->m_ReadOnly))
+		{
+			try {
+				if (pData->m_pFuncPtr(pConnector->SqlServer(), pData->m_pSqlData, false))
+					Success = true;
+			} catch (...) {
+				dbg_msg("sql", "Unexpected exception caught");
+			}
+
+			// disconnect from databaseserver
+			pConnector->SqlServer()->Disconnect();
+		}
+
+		// handle failures
+		// eg write inserts to a file and print a nice error message
+		if (!Success)
+			pData->m_pFuncPtr(0, pData->m_pSqlData, true);
+	} catch (...) {
+		dbg_msg("sql", "Unexpected exception caught");
+	}
+
+	delete pData->m_pSqlData;
+	delete pData;
+}
+
+void CSqlWorkerPool::WorkerThread(void *pUser)
+{
+	CWorker *pWorker = (CWorker *)pUser;
+	CSqlWorkerPool *pPool = pWorker->m_pPool;
+
+	while(true)
+	{
+		sphore_wait(&pPool->m_Semaphore);
+
+		lock_wait(pPool->m_Lock);
+		if(pPool->m_Queue.empty())
+		{
+			bool Shutdown = pPool->m_Shutdown;
+			lock_unlock(pPool->m_Lock);
+			if(Shutdown)
+				break;
+			continue;
+		}
+		CSqlExecData *pData = pPool->m_Queue.front();
+		pPool->m_Queue.pop_front();
+		lock_unlock(pPool->m_Lock);
+
+		UpdateServers(pWorker->m_apSqlReadServers, true);
+		UpdateServers(pWorker->m_apSqlWriteServers, false);
+
+		CSqlConnector Connector(pWorker->m_apSqlReadServers, pWorker->m_apSqlWriteServers);
+		Execute(pData, &Connector);
+	}
+}
+
 LOCK CSqlScore::ms_FailureFileLock = lock_create();
 
 CSqlTeamSave::~CSqlTeamSave()
@@ -41,7 +226,9 @@ CSqlTeamSave::~CSqlTeamSave()
 
 CSqlScore::CSqlScore(CGameContext *pGameServer) :
 m_pGameServer(pGameServer),
-m_pServer(pGameServer->Server())
+m_pServer(pGameServer->Server()),
+m_pScoreBatch(0),
+m_ScoreBatchStart(0)
 {
 	str_copy(m_aMap, g_Config.m_SvMap, sizeof(m_aMap));
 	FormatUuid(m_pGameServer->GameUuid(), m_aGameUuid, sizeof(m_aGameUuid));
@@ -57,18 +244,24 @@ m_pServer(pGameServer->Server())
 
 	CSqlConnector::ResetReachable();
 
-	void* InitThread = thread_init(ExecSqlFunc, new CSqlExecData(Init, new CSqlData()));
-	thread_detach(InitThread);
+	// the workers and their connections are kept across map changes
+	if(!CSqlData::ms_pPool)
+		CSqlData::ms_pPool = new CSqlWorkerPool(g_Config.m_SvSqlWorkers, g_Config.m_SvSqlQueueSize);
+
+	ExecSqlFunc(new CSqlExecData(Init, new CSqlData()));
 }
 
 
 CSqlScore::~CSqlScore()
 {
+	if(CSqlData::ms_pPool)
+		FlushScoreBatch();
 	CSqlData::ms_GameContextAvailable = false;
 }
 
 void CSqlScore::OnShutdown()
 {
+	FlushScoreBatch();
 	CSqlData::ms_GameContextAvailable = false;
 	int i = 0;
 	while (CSqlExecData::ms_InstanceCount != 0)
@@ -85,42 +278,99 @@ void CSqlScore::OnShutdown()
 		thread_sleep(100000);
 	}
 
+	// don't block on workers that are still stuck in a query
+	if(CSqlExecData::ms_InstanceCount == 0)
+	{
+		delete CSqlData::ms_pPool;
+		CSqlData::ms_pPool = 0;
+	}
+
 	lock_destroy(ms_FailureFileLock);
 }
 
-void CSqlScore::ExecSqlFunc(void *pUser)
+bool CSqlScore::ExecSqlFunc(CSqlExecData *pExecData, int ClientID)
 {
-	CSqlExecData* pData = (CSqlExecData *)pUser;
+	if(CSqlData::ms_pPool->Queue(pExecData))
+		return true;
 
-	CSqlConnector connector;
+	delete pExecData->m_pSqlData;
+	delete pExecData;
+	if(ClientID >= 0)
+		GameServer()->SendChatTarget(ClientID, "The database is busy right now, please try again later");
+	return false;
+}
 
-	bool Success = false;
+void CSqlScore::OnTick()
+{
+	if(m_pScoreBatch && time_get() > m_ScoreBatchStart + time_freq() * SCORE_BATCH_DELAY / 1000)
+		FlushScoreBatch();
 
-	try {
-		// try to connect to a working databaseserver
-		while (!Success && !connector.MaxTriesReached(pData->m_ReadOnly) && connector.ConnectSqlServer(pData->m_ReadOnly))
-		{
-			try {
-				if (pData->m_pFuncPtr(connector.SqlServer(), pData->m_pSqlData, false))
-					Success = true;
-			} catch (...) {
-				dbg_msg("sql", "Unexpected exception caught");
-			}
+	std::vector<CSqlResult *> Results;
+	CSqlData::ms_pPool->GetResults(&Results);
+	for(unsigned i = 0; i < Results.size(); i++)
+	{
+		// results of the previous map are outdated
+		if(Results[i]->m_Instance == CSqlData::ms_Instance)
+			ApplyResult(Results[i]);
+		delete Results[i];
+	}
+}
 
-			// disconnect from databaseserver
-			connector.SqlServer()->Disconnect();
+void CSqlScore::ApplyResult(const CSqlResult *pResult)
+{
+	switch(pResult->m_Type)
+	{
+	case CSqlResult::CHAT_TARGET:
+		GameServer()->SendChatTarget(pResult->m_ClientID, pResult->m_Message.c_str());
+		break;
+	case CSqlResult::CHAT_ALL:
+		GameServer()->SendChat(-1, CGameContext::CHAT_ALL, pResult->m_Message.c_str(), pResult->m_ClientID);
+		break;
+	case CSqlResult::CHAT_TEAM:
+		GameServer()->SendChatTeam(pResult->m_ClientID, pResult->m_Message.c_str());
+		break;
+	case CSqlResult::BROADCAST:
+		GameServer()->SendBroadcast(pResult->m_Message.c_str(), pResult->m_ClientID);
+		break;
+	case CSqlResult::PLAYER_SCORE:
+	{
+		CPlayerData *pPlayerData = PlayerData(pResult->m_ClientID);
+		pPlayerData->m_BestTime = pResult->m_Time;
+		pPlayerData->m_CurrentTime = pResult->m_Time;
+		if(pResult->m_HasCpTime)
+			for(int i = 0; i < NUM_CHECKPOINTS; i++)
+				pPlayerData->m_aBestCpTime[i] = pResult->m_aCpTime[i];
+
+		CPlayer *pPlayer = GameServer()->m_apPlayers[pResult->m_ClientID];
+		if(pPlayer)
+		{
+			pPlayer->m_Score = -pResult->m_Time;
+			pPlayer->m_HasFinishScore = true;
 		}
-
-		// handle failures
-		// eg write inserts to a file and print a nice error message
-		if (!Success)
-			pData->m_pFuncPtr(0, pData->m_pSqlData, true);
-	} catch (...) {
-		dbg_msg("sql", "Unexpected exception caught");
+		break;
 	}
+	case CSqlResult::MAP_RECORD:
+		((CGameControllerDDRace*)GameServer()->m_pController)->m_CurrentRecord = pResult->m_Time;
+		break;
+	case CSqlResult::CACHE_ROWS:
+	{
+		std::vector<CScoreCache::CWaiter> aWaiters;
+		if(pResult->m_Failed)
+		{
+			m_Cache.Cancel(pResult->m_CacheKey, &aWaiters);
+			break;
+		}
 
-	delete pData->m_pSqlData;
-	delete pData;
+		int64 Now = time_get();
+		m_Cache.Complete(pResult->m_CacheKey, pResult->m_aRows, Now, &aWaiters);
+		for(unsigned i = 0; i < aWaiters.size(); i++)
+			SendCached(pResult->m_CacheKey, pResult->m_aRows, Now, aWaiters[i]);
+		break;
+	}
+	case CSqlResult::SCORES_SAVED:
+		m_Cache.EndWrite();
+		break;
+	}
 }
 
 bool CSqlScore::Init(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -142,7 +392,10 @@ bool CSqlScore::Init(CSqlServer* pSqlServer, const CSqlData *pGameData, bool Han
 
 		if(pSqlServer->GetResults()->next())
 		{
-			((CGameControllerDDRace*)pData->GameServer()->m_pController)->m_CurrentRecord = (float)pSqlServer->GetResults()->getDouble("Time");
+			CSqlResult *pResult = new CSqlResult();
+			pResult->m_Type = CSqlResult::MAP_RECORD;
+			pResult->m_Time = (float)pSqlServer->GetResults()->getDouble("Time");
+			pData->AddResult(pResult);
 
 			dbg_msg("sql", "Getting best time on server done");
 		}
@@ -166,8 +419,7 @@ void CSqlScore::CheckBirthday(int ClientID)
 	CSqlPlayerData *Tmp = new CSqlPlayerData();
 	Tmp->m_ClientID = ClientID;
 	Tmp->m_Name = Server()->ClientName(ClientID);
-	void *CheckThread = thread_init(ExecSqlFunc, new CSqlExecData(CheckBirthdayThread, Tmp));
-	thread_detach(CheckThread);
+	ExecSqlFunc(new CSqlExecData(CheckBirthdayThread, Tmp), ClientID);
 }
 
 bool CSqlScore::CheckBirthdayThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -181,18 +433,20 @@ bool CSqlScore::CheckBirthdayThread(CSqlServer* pSqlServer, const CSqlData *pGam
 	{
 		char aBuf[512];
 
-		str_format(aBuf, sizeof(aBuf), "select year(Current) - year(Stamp) as YearsAgo from (select CURRENT_TIMESTAMP as Current, min(Timestamp) as Stamp from %s_race WHERE Name='%s') as l where dayofmonth(Current) = dayofmonth(Stamp) and month(Current) = month(Stamp) and year(Current) > year(Stamp);", pSqlServer->GetPrefix(), pData->m_Name.ClrStr());
-		pSqlServer->executeSqlQuery(aBuf);
+		str_format(aBuf, sizeof(aBuf), "select year(Current) - year(Stamp) as YearsAgo from (select CURRENT_TIMESTAMP as Current, min(Timestamp) as Stamp from %s_race WHERE Name=?) as l where dayofmonth(Current) = dayofmonth(Stamp) and month(Current) = month(Stamp) and year(Current) > year(Stamp);", pSqlServer->GetPrefix());
+		sql::PreparedStatement *pStatement = pSqlServer->prepareSql(aBuf);
+		pStatement->setString(1, pData->m_Name.Str());
+		pSqlServer->executePreparedQuery(pStatement);
 
 		if(pSqlServer->GetResults()->next())
 		{
 			int yearsAgo = (int)pSqlServer->GetResults()->getInt("YearsAgo");
 			str_format(aBuf, sizeof(aBuf), "Happy DDNet birthday to %s for finishing their first map %d year%s ago!", pData->m_Name.Str(), yearsAgo, yearsAgo > 1 ? "s" : "");
-			pData->GameServer()->SendChat(-1, CGameContext::CHAT_ALL, aBuf, pData->m_ClientID);
+			pData->SendChat(pData->m_ClientID, aBuf);
 
 			str_format(aBuf, sizeof(aBuf), "Happy DDNet birthday, %s!\nYou have finished your first map exactly %d year%s ago!", pData->m_Name.Str(), yearsAgo, yearsAgo > 1 ? "s" : "");
 
-			pData->GameServer()->SendBroadcast(aBuf, pData->m_ClientID);
+			pData->SendBroadcast(aBuf, pData->m_ClientID);
 		}
 
 		dbg_msg("sql", "checking birthday done");
@@ -218,8 +472,7 @@ void CSqlScore::LoadScore(int ClientID)
 	Tmp->m_ClientID = ClientID;
 	Tmp->m_Name = Server()->ClientName(ClientID);
 
-	void *LoadThread = thread_init(ExecSqlFunc, new CSqlExecData(LoadScoreThread, Tmp));
-	thread_detach(LoadThread);
+	ExecSqlFunc(new CSqlExecData(LoadScoreThread, Tmp), ClientID);
 }
 
 // update stuff
@@ -234,29 +487,30 @@ bool CSqlScore::LoadScoreThread(CSqlServer* pSqlServer, const CSqlData *pGameDat
 	{
 		char aBuf[512];
 
-		str_format(aBuf, sizeof(aBuf), "SELECT * FROM %s_race WHERE Map='%s' AND Name='%s' ORDER BY time ASC LIMIT 1;", pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pData->m_Name.ClrStr());
-		pSqlServer->executeSqlQuery(aBuf);
+		str_format(aBuf, sizeof(aBuf), "SELECT * FROM %s_race WHERE Map=? AND Name=? ORDER BY time ASC LIMIT 1;", pSqlServer->GetPrefix());
+		sql::PreparedStatement *pStatement = pSqlServer->prepareSql(aBuf);
+		pStatement->setString(1, pData->m_Map.Str());
+		pStatement->setString(2, pData->m_Name.Str());
+		pSqlServer->executePreparedQuery(pStatement);
 		if(pSqlServer->GetResults()->next())
 		{
 			// get the best time
-			float Time = (float)pSqlServer->GetResults()->getDouble("Time");
-			pData->PlayerData(pData->m_ClientID)->m_BestTime = Time;
-			pData->PlayerData(pData->m_ClientID)->m_CurrentTime = Time;
-			if(pData->GameServer()->m_apPlayers[pData->m_ClientID])
-			{
-				pData->GameServer()->m_apPlayers[pData->m_ClientID]->m_Score = -Time;
-				pData->GameServer()->m_apPlayers[pData->m_ClientID]->m_HasFinishScore = true;
-			}
+			CSqlResult *pResult = new CSqlResult();
+			pResult->m_Type = CSqlResult::PLAYER_SCORE;
+			pResult->m_ClientID = pData->m_ClientID;
+			pResult->m_Time = (float)pSqlServer->GetResults()->getDouble("Time");
 
 			char aColumn[8];
-			if(g_Config.m_SvCheckpointSave)
+			pResult->m_HasCpTime = g_Config.m_SvCheckpointSave;
+			if(pResult->m_HasCpTime)
 			{
 				for(int i = 0; i < NUM_CHECKPOINTS; i++)
 				{
 					str_format(aColumn, sizeof(aColumn), "cp%d", i+1);
-					pData->PlayerData(pData->m_ClientID)->m_aBestCpTime[i] = (float)pSqlServer->GetResults()->getDouble(aColumn);
+					pResult->m_aCpTime[i] = (float)pSqlServer->GetResults()->getDouble(aColumn);
 				}
 			}
+			pData->AddResult(pResult);
 		}
 
 		dbg_msg("sql", "Getting best time done");
@@ -284,8 +538,7 @@ void CSqlScore::MapVote(int ClientID, const char* MapName)
 	sqlstr::ClearString(Tmp->m_aFuzzyMap, sizeof(Tmp->m_aFuzzyMap));
 	sqlstr::FuzzyString(Tmp->m_aFuzzyMap, sizeof(Tmp->m_aFuzzyMap));
 
-	void *VoteThread = thread_init(ExecSqlFunc, new CSqlExecData(MapVoteThread, Tmp));
-	thread_detach(VoteThread);
+	ExecSqlFunc(new CSqlExecData(MapVoteThread, Tmp), ClientID);
 }
 
 bool CSqlScore::MapVoteThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -314,25 +567,25 @@ bool CSqlScore::MapVoteThread(CSqlServer* pSqlServer, const CSqlData *pGameData,
 		if(pSqlServer->GetResults()->rowsCount() != 1)
 		{
 			str_format(aBuf, sizeof(aBuf), "No map like \"%s\" found. Try adding a '%%' at the start if you don't know the first character. Example: /map %%castle for \"Out of Castle\"", pData->m_RequestedMap.Str());
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
+			pData->SendChatTarget(pData->m_ClientID, aBuf);
 		}
 		else if(Now < pPlayer->m_FirstVoteTick)
 		{
 			char aBuf[64];
 			str_format(aBuf, sizeof(aBuf), "You must wait %d seconds before making your first vote", (int)((pPlayer->m_FirstVoteTick - Now) / pData->Server()->TickSpeed()) + 1);
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
+			pData->SendChatTarget(pData->m_ClientID, aBuf);
 		}
 		else if(pPlayer->m_LastVoteCall && Timeleft > 0)
 		{
 			char aChatmsg[512] = {0};
 			str_format(aChatmsg, sizeof(aChatmsg), "You must wait %d seconds before making another vote", (Timeleft/pData->Server()->TickSpeed())+1);
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, aChatmsg);
+			pData->SendChatTarget(pData->m_ClientID, aChatmsg);
 		}
 		else if(time_get() < pData->GameServer()->m_LastMapVote + (time_freq() * g_Config.m_SvVoteMapTimeDelay))
 		{
 			char chatmsg[512] = {0};
 			str_format(chatmsg, sizeof(chatmsg), "There's a %d second delay between map-votes, please wait %d seconds.", g_Config.m_SvVoteMapTimeDelay, (int)(((pData->GameServer()->m_LastMapVote+(g_Config.m_SvVoteMapTimeDelay * time_freq()))/time_freq())-(time_get()/time_freq())));
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, chatmsg);
+			pData->SendChatTarget(pData->m_ClientID, chatmsg);
 		}
 		else
 		{
@@ -381,8 +634,7 @@ void CSqlScore::MapInfo(int ClientID, const char* MapName)
 	sqlstr::ClearString(Tmp->m_aFuzzyMap, sizeof(Tmp->m_aFuzzyMap));
 	sqlstr::FuzzyString(Tmp->m_aFuzzyMap, sizeof(Tmp->m_aFuzzyMap));
 
-	void *InfoThread = thread_init(ExecSqlFunc, new CSqlExecData(MapInfoThread, Tmp));
-	thread_detach(InfoThread);
+	ExecSqlFunc(new CSqlExecData(MapInfoThread, Tmp), ClientID);
 }
 
 bool CSqlScore::MapInfoThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -455,7 +707,7 @@ bool CSqlScore::MapInfoThread(CSqlServer* pSqlServer, const CSqlData *pGameData,
 			str_format(aBuf, sizeof(aBuf), "\"%s\" by %s on %s, %s, %d %s%s, %d %s by %d %s%s%s", aMap, aMapper, aServer, aStars, points, points == 1 ? "point" : "points", pReleasedString, finishes, finishes == 1 ? "finish" : "finishes", finishers, finishers == 1 ? "tee" : "tees", pAverageString, pOwnFinishesString);
 		}
 
-		pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
+		pData->SendChatTarget(pData->m_ClientID, aBuf);
 		return true;
 	}
 	catch (sql::SQLException &e)
@@ -484,13 +736,107 @@ void CSqlScore::SaveScore(int ClientID, float Time, float CpTime[NUM_CHECKPOINTS
 	for(int i = 0; i < NUM_CHECKPOINTS; i++)
 		Tmp->m_aCpCurrent[i] = CpTime[i];
 
-	void *SaveThread = thread_init(ExecSqlFunc, new CSqlExecData(SaveScoreThread, Tmp, false));
-	thread_detach(SaveThread);
+	AddScoreBatch()->m_apScores.push_back(Tmp);
+	if(!NotEligible)
+		m_Cache.OnFinish(Server()->ClientName(ClientID), Time);
 }
 
-bool CSqlScore::SaveScoreThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
+void CSqlScore::SaveTeamScore(int* aClientIDs, unsigned int Size, float Time)
 {
-	const CSqlScoreData *pData = dynamic_cast<const CSqlScoreData *>(pGameData);
+	CConsole* pCon = (CConsole*)GameServer()->Console();
+	if(pCon->m_Cheated)
+		return;
+	CSqlTeamScoreData *Tmp = new CSqlTeamScoreData();
+	Tmp->m_NotEligible = false;
+	for(unsigned int i = 0; i < Size; i++)
+	{
+		Tmp->m_aClientIDs[i] = aClientIDs[i];
+		Tmp->m_aNames[i] = Server()->ClientName(aClientIDs[i]);
+		Tmp->m_NotEligible = Tmp->m_NotEligible || GameServer()->m_apPlayers[aClientIDs[i]]->m_NotEligibleForFinish;
+	}
+	Tmp->m_Size = Size;
+	Tmp->m_Time = Time;
+
+	AddScoreBatch()->m_apTeamScores.push_back(Tmp);
+	if(!Tmp->m_NotEligible)
+	{
+		const char *apNames[MAX_CLIENTS];
+		for(unsigned int i = 0; i < Size; i++)
+			apNames[i] = Server()->ClientName(aClientIDs[i]);
+		m_Cache.OnTeamFinish(apNames, Size, Time);
+	}
+}
+
+CSqlScoreBatch *CSqlScore::AddScoreBatch()
+{
+	if(m_pScoreBatch && m_pScoreBatch->m_apScores.size() + m_pScoreBatch->m_apTeamScores.size() >= SCORE_BATCH_MAX)
+		FlushScoreBatch();
+
+	if(!m_pScoreBatch)
+	{
+		m_pScoreBatch = new CSqlScoreBatch();
+		m_ScoreBatchStart = time_get();
+		m_Cache.BeginWrite();
+	}
+	return m_pScoreBatch;
+}
+
+void CSqlScore::FlushScoreBatch()
+{
+	if(!m_pScoreBatch)
+		return;
+
+	ExecSqlFunc(new CSqlExecData(SaveScoreBatchThread, m_pScoreBatch, false));
+	m_pScoreBatch = 0;
+}
+
+CSqlScoreBatch::~CSqlScoreBatch()
+{
+	// the cache stores query results again once the finishes are written
+	CSqlResult *pResult = new CSqlResult();
+	pResult->m_Type = CSqlResult::SCORES_SAVED;
+	AddResult(pResult);
+
+	for(unsigned i = 0; i < m_apScores.size(); i++)
+		delete m_apScores[i];
+	for(unsigned i = 0; i < m_apTeamScores.size(); i++)
+		delete m_apTeamScores[i];
+}
+
+bool CSqlScore::WriteScoreFailure(IOHANDLE File, const CSqlScoreData *pData)
+{
+	char aTimestamp [20];
+	sqlstr::GetTimeStamp(aTimestamp, sizeof(aTimestamp));
+
+	char aBuf[768];
+	str_format(aBuf, sizeof(aBuf), "INSERT IGNORE INTO %%s_race(Map, Name, Timestamp, Time, Server, cp1, cp2, cp3, cp4, cp5, cp6, cp7, cp8, cp9, cp10, cp11, cp12, cp13, cp14, cp15, cp16, cp17, cp18, cp19, cp20, cp21, cp22, cp23, cp24, cp25, GameID) VALUES ('%s', '%s', '%s', '%.2f', '%s', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%s');%s", pData->m_Map.ClrStr(), pData->m_Name.ClrStr(), aTimestamp, pData->m_Time, g_Config.m_SvSqlServerName, pData->m_aCpCurrent[0], pData->m_aCpCurrent[1], pData->m_aCpCurrent[2], pData->m_aCpCurrent[3], pData->m_aCpCurrent[4], pData->m_aCpCurrent[5], pData->m_aCpCurrent[6], pData->m_aCpCurrent[7], pData->m_aCpCurrent[8], pData->m_aCpCurrent[9], pData->m_aCpCurrent[10], pData->m_aCpCurrent[11], pData->m_aCpCurrent[12], pData->m_aCpCurrent[13], pData->m_aCpCurrent[14], pData->m_aCpCurrent[15], pData->m_aCpCurrent[16], pData->m_aCpCurrent[17], pData->m_aCpCurrent[18], pData->m_aCpCurrent[19], pData->m_aCpCurrent[20], pData->m_aCpCurrent[21], pData->m_aCpCurrent[22], pData->m_aCpCurrent[23], pData->m_aCpCurrent[24], pData->m_GameUuid.ClrStr(), pData->m_NotEligible ? " -- not eligible" : "");
+	io_write(File, aBuf, str_length(aBuf));
+	io_write_newline(File);
+	return !pData->m_NotEligible;
+}
+
+bool CSqlScore::WriteTeamScoreFailure(IOHANDLE File, const CSqlTeamScoreData *pData)
+{
+	const char pUUID[] = "SET @id = UUID();";
+	io_write(File, pUUID, sizeof(pUUID) - 1);
+	io_write_newline(File);
+
+	char aTimestamp [20];
+	sqlstr::GetTimeStamp(aTimestamp, sizeof(aTimestamp));
+
+	char aBuf[2300];
+	for(unsigned int i = 0; i < pData->m_Size; i++)
+	{
+		str_format(aBuf, sizeof(aBuf), "INSERT IGNORE INTO %%s_teamrace(Map, Name, Timestamp, Time, ID, GameID) VALUES ('%s', '%s', '%s', '%.2f', @id, '%s');%s", pData->m_Map.ClrStr(), pData->m_aNames[i].ClrStr(), aTimestamp, pData->m_Time, pData->m_GameUuid.ClrStr(), pData->m_NotEligible ? " -- not eligible" : "");
+		io_write(File, aBuf, str_length(aBuf));
+		io_write_newline(File);
+	}
+	return !pData->m_NotEligible;
+}
+
+bool CSqlScore::SaveScoreBatchThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
+{
+	const CSqlScoreBatch *pData = dynamic_cast<const CSqlScoreBatch *>(pGameData);
 
 	if (HandleFailure)
 	{
@@ -501,19 +847,18 @@ bool CSqlScore::SaveScoreThread(CSqlServer* pSqlServer, const CSqlData *pGameDat
 		IOHANDLE File = io_open(g_Config.m_SvSqlFailureFile, IOFLAG_APPEND);
 		if(File)
 		{
-			dbg_msg("sql", "ERROR: Could not save Score, writing insert to a file now...");
-
-			char aTimestamp [20];
-			sqlstr::GetTimeStamp(aTimestamp, sizeof(aTimestamp));
+			dbg_msg("sql", "ERROR: Could not save %d scores and %d team scores, writing inserts to a file now...", (int)pData->m_apScores.size(), (int)pData->m_apTeamScores.size());
 
-			char aBuf[768];
-				str_format(aBuf, sizeof(aBuf), "INSERT IGNORE INTO %%s_race(Map, Name, Timestamp, Time, Server, cp1, cp2, cp3, cp4, cp5, cp6, cp7, cp8, cp9, cp10, cp11, cp12, cp13, cp14, cp15, cp16, cp17, cp18, cp19, cp20, cp21, cp22, cp23, cp24, cp25, GameID) VALUES ('%s', '%s', '%s', '%.2f', '%s', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%s');%s", pData->m_Map.ClrStr(), pData->m_Name.ClrStr(), aTimestamp, pData->m_Time, g_Config.m_SvSqlServerName, pData->m_aCpCurrent[0], pData->m_aCpCurrent[1], pData->m_aCpCurrent[2], pData->m_aCpCurrent[3], pData->m_aCpCurrent[4], pData->m_aCpCurrent[5], pData->m_aCpCurrent[6], pData->m_aCpCurrent[7], pData->m_aCpCurrent[8], pData->m_aCpCurrent[9], pData->m_aCpCurrent[10], pData->m_aCpCurrent[11], pData->m_aCpCurrent[12], pData->m_aCpCurrent[13], pData->m_aCpCurrent[14], pData->m_aCpCurrent[15], pData->m_aCpCurrent[16], pData->m_aCpCurrent[17], pData->m_aCpCurrent[18], pData->m_aCpCurrent[19], pData->m_aCpCurrent[20], pData->m_aCpCurrent[21], pData->m_aCpCurrent[22], pData->m_aCpCurrent[23], pData->m_aCpCurrent[24], pData->m_GameUuid.ClrStr(), pData->m_NotEligible ? " -- not eligible" : "");
-				io_write(File, aBuf, str_length(aBuf));
-				io_write_newline(File);
-				io_close(File);
-				lock_unlock(ms_FailureFileLock);
+			bool Eligible = false;
+			for(unsigned i = 0; i < pData->m_apScores.size(); i++)
+				Eligible |= WriteScoreFailure(File, pData->m_apScores[i]);
+			for(unsigned i = 0; i < pData->m_apTeamScores.size(); i++)
+				WriteTeamScoreFailure(File, pData->m_apTeamScores[i]);
+			io_close(File);
+			lock_unlock(ms_FailureFileLock);
 
-				pData->GameServer()->SendBroadcast("Database connection failed, score written to a file instead. Admins will add it manually in a few days.", -1);
+			if(Eligible)
+				pData->SendBroadcast("Database connection failed, score written to a file instead. Admins will add it manually in a few days.", -1);
 
 			return true;
 		}
@@ -522,229 +867,222 @@ bool CSqlScore::SaveScoreThread(CSqlServer* pSqlServer, const CSqlData *pGameDat
 		return false;
 	}
 
-	if(pData->m_NotEligible)
+	try
+	{
+		pSqlServer->executeSql("START TRANSACTION;");
+
+		SaveScores(pSqlServer, pData);
+		for(unsigned i = 0; i < pData->m_apTeamScores.size(); i++)
+			if(!pData->m_apTeamScores[i]->m_NotEligible)
+				SaveTeamScore(pSqlServer, pData->m_apTeamScores[i]);
+
+		pSqlServer->executeSql("COMMIT;");
+	}
+	catch (sql::SQLException &e)
 	{
+		dbg_msg("sql", "MySQL Error: %s", e.what());
+		dbg_msg("sql", "ERROR: Could not update times");
+		try
+		{
+			pSqlServer->executeSql("ROLLBACK;");
+		}
+		catch (sql::SQLException &e) {}
 		return false;
 	}
 
-	try
+	// finishes that are not eligible only end up in the failure file, commented out
+	if(g_Config.m_SvSqlFailureFile[0])
 	{
-		char aBuf[768];
+		lock_wait(ms_FailureFileLock);
+		IOHANDLE File = 0;
+		for(unsigned i = 0; i < pData->m_apScores.size(); i++)
+			if(pData->m_apScores[i]->m_NotEligible && (File || (File = io_open(g_Config.m_SvSqlFailureFile, IOFLAG_APPEND))))
+				WriteScoreFailure(File, pData->m_apScores[i]);
+		for(unsigned i = 0; i < pData->m_apTeamScores.size(); i++)
+			if(pData->m_apTeamScores[i]->m_NotEligible && (File || (File = io_open(g_Config.m_SvSqlFailureFile, IOFLAG_APPEND))))
+				WriteTeamScoreFailure(File, pData->m_apTeamScores[i]);
+		if(File)
+			io_close(File);
+		lock_unlock(ms_FailureFileLock);
+	}
+
+	dbg_msg("sql", "Updating times done");
+	return true;
+}
+
+void CSqlScore::SaveScores(CSqlServer* pSqlServer, const CSqlScoreBatch *pData)
+{
+	std::vector<const CSqlScoreData *> apScores;
+	for(unsigned i = 0; i < pData->m_apScores.size(); i++)
+		if(!pData->m_apScores[i]->m_NotEligible)
+			apScores.push_back(pData->m_apScores[i]);
+	if(apScores.empty())
+		return;
+
+	char aBuf[768];
+	std::string Query;
+
+	// players without a finish on this map get the points of the map
+	str_format(aBuf, sizeof(aBuf), "SELECT DISTINCT Name FROM %s_race WHERE Map='%s' AND Name IN (", pSqlServer->GetPrefix(), pData->m_Map.ClrStr());
+	Query = aBuf;
+	for(unsigned i = 0; i < apScores.size(); i++)
+	{
+		str_format(aBuf, sizeof(aBuf), "%s'%s'", i ? ", " : "", apScores[i]->m_Name.ClrStr());
+		Query += aBuf;
+	}
+	Query += ");";
+	pSqlServer->executeSqlQuery(Query.c_str());
+
+	std::vector<const CSqlScoreData *> apFirstFinishes;
+	for(unsigned i = 0; i < apScores.size(); i++)
+	{
+		bool Known = false;
+		for(unsigned k = 0; k < apFirstFinishes.size() && !Known; k++)
+			Known = str_comp(apFirstFinishes[k]->m_Name.Str(), apScores[i]->m_Name.Str()) == 0;
+		pSqlServer->GetResults()->beforeFirst();
+		while(!Known && pSqlServer->GetResults()->next())
+			Known = str_comp(pSqlServer->GetResults()->getString("Name").c_str(), apScores[i]->m_Name.Str()) == 0;
+		if(!Known)
+			apFirstFinishes.push_back(apScores[i]);
+	}
 
-		str_format(aBuf, sizeof(aBuf), "SELECT * FROM %s_race WHERE Map='%s' AND Name='%s' ORDER BY time ASC LIMIT 1;", pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pData->m_Name.ClrStr());
+	if(!apFirstFinishes.empty())
+	{
+		str_format(aBuf, sizeof(aBuf), "SELECT Points FROM %s_maps WHERE Map ='%s'", pSqlServer->GetPrefix(), pData->m_Map.ClrStr());
 		pSqlServer->executeSqlQuery(aBuf);
-		if(!pSqlServer->GetResults()->next())
+
+		if(pSqlServer->GetResults()->rowsCount() == 1)
 		{
-			str_format(aBuf, sizeof(aBuf), "SELECT Points FROM %s_maps WHERE Map ='%s'", pSqlServer->GetPrefix(), pData->m_Map.ClrStr());
-			pSqlServer->executeSqlQuery(aBuf);
+			pSqlServer->GetResults()->next();
+			int points = (int)pSqlServer->GetResults()->getInt("Points");
 
-			if(pSqlServer->GetResults()->rowsCount() == 1)
+			str_format(aBuf, sizeof(aBuf), "INSERT INTO %s_points(Name, Points) VALUES ", pSqlServer->GetPrefix());
+			Query = aBuf;
+			for(unsigned i = 0; i < apFirstFinishes.size(); i++)
 			{
-				pSqlServer->GetResults()->next();
-				int points = (int)pSqlServer->GetResults()->getInt("Points");
 				if (points == 1)
 					str_format(aBuf, sizeof(aBuf), "You earned %d point for finishing this map!", points);
 				else
 					str_format(aBuf, sizeof(aBuf), "You earned %d points for finishing this map!", points);
+				pData->SendChatTarget(apFirstFinishes[i]->m_ClientID, aBuf);
 
-				try
-				{
-					pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
-				}
-				catch (CGameContextError &e) {} // just do nothing, it is not much of a problem if the player is not informed about points during mapchange
-
-				str_format(aBuf, sizeof(aBuf), "INSERT INTO %s_points(Name, Points) VALUES ('%s', '%d') ON duplicate key UPDATE Name=VALUES(Name), Points=Points+VALUES(Points);", pSqlServer->GetPrefix(), pData->m_Name.ClrStr(), points);
-				pSqlServer->executeSql(aBuf);
+				str_format(aBuf, sizeof(aBuf), "%s('%s', '%d')", i ? ", " : "", apFirstFinishes[i]->m_Name.ClrStr(), points);
+				Query += aBuf;
 			}
+			Query += " ON duplicate key UPDATE Name=VALUES(Name), Points=Points+VALUES(Points);";
+			pSqlServer->executeSql(Query.c_str());
 		}
-
-		// if no entry found... create a new one
-		str_format(aBuf, sizeof(aBuf), "INSERT IGNORE INTO %s_race(Map, Name, Timestamp, Time, Server, cp1, cp2, cp3, cp4, cp5, cp6, cp7, cp8, cp9, cp10, cp11, cp12, cp13, cp14, cp15, cp16, cp17, cp18, cp19, cp20, cp21, cp22, cp23, cp24, cp25, GameID) VALUES ('%s', '%s', CURRENT_TIMESTAMP(), '%.2f', '%s', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%s');", pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pData->m_Name.ClrStr(), pData->m_Time, g_Config.m_SvSqlServerName, pData->m_aCpCurrent[0], pData->m_aCpCurrent[1], pData->m_aCpCurrent[2], pData->m_aCpCurrent[3], pData->m_aCpCurrent[4], pData->m_aCpCurrent[5], pData->m_aCpCurrent[6], pData->m_aCpCurrent[7], pData->m_aCpCurrent[8], pData->m_aCpCurrent[9], pData->m_aCpCurrent[10], pData->m_aCpCurrent[11], pData->m_aCpCurrent[12], pData->m_aCpCurrent[13], pData->m_aCpCurrent[14], pData->m_aCpCurrent[15], pData->m_aCpCurrent[16], pData->m_aCpCurrent[17], pData->m_aCpCurrent[18], pData->m_aCpCurrent[19], pData->m_aCpCurrent[20], pData->m_aCpCurrent[21], pData->m_aCpCurrent[22], pData->m_aCpCurrent[23], pData->m_aCpCurrent[24], pData->m_GameUuid.ClrStr());
-		dbg_msg("sql", "%s", aBuf);
-		pSqlServer->executeSql(aBuf);
-
-		dbg_msg("sql", "Updating time done");
-		return true;
-	}
-	catch (sql::SQLException &e)
-	{
-		dbg_msg("sql", "MySQL Error: %s", e.what());
-		dbg_msg("sql", "ERROR: Could not update time");
 	}
-	return false;
-}
 
-void CSqlScore::SaveTeamScore(int* aClientIDs, unsigned int Size, float Time)
-{
-	CConsole* pCon = (CConsole*)GameServer()->Console();
-	if(pCon->m_Cheated)
-		return;
-	CSqlTeamScoreData *Tmp = new CSqlTeamScoreData();
-	Tmp->m_NotEligible = false;
-	for(unsigned int i = 0; i < Size; i++)
+	str_format(aBuf, sizeof(aBuf), "INSERT IGNORE INTO %s_race(Map, Name, Timestamp, Time, Server, cp1, cp2, cp3, cp4, cp5, cp6, cp7, cp8, cp9, cp10, cp11, cp12, cp13, cp14, cp15, cp16, cp17, cp18, cp19, cp20, cp21, cp22, cp23, cp24, cp25, GameID) VALUES ", pSqlServer->GetPrefix());
+	Query = aBuf;
+	for(unsigned i = 0; i < apScores.size(); i++)
 	{
-		Tmp->m_aClientIDs[i] = aClientIDs[i];
-		Tmp->m_aNames[i] = Server()->ClientName(aClientIDs[i]);
-		Tmp->m_NotEligible = Tmp->m_NotEligible || GameServer()->m_apPlayers[aClientIDs[i]]->m_NotEligibleForFinish;
+		const CSqlScoreData *pScore = apScores[i];
+		str_format(aBuf, sizeof(aBuf), "%s('%s', '%s', CURRENT_TIMESTAMP(), '%.2f', '%s', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%.2f', '%s')", i ? ", " : "", pScore->m_Map.ClrStr(), pScore->m_Name.ClrStr(), pScore->m_Time, g_Config.m_SvSqlServerName, pScore->m_aCpCurrent[0], pScore->m_aCpCurrent[1], pScore->m_aCpCurrent[2], pScore->m_aCpCurrent[3], pScore->m_aCpCurrent[4], pScore->m_aCpCurrent[5], pScore->m_aCpCurrent[6], pScore->m_aCpCurrent[7], pScore->m_aCpCurrent[8], pScore->m_aCpCurrent[9], pScore->m_aCpCurrent[10], pScore->m_aCpCurrent[11], pScore->m_aCpCurrent[12], pScore->m_aCpCurrent[13], pScore->m_aCpCurrent[14], pScore->m_aCpCurrent[15], pScore->m_aCpCurrent[16], pScore->m_aCpCurrent[17], pScore->m_aCpCurrent[18], pScore->m_aCpCurrent[19], pScore->m_aCpCurrent[20], pScore->m_aCpCurrent[21], pScore->m_aCpCurrent[22], pScore->m_aCpCurrent[23], pScore->m_aCpCurrent[24], pScore->m_GameUuid.ClrStr());
+		Query += aBuf;
 	}
-	Tmp->m_Size = Size;
-	Tmp->m_Time = Time;
-
-	void *SaveTeamThread = thread_init(ExecSqlFunc, new CSqlExecData(SaveTeamScoreThread, Tmp, false));
-	thread_detach(SaveTeamThread);
+	Query += ";";
+	dbg_msg("sql", "%s", Query.c_str());
+	pSqlServer->executeSql(Query.c_str());
 }
 
-bool CSqlScore::SaveTeamScoreThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
+
+void CSqlScore::SaveTeamScore(CSqlServer* pSqlServer, const CSqlTeamScoreData *pData)
 {
-	const CSqlTeamScoreData *pData = dynamic_cast<const CSqlTeamScoreData *>(pGameData);
+	char aBuf[2300];
+	char aUpdateID[17];
+	aUpdateID[0] = 0;
 
-	if (HandleFailure)
+	str_format(aBuf, sizeof(aBuf), "SELECT Name, l.ID, Time FROM ((SELECT ID FROM %s_teamrace WHERE Map = '%s' AND Name = '%s') as l) LEFT JOIN %s_teamrace as r ON l.ID = r.ID ORDER BY ID;", pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pData->m_aNames[0].ClrStr(), pSqlServer->GetPrefix());
+	pSqlServer->executeSqlQuery(aBuf);
+
+	if (pSqlServer->GetResults()->rowsCount() > 0)
 	{
-		if (!g_Config.m_SvSqlFailureFile[0])
-			return true;
+		char aID[17];
+		char aID2[17];
+		char aName[64];
+		unsigned int Count = 0;
+		bool ValidNames = true;
 
-		dbg_msg("sql", "ERROR: Could not save TeamScore, writing insert to a file now...");
+		pSqlServer->GetResults()->first();
+		float Time = (float)pSqlServer->GetResults()->getDouble("Time");
+		strcpy(aID, pSqlServer->GetResults()->getString("ID").c_str());
 
-		lock_wait(ms_FailureFileLock);
-		IOHANDLE File = io_open(g_Config.m_SvSqlFailureFile, IOFLAG_APPEND);
-		if(File)
+		do
 		{
-			const char pUUID[] = "SET @id = UUID();";
-			io_write(File, pUUID, sizeof(pUUID) - 1);
-			io_write_newline(File);
-
-			char aTimestamp [20];
-			sqlstr::GetTimeStamp(aTimestamp, sizeof(aTimestamp));
-
-			char aBuf[2300];
-			for(unsigned int i = 0; i < pData->m_Size; i++)
+			strcpy(aID2, pSqlServer->GetResults()->getString("ID").c_str());
+			strcpy(aName, pSqlServer->GetResults()->getString("Name").c_str());
+			sqlstr::ClearString(aName);
+			if (str_comp(aID, aID2) != 0)
 			{
-				str_format(aBuf, sizeof(aBuf), "INSERT IGNORE INTO %%s_teamrace(Map, Name, Timestamp, Time, ID, GameID) VALUES ('%s', '%s', '%s', '%.2f', @id, '%s');%s", pData->m_Map.ClrStr(), pData->m_aNames[i].ClrStr(), aTimestamp, pData->m_Time, pData->m_GameUuid.ClrStr(), pData->m_NotEligible ? " -- not eligible" : "");
-				io_write(File, aBuf, str_length(aBuf));
-				io_write_newline(File);
-			}
-			io_close(File);
-			lock_unlock(ms_FailureFileLock);
-			return true;
-		}
-		lock_unlock(ms_FailureFileLock);
-		return false;
-	}
-
-	if(pData->m_NotEligible)
-	{
-		return false;
-	}
-
-	try
-	{
-		char aBuf[2300];
-		char aUpdateID[17];
-		aUpdateID[0] = 0;
+				if (ValidNames && Count == pData->m_Size)
+				{
+					if (pData->m_Time < Time)
+						strcpy(aUpdateID, aID);
+					else
+						return;
+					break;
+				}
 
-		str_format(aBuf, sizeof(aBuf), "SELECT Name, l.ID, Time FROM ((SELECT ID FROM %s_teamrace WHERE Map = '%s' AND Name = '%s') as l) LEFT JOIN %s_teamrace as r ON l.ID = r.ID ORDER BY ID;", pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pData->m_aNames[0].ClrStr(), pSqlServer->GetPrefix());
-		pSqlServer->executeSqlQuery(aBuf);
+				Time = (float)pSqlServer->GetResults()->getDouble("Time");
+				ValidNames = true;
+				Count = 0;
+				strcpy(aID, aID2);
+			}
 
-		if (pSqlServer->GetResults()->rowsCount() > 0)
-		{
-			char aID[17];
-			char aID2[17];
-			char aName[64];
-			unsigned int Count = 0;
-			bool ValidNames = true;
+			if (!ValidNames)
+				continue;
 
-			pSqlServer->GetResults()->first();
-			float Time = (float)pSqlServer->GetResults()->getDouble("Time");
-			strcpy(aID, pSqlServer->GetResults()->getString("ID").c_str());
+			ValidNames = false;
 
-			do
+			for(unsigned int i = 0; i < pData->m_Size; i++)
 			{
-				strcpy(aID2, pSqlServer->GetResults()->getString("ID").c_str());
-				strcpy(aName, pSqlServer->GetResults()->getString("Name").c_str());
-				sqlstr::ClearString(aName);
-				if (str_comp(aID, aID2) != 0)
+				if (str_comp(aName, pData->m_aNames[i].ClrStr()) == 0)
 				{
-					if (ValidNames && Count == pData->m_Size)
-					{
-						if (pData->m_Time < Time)
-							strcpy(aUpdateID, aID);
-						else
-							goto end;
-						break;
-					}
-
-					Time = (float)pSqlServer->GetResults()->getDouble("Time");
 					ValidNames = true;
-					Count = 0;
-					strcpy(aID, aID2);
-				}
-
-				if (!ValidNames)
-					continue;
-
-				ValidNames = false;
-
-				for(unsigned int i = 0; i < pData->m_Size; i++)
-				{
-					if (str_comp(aName, pData->m_aNames[i].ClrStr()) == 0)
-					{
-						ValidNames = true;
-						Count++;
-						break;
-					}
+					Count++;
+					break;
 				}
-			} while (pSqlServer->GetResults()->next());
-
-			if (ValidNames && Count == pData->m_Size)
-			{
-				if (pData->m_Time < Time)
-					strcpy(aUpdateID, aID);
-				else
-					goto end;
 			}
-		}
+		} while (pSqlServer->GetResults()->next());
 
-		if (aUpdateID[0])
+		if (ValidNames && Count == pData->m_Size)
 		{
-			str_format(aBuf, sizeof(aBuf), "UPDATE %s_teamrace SET Time='%.2f', Timestamp=CURRENT_TIMESTAMP() WHERE ID = '%s';", pSqlServer->GetPrefix(), pData->m_Time, aUpdateID);
-			dbg_msg("sql", "%s", aBuf);
-			pSqlServer->executeSql(aBuf);
-		}
-		else
-		{
-			pSqlServer->executeSql("SET @id = UUID();");
-
-			for(unsigned int i = 0; i < pData->m_Size; i++)
-			{
-			// if no entry found... create a new one
-				str_format(aBuf, sizeof(aBuf), "INSERT IGNORE INTO %s_teamrace(Map, Name, Timestamp, Time, ID, GameID) VALUES ('%s', '%s', CURRENT_TIMESTAMP(), '%.2f', @id, '%s');", pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pData->m_aNames[i].ClrStr(), pData->m_Time, pData->m_GameUuid.ClrStr());
-				dbg_msg("sql", "%s", aBuf);
-				pSqlServer->executeSql(aBuf);
-			}
+			if (pData->m_Time < Time)
+				strcpy(aUpdateID, aID);
+			else
+				return;
 		}
+	}
 
-		end:
-		dbg_msg("sql", "Updating team time done");
-		return true;
+	if (aUpdateID[0])
+	{
+		str_format(aBuf, sizeof(aBuf), "UPDATE %s_teamrace SET Time='%.2f', Timestamp=CURRENT_TIMESTAMP() WHERE ID = '%s';", pSqlServer->GetPrefix(), pData->m_Time, aUpdateID);
+		dbg_msg("sql", "%s", aBuf);
+		pSqlServer->executeSql(aBuf);
 	}
-	catch (sql::SQLException &e)
+	else
 	{
-		dbg_msg("sql", "MySQL Error: %s", e.what());
-		dbg_msg("sql", "ERROR: Could not update time");
+		pSqlServer->executeSql("SET @id = UUID();");
+
+		// if no entry found... create a new one
+		str_format(aBuf, sizeof(aBuf), "INSERT IGNORE INTO %s_teamrace(Map, Name, Timestamp, Time, ID, GameID) VALUES ", pSqlServer->GetPrefix());
+		std::string Query = aBuf;
+		for(unsigned int i = 0; i < pData->m_Size; i++)
+		{
+			str_format(aBuf, sizeof(aBuf), "%s('%s', '%s', CURRENT_TIMESTAMP(), '%.2f', @id, '%s')", i ? ", " : "", pData->m_Map.ClrStr(), pData->m_aNames[i].ClrStr(), pData->m_Time, pData->m_GameUuid.ClrStr());
+			Query += aBuf;
+		}
+		Query += ";";
+		dbg_msg("sql", "%s", Query.c_str());
+		pSqlServer->executeSql(Query.c_str());
 	}
-	return false;
 }
 
 void CSqlScore::ShowRank(int ClientID, const char* pName, bool Search)
 {
-	CSqlScoreData *Tmp = new CSqlScoreData();
-	Tmp->m_ClientID = ClientID;
-	Tmp->m_Name = pName;
-	Tmp->m_Search = Search;
-	str_copy(Tmp->m_aRequestingPlayer, Server()->ClientName(ClientID), sizeof(Tmp->m_aRequestingPlayer));
-
-	void *RankThread = thread_init(ExecSqlFunc, new CSqlExecData(ShowRankThread, Tmp));
-	thread_detach(RankThread);
+	ShowCached(CScoreCache::RANK, 0, pName, ClientID, ShowRankThread);
 }
 
 bool CSqlScore::ShowRankThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -752,42 +1090,38 @@ bool CSqlScore::ShowRankThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 	const CSqlScoreData *pData = dynamic_cast<const CSqlScoreData *>(pGameData);
 
 	if (HandleFailure)
+	{
+		AddCacheResult(pData, 0);
 		return true;
+	}
 
 	try
 	{
 		// check sort method
 		char aBuf[600];
+		std::vector<CScoreCache::CRow> aRows;
 
 		pSqlServer->executeSql("SET @prev := NULL;");
 		pSqlServer->executeSql("SET @rank := 1;");
 		pSqlServer->executeSql("SET @pos := 0;");
-		str_format(aBuf, sizeof(aBuf), "SELECT Rank, Name, Time FROM (SELECT Name, (@pos := @pos+1) pos, (@rank := IF(@prev = Time,@rank, @pos)) rank, (@prev := Time) Time FROM (SELECT Name, min(Time) as Time FROM %s_race WHERE Map = '%s' GROUP BY Name ORDER BY `Time` ASC) as a) as b WHERE Name = '%s';", pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pData->m_Name.ClrStr());
+		str_format(aBuf, sizeof(aBuf), "SELECT Rank, Name, Time FROM (SELECT Name, (@pos := @pos+1) pos, (@rank := IF(@prev = Time,@rank, @pos)) rank, (@prev := Time) Time FROM (SELECT Name, min(Time) as Time FROM %s_race WHERE Map = ? GROUP BY Name ORDER BY `Time` ASC) as a) as b WHERE Name = ?;", pSqlServer->GetPrefix());
 
-		pSqlServer->executeSqlQuery(aBuf);
+		sql::PreparedStatement *pStatement = pSqlServer->prepareSql(aBuf);
+		pStatement->setString(1, pData->m_Map.Str());
+		pStatement->setString(2, pData->m_Name.Str());
+		pSqlServer->executePreparedQuery(pStatement);
 
-		if(pSqlServer->GetResults()->rowsCount() != 1)
-		{
-			str_format(aBuf, sizeof(aBuf), "%s is not ranked", pData->m_Name.Str());
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
-		}
-		else
+		if(pSqlServer->GetResults()->rowsCount() == 1)
 		{
 			pSqlServer->GetResults()->next();
 
-			float Time = (float)pSqlServer->GetResults()->getDouble("Time");
-			int Rank = (int)pSqlServer->GetResults()->getInt("Rank");
-			if(g_Config.m_SvHideScore)
-			{
-				str_format(aBuf, sizeof(aBuf), "Your time: %02d:%05.2f", (int)(Time/60), Time-((int)Time/60*60));
-				pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
-			}
-			else
-			{
-				str_format(aBuf, sizeof(aBuf), "%d. %s Time: %02d:%05.2f, requested by %s", Rank, pSqlServer->GetResults()->getString("Name").c_str(), (int)(Time/60), Time-((int)Time/60*60), pData->m_aRequestingPlayer);
-				pData->GameServer()->SendChat(-1, CGameContext::CHAT_ALL, aBuf, pData->m_ClientID);
-			}
+			CScoreCache::CRow Row;
+			Row.m_Rank = (int)pSqlServer->GetResults()->getInt("Rank");
+			Row.m_Name = pSqlServer->GetResults()->getString("Name").c_str();
+			Row.m_Time = (float)pSqlServer->GetResults()->getDouble("Time");
+			aRows.push_back(Row);
 		}
+		AddCacheResult(pData, &aRows);
 
 		dbg_msg("sql", "Showing rank done");
 		return true;
@@ -797,24 +1131,12 @@ bool CSqlScore::ShowRankThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 		dbg_msg("sql", "MySQL Error: %s", e.what());
 		dbg_msg("sql", "ERROR: Could not show rank");
 	}
-	catch (CGameContextError &e)
-	{
-		dbg_msg("sql", "WARNING: Aborted showing rank due to reload/change of map.");
-		return true;
-	}
 	return false;
 }
 
 void CSqlScore::ShowTeamRank(int ClientID, const char* pName, bool Search)
 {
-	CSqlScoreData *Tmp = new CSqlScoreData();
-	Tmp->m_ClientID = ClientID;
-	Tmp->m_Name = pName;
-	Tmp->m_Search = Search;
-	str_copy(Tmp->m_aRequestingPlayer, Server()->ClientName(ClientID), sizeof(Tmp->m_aRequestingPlayer));
-
-	void *TeamRankThread = thread_init(ExecSqlFunc, new CSqlExecData(ShowTeamRankThread, Tmp));
-	thread_detach(TeamRankThread);
+	ShowCached(CScoreCache::TEAMRANK, 0, pName, ClientID, ShowTeamRankThread);
 }
 
 bool CSqlScore::ShowTeamRankThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -822,7 +1144,10 @@ bool CSqlScore::ShowTeamRankThread(CSqlServer* pSqlServer, const CSqlData *pGame
 	const CSqlScoreData *pData = dynamic_cast<const CSqlScoreData *>(pGameData);
 
 	if (HandleFailure)
+	{
+		AddCacheResult(pData, 0);
 		return true;
+	}
 
 	try
 	{
@@ -830,27 +1155,28 @@ bool CSqlScore::ShowTeamRankThread(CSqlServer* pSqlServer, const CSqlData *pGame
 		char aBuf[2400];
 		char aNames[2300];
 		aNames[0] = '\0';
+		std::vector<CScoreCache::CRow> aRows;
 
 		pSqlServer->executeSql("SET @prev := NULL;");
 		pSqlServer->executeSql("SET @rank := 1;");
 		pSqlServer->executeSql("SET @pos := 0;");
-		str_format(aBuf, sizeof(aBuf), "SELECT Rank, Name, Time FROM (SELECT Rank, l2.ID FROM ((SELECT ID, (@pos := @pos+1) pos, (@rank := IF(@prev = Time,@rank,@pos)) rank, (@prev := Time) Time FROM (SELECT ID, Time FROM %s_teamrace WHERE Map = '%s' GROUP BY ID ORDER BY Time) as ll) as l2) LEFT JOIN %s_teamrace as r2 ON l2.ID = r2.ID WHERE Map = '%s' AND Name = '%s' ORDER BY Rank LIMIT 1) as l LEFT JOIN %s_teamrace as r ON l.ID = r.ID ORDER BY Name;", pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pData->m_Name.ClrStr(), pSqlServer->GetPrefix());
+		str_format(aBuf, sizeof(aBuf), "SELECT Rank, Name, Time FROM (SELECT Rank, l2.ID FROM ((SELECT ID, (@pos := @pos+1) pos, (@rank := IF(@prev = Time,@rank,@pos)) rank, (@prev := Time) Time FROM (SELECT ID, Time FROM %s_teamrace WHERE Map = ? GROUP BY ID ORDER BY Time) as ll) as l2) LEFT JOIN %s_teamrace as r2 ON l2.ID = r2.ID WHERE Map = ? AND Name = ? ORDER BY Rank LIMIT 1) as l LEFT JOIN %s_teamrace as r ON l.ID = r.ID ORDER BY Name;", pSqlServer->GetPrefix(), pSqlServer->GetPrefix(), pSqlServer->GetPrefix());
 
-		pSqlServer->executeSqlQuery(aBuf);
+		sql::PreparedStatement *pStatement = pSqlServer->prepareSql(aBuf);
+		pStatement->setString(1, pData->m_Map.Str());
+		pStatement->setString(2, pData->m_Map.Str());
+		pStatement->setString(3, pData->m_Name.Str());
+		pSqlServer->executePreparedQuery(pStatement);
 
 		int Rows = pSqlServer->GetResults()->rowsCount();
 
-		if(Rows < 1)
-		{
-			str_format(aBuf, sizeof(aBuf), "%s has no team ranks", pData->m_Name.Str());
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
-		}
-		else
+		if(Rows >= 1)
 		{
 			pSqlServer->GetResults()->first();
 
-			float Time = (float)pSqlServer->GetResults()->getDouble("Time");
-			int Rank = (int)pSqlServer->GetResults()->getInt("Rank");
+			CScoreCache::CRow Row;
+			Row.m_Time = (float)pSqlServer->GetResults()->getDouble("Time");
+			Row.m_Rank = (int)pSqlServer->GetResults()->getInt("Rank");
 
 			for(int Row = 0; Row < Rows; Row++)
 			{
@@ -863,19 +1189,10 @@ bool CSqlScore::ShowTeamRankThread(CSqlServer* pSqlServer, const CSqlData *pGame
 					str_append(aNames, " & ", sizeof(aNames));
 			}
 
-			pSqlServer->GetResults()->first();
-
-			if(g_Config.m_SvHideScore)
-			{
-				str_format(aBuf, sizeof(aBuf), "Your team time: %02d:%05.02f", (int)(Time/60), Time-((int)Time/60*60));
-				pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
-			}
-			else
-			{
-				str_format(aBuf, sizeof(aBuf), "%d. %s Team time: %02d:%05.02f, requested by %s", Rank, aNames, (int)(Time/60), Time-((int)Time/60*60), pData->m_aRequestingPlayer);
-				pData->GameServer()->SendChat(-1, CGameContext::CHAT_ALL, aBuf, pData->m_ClientID);
-			}
+			Row.m_Name = aNames;
+			aRows.push_back(Row);
 		}
+		AddCacheResult(pData, &aRows);
 
 		dbg_msg("sql", "Showing teamrank done");
 		return true;
@@ -885,22 +1202,12 @@ bool CSqlScore::ShowTeamRankThread(CSqlServer* pSqlServer, const CSqlData *pGame
 		dbg_msg("sql", "MySQL Error: %s", e.what());
 		dbg_msg("sql", "ERROR: Could not show team rank");
 	}
-	catch (CGameContextError &e)
-	{
-		dbg_msg("sql", "WARNING: Aborted showing teamrank due to reload/change of map.");
-		return true;
-	}
 	return false;
 }
 
 void CSqlScore::ShowTop5(IConsole::IResult *pResult, int ClientID, void *pUserData, int Debut)
 {
-	CSqlScoreData *Tmp = new CSqlScoreData();
-	Tmp->m_Num = Debut;
-	Tmp->m_ClientID = ClientID;
-
-	void *Top5Thread = thread_init(ExecSqlFunc, new CSqlExecData(ShowTop5Thread, Tmp));
-	thread_detach(Top5Thread);
+	ShowCached(CScoreCache::TOP5, Debut, "", ClientID, ShowTop5Thread);
 }
 
 bool CSqlScore::ShowTop5Thread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -908,7 +1215,10 @@ bool CSqlScore::ShowTop5Thread(CSqlServer* pSqlServer, const CSqlData *pGameData
 	const CSqlScoreData *pData = dynamic_cast<const CSqlScoreData *>(pGameData);
 
 	if (HandleFailure)
+	{
+		AddCacheResult(pData, 0);
 		return true;
+	}
 
 	int LimitStart = max(abs(pData->m_Num)-1, 0);
 	const char *pOrder = pData->m_Num >= 0 ? "ASC" : "DESC";
@@ -917,26 +1227,27 @@ bool CSqlScore::ShowTop5Thread(CSqlServer* pSqlServer, const CSqlData *pGameData
 	{
 		// check sort method
 		char aBuf[512];
+		std::vector<CScoreCache::CRow> aRows;
+
 		pSqlServer->executeSql("SET @prev := NULL;");
 		pSqlServer->executeSql("SET @rank := 1;");
 		pSqlServer->executeSql("SET @pos := 0;");
-		str_format(aBuf, sizeof(aBuf), "SELECT Name, Time, Rank FROM (SELECT Name, (@pos := @pos+1) pos, (@rank := IF(@prev = Time,@rank, @pos)) Rank, (@prev := Time) Time FROM (SELECT Name, min(Time) as Time FROM %s_race WHERE Map = '%s' GROUP BY Name ORDER BY `Time` ASC) as a) as b ORDER BY Rank %s LIMIT %d, 5;", pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pOrder, LimitStart);
-		pSqlServer->executeSqlQuery(aBuf);
+		str_format(aBuf, sizeof(aBuf), "SELECT Name, Time, Rank FROM (SELECT Name, (@pos := @pos+1) pos, (@rank := IF(@prev = Time,@rank, @pos)) Rank, (@prev := Time) Time FROM (SELECT Name, min(Time) as Time FROM %s_race WHERE Map = ? GROUP BY Name ORDER BY `Time` ASC) as a) as b ORDER BY Rank %s LIMIT ?, 5;", pSqlServer->GetPrefix(), pOrder);
 
-		// show top5
-		pData->GameServer()->SendChatTarget(pData->m_ClientID, "----------- Top 5 -----------");
+		sql::PreparedStatement *pStatement = pSqlServer->prepareSql(aBuf);
+		pStatement->setString(1, pData->m_Map.Str());
+		pStatement->setInt(2, LimitStart);
+		pSqlServer->executePreparedQuery(pStatement);
 
-		int Rank = 0;
-		float Time = 0;
 		while(pSqlServer->GetResults()->next())
 		{
-			Time = (float)pSqlServer->GetResults()->getDouble("Time");
-			Rank = (float)pSqlServer->GetResults()->getInt("Rank");
-			str_format(aBuf, sizeof(aBuf), "%d. %s Time: %02d:%05.2f", Rank, pSqlServer->GetResults()->getString("Name").c_str(), (int)(Time/60), Time-((int)Time/60*60));
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
-			//Rank++;
+			CScoreCache::CRow Row;
+			Row.m_Time = (float)pSqlServer->GetResults()->getDouble("Time");
+			Row.m_Rank = (int)pSqlServer->GetResults()->getInt("Rank");
+			Row.m_Name = pSqlServer->GetResults()->getString("Name").c_str();
+			aRows.push_back(Row);
 		}
-		pData->GameServer()->SendChatTarget(pData->m_ClientID, "-------------------------------");
+		AddCacheResult(pData, &aRows);
 
 		dbg_msg("sql", "Showing top5 done");
 		return true;
@@ -946,22 +1257,12 @@ bool CSqlScore::ShowTop5Thread(CSqlServer* pSqlServer, const CSqlData *pGameData
 		dbg_msg("sql", "MySQL Error: %s", e.what());
 		dbg_msg("sql", "ERROR: Could not show top5");
 	}
-	catch (CGameContextError &e)
-	{
-		dbg_msg("sql", "WARNING: Aborted showing top5 due to reload/change of map.");
-		return true;
-	}
 	return false;
 }
 
 void CSqlScore::ShowTeamTop5(IConsole::IResult *pResult, int ClientID, void *pUserData, int Debut)
 {
-	CSqlScoreData *Tmp = new CSqlScoreData();
-	Tmp->m_Num = Debut;
-	Tmp->m_ClientID = ClientID;
-
-	void *TeamTop5Thread = thread_init(ExecSqlFunc, new CSqlExecData(ShowTeamTop5Thread, Tmp));
-	thread_detach(TeamTop5Thread);
+	ShowCached(CScoreCache::TEAMTOP5, Debut, "", ClientID, ShowTeamTop5Thread);
 }
 
 bool CSqlScore::ShowTeamTop5Thread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -969,7 +1270,10 @@ bool CSqlScore::ShowTeamTop5Thread(CSqlServer* pSqlServer, const CSqlData *pGame
 	const CSqlScoreData *pData = dynamic_cast<const CSqlScoreData *>(pGameData);
 
 	if (HandleFailure)
+	{
+		AddCacheResult(pData, 0);
 		return true;
+	}
 
 	int LimitStart = max(abs(pData->m_Num)-1, 0);
 	const char *pOrder = pData->m_Num >= 0 ? "ASC" : "DESC";
@@ -978,16 +1282,18 @@ bool CSqlScore::ShowTeamTop5Thread(CSqlServer* pSqlServer, const CSqlData *pGame
 	{
 		// check sort method
 		char aBuf[2400];
+		std::vector<CScoreCache::CRow> aRows;
 
 		pSqlServer->executeSql("SET @prev := NULL;");
 		pSqlServer->executeSql("SET @previd := NULL;");
 		pSqlServer->executeSql("SET @rank := 1;");
 		pSqlServer->executeSql("SET @pos := 0;");
-		str_format(aBuf, sizeof(aBuf), "SELECT ID, Name, Time, Rank FROM (SELECT r.ID, Name, Rank, l.Time FROM ((SELECT ID, Rank, Time FROM (SELECT ID, (@pos := IF(@previd = ID,@pos,@pos+1)) pos, (@previd := ID), (@rank := IF(@prev = Time,@rank,@pos)) Rank, (@prev := Time) Time FROM (SELECT ID, MIN(Time) as Time FROM %s_teamrace WHERE Map = '%s' GROUP BY ID ORDER BY `Time` ASC) as all_top_times) as a ORDER BY Rank %s LIMIT %d, 5) as l) LEFT JOIN %s_teamrace as r ON l.ID = r.ID ORDER BY Time ASC, r.ID, Name ASC) as a;", pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pOrder, LimitStart, pSqlServer->GetPrefix());
-		pSqlServer->executeSqlQuery(aBuf);
+		str_format(aBuf, sizeof(aBuf), "SELECT ID, Name, Time, Rank FROM (SELECT r.ID, Name, Rank, l.Time FROM ((SELECT ID, Rank, Time FROM (SELECT ID, (@pos := IF(@previd = ID,@pos,@pos+1)) pos, (@previd := ID), (@rank := IF(@prev = Time,@rank,@pos)) Rank, (@prev := Time) Time FROM (SELECT ID, MIN(Time) as Time FROM %s_teamrace WHERE Map = ? GROUP BY ID ORDER BY `Time` ASC) as all_top_times) as a ORDER BY Rank %s LIMIT ?, 5) as l) LEFT JOIN %s_teamrace as r ON l.ID = r.ID ORDER BY Time ASC, r.ID, Name ASC) as a;", pSqlServer->GetPrefix(), pOrder, pSqlServer->GetPrefix());
 
-		// show teamtop5
-		pData->GameServer()->SendChatTarget(pData->m_ClientID, "------- Team Top 5 -------");
+		sql::PreparedStatement *pStatement = pSqlServer->prepareSql(aBuf);
+		pStatement->setString(1, pData->m_Map.Str());
+		pStatement->setInt(2, LimitStart);
+		pSqlServer->executePreparedQuery(pStatement);
 
 		int Rows = pSqlServer->GetResults()->rowsCount();
 
@@ -996,8 +1302,6 @@ bool CSqlScore::ShowTeamTop5Thread(CSqlServer* pSqlServer, const CSqlData *pGame
 			char aID[17];
 			char aID2[17];
 			char aNames[2300];
-			int Rank = 0;
-			float Time = 0;
 			int aCuts[320]; // 64 * 5
 			int CutPos = 0;
 
@@ -1029,13 +1333,13 @@ bool CSqlScore::ShowTeamTop5Thread(CSqlServer* pSqlServer, const CSqlData *pGame
 				else if (Row < aCuts[CutPos])
 					str_append(aNames, " & ", sizeof(aNames));
 
-				Time = (float)pSqlServer->GetResults()->getDouble("Time");
-				Rank = (float)pSqlServer->GetResults()->getInt("Rank");
-
 				if (Row == aCuts[CutPos])
 				{
-					str_format(aBuf, sizeof(aBuf), "%d. %s Team Time: %02d:%05.2f", Rank, aNames, (int)(Time/60), Time-((int)Time/60*60));
-					pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
+					CScoreCache::CRow Team;
+					Team.m_Time = (float)pSqlServer->GetResults()->getDouble("Time");
+					Team.m_Rank = (int)pSqlServer->GetResults()->getInt("Rank");
+					Team.m_Name = aNames;
+					aRows.push_back(Team);
 					CutPos++;
 					aNames[0] = '\0';
 				}
@@ -1043,8 +1347,7 @@ bool CSqlScore::ShowTeamTop5Thread(CSqlServer* pSqlServer, const CSqlData *pGame
 				pSqlServer->GetResults()->next();
 			}
 		}
-
-		pData->GameServer()->SendChatTarget(pData->m_ClientID, "-------------------------------");
+		AddCacheResult(pData, &aRows);
 
 		dbg_msg("sql", "Showing teamtop5 done");
 		return true;
@@ -1054,35 +1357,17 @@ bool CSqlScore::ShowTeamTop5Thread(CSqlServer* pSqlServer, const CSqlData *pGame
 		dbg_msg("sql", "MySQL Error: %s", e.what());
 		dbg_msg("sql", "ERROR: Could not show teamtop5");
 	}
-	catch (CGameContextError &e)
-	{
-		dbg_msg("sql", "WARNING: Aborted showing teamtop5 due to reload/change of map.");
-		return true;
-	}
 	return false;
 }
 
 void CSqlScore::ShowTimes(int ClientID, int Debut)
 {
-	CSqlScoreData *Tmp = new CSqlScoreData();
-	Tmp->m_Num = Debut;
-	Tmp->m_ClientID = ClientID;
-	Tmp->m_Search = false;
-
-	void *TimesThread = thread_init(ExecSqlFunc, new CSqlExecData(ShowTimesThread, Tmp));
-	thread_detach(TimesThread);
+	ShowCached(CScoreCache::TIMES, Debut, "", ClientID, ShowTimesThread);
 }
 
 void CSqlScore::ShowTimes(int ClientID, const char* pName, int Debut)
 {
-	CSqlScoreData *Tmp = new CSqlScoreData();
-	Tmp->m_Num = Debut;
-	Tmp->m_ClientID = ClientID;
-	Tmp->m_Name = pName;
-	Tmp->m_Search = true;
-
-	void *TimesThread = thread_init(ExecSqlFunc, new CSqlExecData(ShowTimesThread, Tmp));
-	thread_detach(TimesThread);
+	ShowCached(CScoreCache::TIMES, Debut, pName, ClientID, ShowTimesThread);
 }
 
 bool CSqlScore::ShowTimesThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -1090,7 +1375,10 @@ bool CSqlScore::ShowTimesThread(CSqlServer* pSqlServer, const CSqlData *pGameDat
 	const CSqlScoreData *pData = dynamic_cast<const CSqlScoreData *>(pGameData);
 
 	if (HandleFailure)
+	{
+		AddCacheResult(pData, 0);
 		return true;
+	}
 
 	int LimitStart = max(abs(pData->m_Num)-1, 0);
 	const char *pOrder = pData->m_Num >= 0 ? "DESC" : "ASC";
@@ -1098,53 +1386,32 @@ bool CSqlScore::ShowTimesThread(CSqlServer* pSqlServer, const CSqlData *pGameDat
 	try
 	{
 		char aBuf[512];
+		std::vector<CScoreCache::CRow> aRows;
 
 		if(pData->m_Search) // last 5 times of a player
-			str_format(aBuf, sizeof(aBuf), "SELECT Time, UNIX_TIMESTAMP(CURRENT_TIMESTAMP)-UNIX_TIMESTAMP(Timestamp) as Ago, UNIX_TIMESTAMP(Timestamp) as Stamp FROM %s_race WHERE Map = '%s' AND Name = '%s' ORDER BY Timestamp %s LIMIT %d, 5;", pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pData->m_Name.ClrStr(), pOrder, LimitStart);
+			str_format(aBuf, sizeof(aBuf), "SELECT Time, UNIX_TIMESTAMP(CURRENT_TIMESTAMP)-UNIX_TIMESTAMP(Timestamp) as Ago, UNIX_TIMESTAMP(Timestamp) as Stamp FROM %s_race WHERE Map = ? AND Name = ? ORDER BY Timestamp %s LIMIT ?, 5;", pSqlServer->GetPrefix(), pOrder);
 		else// last 5 times of server
-			str_format(aBuf, sizeof(aBuf), "SELECT Name, Time, UNIX_TIMESTAMP(CURRENT_TIMESTAMP)-UNIX_TIMESTAMP(Timestamp) as Ago, UNIX_TIMESTAMP(Timestamp) as Stamp FROM %s_race WHERE Map = '%s' ORDER BY Timestamp %s LIMIT %d, 5;", pSqlServer->GetPrefix(), pData->m_Map.ClrStr(), pOrder, LimitStart);
+			str_format(aBuf, sizeof(aBuf), "SELECT Name, Time, UNIX_TIMESTAMP(CURRENT_TIMESTAMP)-UNIX_TIMESTAMP(Timestamp) as Ago, UNIX_TIMESTAMP(Timestamp) as Stamp FROM %s_race WHERE Map = ? ORDER BY Timestamp %s LIMIT ?, 5;", pSqlServer->GetPrefix(), pOrder);
 
-		pSqlServer->executeSqlQuery(aBuf);
-
-		// show top5
-		if(pSqlServer->GetResults()->rowsCount() == 0)
-		{
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, "There are no times in the specified range");
-			return true;
-		}
-
-		pData->GameServer()->SendChatTarget(pData->m_ClientID, "------------- Last Times -------------");
-
-		float pTime = 0;
-		int pSince = 0;
-		int pStamp = 0;
+		sql::PreparedStatement *pStatement = pSqlServer->prepareSql(aBuf);
+		int Param = 1;
+		pStatement->setString(Param++, pData->m_Map.Str());
+		if(pData->m_Search)
+			pStatement->setString(Param++, pData->m_Name.Str());
+		pStatement->setInt(Param++, LimitStart);
+		pSqlServer->executePreparedQuery(pStatement);
 
 		while(pSqlServer->GetResults()->next())
 		{
-			char pAgoString[40] = "\0";
-			pSince = (int)pSqlServer->GetResults()->getInt("Ago");
-			pStamp = (int)pSqlServer->GetResults()->getInt("Stamp");
-			pTime = (float)pSqlServer->GetResults()->getDouble("Time");
-
-			sqlstr::AgoTimeToString(pSince,pAgoString);
-
-			if(pData->m_Search) // last 5 times of a player
-			{
-				if(pStamp == 0) // stamp is 00:00:00 cause it's an old entry from old times where there where no stamps yet
-					str_format(aBuf, sizeof(aBuf), "%02d:%05.02f, don't know how long ago", (int)(pTime/60), pTime-((int)pTime/60*60));
-				else
-					str_format(aBuf, sizeof(aBuf), "%s ago, %02d:%05.02f", pAgoString, (int)(pTime/60), pTime-((int)pTime/60*60));
-			}
-			else // last 5 times of the server
-			{
-				if(pStamp == 0) // stamp is 00:00:00 cause it's an old entry from old times where there where no stamps yet
-					str_format(aBuf, sizeof(aBuf), "%s, %02d:%05.02f, don't know when", pSqlServer->GetResults()->getString("Name").c_str(), (int)(pTime/60), pTime-((int)pTime/60*60));
-				else
-					str_format(aBuf, sizeof(aBuf), "%s, %s ago, %02d:%05.02f", pSqlServer->GetResults()->getString("Name").c_str(), pAgoString, (int)(pTime/60), pTime-((int)pTime/60*60));
-			}
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
+			CScoreCache::CRow Row;
+			Row.m_Ago = (int)pSqlServer->GetResults()->getInt("Ago");
+			Row.m_Stamp = (int)pSqlServer->GetResults()->getInt("Stamp");
+			Row.m_Time = (float)pSqlServer->GetResults()->getDouble("Time");
+			if(!pData->m_Search)
+				Row.m_Name = pSqlServer->GetResults()->getString("Name").c_str();
+			aRows.push_back(Row);
 		}
-		pData->GameServer()->SendChatTarget(pData->m_ClientID, "----------------------------------------------------");
+		AddCacheResult(pData, &aRows);
 
 		dbg_msg("sql", "Showing times done");
 		return true;
@@ -1153,25 +1420,13 @@ bool CSqlScore::ShowTimesThread(CSqlServer* pSqlServer, const CSqlData *pGameDat
 	{
 		dbg_msg("sql", "MySQL Error: %s", e.what());
 		dbg_msg("sql", "ERROR: Could not show times");
-		return false;
-	}
-	catch (CGameContextError &e)
-	{
-		dbg_msg("sql", "WARNING: Aborted showing times due to reload/change of map.");
-		return true;
 	}
+	return false;
 }
 
 void CSqlScore::ShowPoints(int ClientID, const char* pName, bool Search)
 {
-	CSqlScoreData *Tmp = new CSqlScoreData();
-	Tmp->m_ClientID = ClientID;
-	Tmp->m_Name = pName;
-	Tmp->m_Search = Search;
-	str_copy(Tmp->m_aRequestingPlayer, Server()->ClientName(ClientID), sizeof(Tmp->m_aRequestingPlayer));
-
-	void *PointsThread = thread_init(ExecSqlFunc, new CSqlExecData(ShowPointsThread, Tmp));
-	thread_detach(PointsThread);
+	ShowCached(CScoreCache::POINTS, 0, pName, ClientID, ShowPointsThread);
 }
 
 bool CSqlScore::ShowPointsThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -1179,31 +1434,36 @@ bool CSqlScore::ShowPointsThread(CSqlServer* pSqlServer, const CSqlData *pGameDa
 	const CSqlScoreData *pData = dynamic_cast<const CSqlScoreData *>(pGameData);
 
 	if (HandleFailure)
+	{
+		AddCacheResult(pData, 0);
 		return true;
+	}
 
 	try
 	{
+		std::vector<CScoreCache::CRow> aRows;
+
 		pSqlServer->executeSql("SET @prev := NULL;");
 		pSqlServer->executeSql("SET @rank := 1;");
 		pSqlServer->executeSql("SET @pos := 0;");
 
 		char aBuf[512];
-		str_format(aBuf, sizeof(aBuf), "SELECT Rank, Points, Name FROM (SELECT Name, (@pos := @pos+1) pos, (@rank := IF(@prev = Points, @rank, @pos)) Rank, (@prev := Points) Points FROM (SELECT Name, Points FROM %s_points GROUP BY Name ORDER BY Points DESC) as a) as b where Name = '%s';", pSqlServer->GetPrefix(), pData->m_Name.ClrStr());
-		pSqlServer->executeSqlQuery(aBuf);
+		str_format(aBuf, sizeof(aBuf), "SELECT Rank, Points, Name FROM (SELECT Name, (@pos := @pos+1) pos, (@rank := IF(@prev = Points, @rank, @pos)) Rank, (@prev := Points) Points FROM (SELECT Name, Points FROM %s_points GROUP BY Name ORDER BY Points DESC) as a) as b where Name = ?;", pSqlServer->GetPrefix());
+		sql::PreparedStatement *pStatement = pSqlServer->prepareSql(aBuf);
+		pStatement->setString(1, pData->m_Name.Str());
+		pSqlServer->executePreparedQuery(pStatement);
 
-		if(pSqlServer->GetResults()->rowsCount() != 1)
-		{
-			str_format(aBuf, sizeof(aBuf), "%s has not collected any points so far", pData->m_Name.Str());
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
-		}
-		else
+		if(pSqlServer->GetResults()->rowsCount() == 1)
 		{
 			pSqlServer->GetResults()->next();
-			int count = (int)pSqlServer->GetResults()->getInt("Points");
-			int rank = (int)pSqlServer->GetResults()->getInt("Rank");
-			str_format(aBuf, sizeof(aBuf), "%d. %s Points: %d, requested by %s", rank, pSqlServer->GetResults()->getString("Name").c_str(), count, pData->m_aRequestingPlayer);
-			pData->GameServer()->SendChat(-1, CGameContext::CHAT_ALL, aBuf, pData->m_ClientID);
+
+			CScoreCache::CRow Row;
+			Row.m_Points = (int)pSqlServer->GetResults()->getInt("Points");
+			Row.m_Rank = (int)pSqlServer->GetResults()->getInt("Rank");
+			Row.m_Name = pSqlServer->GetResults()->getString("Name").c_str();
+			aRows.push_back(Row);
 		}
+		AddCacheResult(pData, &aRows);
 
 		dbg_msg("sql", "Showing points done");
 		return true;
@@ -1213,22 +1473,12 @@ bool CSqlScore::ShowPointsThread(CSqlServer* pSqlServer, const CSqlData *pGameDa
 		dbg_msg("sql", "MySQL Error: %s", e.what());
 		dbg_msg("sql", "ERROR: Could not show points");
 	}
-	catch (CGameContextError &e)
-	{
-		dbg_msg("sql", "WARNING: Aborted showing points due to reload/change of map.");
-		return true;
-	}
 	return false;
 }
 
 void CSqlScore::ShowTopPoints(IConsole::IResult *pResult, int ClientID, void *pUserData, int Debut)
 {
-	CSqlScoreData *Tmp = new CSqlScoreData();
-	Tmp->m_Num = Debut;
-	Tmp->m_ClientID = ClientID;
-
-	void *TopPointsThread = thread_init(ExecSqlFunc, new CSqlExecData(ShowTopPointsThread, Tmp));
-	thread_detach(TopPointsThread);
+	ShowCached(CScoreCache::TOPPOINTS, Debut, "", ClientID, ShowTopPointsThread);
 }
 
 bool CSqlScore::ShowTopPointsThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -1236,7 +1486,10 @@ bool CSqlScore::ShowTopPointsThread(CSqlServer* pSqlServer, const CSqlData *pGam
 	const CSqlScoreData *pData = dynamic_cast<const CSqlScoreData *>(pGameData);
 
 	if (HandleFailure)
+	{
+		AddCacheResult(pData, 0);
 		return true;
+	}
 
 	int LimitStart = max(abs(pData->m_Num)-1, 0);
 	const char *pOrder = pData->m_Num >= 0 ? "ASC" : "DESC";
@@ -1244,22 +1497,26 @@ bool CSqlScore::ShowTopPointsThread(CSqlServer* pSqlServer, const CSqlData *pGam
 	try
 	{
 		char aBuf[512];
+		std::vector<CScoreCache::CRow> aRows;
+
 		pSqlServer->executeSql("SET @prev := NULL;");
 		pSqlServer->executeSql("SET @rank := 1;");
 		pSqlServer->executeSql("SET @pos := 0;");
-		str_format(aBuf, sizeof(aBuf), "SELECT Rank, Points, Name FROM (SELECT Name, (@pos := @pos+1) pos, (@rank := IF(@prev = Points,@rank, @pos)) Rank, (@prev := Points) Points FROM (SELECT Name, Points FROM %s_points GROUP BY Name ORDER BY Points DESC) as a) as b ORDER BY Rank %s LIMIT %d, 5;", pSqlServer->GetPrefix(), pOrder, LimitStart);
-
-		pSqlServer->executeSqlQuery(aBuf);
+		str_format(aBuf, sizeof(aBuf), "SELECT Rank, Points, Name FROM (SELECT Name, (@pos := @pos+1) pos, (@rank := IF(@prev = Points,@rank, @pos)) Rank, (@prev := Points) Points FROM (SELECT Name, Points FROM %s_points GROUP BY Name ORDER BY Points DESC) as a) as b ORDER BY Rank %s LIMIT ?, 5;", pSqlServer->GetPrefix(), pOrder);
 
-		// show top points
-		pData->GameServer()->SendChatTarget(pData->m_ClientID, "-------- Top Points --------");
+		sql::PreparedStatement *pStatement = pSqlServer->prepareSql(aBuf);
+		pStatement->setInt(1, LimitStart);
+		pSqlServer->executePreparedQuery(pStatement);
 
 		while(pSqlServer->GetResults()->next())
 		{
-			str_format(aBuf, sizeof(aBuf), "%d. %s Points: %d", pSqlServer->GetResults()->getInt("Rank"), pSqlServer->GetResults()->getString("Name").c_str(), pSqlServer->GetResults()->getInt("Points"));
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
+			CScoreCache::CRow Row;
+			Row.m_Rank = (int)pSqlServer->GetResults()->getInt("Rank");
+			Row.m_Name = pSqlServer->GetResults()->getString("Name").c_str();
+			Row.m_Points = (int)pSqlServer->GetResults()->getInt("Points");
+			aRows.push_back(Row);
 		}
-		pData->GameServer()->SendChatTarget(pData->m_ClientID, "-------------------------------");
+		AddCacheResult(pData, &aRows);
 
 		dbg_msg("sql", "Showing toppoints done");
 		return true;
@@ -1269,13 +1526,184 @@ bool CSqlScore::ShowTopPointsThread(CSqlServer* pSqlServer, const CSqlData *pGam
 		dbg_msg("sql", "MySQL Error: %s", e.what());
 		dbg_msg("sql", "ERROR: Could not show toppoints");
 	}
-	catch (CGameContextError &e)
+	return false;
+}
+
+void CSqlScore::ShowCached(int Type, int Page, const char *pName, int ClientID, bool (*pFuncPtr) (CSqlServer*, const CSqlData *, bool))
+{
+	CScoreCache::CKey Key(Type, Page, pName);
+	CScoreCache::CWaiter Waiter;
+	Waiter.m_ClientID = ClientID;
+	str_copy(Waiter.m_aRequestingPlayer, Server()->ClientName(ClientID), sizeof(Waiter.m_aRequestingPlayer));
+
+	const CScoreCache::CEntry *pEntry = m_Cache.Find(Key, time_get(), g_Config.m_SvSqlCacheTime);
+	if(pEntry)
 	{
-		dbg_msg("sql", "WARNING: Aborted toppoints-thread due to reload/change of map.");
-		return true;
+		SendCached(Key, pEntry->m_aRows, pEntry->m_Fetched, Waiter);
+		return;
 	}
 
-	return false;
+	// the same query is running already
+	if(!m_Cache.Request(Key, Waiter))
+		return;
+
+	CSqlScoreData *Tmp = new CSqlScoreData();
+	Tmp->m_ClientID = ClientID;
+	Tmp->m_Name = pName;
+	Tmp->m_Num = Page;
+	Tmp->m_Search = pName[0] != 0;
+	Tmp->m_CacheKey = Key;
+
+	if(!ExecSqlFunc(new CSqlExecData(pFuncPtr, Tmp), ClientID))
+	{
+		std::vector<CScoreCache::CWaiter> aWaiters;
+		m_Cache.Cancel(Key, &aWaiters);
+	}
+}
+
+void CSqlScore::AddCacheResult(const CSqlScoreData *pData, const std::vector<CScoreCache::CRow> *paRows)
+{
+	CSqlResult *pResult = new CSqlResult();
+	pResult->m_Type = CSqlResult::CACHE_ROWS;
+	pResult->m_CacheKey = pData->m_CacheKey;
+	pResult->m_Failed = !paRows;
+	if(paRows)
+		pResult->m_aRows = *paRows;
+	pData->AddResult(pResult);
+}
+
+void CSqlScore::SendCached(const CScoreCache::CKey &Key, const std::vector<CScoreCache::CRow> &aRows, int64 Fetched, const CScoreCache::CWaiter &Waiter)
+{
+	char aBuf[2400];
+	int ClientID = Waiter.m_ClientID;
+
+	switch(Key.m_Type)
+	{
+	case CScoreCache::RANK:
+		if(aRows.empty())
+		{
+			str_format(aBuf, sizeof(aBuf), "%s is not ranked", Key.m_Name.c_str());
+			GameServer()->SendChatTarget(ClientID, aBuf);
+		}
+		else
+		{
+			float Time = aRows[0].m_Time;
+			if(g_Config.m_SvHideScore)
+			{
+				str_format(aBuf, sizeof(aBuf), "Your time: %02d:%05.2f", (int)(Time/60), Time-((int)Time/60*60));
+				GameServer()->SendChatTarget(ClientID, aBuf);
+			}
+			else
+			{
+				str_format(aBuf, sizeof(aBuf), "%d. %s Time: %02d:%05.2f, requested by %s", aRows[0].m_Rank, aRows[0].m_Name.c_str(), (int)(Time/60), Time-((int)Time/60*60), Waiter.m_aRequestingPlayer);
+				GameServer()->SendChat(-1, CGameContext::CHAT_ALL, aBuf, ClientID);
+			}
+		}
+		break;
+
+	case CScoreCache::TEAMRANK:
+		if(aRows.empty())
+		{
+			str_format(aBuf, sizeof(aBuf), "%s has no team ranks", Key.m_Name.c_str());
+			GameServer()->SendChatTarget(ClientID, aBuf);
+		}
+		else
+		{
+			float Time = aRows[0].m_Time;
+			if(g_Config.m_SvHideScore)
+			{
+				str_format(aBuf, sizeof(aBuf), "Your team time: %02d:%05.02f", (int)(Time/60), Time-((int)Time/60*60));
+				GameServer()->SendChatTarget(ClientID, aBuf);
+			}
+			else
+			{
+				str_format(aBuf, sizeof(aBuf), "%d. %s Team time: %02d:%05.02f, requested by %s", aRows[0].m_Rank, aRows[0].m_Name.c_str(), (int)(Time/60), Time-((int)Time/60*60), Waiter.m_aRequestingPlayer);
+				GameServer()->SendChat(-1, CGameContext::CHAT_ALL, aBuf, ClientID);
+			}
+		}
+		break;
+
+	case CScoreCache::TOP5:
+		GameServer()->SendChatTarget(ClientID, "----------- Top 5 -----------");
+		for(unsigned i = 0; i < aRows.size(); i++)
+		{
+			float Time = aRows[i].m_Time;
+			str_format(aBuf, sizeof(aBuf), "%d. %s Time: %02d:%05.2f", aRows[i].m_Rank, aRows[i].m_Name.c_str(), (int)(Time/60), Time-((int)Time/60*60));
+			GameServer()->SendChatTarget(ClientID, aBuf);
+		}
+		GameServer()->SendChatTarget(ClientID, "-------------------------------");
+		break;
+
+	case CScoreCache::TEAMTOP5:
+		GameServer()->SendChatTarget(ClientID, "------- Team Top 5 -------");
+		for(unsigned i = 0; i < aRows.size(); i++)
+		{
+			float Time = aRows[i].m_Time;
+			str_format(aBuf, sizeof(aBuf), "%d. %s Team Time: %02d:%05.2f", aRows[i].m_Rank, aRows[i].m_Name.c_str(), (int)(Time/60), Time-((int)Time/60*60));
+			GameServer()->SendChatTarget(ClientID, aBuf);
+		}
+		GameServer()->SendChatTarget(ClientID, "-------------------------------");
+		break;
+
+	case CScoreCache::TIMES:
+	{
+		if(aRows.empty())
+		{
+			GameServer()->SendChatTarget(ClientID, "There are no times in the specified range");
+			break;
+		}
+
+		GameServer()->SendChatTarget(ClientID, "------------- Last Times -------------");
+		int Elapsed = (time_get() - Fetched) / time_freq();
+		for(unsigned i = 0; i < aRows.size(); i++)
+		{
+			float pTime = aRows[i].m_Time;
+			char pAgoString[40] = "\0";
+			sqlstr::AgoTimeToString(aRows[i].m_Ago + Elapsed, pAgoString);
+
+			if(!Key.m_Name.empty()) // last 5 times of a player
+			{
+				if(aRows[i].m_Stamp == 0) // stamp is 00:00:00 cause it's an old entry from old times where there where no stamps yet
+					str_format(aBuf, sizeof(aBuf), "%02d:%05.02f, don't know how long ago", (int)(pTime/60), pTime-((int)pTime/60*60));
+				else
+					str_format(aBuf, sizeof(aBuf), "%s ago, %02d:%05.02f", pAgoString, (int)(pTime/60), pTime-((int)pTime/60*60));
+			}
+			else // last 5 times of the server
+			{
+				if(aRows[i].m_Stamp == 0) // stamp is 00:00:00 cause it's an old entry from old times where there where no stamps yet
+					str_format(aBuf, sizeof(aBuf), "%s, %02d:%05.02f, don't know when", aRows[i].m_Name.c_str(), (int)(pTime/60), pTime-((int)pTime/60*60));
+				else
+					str_format(aBuf, sizeof(aBuf), "%s, %s ago, %02d:%05.02f", aRows[i].m_Name.c_str(), pAgoString, (int)(pTime/60), pTime-((int)pTime/60*60));
+			}
+			GameServer()->SendChatTarget(ClientID, aBuf);
+		}
+		GameServer()->SendChatTarget(ClientID, "----------------------------------------------------");
+		break;
+	}
+
+	case CScoreCache::POINTS:
+		if(aRows.empty())
+		{
+			str_format(aBuf, sizeof(aBuf), "%s has not collected any points so far", Key.m_Name.c_str());
+			GameServer()->SendChatTarget(ClientID, aBuf);
+		}
+		else
+		{
+			str_format(aBuf, sizeof(aBuf), "%d. %s Points: %d, requested by %s", aRows[0].m_Rank, aRows[0].m_Name.c_str(), aRows[0].m_Points, Waiter.m_aRequestingPlayer);
+			GameServer()->SendChat(-1, CGameContext::CHAT_ALL, aBuf, ClientID);
+		}
+		break;
+
+	case CScoreCache::TOPPOINTS:
+		GameServer()->SendChatTarget(ClientID, "-------- Top Points --------");
+		for(unsigned i = 0; i < aRows.size(); i++)
+		{
+			str_format(aBuf, sizeof(aBuf), "%d. %s Points: %d", aRows[i].m_Rank, aRows[i].m_Name.c_str(), aRows[i].m_Points);
+			GameServer()->SendChatTarget(ClientID, aBuf);
+		}
+		GameServer()->SendChatTarget(ClientID, "-------------------------------");
+		break;
+	}
 }
 
 void CSqlScore::RandomMap(int ClientID, int stars)
@@ -1285,8 +1713,7 @@ void CSqlScore::RandomMap(int ClientID, int stars)
 	Tmp->m_ClientID = ClientID;
 	Tmp->m_Name = GameServer()->Server()->ClientName(ClientID);
 
-	void *RandomThread = thread_init(ExecSqlFunc, new CSqlExecData(RandomMapThread, Tmp));
-	thread_detach(RandomThread);
+	ExecSqlFunc(new CSqlExecData(RandomMapThread, Tmp), ClientID);
 }
 
 bool CSqlScore::RandomMapThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -1307,7 +1734,7 @@ bool CSqlScore::RandomMapThread(CSqlServer* pSqlServer, const CSqlData *pGameDat
 
 		if(pSqlServer->GetResults()->rowsCount() != 1)
 		{
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, "No maps found on this server!");
+			pData->SendChatTarget(pData->m_ClientID, "No maps found on this server!");
 			pData->GameServer()->m_LastMapVote = 0;
 		}
 		else
@@ -1343,8 +1770,7 @@ void CSqlScore::RandomUnfinishedMap(int ClientID, int stars)
 	Tmp->m_ClientID = ClientID;
 	Tmp->m_Name = GameServer()->Server()->ClientName(ClientID);
 
-	void *RandomUnfinishedThread = thread_init(ExecSqlFunc, new CSqlExecData(RandomUnfinishedMapThread, Tmp));
-	thread_detach(RandomUnfinishedThread);
+	ExecSqlFunc(new CSqlExecData(RandomUnfinishedMapThread, Tmp), ClientID);
 }
 
 bool CSqlScore::RandomUnfinishedMapThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -1365,7 +1791,7 @@ bool CSqlScore::RandomUnfinishedMapThread(CSqlServer* pSqlServer, const CSqlData
 
 		if(pSqlServer->GetResults()->rowsCount() != 1)
 		{
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, "You have no unfinished maps on this server!");
+			pData->SendChatTarget(pData->m_ClientID, "You have no unfinished maps on this server!");
 			pData->GameServer()->m_LastMapVote = 0;
 		}
 		else
@@ -1414,8 +1840,7 @@ void CSqlScore::SaveTeam(int Team, const char* Code, int ClientID, const char* S
 	Tmp->m_Code = Code;
 	str_copy(Tmp->m_Server, Server, sizeof(Tmp->m_Server));
 
-	void *SaveThread = thread_init(ExecSqlFunc, new CSqlExecData(SaveTeamThread, Tmp, false));
-	thread_detach(SaveThread);
+	ExecSqlFunc(new CSqlExecData(SaveTeamThread, Tmp, false), ClientID);
 }
 
 bool CSqlScore::SaveTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -1437,16 +1862,16 @@ bool CSqlScore::SaveTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 			switch (Num)
 			{
 				case 1:
-					pData->GameServer()->SendChatTarget(pData->m_ClientID, "You have to be in a team (from 1-63)");
+					pData->SendChatTarget(pData->m_ClientID, "You have to be in a team (from 1-63)");
 					break;
 				case 2:
-					pData->GameServer()->SendChatTarget(pData->m_ClientID, "Could not find your Team");
+					pData->SendChatTarget(pData->m_ClientID, "Could not find your Team");
 					break;
 				case 3:
-					pData->GameServer()->SendChatTarget(pData->m_ClientID, "Unable to find all Characters");
+					pData->SendChatTarget(pData->m_ClientID, "Unable to find all Characters");
 					break;
 				case 4:
-					pData->GameServer()->SendChatTarget(pData->m_ClientID, "Your team is not started yet");
+					pData->SendChatTarget(pData->m_ClientID, "Your team is not started yet");
 					break;
 			}
 			if(!Num)
@@ -1456,7 +1881,7 @@ bool CSqlScore::SaveTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 			}
 		}
 		else
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, "You have to be in a team (from 1-63)");
+			pData->SendChatTarget(pData->m_ClientID, "You have to be in a team (from 1-63)");
 
 		if (Num)
 			return true;
@@ -1482,7 +1907,7 @@ bool CSqlScore::SaveTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 				io_close(File);
 				lock_unlock(ms_FailureFileLock);
 
-				pData->GameServer()->SendBroadcast("Database connection failed, teamsave written to a file instead. Admins will add it manually in a few days.", -1);
+				pData->SendBroadcast("Database connection failed, teamsave written to a file instead. Admins will add it manually in a few days.", -1);
 
 				return true;
 			}
@@ -1510,13 +1935,13 @@ bool CSqlScore::SaveTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 
 				char aBuf2[256];
 				str_format(aBuf2, sizeof(aBuf2), "Team successfully saved. Use '/load %s' to continue", pData->m_Code.Str());
-				pData->GameServer()->SendChatTeam(Team, aBuf2);
+				pData->SendChatTeam(Team, aBuf2);
 				((CGameControllerDDRace*)(pData->GameServer()->m_pController))->m_Teams.KillSavedTeam(Team);
 			}
 			else
 			{
 				dbg_msg("sql", "ERROR: This save-code already exists");
-				pData->GameServer()->SendChatTarget(pData->m_ClientID, "This save-code already exists");
+				pData->SendChatTarget(pData->m_ClientID, "This save-code already exists");
 			}
 
 		}
@@ -1524,7 +1949,7 @@ bool CSqlScore::SaveTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 		{
 			dbg_msg("sql", "MySQL Error: %s", e.what());
 			dbg_msg("sql", "ERROR: Could not save the team");
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, "MySQL Error: Could not save the team");
+			pData->SendChatTarget(pData->m_ClientID, "MySQL Error: Could not save the team");
 			pSqlServer->executeSql("unlock tables;");
 			return false;
 		}
@@ -1548,8 +1973,7 @@ void CSqlScore::LoadTeam(const char* Code, int ClientID)
 	Tmp->m_Code = Code;
 	Tmp->m_ClientID = ClientID;
 
-	void *LoadThread = thread_init(ExecSqlFunc, new CSqlExecData(LoadTeamThread, Tmp));
-	thread_detach(LoadThread);
+	ExecSqlFunc(new CSqlExecData(LoadTeamThread, Tmp), ClientID);
 }
 
 bool CSqlScore::LoadTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure)
@@ -1575,7 +1999,7 @@ bool CSqlScore::LoadTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 			if(str_comp(ServerName, g_Config.m_SvSqlServerName))
 			{
 				str_format(aBuf, sizeof(aBuf), "You have to be on the '%s' server to load this savegame", ServerName);
-				pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
+				pData->SendChatTarget(pData->m_ClientID, aBuf);
 				goto end;
 			}
 
@@ -1585,7 +2009,7 @@ bool CSqlScore::LoadTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 			if(since < g_Config.m_SvSaveGamesDelay)
 			{
 				str_format(aBuf, sizeof(aBuf), "You have to wait %d seconds until you can load this savegame", g_Config.m_SvSaveGamesDelay - since);
-				pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
+				pData->SendChatTarget(pData->m_ClientID, aBuf);
 				goto end;
 			}
 
@@ -1594,7 +2018,7 @@ bool CSqlScore::LoadTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 			int Num = SavedTeam.LoadString(pSqlServer->GetResults()->getString("Savegame").c_str());
 
 			if(Num)
-				pData->GameServer()->SendChatTarget(pData->m_ClientID, "Unable to load savegame: data corrupted");
+				pData->SendChatTarget(pData->m_ClientID, "Unable to load savegame: data corrupted");
 			else
 			{
 
@@ -1608,7 +2032,7 @@ bool CSqlScore::LoadTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 					}
 				}
 				if(!Found)
-					pData->GameServer()->SendChatTarget(pData->m_ClientID, "You don't belong to this team");
+					pData->SendChatTarget(pData->m_ClientID, "You don't belong to this team");
 				else
 				{
 					int Team = ((CGameControllerDDRace*)(pData->GameServer()->m_pController))->m_Teams.m_Core.Team(pData->m_ClientID);
@@ -1617,35 +2041,35 @@ bool CSqlScore::LoadTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 
 					if(Num == 1)
 					{
-						pData->GameServer()->SendChatTarget(pData->m_ClientID, "You have to be in a team (from 1-63)");
+						pData->SendChatTarget(pData->m_ClientID, "You have to be in a team (from 1-63)");
 					}
 					else if(Num == 2)
 					{
 						char aBuf[256];
 						str_format(aBuf, sizeof(aBuf), "Too many players in this team, should be %d", SavedTeam.GetMembersCount());
-						pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
+						pData->SendChatTarget(pData->m_ClientID, aBuf);
 					}
 					else if(Num >= 10 && Num < 100)
 					{
 						char aBuf[256];
 						str_format(aBuf, sizeof(aBuf), "Unable to find player: '%s'", SavedTeam.SavedTees[Num-10].GetName());
-						pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
+						pData->SendChatTarget(pData->m_ClientID, aBuf);
 					}
 					else if(Num >= 100 && Num < 200)
 					{
 						char aBuf[256];
 						str_format(aBuf, sizeof(aBuf), "%s is racing right now, Team can't be loaded if a Tee is racing already", SavedTeam.SavedTees[Num-100].GetName());
-						pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
+						pData->SendChatTarget(pData->m_ClientID, aBuf);
 					}
 					else if(Num >= 200)
 					{
 						char aBuf[256];
 						str_format(aBuf, sizeof(aBuf), "Everyone has to be in a team, %s is in team 0 or the wrong team", SavedTeam.SavedTees[Num-200].GetName());
-						pData->GameServer()->SendChatTarget(pData->m_ClientID, aBuf);
+						pData->SendChatTarget(pData->m_ClientID, aBuf);
 					}
 					else
 					{
-						pData->GameServer()->SendChatTeam(Team, "Loading successfully done");
+						pData->SendChatTeam(Team, "Loading successfully done");
 						char aBuf[512];
 						str_format(aBuf, sizeof(aBuf), "DELETE from %s_saves where Code='%s' and Map='%s';", pSqlServer->GetPrefix(), pData->m_Code.ClrStr(), pData->m_Map.ClrStr());
 						pSqlServer->executeSql(aBuf);
@@ -1654,7 +2078,7 @@ bool CSqlScore::LoadTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 			}
 		}
 		else
-			pData->GameServer()->SendChatTarget(pData->m_ClientID, "No such savegame for this map");
+			pData->SendChatTarget(pData->m_ClientID, "No such savegame for this map");
 
 		end:
 		pSqlServer->executeSql("unlock tables;");
@@ -1664,7 +2088,7 @@ bool CSqlScore::LoadTeamThread(CSqlServer* pSqlServer, const CSqlData *pGameData
 	{
 		dbg_msg("sql", "MySQL Error: %s", e.what());
 		dbg_msg("sql", "ERROR: Could not load the team");
-		pData->GameServer()->SendChatTarget(pData->m_ClientID, "MySQL Error: Could not load the team");
+		pData->SendChatTarget(pData->m_ClientID, "MySQL Error: Could not load the team");
 	}
 	catch (CGameContextError &e)
 	{
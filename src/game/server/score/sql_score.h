@@ -4,7 +4,10 @@
 #ifndef GAME_SERVER_SCORE_SQL_SCORE_H
 #define GAME_SERVER_SCORE_SQL_SCORE_H
 
+#include <deque>
 #include <exception>
+#include <string>
+#include <vector>
 
 #include <base/system.h>
 #include <engine/console.h>
@@ -12,6 +15,7 @@
 #include <engine/server/sql_string_helpers.h>
 
 #include "../score.h"
+#include "score_cache.h"
 
 
 class CGameContextError : public std::runtime_error
@@ -21,6 +25,36 @@ public:
 };
 
 
+// output of a score query, applied by the game thread in CSqlScore::OnTick()
+struct CSqlResult
+{
+	enum
+	{
+		CHAT_TARGET=0,
+		CHAT_ALL,
+		CHAT_TEAM,
+		BROADCAST,
+		PLAYER_SCORE,
+		MAP_RECORD,
+		CACHE_ROWS,
+		SCORES_SAVED,
+	};
+
+	int m_Type;
+	int m_Instance;
+	// target client, spam protected client or team, depending on the type
+	int m_ClientID;
+	std::string m_Message;
+
+	float m_Time;
+	bool m_HasCpTime;
+	float m_aCpTime[NUM_CHECKPOINTS];
+
+	CScoreCache::CKey m_CacheKey;
+	std::vector<CScoreCache::CRow> m_aRows;
+	bool m_Failed;
+};
+
 // generic implementation to provide gameserver and server
 struct CSqlData
 {
@@ -40,6 +74,13 @@ struct CSqlData
 	IServer* Server() const { return isGameContextVaild() ? ms_pServer : throw CGameContextError("[CSqlData]: Server() unavailable."); }
 	CPlayerData* PlayerData(int ID) const { return isGameContextVaild() ? &ms_pPlayerData[ID] : throw CGameContextError("[CSqlData]: PlayerData() unavailable."); }
 
+	// queued for the game thread, dropped if the map changes in between
+	void SendChatTarget(int To, const char *pText) const;
+	void SendChat(int SpamProtectionClientID, const char *pText) const;
+	void SendChatTeam(int Team, const char *pText) const;
+	void SendBroadcast(const char *pText, int ClientID) const;
+	void AddResult(CSqlResult *pResult) const;
+
 	sqlstr::CSqlString<128> m_Map;
 	sqlstr::CSqlString<UUID_MAXSTRSIZE> m_GameUuid;
 
@@ -51,6 +92,7 @@ struct CSqlData
 	static CPlayerData *ms_pPlayerData;
 	static const char *ms_pMap;
 	static const char *ms_pGameUuid;
+	static class CSqlWorkerPool *ms_pPool;
 
 	static bool ms_GameContextAvailable;
 	// contains the instancecount of the current GameServer
@@ -79,6 +121,46 @@ struct CSqlExecData
 	volatile static int ms_InstanceCount;
 };
 
+// Runs the score queries on a fixed number of threads. Every worker keeps
+// its own connection to each sqlserver, so queries don't queue up on the
+// lock of a shared connection.
+class CSqlWorkerPool
+{
+public:
+	CSqlWorkerPool(int NumWorkers, int MaxQueued);
+	~CSqlWorkerPool();
+
+	// returns false if the queue is full, inserts are queued regardless
+	bool Queue(CSqlExecData *pData);
+
+	void AddResult(CSqlResult *pResult);
+	// moves the results to pResults, the caller has to delete them
+	void GetResults(std::vector<CSqlResult *> *pResults);
+
+private:
+	struct CWorker
+	{
+		CSqlWorkerPool *m_pPool;
+		void *m_pThread;
+		CSqlServer *m_apSqlReadServers[MAX_SQLSERVERS];
+		CSqlServer *m_apSqlWriteServers[MAX_SQLSERVERS];
+	};
+
+	static void WorkerThread(void *pUser);
+	static void Execute(CSqlExecData *pData, CSqlConnector *pConnector);
+	static void UpdateServers(CSqlServer **ppServers, bool ReadOnly);
+
+	std::vector<CWorker *> m_apWorkers;
+	int m_MaxQueued;
+	LOCK m_Lock;
+	SEMAPHORE m_Semaphore;
+
+	// guarded by m_Lock
+	std::deque<CSqlExecData *> m_Queue;
+	std::vector<CSqlResult *> m_Results;
+	bool m_Shutdown;
+};
+
 struct CSqlPlayerData : CSqlData
 {
 	int m_ClientID;
@@ -107,6 +189,7 @@ struct CSqlScoreData : CSqlData
 	int m_Num;
 	bool m_Search;
 	char m_aRequestingPlayer [MAX_NAME_LENGTH];
+	CScoreCache::CKey m_CacheKey;
 };
 
 struct CSqlTeamScoreData : CSqlData
@@ -119,6 +202,15 @@ struct CSqlTeamScoreData : CSqlData
 	float m_Time;
 };
 
+// finishes that are written to the database together
+struct CSqlScoreBatch : CSqlData
+{
+	virtual ~CSqlScoreBatch();
+
+	std::vector<CSqlScoreData *> m_apScores;
+	std::vector<CSqlTeamScoreData *> m_apTeamScores;
+};
+
 struct CSqlTeamSave : CSqlData
 {
 	virtual ~CSqlTeamSave();
@@ -143,21 +235,48 @@ class CSqlScore: public IScore
 	CGameContext *m_pGameServer;
 	IServer *m_pServer;
 
-	static void ExecSqlFunc(void *pUser);
+	// returns false if the request was rejected
+	bool ExecSqlFunc(CSqlExecData *pExecData, int ClientID = -1);
+	void ApplyResult(const CSqlResult *pResult);
+
+	CScoreCache m_Cache;
+
+	void ShowCached(int Type, int Page, const char *pName, int ClientID, bool (*pFuncPtr) (CSqlServer*, const CSqlData *, bool));
+	void SendCached(const CScoreCache::CKey &Key, const std::vector<CScoreCache::CRow> &aRows, int64 Fetched, const CScoreCache::CWaiter &Waiter);
+	// pass no rows if the query failed
+	static void AddCacheResult(const CSqlScoreData *pData, const std::vector<CScoreCache::CRow> *paRows);
 
 	static bool Init(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure);
 
 	char m_aMap[64];
 	char m_aGameUuid[UUID_MAXSTRSIZE];
 
+	enum
+	{
+		SCORE_BATCH_MAX=32,
+		// in milliseconds
+		SCORE_BATCH_DELAY=500,
+	};
+
+	// finishes are collected for a short time and written in one transaction
+	CSqlScoreBatch *m_pScoreBatch;
+	int64 m_ScoreBatchStart;
+
+	CSqlScoreBatch *AddScoreBatch();
+	void FlushScoreBatch();
+	static void SaveScores(CSqlServer* pSqlServer, const CSqlScoreBatch *pData);
+	static void SaveTeamScore(CSqlServer* pSqlServer, const CSqlTeamScoreData *pData);
+	// returns whether the score was eligible
+	static bool WriteScoreFailure(IOHANDLE File, const CSqlScoreData *pData);
+	static bool WriteTeamScoreFailure(IOHANDLE File, const CSqlTeamScoreData *pData);
+
 	static LOCK ms_FailureFileLock;
 
 	static bool CheckBirthdayThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure = false);
 	static bool MapInfoThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure = false);
 	static bool MapVoteThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure = false);
 	static bool LoadScoreThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure = false);
-	static bool SaveScoreThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure = false);
-	static bool SaveTeamScoreThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure = false);
+	static bool SaveScoreBatchThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure = false);
 	static bool ShowRankThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure = false);
 	static bool ShowTop5Thread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure = false);
 	static bool ShowTeamRankThread(CSqlServer* pSqlServer, const CSqlData *pGameData, bool HandleFailure = false);
@@ -198,6 +317,7 @@ public:
 	virtual void SaveTeam(int Team, const char* Code, int ClientID, const char* Server);
 	virtual void LoadTeam(const char* Code, int ClientID);
 
+	virtual void OnTick();
 	virtual void OnShutdown();
 };
 
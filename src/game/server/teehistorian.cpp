@@ -5,9 +5,13 @@
 #include <engine/shared/json.h>
 #include <game/gamecore.h>
 
+#include <algorithm>
+
 static const char TEEHISTORIAN_NAME[] = "teehistorian@ddnet.tw";
 static const CUuid TEEHISTORIAN_UUID = CalculateUuid(TEEHISTORIAN_NAME);
 static const char TEEHISTORIAN_VERSION[] = "2";
+static const char TEEHISTORIAN_INDEX_NAME[] = "teehistorian-index@ddnet.tw";
+static const CUuid TEEHISTORIAN_INDEX_UUID = CalculateUuid(TEEHISTORIAN_INDEX_NAME);
 
 #define UUID(id, name) static const CUuid UUID_ ## id = CalculateUuid(name);
 #include <engine/shared/teehistorian_ex_chunks.h>
@@ -34,6 +38,8 @@ CTeeHistorian::CTeeHistorian()
 	m_State = STATE_START;
 	m_pfnWriteCallback = 0;
 	m_pWriteCallbackUserdata = 0;
+	m_pfnIndexCallback = 0;
+	m_pIndexCallbackUserdata = 0;
 }
 
 void CTeeHistorian::Reset(const CGameInfo *pGameInfo, WRITE_CALLBACK pfnWriteCallback, void *pUser)
@@ -55,12 +61,31 @@ void CTeeHistorian::Reset(const CGameInfo *pGameInfo, WRITE_CALLBACK pfnWriteCal
 	}
 	m_pfnWriteCallback = pfnWriteCallback;
 	m_pWriteCallbackUserdata = pUser;
+	m_pfnIndexCallback = 0;
+	m_pIndexCallbackUserdata = 0;
+	m_ForceTick = false;
+	m_GameUuid = pGameInfo->m_GameUuid;
+	m_Offset = 0;
 
 	WriteHeader(pGameInfo);
 
 	m_State = STATE_START;
 }
 
+void CTeeHistorian::EnableIndex(WRITE_CALLBACK pfnIndexCallback, void *pUser, int KeyframeInterval)
+{
+	dbg_assert(m_State == STATE_START, "invalid teehistorian state");
+	dbg_assert(KeyframeInterval > 0, "invalid keyframe interval");
+
+	m_pfnIndexCallback = pfnIndexCallback;
+	m_pIndexCallbackUserdata = pUser;
+	m_KeyframeInterval = KeyframeInterval;
+	m_NextKeyframeTick = 0;
+
+	m_pfnIndexCallback(&TEEHISTORIAN_INDEX_UUID, sizeof(TEEHISTORIAN_INDEX_UUID), m_pIndexCallbackUserdata);
+	m_pfnIndexCallback(&m_GameUuid, sizeof(m_GameUuid), m_pIndexCallbackUserdata);
+}
+
 void CTeeHistorian::WriteHeader(const CGameInfo *pGameInfo)
 {
 	Write(&TEEHISTORIAN_UUID, sizeof(TEEHISTORIAN_UUID));
@@ -192,6 +217,12 @@ void CTeeHistorian::BeginTick(int Tick)
 		dbg_msg("teehistorian", "tick %d", Tick);
 	}
 
+	if(m_pfnIndexCallback && m_Tick >= m_NextKeyframeTick)
+	{
+		WriteKeyframe();
+		m_NextKeyframeTick = m_Tick + m_KeyframeInterval;
+	}
+
 	m_State = STATE_BEFORE_PLAYERS;
 }
 
@@ -210,7 +241,7 @@ void CTeeHistorian::EnsureTickWrittenPlayerData(int ClientID)
 	dbg_assert(ClientID > m_MaxClientID, "invalid player data order");
 	m_MaxClientID = ClientID;
 
-	if(!m_TickWritten && (ClientID > m_PrevMaxClientID || m_LastWrittenTick + 1 != m_Tick))
+	if(!m_TickWritten && (ClientID > m_PrevMaxClientID || m_LastWrittenTick + 1 != m_Tick || m_ForceTick))
 	{
 		WriteTick();
 	}
@@ -290,6 +321,7 @@ void CTeeHistorian::RecordDeadPlayer(int ClientID)
 void CTeeHistorian::Write(const void *pData, int DataSize)
 {
 	m_pfnWriteCallback(pData, DataSize, m_pWriteCallbackUserdata);
+	m_Offset += DataSize;
 }
 
 void CTeeHistorian::EnsureTickWritten()
@@ -316,6 +348,61 @@ void CTeeHistorian::WriteTick()
 
 	m_TickWritten = true;
 	m_LastWrittenTick = m_Tick;
+	m_ForceTick = false;
+}
+
+void CTeeHistorian::WriteKeyframe()
+{
+	int NumPlayers = 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(m_aPrevPlayers[i].m_Alive || m_aPrevPlayers[i].m_InputExists)
+		{
+			NumPlayers++;
+		}
+	}
+
+	CPacker Buffer;
+	Buffer.Reset();
+	Buffer.AddInt(m_Tick);
+	Buffer.AddInt(m_LastWrittenTick);
+	Buffer.AddInt(m_Offset >> 32);
+	Buffer.AddInt((int)(m_Offset & 0xffffffff));
+	Buffer.AddInt(NumPlayers);
+	m_pfnIndexCallback(Buffer.Data(), Buffer.Size(), m_pIndexCallbackUserdata);
+
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		CPlayer *pPlayer = &m_aPrevPlayers[i];
+		if(!pPlayer->m_Alive && !pPlayer->m_InputExists)
+		{
+			continue;
+		}
+		Buffer.Reset();
+		Buffer.AddInt(i);
+		Buffer.AddInt(pPlayer->m_Alive | (pPlayer->m_InputExists << 1));
+		if(pPlayer->m_Alive)
+		{
+			Buffer.AddInt(pPlayer->m_X);
+			Buffer.AddInt(pPlayer->m_Y);
+		}
+		if(pPlayer->m_InputExists)
+		{
+			for(int j = 0; j < (int)(sizeof(pPlayer->m_Input) / sizeof(int)); j++)
+			{
+				Buffer.AddInt(((int *)&pPlayer->m_Input)[j]);
+			}
+		}
+		m_pfnIndexCallback(Buffer.Data(), Buffer.Size(), m_pIndexCallbackUserdata);
+	}
+
+	if(m_Debug)
+	{
+		dbg_msg("teehistorian", "keyframe tick=%d offset=%lld players=%d", m_Tick, m_Offset, NumPlayers);
+	}
+
+	// the implicit tick depends on data before the keyframe
+	m_ForceTick = true;
 }
 
 void CTeeHistorian::EndPlayers()
@@ -555,3 +642,431 @@ void CTeeHistorian::Finish()
 
 	Write(Buffer.Data(), Buffer.Size());
 }
+
+
+bool CTeeHistorianIndex::Load(const void *pData, int DataSize)
+{
+	m_aKeyframes.clear();
+
+	const unsigned char *pBytes = (const unsigned char *)pData;
+	if(DataSize < (int)(sizeof(TEEHISTORIAN_INDEX_UUID) + sizeof(m_GameUuid))
+		|| mem_comp(pBytes, &TEEHISTORIAN_INDEX_UUID, sizeof(TEEHISTORIAN_INDEX_UUID)) != 0)
+	{
+		return false;
+	}
+	mem_copy(&m_GameUuid, pBytes + sizeof(TEEHISTORIAN_INDEX_UUID), sizeof(m_GameUuid));
+
+	CUnpacker Unpacker;
+	Unpacker.Reset(pBytes + sizeof(TEEHISTORIAN_INDEX_UUID) + sizeof(m_GameUuid),
+		DataSize - sizeof(TEEHISTORIAN_INDEX_UUID) - sizeof(m_GameUuid));
+	while(true)
+	{
+		CKeyframe Keyframe;
+		Keyframe.m_Tick = Unpacker.GetInt();
+		Keyframe.m_LastWrittenTick = Unpacker.GetInt();
+		int OffsetHigh = Unpacker.GetInt();
+		int OffsetLow = Unpacker.GetInt();
+		Keyframe.m_Offset = ((int64)OffsetHigh << 32) | (unsigned)OffsetLow;
+		int NumPlayers = Unpacker.GetInt();
+		if(Unpacker.Error() || NumPlayers < 0 || NumPlayers > MAX_CLIENTS)
+		{
+			break;
+		}
+
+		for(int i = 0; i < NumPlayers; i++)
+		{
+			CPlayer Player;
+			mem_zero(&Player, sizeof(Player));
+			Player.m_ClientID = Unpacker.GetInt();
+			int Flags = Unpacker.GetInt();
+			Player.m_Alive = Flags & 1;
+			Player.m_InputExists = Flags & 2;
+			if(Player.m_Alive)
+			{
+				Player.m_X = Unpacker.GetInt();
+				Player.m_Y = Unpacker.GetInt();
+			}
+			if(Player.m_InputExists)
+			{
+				for(int j = 0; j < (int)(sizeof(Player.m_Input) / sizeof(int)); j++)
+				{
+					((int *)&Player.m_Input)[j] = Unpacker.GetInt();
+				}
+			}
+			if(Player.m_ClientID < 0 || Player.m_ClientID >= MAX_CLIENTS)
+			{
+				break;
+			}
+			Keyframe.m_aPlayers.push_back(Player);
+		}
+		if(Unpacker.Error() || (int)Keyframe.m_aPlayers.size() != NumPlayers
+			|| (!m_aKeyframes.empty() && Keyframe.m_Tick <= m_aKeyframes.back().m_Tick))
+		{
+			break;
+		}
+		m_aKeyframes.push_back(Keyframe);
+	}
+	return true;
+}
+
+static bool CompareKeyframeTick(int Tick, const CTeeHistorianIndex::CKeyframe &Keyframe)
+{
+	return Tick < Keyframe.m_Tick;
+}
+
+const CTeeHistorianIndex::CKeyframe *CTeeHistorianIndex::Find(int Tick) const
+{
+	std::vector<CKeyframe>::const_iterator It = std::upper_bound(m_aKeyframes.begin(), m_aKeyframes.end(), Tick, CompareKeyframeTick);
+	if(It == m_aKeyframes.begin())
+	{
+		return 0;
+	}
+	return &*(It - 1);
+}
+
+CTeeHistorianReader::CTeeHistorianReader(READ_CALLBACK pfnReadCallback, void *pUser)
+{
+	m_pfnReadCallback = pfnReadCallback;
+	m_pReadCallbackUserdata = pUser;
+	m_BufferPos = 0;
+	m_BufferSize = 0;
+	m_Offset = 0;
+	m_Error = false;
+
+	// same as `CTeeHistorian::Reset`, tick 0 is implicit
+	m_Tick = 0;
+	m_MaxClientID = MAX_CLIENTS;
+	m_PendingClientID = -1;
+	mem_zero(m_aPlayers, sizeof(m_aPlayers));
+
+	m_ClientID = -1;
+	m_FlagMask = 0;
+	mem_zero(&m_ExUuid, sizeof(m_ExUuid));
+}
+
+bool CTeeHistorianReader::ReadByte(unsigned char *pByte)
+{
+	if(m_BufferPos == m_BufferSize)
+	{
+		m_BufferPos = 0;
+		m_BufferSize = m_pfnReadCallback(m_aBuffer, sizeof(m_aBuffer), m_pReadCallbackUserdata);
+		if(m_BufferSize <= 0)
+		{
+			m_BufferSize = 0;
+			return false;
+		}
+	}
+	*pByte = m_aBuffer[m_BufferPos++];
+	m_Offset++;
+	return true;
+}
+
+bool CTeeHistorianReader::ReadInt(int *pInt)
+{
+	// like `CVariableInt::Unpack`, but the data may end anywhere
+	unsigned char Byte;
+	if(!ReadByte(&Byte))
+	{
+		return false;
+	}
+	int Sign = (Byte >> 6) & 1;
+	int Value = Byte & 0x3f;
+	for(int Shift = 6; Shift <= 6 + 7 * 3 && (Byte & 0x80); Shift += 7)
+	{
+		if(!ReadByte(&Byte))
+		{
+			return false;
+		}
+		Value |= (Byte & 0x7f) << Shift;
+	}
+	*pInt = Value ^ -Sign;
+	return true;
+}
+
+bool CTeeHistorianReader::ReadRaw(void *pData, int DataSize)
+{
+	unsigned char *pBytes = (unsigned char *)pData;
+	while(DataSize > 0)
+	{
+		if(m_BufferPos == m_BufferSize)
+		{
+			unsigned char Byte;
+			if(!ReadByte(&Byte))
+			{
+				return false;
+			}
+			*pBytes++ = Byte;
+			DataSize--;
+			continue;
+		}
+		int Copy = min(DataSize, m_BufferSize - m_BufferPos);
+		mem_copy(pBytes, m_aBuffer + m_BufferPos, Copy);
+		m_BufferPos += Copy;
+		m_Offset += Copy;
+		pBytes += Copy;
+		DataSize -= Copy;
+	}
+	return true;
+}
+
+bool CTeeHistorianReader::ReadString(std::string *pString)
+{
+	pString->clear();
+	unsigned char Byte;
+	while(true)
+	{
+		if(!ReadByte(&Byte))
+		{
+			return false;
+		}
+		if(Byte == 0)
+		{
+			return true;
+		}
+		pString->push_back(Byte);
+	}
+}
+
+bool CTeeHistorianReader::ReadHeader()
+{
+	CUuid Uuid;
+	if(!ReadRaw(&Uuid, sizeof(Uuid)) || Uuid != TEEHISTORIAN_UUID)
+	{
+		return false;
+	}
+	return ReadString(&m_aHeaderJson);
+}
+
+void CTeeHistorianReader::Seek(const CTeeHistorianIndex::CKeyframe *pKeyframe)
+{
+	m_BufferPos = 0;
+	m_BufferSize = 0;
+	m_Offset = pKeyframe->m_Offset;
+	m_Error = false;
+
+	// the writer starts the first tick after a keyframe explicitly
+	m_Tick = pKeyframe->m_LastWrittenTick;
+	m_MaxClientID = MAX_CLIENTS;
+	m_PendingClientID = -1;
+	mem_zero(m_aPlayers, sizeof(m_aPlayers));
+	for(unsigned i = 0; i < pKeyframe->m_aPlayers.size(); i++)
+	{
+		const CTeeHistorianIndex::CPlayer *pFrom = &pKeyframe->m_aPlayers[i];
+		CPlayer *pTo = &m_aPlayers[pFrom->m_ClientID];
+		pTo->m_Alive = pFrom->m_Alive;
+		pTo->m_X = pFrom->m_X;
+		pTo->m_Y = pFrom->m_Y;
+		pTo->m_InputExists = pFrom->m_InputExists;
+		pTo->m_Input = pFrom->m_Input;
+	}
+}
+
+int CTeeHistorianReader::Next()
+{
+	if(m_Error)
+	{
+		return ITEM_ERROR;
+	}
+
+	int Type;
+	if(m_PendingClientID >= 0)
+	{
+		Type = m_aPendingValues[0];
+	}
+	else if(!ReadInt(&Type))
+	{
+		return ITEM_END;
+	}
+
+	int Item = ReadItem(Type);
+	if(Item == ITEM_ERROR)
+	{
+		m_Error = true;
+	}
+	return Item;
+}
+
+int CTeeHistorianReader::ReadPlayer(int Type, int ClientID, int X, int Y)
+{
+	if(ClientID < 0 || ClientID >= MAX_CLIENTS)
+	{
+		return ITEM_ERROR;
+	}
+
+	if(m_PendingClientID < 0 && ClientID <= m_MaxClientID)
+	{
+		// implicit tick, return the player data with the next call
+		m_PendingClientID = ClientID;
+		m_aPendingValues[0] = Type;
+		m_aPendingValues[1] = X;
+		m_aPendingValues[2] = Y;
+		m_Tick++;
+		m_MaxClientID = -1;
+		return ITEM_TICK;
+	}
+	m_PendingClientID = -1;
+	m_MaxClientID = ClientID;
+	m_ClientID = ClientID;
+
+	CPlayer *pPlayer = &m_aPlayers[ClientID];
+	if(Type >= 0)
+	{
+		if(!pPlayer->m_Alive)
+		{
+			return ITEM_ERROR;
+		}
+		pPlayer->m_X += X;
+		pPlayer->m_Y += Y;
+		return ITEM_PLAYER;
+	}
+	if(Type == -TEEHISTORIAN_PLAYER_NEW)
+	{
+		pPlayer->m_Alive = true;
+		pPlayer->m_X = X;
+		pPlayer->m_Y = Y;
+		return ITEM_PLAYER;
+	}
+	pPlayer->m_Alive = false;
+	return ITEM_PLAYER_DEAD;
+}
+
+int CTeeHistorianReader::ReadItem(int Type)
+{
+	// the data of player records is kept while an implicit tick is returned
+	if(m_PendingClientID >= 0)
+	{
+		return ReadPlayer(Type, m_PendingClientID, m_aPendingValues[1], m_aPendingValues[2]);
+	}
+
+	int ClientID = -1;
+	if(Type >= 0)
+	{
+		int dx, dy;
+		if(!ReadInt(&dx) || !ReadInt(&dy))
+		{
+			return ITEM_END;
+		}
+		return ReadPlayer(Type, Type, dx, dy);
+	}
+
+	if(Type != -TEEHISTORIAN_FINISH && Type != -TEEHISTORIAN_TICK_SKIP && Type != -TEEHISTORIAN_EX)
+	{
+		if(!ReadInt(&ClientID))
+		{
+			return ITEM_END;
+		}
+		if(ClientID < 0 || ClientID >= MAX_CLIENTS)
+		{
+			return ITEM_ERROR;
+		}
+		m_ClientID = ClientID;
+	}
+
+	switch(-Type)
+	{
+	case TEEHISTORIAN_FINISH:
+		return ITEM_FINISH;
+	case TEEHISTORIAN_TICK_SKIP:
+	{
+		int dt;
+		if(!ReadInt(&dt))
+		{
+			return ITEM_END;
+		}
+		if(dt < 0)
+		{
+			return ITEM_ERROR;
+		}
+		m_Tick += dt + 1;
+		m_MaxClientID = -1;
+		return ITEM_TICK;
+	}
+	case TEEHISTORIAN_PLAYER_NEW:
+	{
+		int x, y;
+		if(!ReadInt(&x) || !ReadInt(&y))
+		{
+			return ITEM_END;
+		}
+		return ReadPlayer(Type, ClientID, x, y);
+	}
+	case TEEHISTORIAN_PLAYER_OLD:
+		return ReadPlayer(Type, ClientID, 0, 0);
+	case TEEHISTORIAN_INPUT_DIFF:
+	case TEEHISTORIAN_INPUT_NEW:
+	{
+		CPlayer *pPlayer = &m_aPlayers[ClientID];
+		int aInput[sizeof(CNetObj_PlayerInput) / sizeof(int)];
+		for(int i = 0; i < (int)(sizeof(aInput) / sizeof(int)); i++)
+		{
+			if(!ReadInt(&aInput[i]))
+			{
+				return ITEM_END;
+			}
+		}
+		if(Type == -TEEHISTORIAN_INPUT_DIFF)
+		{
+			if(!pPlayer->m_InputExists)
+			{
+				return ITEM_ERROR;
+			}
+			for(int i = 0; i < (int)(sizeof(aInput) / sizeof(int)); i++)
+			{
+				aInput[i] += ((int *)&pPlayer->m_Input)[i];
+			}
+		}
+		mem_copy(&pPlayer->m_Input, aInput, sizeof(pPlayer->m_Input));
+		pPlayer->m_InputExists = true;
+		return ITEM_INPUT;
+	}
+	case TEEHISTORIAN_MESSAGE:
+	case TEEHISTORIAN_EX:
+	{
+		if(Type == -TEEHISTORIAN_EX && !ReadRaw(&m_ExUuid, sizeof(m_ExUuid)))
+		{
+			return ITEM_END;
+		}
+		int Size;
+		if(!ReadInt(&Size))
+		{
+			return ITEM_END;
+		}
+		if(Size < 0 || Size > MAX_ITEM_SIZE)
+		{
+			return ITEM_ERROR;
+		}
+		m_aData.resize(Size);
+		if(Size && !ReadRaw(&m_aData[0], Size))
+		{
+			return ITEM_END;
+		}
+		return Type == -TEEHISTORIAN_EX ? ITEM_EX : ITEM_MESSAGE;
+	}
+	case TEEHISTORIAN_JOIN:
+		return ITEM_JOIN;
+	case TEEHISTORIAN_DROP:
+		return ReadString(&m_aString) ? ITEM_DROP : ITEM_END;
+	case TEEHISTORIAN_CONSOLE_COMMAND:
+	{
+		int NumArguments;
+		if(!ReadInt(&m_FlagMask) || !ReadString(&m_aString) || !ReadInt(&NumArguments))
+		{
+			return ITEM_END;
+		}
+		if(NumArguments < 0 || NumArguments > MAX_ARGUMENTS)
+		{
+			return ITEM_ERROR;
+		}
+		m_aArguments.resize(NumArguments);
+		for(int i = 0; i < NumArguments; i++)
+		{
+			if(!ReadString(&m_aArguments[i]))
+			{
+				return ITEM_END;
+			}
+		}
+		return ITEM_CONSOLE_COMMAND;
+	}
+	}
+	return ITEM_ERROR;
+}
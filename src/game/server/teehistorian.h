@@ -5,10 +5,14 @@
 #include <engine/console.h>
 #include <engine/shared/packer.h>
 #include <engine/shared/protocol.h>
+#include <engine/shared/uuid_manager.h>
 #include <game/generated/protocol.h>
 
 #include <time.h>
 
+#include <string>
+#include <vector>
+
 struct CConfiguration;
 class CTuningParams;
 class CUuidManager;
@@ -41,6 +45,9 @@ public:
 	CTeeHistorian();
 
 	void Reset(const CGameInfo *pGameInfo, WRITE_CALLBACK pfnWriteCallback, void *pUser);
+	// Writes the tick → offset index with a keyframe of all player states
+	// every `KeyframeInterval` ticks. Must be called right after `Reset`.
+	void EnableIndex(WRITE_CALLBACK pfnIndexCallback, void *pUser, int KeyframeInterval);
 	void Finish();
 
 	bool Starting() const { return m_State == STATE_START; }
@@ -75,6 +82,7 @@ private:
 	void EnsureTickWrittenPlayerData(int ClientID);
 	void EnsureTickWritten();
 	void WriteTick();
+	void WriteKeyframe();
 	void Write(const void *pData, int DataSize);
 
 	enum
@@ -102,8 +110,19 @@ private:
 	WRITE_CALLBACK m_pfnWriteCallback;
 	void *m_pWriteCallbackUserdata;
 
+	WRITE_CALLBACK m_pfnIndexCallback;
+	void *m_pIndexCallbackUserdata;
+	int m_KeyframeInterval;
+	int m_NextKeyframeTick;
+	// the next tick must be written explicitly so it can be read
+	// starting at the last keyframe
+	bool m_ForceTick;
+
 	int m_State;
 
+	CUuid m_GameUuid;
+	int64 m_Offset;
+
 	int m_LastWrittenTick;
 	bool m_TickWritten;
 	int m_Tick;
@@ -112,4 +131,148 @@ private:
 	CPlayer m_aPrevPlayers[MAX_CLIENTS];
 };
 
+// Keyframes written by `CTeeHistorian::EnableIndex`. Reading the
+// teehistorian file can start at `m_Offset` with the state of the keyframe.
+class CTeeHistorianIndex
+{
+public:
+	struct CPlayer
+	{
+		int m_ClientID;
+		bool m_Alive;
+		int m_X;
+		int m_Y;
+		bool m_InputExists;
+		CNetObj_PlayerInput m_Input;
+	};
+
+	struct CKeyframe
+	{
+		int m_Tick;
+		// tick of the last data before `m_Offset`
+		int m_LastWrittenTick;
+		int64 m_Offset;
+		std::vector<CPlayer> m_aPlayers;
+	};
+
+	// returns false if the data isn't an index, a truncated index keeps
+	// its complete keyframes
+	bool Load(const void *pData, int DataSize);
+
+	CUuid GameUuid() const { return m_GameUuid; }
+	int NumKeyframes() const { return m_aKeyframes.size(); }
+	const CKeyframe *Keyframe(int Index) const { return &m_aKeyframes[Index]; }
+	// latest keyframe at or before `Tick`, 0 if there is none
+	const CKeyframe *Find(int Tick) const;
+
+private:
+	CUuid m_GameUuid;
+	std::vector<CKeyframe> m_aKeyframes;
+};
+
+class CTeeHistorianReader
+{
+public:
+	// returns the number of bytes read, 0 at the end of the data
+	typedef int (*READ_CALLBACK)(void *pData, int DataSize, void *pUser);
+
+	enum
+	{
+		ITEM_ERROR=-1,
+		// data ended without FINISH, e.g. the server crashed
+		ITEM_END,
+		ITEM_FINISH,
+		// the tick changed, `Tick()` is the new tick
+		ITEM_TICK,
+		ITEM_PLAYER,
+		ITEM_PLAYER_DEAD,
+		ITEM_INPUT,
+		ITEM_MESSAGE,
+		ITEM_JOIN,
+		ITEM_DROP,
+		ITEM_CONSOLE_COMMAND,
+		ITEM_EX,
+	};
+
+	struct CPlayer
+	{
+		bool m_Alive;
+		int m_X;
+		int m_Y;
+
+		CNetObj_PlayerInput m_Input;
+		bool m_InputExists;
+	};
+
+	CTeeHistorianReader(READ_CALLBACK pfnReadCallback, void *pUser);
+
+	// reads the header, returns false if the data isn't a teehistorian file
+	bool ReadHeader();
+	const char *HeaderJson() const { return m_aHeaderJson.c_str(); }
+
+	// continues with the state of the keyframe, the caller must have moved
+	// the data of the read callback to `pKeyframe->m_Offset`
+	void Seek(const CTeeHistorianIndex::CKeyframe *pKeyframe);
+
+	int Next();
+
+	int Tick() const { return m_Tick; }
+	int64 Offset() const { return m_Offset; }
+	const CPlayer *Player(int ClientID) const { return &m_aPlayers[ClientID]; }
+
+	// valid depending on the item returned by `Next`
+	int ClientID() const { return m_ClientID; }
+	// message, data of ex chunks
+	const void *Data() const { return m_aData.empty() ? 0 : &m_aData[0]; }
+	int DataSize() const { return m_aData.size(); }
+	// drop reason, console command
+	const char *String() const { return m_aString.c_str(); }
+	int FlagMask() const { return m_FlagMask; }
+	int NumArguments() const { return m_aArguments.size(); }
+	const char *Argument(int Index) const { return m_aArguments[Index].c_str(); }
+	CUuid ExUuid() const { return m_ExUuid; }
+
+private:
+	bool ReadByte(unsigned char *pByte);
+	bool ReadInt(int *pInt);
+	bool ReadRaw(void *pData, int DataSize);
+	bool ReadString(std::string *pString);
+	int ReadItem(int Type);
+	int ReadPlayer(int Type, int ClientID, int X, int Y);
+
+	enum
+	{
+		// sanity limits for damaged files
+		MAX_ITEM_SIZE=1024*1024,
+		MAX_ARGUMENTS=64,
+	};
+
+	READ_CALLBACK m_pfnReadCallback;
+	void *m_pReadCallbackUserdata;
+
+	unsigned char m_aBuffer[16 * 1024];
+	int m_BufferPos;
+	int m_BufferSize;
+	int64 m_Offset;
+	bool m_Error;
+
+	std::string m_aHeaderJson;
+
+	int m_Tick;
+	// highest client id of player data in the current tick, player data
+	// of a lower one starts the next tick
+	int m_MaxClientID;
+	// player data read ahead to find an implicit tick
+	int m_PendingClientID;
+	int m_aPendingValues[3];
+	CPlayer m_aPlayers[MAX_CLIENTS];
+
+	int m_ClientID;
+	std::vector<unsigned char> m_aData;
+	std::string m_aString;
+	int m_FlagMask;
+	std::vector<std::string> m_aArguments;
+	CUuid m_ExUuid;
+};
+
 #endif // GAME_SERVER_TEEHISTORIAN_H
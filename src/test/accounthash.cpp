@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include <game/server/accounthash.h>
+
+static void ExpectPbkdf2(const char *pPassword, const char *pSalt, int Rounds, const char *pExpected)
+{
+	char aHash[SHA256_MAXSTRSIZE];
+	sha256_str(Pbkdf2Sha256(pPassword, str_length(pPassword), pSalt, str_length(pSalt), Rounds), aHash, sizeof(aHash));
+	EXPECT_STREQ(aHash, pExpected);
+}
+
+TEST(AccountHash, Pbkdf2)
+{
+	ExpectPbkdf2("password", "salt", 1, "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b");
+	ExpectPbkdf2("password", "salt", 2, "ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43");
+	ExpectPbkdf2("password", "salt", 4096, "c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a");
+	ExpectPbkdf2("passwd", "salt", 1, "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc");
+}
+
+TEST(AccountHash, RoundTrip)
+{
+	char aStored[ACCOUNT_PASSWORD_MAXSTRSIZE];
+	AccountHashPassword(aStored, sizeof(aStored), "hunter2", 1000);
+
+	bool NeedsRehash = true;
+	EXPECT_TRUE(AccountCheckPassword(aStored, "hunter2", 1000, &NeedsRehash));
+	EXPECT_FALSE(NeedsRehash);
+	EXPECT_FALSE(AccountCheckPassword(aStored, "hunter3", 1000, &NeedsRehash));
+	EXPECT_FALSE(AccountCheckPassword(aStored, "", 1000, &NeedsRehash));
+
+	EXPECT_TRUE(AccountCheckPassword(aStored, "hunter2", 2000, &NeedsRehash));
+	EXPECT_TRUE(NeedsRehash);
+}
+
+TEST(AccountHash, Salted)
+{
+	char aStored1[ACCOUNT_PASSWORD_MAXSTRSIZE];
+	char aStored2[ACCOUNT_PASSWORD_MAXSTRSIZE];
+	AccountHashPassword(aStored1, sizeof(aStored1), "hunter2", 1000);
+	AccountHashPassword(aStored2, sizeof(aStored2), "hunter2", 1000);
+	EXPECT_STRNE(aStored1, aStored2);
+}
+
+TEST(AccountHash, Cleartext)
+{
+	bool NeedsRehash = false;
+	EXPECT_TRUE(AccountCheckPassword("hunter2", "hunter2", 1000, &NeedsRehash));
+	EXPECT_TRUE(NeedsRehash);
+	EXPECT_FALSE(AccountCheckPassword("hunter2", "hunter", 1000, &NeedsRehash));
+	EXPECT_FALSE(AccountCheckPassword("hunter2", "Hunter2", 1000, &NeedsRehash));
+}
@@ -0,0 +1,42 @@
+#include "test.h"
+#include <gtest/gtest.h>
+
+#include <game/server/accountwriter.h>
+
+TEST(AccountWriter, Write)
+{
+	CTestInfo Info;
+	CAccountWriter Writer;
+	Writer.Queue(Info.m_aFilename, "old");
+	Writer.Queue(Info.m_aFilename, "new");
+	Writer.Flush();
+
+	IOHANDLE File = io_open(Info.m_aFilename, IOFLAG_READ);
+	ASSERT_TRUE(File);
+	char aBuf[16] = {0};
+	io_read(File, aBuf, sizeof(aBuf) - 1);
+	io_close(File);
+	EXPECT_STREQ(aBuf, "new");
+	fs_remove(Info.m_aFilename);
+
+	std::vector<std::string> Failed;
+	Writer.GetFailed(&Failed);
+	EXPECT_TRUE(Failed.empty());
+}
+
+TEST(AccountWriter, Failed)
+{
+	CAccountWriter Writer;
+	Writer.Queue("nonexistent_directory/account.acc", "data");
+	Writer.Flush();
+
+	std::vector<std::string> Failed;
+	Writer.GetFailed(&Failed);
+	ASSERT_EQ(Failed.size(), 1u);
+	EXPECT_EQ(Failed[0], "nonexistent_directory/account.acc");
+
+	// reported once
+	Failed.clear();
+	Writer.GetFailed(&Failed);
+	EXPECT_TRUE(Failed.empty());
+}
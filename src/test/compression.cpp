@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include <base/math.h>
+#include <base/system.h>
+#include <engine/shared/compression.h>
+
+#include <vector>
+
+// one int at a time with Pack and Unpack, how Compress and Decompress
+// worked before they got the faster paths
+static long ReferenceCompress(const int *pSrc, int Num, unsigned char *pDst, int DstSize)
+{
+	unsigned char *pCur = pDst;
+	for(int i = 0; i < Num; i++)
+	{
+		if(pDst + DstSize - pCur < 6)
+			return -1;
+		pCur = CVariableInt::Pack(pCur, pSrc[i]);
+	}
+	return pCur - pDst;
+}
+
+static long ReferenceDecompress(const unsigned char *pSrc, int Size, int *pDst, int DstNum)
+{
+	const unsigned char *pEnd = pSrc + Size;
+	int Num = 0;
+	while(pSrc < pEnd)
+	{
+		if(Num >= DstNum)
+			return -1;
+		pSrc = CVariableInt::Unpack(pSrc, &pDst[Num++]);
+	}
+	return Num * sizeof(int);
+}
+
+static int RandomInt(unsigned *pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	unsigned Kind = (*pSeed >> 8) % 8;
+	*pSeed = *pSeed * 1103515245 + 12345;
+	unsigned Value = *pSeed ^ (*pSeed << 13);
+	switch(Kind)
+	{
+	case 0: case 1: case 2: return 0;
+	case 3: return (int)(Value % 129) - 64; // around the one byte limit
+	case 4: return (int)(Value % 20000) - 10000;
+	case 5: return (int)(Value >> ((Value >> 4) % 32));
+	case 6: return (Value & 1) ? 0x7FFFFFFF - (int)(Value % 4) : (int)0x80000000 + (int)(Value % 4);
+	default: return (int)(Value % 64);
+	}
+}
+
+TEST(VariableInt, Equivalence)
+{
+	unsigned Seed = 1;
+	std::vector<int> aData;
+	std::vector<int> aDecompressed;
+	unsigned char aCompressed[6000];
+	unsigned char aExpected[6000];
+
+	for(int Run = 0; Run < 2000; Run++)
+	{
+		int Num = Run % 100 == 0 ? 1000 : Run % 70;
+		aData.resize(Num + 1);
+		aDecompressed.resize(Num + 16);
+		for(int i = 0; i < Num; i++)
+			aData[i] = RandomInt(&Seed);
+
+		long Expected = ReferenceCompress(aData.data(), Num, aExpected, sizeof(aExpected));
+		ASSERT_GE(Expected, 0);
+		ASSERT_EQ(CVariableInt::Compress(aData.data(), Num * sizeof(int), aCompressed, sizeof(aCompressed)), Expected);
+		ASSERT_EQ(mem_comp(aCompressed, aExpected, Expected), 0);
+
+		// fails on the same output sizes
+		for(int DstSize = max((int)Expected - 8, 0); DstSize <= Expected + 8; DstSize++)
+			EXPECT_EQ(CVariableInt::Compress(aData.data(), Num * sizeof(int), aCompressed, DstSize), ReferenceCompress(aData.data(), Num, aExpected, DstSize));
+
+		ASSERT_EQ(CVariableInt::Decompress(aExpected, Expected, aDecompressed.data(), Num * sizeof(int)), (long)(Num * sizeof(int)));
+		for(int i = 0; i < Num; i++)
+			ASSERT_EQ(aDecompressed[i], aData[i]);
+		if(Num > 0)
+		{
+			EXPECT_EQ(CVariableInt::Decompress(aExpected, Expected, aDecompressed.data(), (Num - 1) * sizeof(int)), -1);
+		}
+	}
+}
+
+TEST(VariableInt, Garbage)
+{
+	// any bytes decode like before, also when they end in the middle of an int
+	unsigned Seed = 2;
+	unsigned char aData[64];
+	int aDecompressed[64];
+	int aExpected[64];
+	for(int Run = 0; Run < 5000; Run++)
+	{
+		int Size = Run % 40;
+		for(int i = 0; i < Size; i++)
+		{
+			Seed = Seed * 1103515245 + 12345;
+			aData[i] = (Seed >> 8) % 3 == 0 ? (Seed >> 16) & 0x3F : Seed >> 16;
+		}
+		// the old code read over the end, so pad like a larger buffer would
+		mem_zero(aData + Size, sizeof(aData) - Size);
+		int DstNum = Run % 7 == 0 ? Size / 2 : Size;
+		long Expected = ReferenceDecompress(aData, Size, aExpected, DstNum);
+		ASSERT_EQ(CVariableInt::Decompress(aData, Size, aDecompressed, DstNum * sizeof(int)), Expected);
+		for(int i = 0; i < Expected / (int)sizeof(int); i++)
+			ASSERT_EQ(aDecompressed[i], aExpected[i]);
+	}
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <engine/console.h>
+#include <engine/shared/config.h>
+
+#include <vector>
+
+class Console : public ::testing::Test
+{
+protected:
+	IConsole *m_pConsole;
+	std::vector<int> m_aCalls;
+
+	Console()
+	{
+		m_pConsole = CreateConsole(CFGFLAG_SERVER);
+	}
+
+	~Console()
+	{
+		delete m_pConsole;
+	}
+
+	static void ConRecord(IConsole::IResult *pResult, void *pUserData)
+	{
+		Console *pSelf = (Console *)pUserData;
+		pSelf->m_aCalls.push_back(pResult->NumArguments() ? pResult->GetInteger(0) : -1);
+	}
+
+	static void ConStroke(IConsole::IResult *pResult, void *pUserData)
+	{
+		((Console *)pUserData)->m_aCalls.push_back(100 + pResult->GetInteger(0));
+	}
+};
+
+TEST_F(Console, FindCaseInsensitive)
+{
+	m_pConsole->Register("test_record", "?i", CFGFLAG_SERVER, ConRecord, this, "");
+	const IConsole::CCommandInfo *pInfo = m_pConsole->GetCommandInfo("TEST_Record", CFGFLAG_SERVER, false);
+	ASSERT_TRUE(pInfo);
+	EXPECT_STREQ(pInfo->m_pName, "test_record");
+	EXPECT_FALSE(m_pConsole->GetCommandInfo("test_record", CFGFLAG_CLIENT, false));
+	EXPECT_FALSE(m_pConsole->GetCommandInfo("test_recor", CFGFLAG_SERVER, false));
+
+	m_pConsole->ExecuteLine("Test_Record 3; test_record; no_such_command 1; TEST_RECORD 5");
+	ASSERT_EQ(m_aCalls.size(), 3u);
+	EXPECT_EQ(m_aCalls[0], 3);
+	EXPECT_EQ(m_aCalls[1], -1);
+	EXPECT_EQ(m_aCalls[2], 5);
+}
+
+TEST_F(Console, ReRegisterFlags)
+{
+	m_pConsole->Register("test_record", "?i", CFGFLAG_SERVER, ConRecord, this, "");
+	m_pConsole->Register("test_record", "?i", CFGFLAG_CLIENT, ConRecord, this, "client");
+	ASSERT_TRUE(m_pConsole->GetCommandInfo("test_record", CFGFLAG_SERVER, false));
+	EXPECT_STREQ(m_pConsole->GetCommandInfo("test_record", CFGFLAG_SERVER, false)->m_pHelp, "");
+	ASSERT_TRUE(m_pConsole->GetCommandInfo("test_record", CFGFLAG_CLIENT, false));
+	EXPECT_STREQ(m_pConsole->GetCommandInfo("test_record", CFGFLAG_CLIENT, false)->m_pHelp, "client");
+}
+
+TEST_F(Console, Temp)
+{
+	m_pConsole->RegisterTemp("temp_a", "", CFGFLAG_SERVER, "a");
+	m_pConsole->RegisterTemp("temp_b", "", CFGFLAG_SERVER, "b");
+	EXPECT_TRUE(m_pConsole->GetCommandInfo("Temp_A", CFGFLAG_SERVER, true));
+	EXPECT_FALSE(m_pConsole->GetCommandInfo("temp_a", CFGFLAG_SERVER, false));
+
+	m_pConsole->DeregisterTemp("temp_a");
+	EXPECT_FALSE(m_pConsole->GetCommandInfo("temp_a", CFGFLAG_SERVER, true));
+	EXPECT_TRUE(m_pConsole->GetCommandInfo("temp_b", CFGFLAG_SERVER, true));
+
+	// recycles the entry of temp_a
+	m_pConsole->RegisterTemp("temp_c", "", CFGFLAG_SERVER, "c");
+	EXPECT_FALSE(m_pConsole->GetCommandInfo("temp_a", CFGFLAG_SERVER, true));
+	ASSERT_TRUE(m_pConsole->GetCommandInfo("temp_c", CFGFLAG_SERVER, true));
+	EXPECT_STREQ(m_pConsole->GetCommandInfo("temp_c", CFGFLAG_SERVER, true)->m_pHelp, "c");
+
+	m_pConsole->DeregisterTempAll();
+	EXPECT_FALSE(m_pConsole->GetCommandInfo("temp_b", CFGFLAG_SERVER, true));
+	EXPECT_FALSE(m_pConsole->GetCommandInfo("temp_c", CFGFLAG_SERVER, true));
+	EXPECT_TRUE(m_pConsole->GetCommandInfo("echo", CFGFLAG_SERVER, false));
+}
+
+TEST_F(Console, Stroke)
+{
+	m_pConsole->Register("+test_stroke", "", CFGFLAG_SERVER, ConStroke, this, "");
+	m_pConsole->Register("test_record", "?i", CFGFLAG_SERVER, ConRecord, this, "");
+	m_pConsole->ExecuteLine("test_record 1; +test_stroke; test_record 2");
+	ASSERT_EQ(m_aCalls.size(), 4u);
+	EXPECT_EQ(m_aCalls[0], 1);
+	EXPECT_EQ(m_aCalls[1], 101);
+	EXPECT_EQ(m_aCalls[2], 2);
+	EXPECT_EQ(m_aCalls[3], 100);
+}
@@ -59,3 +59,62 @@ TEST(Datafile, ExtendedType)
 
 	delete pStorage;
 }
+
+TEST(Datafile, Mapped)
+{
+	IStorage *pStorage = CreateLocalStorage();
+	CTestInfo Info;
+
+	int aData[1000];
+	for(int i = 0; i < 1000; i++)
+		aData[i] = i * i;
+
+	{
+		CDataFileWriter Writer;
+		Writer.Open(pStorage, Info.m_aFilename);
+		Writer.AddData(sizeof(aData), aData);
+		Writer.AddData(sizeof(int), aData + 7);
+		Writer.Finish();
+	}
+
+	{
+		CDataFileReader Reader;
+		ASSERT_TRUE(Reader.Open(pStorage, Info.m_aFilename, IStorage::TYPE_ALL));
+
+		ASSERT_EQ(Reader.GetDataSize(0), (int)sizeof(aData));
+		EXPECT_EQ(mem_comp(Reader.GetData(0), aData, sizeof(aData)), 0);
+		ASSERT_EQ(Reader.GetDataSize(1), (int)sizeof(int));
+		EXPECT_EQ(*(int *)Reader.GetData(1), 49);
+
+		// the mapping is the file as is
+		unsigned Size;
+		const unsigned char *pMapped = Reader.MappedFile(&Size);
+		ASSERT_TRUE(pMapped);
+		IOHANDLE File = pStorage->OpenFile(Info.m_aFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+		ASSERT_TRUE(File);
+		ASSERT_EQ(Size, (unsigned)io_length(File));
+		unsigned char *pFile = (unsigned char *)malloc(Size);
+		io_read(File, pFile, Size);
+		io_close(File);
+		EXPECT_EQ(mem_comp(pMapped, pFile, Size), 0);
+		free(pFile);
+	}
+
+	{
+		CDataFileReader Reader;
+		ASSERT_TRUE(Reader.Open(pStorage, Info.m_aFilename, IStorage::TYPE_ALL, false));
+
+		unsigned Size;
+		EXPECT_FALSE(Reader.MappedFile(&Size));
+		ASSERT_EQ(Reader.GetDataSize(0), (int)sizeof(aData));
+		EXPECT_EQ(mem_comp(Reader.GetData(0), aData, sizeof(aData)), 0);
+		EXPECT_EQ(*(int *)Reader.GetData(1), 49);
+	}
+
+	if(!HasFailure())
+	{
+		pStorage->RemoveFile(Info.m_aFilename, IStorage::TYPE_SAVE);
+	}
+
+	delete pStorage;
+}
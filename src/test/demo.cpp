@@ -0,0 +1,212 @@
+#include "test.h"
+#include <gtest/gtest.h>
+
+#include <engine/console.h>
+#include <engine/shared/config.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/network.h>
+#include <engine/storage.h>
+
+#include <vector>
+
+class DemoRecorder : public ::testing::Test, public CDemoPlayer::IListener
+{
+protected:
+	IStorage *m_pStorage;
+	IConsole *m_pConsole;
+	CSnapshotDelta m_SnapshotDelta;
+	CDemoWriter m_Writer;
+	CTestInfo m_Info;
+
+	CDemoPlayer *m_pPlayer;
+	std::vector<int> m_aSnapshotTicks;
+	std::vector<int> m_aMessages;
+
+	DemoRecorder()
+	{
+		CNetBase::Init();
+		m_pStorage = CreateLocalStorage();
+		m_pConsole = CreateConsole(CFGFLAG_SERVER);
+		m_pPlayer = 0;
+	}
+
+	~DemoRecorder()
+	{
+		m_pStorage->RemoveFile(m_Info.m_aFilename, IStorage::TYPE_SAVE);
+		delete m_pConsole;
+		delete m_pStorage;
+	}
+
+	int Snapshot(int Tick, void *pData)
+	{
+		CSnapshotBuilder Builder;
+		Builder.Init();
+		int *pItem = (int *)Builder.NewItem(1, 0, 3 * sizeof(int));
+		pItem[0] = Tick;
+		pItem[1] = Tick / 10;
+		pItem[2] = 1234;
+		// a large item that only changes sometimes
+		int *pBig = (int *)Builder.NewItem(2, 0, 512 * sizeof(int));
+		for(int i = 0; i < 512; i++)
+			pBig[i] = i * (Tick / 100 + 1);
+		return Builder.Finish(pData);
+	}
+
+	virtual void OnDemoPlayerSnapshot(void *pData, int Size)
+	{
+		CSnapshot *pSnap = (CSnapshot *)pData;
+		ASSERT_EQ(pSnap->NumItems(), 2);
+		const int *pItem = (const int *)pSnap->GetItem(0)->Data();
+		int Tick = m_pPlayer->BaseInfo()->m_CurrentTick;
+		EXPECT_EQ(pItem[0], Tick);
+		EXPECT_EQ(pItem[1], Tick / 10);
+		EXPECT_EQ(pItem[2], 1234);
+		const int *pBig = (const int *)pSnap->GetItem(1)->Data();
+		EXPECT_EQ(pBig[511], 511 * (Tick / 100 + 1));
+		m_aSnapshotTicks.push_back(Tick);
+	}
+
+	virtual void OnDemoPlayerMessage(void *pData, int Size)
+	{
+		ASSERT_EQ(Size, (int)sizeof(int));
+		m_aMessages.push_back(*(int *)pData);
+	}
+};
+
+TEST_F(DemoRecorder, RecordPlay)
+{
+	CDemoRecorder Recorder(&m_SnapshotDelta, &m_Writer);
+	SHA256_DIGEST Sha256 = {{0}};
+	unsigned char aMapData[16] = {0};
+	ASSERT_EQ(Recorder.Start(m_pStorage, m_pConsole, m_Info.m_aFilename, "0.6 626fce9a778df4d4", "dm1", Sha256, 0, "server", sizeof(aMapData), aMapData), 0);
+	EXPECT_TRUE(Recorder.IsRecording());
+
+	unsigned char aSnap[CSnapshot::MAX_SIZE];
+	for(int Tick = 100; Tick < 600; Tick++)
+	{
+		Recorder.RecordSnapshot(Tick, aSnap, Snapshot(Tick, aSnap));
+		if(Tick % 7 == 0)
+			Recorder.RecordMessage(&Tick, sizeof(Tick));
+		if(Tick % 100 == 0)
+			Recorder.AddDemoMarker();
+	}
+	EXPECT_EQ(Recorder.Length(), 9);
+	EXPECT_EQ(Recorder.Stop(), 0);
+	EXPECT_FALSE(Recorder.IsRecording());
+	m_Writer.Flush();
+
+	CDemoPlayer Player(&m_SnapshotDelta);
+	m_pPlayer = &Player;
+	Player.SetListener(this);
+	ASSERT_EQ(Player.Load(m_pStorage, m_pConsole, m_Info.m_aFilename, IStorage::TYPE_SAVE), 0);
+
+	// header fields written by `Stop`
+	const CDemoHeader *pHeader = &Player.Info()->m_Header;
+	int Length = (pHeader->m_aLength[0] << 24) | (pHeader->m_aLength[1] << 16) | (pHeader->m_aLength[2] << 8) | pHeader->m_aLength[3];
+	EXPECT_EQ(Length, 9);
+	ASSERT_EQ(Player.BaseInfo()->m_NumTimelineMarkers, 5);
+	EXPECT_EQ(Player.BaseInfo()->m_aTimelineMarkers[0], 100);
+	EXPECT_EQ(Player.BaseInfo()->m_aTimelineMarkers[4], 500);
+	EXPECT_EQ(Player.BaseInfo()->m_FirstTick, 100);
+	EXPECT_EQ(Player.BaseInfo()->m_LastTick, 599);
+	EXPECT_GT(Player.Info()->m_SeekablePoints, 1);
+
+	Player.Play();
+	Player.Update(false);
+	Player.Stop();
+
+	ASSERT_FALSE(m_aSnapshotTicks.empty());
+	EXPECT_EQ(m_aSnapshotTicks.back(), 599);
+	for(unsigned i = 1; i < m_aSnapshotTicks.size(); i++)
+		EXPECT_EQ(m_aSnapshotTicks[i], m_aSnapshotTicks[i - 1] + 1);
+
+	ASSERT_FALSE(m_aMessages.empty());
+	EXPECT_EQ(m_aMessages.back(), 595);
+	for(unsigned i = 1; i < m_aMessages.size(); i++)
+		EXPECT_EQ(m_aMessages[i], m_aMessages[i - 1] + 7);
+}
+
+TEST_F(DemoRecorder, SharedDelta)
+{
+	CDemoRecorder Recorder(&m_SnapshotDelta, &m_Writer);
+	SHA256_DIGEST Sha256 = {{0}};
+	unsigned char aMapData[16] = {0};
+	ASSERT_EQ(Recorder.Start(m_pStorage, m_pConsole, m_Info.m_aFilename, "0.6 626fce9a778df4d4", "dm1", Sha256, 0, "server", sizeof(aMapData), aMapData), 0);
+
+	// like the server: deltas against the last acked snapshot, which lags
+	// behind sometimes
+	std::vector<std::vector<unsigned char> > aaSnaps(600);
+	char aDelta[CSnapshot::MAX_SIZE];
+	for(int Tick = 100; Tick < 600; Tick++)
+	{
+		aaSnaps[Tick].resize(CSnapshot::MAX_SIZE);
+		int Size = Snapshot(Tick, &aaSnaps[Tick][0]);
+		int DeltaTick = Tick % 13 == 0 ? Tick - 3 : Tick - 1;
+		if(DeltaTick < 100)
+			DeltaTick = -1;
+		CSnapshot EmptySnap;
+		EmptySnap.Clear();
+		CSnapshot *pBase = DeltaTick == -1 ? &EmptySnap : (CSnapshot *)&aaSnaps[DeltaTick][0];
+		int DeltaSize = m_SnapshotDelta.CreateDelta(pBase, (CSnapshot *)&aaSnaps[Tick][0], aDelta);
+		if(Tick % 50 == 0)
+			Recorder.RecordSnapshot(Tick, &aaSnaps[Tick][0], Size);
+		else
+			Recorder.RecordSnapshotShared(Tick, &aaSnaps[Tick][0], Size, DeltaTick, aDelta, DeltaSize);
+	}
+	EXPECT_EQ(Recorder.Stop(), 0);
+	m_Writer.Flush();
+
+	CDemoPlayer Player(&m_SnapshotDelta);
+	m_pPlayer = &Player;
+	Player.SetListener(this);
+	ASSERT_EQ(Player.Load(m_pStorage, m_pConsole, m_Info.m_aFilename, IStorage::TYPE_SAVE), 0);
+	Player.Play();
+	Player.Update(false);
+	Player.Stop();
+
+	ASSERT_FALSE(m_aSnapshotTicks.empty());
+	EXPECT_EQ(m_aSnapshotTicks.back(), 599);
+	for(unsigned i = 1; i < m_aSnapshotTicks.size(); i++)
+		EXPECT_EQ(m_aSnapshotTicks[i], m_aSnapshotTicks[i - 1] + 1);
+}
+
+TEST_F(DemoRecorder, StopModes)
+{
+	CDemoRecorder Recorder(&m_SnapshotDelta, &m_Writer);
+	SHA256_DIGEST Sha256 = {{0}};
+	unsigned char aMapData[16] = {0};
+	char aTarget[128];
+	str_format(aTarget, sizeof(aTarget), "%s.saved", m_Info.m_aFilename);
+
+	// the second demo with the same name is only opened after the first
+	// one got removed
+	unsigned char aSnap[CSnapshot::MAX_SIZE];
+	for(int i = 0; i < 2; i++)
+	{
+		ASSERT_EQ(Recorder.Start(m_pStorage, m_pConsole, m_Info.m_aFilename, "0.6 626fce9a778df4d4", "dm1", Sha256, 0, "server", sizeof(aMapData), aMapData), 0);
+		for(int Tick = 100; Tick < 200; Tick++)
+			Recorder.RecordSnapshot(Tick, aSnap, Snapshot(Tick, aSnap));
+		if(i == 0)
+			EXPECT_EQ(Recorder.Stop(IDemoRecorder::STOPMODE_REMOVE_FILE), 0);
+		else
+			EXPECT_EQ(Recorder.Stop(IDemoRecorder::STOPMODE_KEEP_FILE, aTarget), 0);
+	}
+	m_Writer.Flush();
+
+	IOHANDLE File = m_pStorage->OpenFile(m_Info.m_aFilename, IOFLAG_READ, IStorage::TYPE_SAVE);
+	EXPECT_FALSE(File);
+	if(File)
+		io_close(File);
+
+	CDemoPlayer Player(&m_SnapshotDelta);
+	m_pPlayer = &Player;
+	Player.SetListener(this);
+	ASSERT_EQ(Player.Load(m_pStorage, m_pConsole, aTarget, IStorage::TYPE_SAVE), 0);
+	Player.Play();
+	Player.Update(false);
+	Player.Stop();
+	m_pStorage->RemoveFile(aTarget, IStorage::TYPE_SAVE);
+
+	ASSERT_FALSE(m_aSnapshotTicks.empty());
+	EXPECT_EQ(m_aSnapshotTicks.back(), 199);
+}
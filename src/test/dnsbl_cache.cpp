@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+
+#include <engine/server/dnsbl_cache.h>
+#include <engine/shared/jobs.h>
+
+#include <string>
+#include <vector>
+
+// answers like a DNSBL that lists 127.0.0.2 and everything in 10.0.0.0/8
+class CStubLookup : public CHostLookup
+{
+	SEMAPHORE *m_pRelease;
+
+	virtual void Run()
+	{
+		if(m_pRelease)
+			sphore_wait(m_pRelease);
+		m_Result = str_startswith(m_aHostname, "2.0.0.127.") || str_find(m_aHostname, ".10.dnsbl.test") ? 0 : -1;
+	}
+
+public:
+	CStubLookup(const char *pHostname, SEMAPHORE *pRelease) :
+		CHostLookup(pHostname, NETTYPE_IPV4), m_pRelease(pRelease)
+	{
+	}
+};
+
+class DnsblCache : public ::testing::Test
+{
+protected:
+	CJobPool m_Pool;
+	CDnsblCache m_Cache;
+	SEMAPHORE m_Release;
+	bool m_Hold;
+	std::vector<std::string> m_aLookups;
+	struct CResult
+	{
+		int m_ClientID;
+		int m_Result;
+	};
+	std::vector<CResult> m_aResults;
+
+	DnsblCache()
+	{
+		m_Pool.Init(2);
+		sphore_init(&m_Release);
+		m_Hold = false;
+		m_Cache.Init(StartLookup, OnResult, this);
+		m_Cache.Configure("dnsbl.test", "", 60, 30);
+	}
+
+	~DnsblCache()
+	{
+		for(int i = 0; i < 8; i++)
+			sphore_signal(&m_Release);
+		// let the pool finish before the semaphore goes away
+		while(m_Cache.NumPending())
+			m_Cache.Update(0);
+		sphore_destroy(&m_Release);
+	}
+
+	static std::shared_ptr<CHostLookup> StartLookup(const char *pHostname, void *pUser)
+	{
+		DnsblCache *pSelf = (DnsblCache *)pUser;
+		pSelf->m_aLookups.push_back(pHostname);
+		std::shared_ptr<CHostLookup> pLookup = std::make_shared<CStubLookup>(pHostname, pSelf->m_Hold ? &pSelf->m_Release : 0);
+		pSelf->m_Pool.Add(pLookup);
+		return pLookup;
+	}
+
+	static void OnResult(int ClientID, const NETADDR *pAddr, int Result, void *pUser)
+	{
+		CResult Entry = {ClientID, Result};
+		((DnsblCache *)pUser)->m_aResults.push_back(Entry);
+	}
+
+	static NETADDR Addr(const char *pStr)
+	{
+		NETADDR Addr;
+		EXPECT_EQ(net_addr_from_str(&Addr, pStr), 0);
+		return Addr;
+	}
+
+	void Query(const char *pAddr, int ClientID, int64 Now)
+	{
+		NETADDR Addr = DnsblCache::Addr(pAddr);
+		m_Cache.Query(&Addr, ClientID, Now);
+	}
+
+	void Wait(int64 Now)
+	{
+		for(int i = 0; i < 1000 && m_Cache.NumPending(); i++)
+		{
+			m_Cache.Update(Now);
+			thread_sleep(1000);
+		}
+		m_Cache.Update(Now);
+	}
+};
+
+TEST_F(DnsblCache, Lookup)
+{
+	Query("127.0.0.2:8303", 3, 0);
+	Query("127.0.0.3:8303", 4, 0);
+	ASSERT_EQ(m_aLookups.size(), 2u);
+	EXPECT_EQ(m_aLookups[0], "2.0.0.127.dnsbl.test");
+	EXPECT_TRUE(m_aResults.empty());
+
+	Wait(0);
+	ASSERT_EQ(m_aResults.size(), 2u);
+	for(unsigned i = 0; i < m_aResults.size(); i++)
+		EXPECT_EQ(m_aResults[i].m_Result, m_aResults[i].m_ClientID == 3 ? CDnsblCache::RESULT_BLACKLISTED : CDnsblCache::RESULT_WHITELISTED);
+	EXPECT_EQ(m_Cache.NumCached(), 2);
+}
+
+TEST_F(DnsblCache, Key)
+{
+	m_Cache.Configure("dnsbl.test", "secret", 60, 30);
+	Query("1.2.3.4", 0, 0);
+	ASSERT_EQ(m_aLookups.size(), 1u);
+	EXPECT_EQ(m_aLookups[0], "secret.4.3.2.1.dnsbl.test");
+	Wait(0);
+}
+
+TEST_F(DnsblCache, Cached)
+{
+	int64 Freq = time_freq();
+	Query("10.1.2.3", 1, 0);
+	Query("1.2.3.4", 2, 0);
+	Wait(0);
+	m_aResults.clear();
+
+	// within the ttl, the result only shows up with the next update
+	Query("10.1.2.3:1234", 5, 20 * Freq);
+	Query("1.2.3.4:1234", 6, 20 * Freq);
+	EXPECT_EQ(m_aLookups.size(), 2u);
+	EXPECT_TRUE(m_aResults.empty());
+	m_Cache.Update(20 * Freq);
+	ASSERT_EQ(m_aResults.size(), 2u);
+	EXPECT_EQ(m_aResults[0].m_ClientID, 5);
+	EXPECT_EQ(m_aResults[0].m_Result, CDnsblCache::RESULT_BLACKLISTED);
+	EXPECT_EQ(m_aResults[1].m_ClientID, 6);
+	EXPECT_EQ(m_aResults[1].m_Result, CDnsblCache::RESULT_WHITELISTED);
+
+	// whitelisted results expire earlier
+	Query("10.1.2.3", 7, 40 * Freq);
+	Query("1.2.3.4", 8, 40 * Freq);
+	EXPECT_EQ(m_aLookups.size(), 3u);
+	Wait(40 * Freq);
+
+	// another provider doesn't know the old results
+	m_Cache.Configure("other.test", "", 60, 30);
+	EXPECT_EQ(m_Cache.NumCached(), 0);
+	Query("10.1.2.3", 9, 40 * Freq);
+	EXPECT_EQ(m_aLookups.size(), 4u);
+	Wait(40 * Freq);
+}
+
+TEST_F(DnsblCache, InFlight)
+{
+	m_Hold = true;
+	Query("10.0.0.1", 1, 0);
+	Query("10.0.0.1:2000", 2, 0);
+	Query("10.0.0.1:3000", 3, 0);
+	EXPECT_EQ(m_aLookups.size(), 1u);
+	EXPECT_EQ(m_Cache.NumPending(), 1);
+	m_Cache.Update(0);
+	EXPECT_TRUE(m_aResults.empty());
+
+	sphore_signal(&m_Release);
+	Wait(0);
+	ASSERT_EQ(m_aResults.size(), 3u);
+	for(unsigned i = 0; i < m_aResults.size(); i++)
+	{
+		EXPECT_EQ(m_aResults[i].m_ClientID, (int)i + 1);
+		EXPECT_EQ(m_aResults[i].m_Result, CDnsblCache::RESULT_BLACKLISTED);
+	}
+}
+
+TEST_F(DnsblCache, NoTtl)
+{
+	m_Cache.Configure("dnsbl.test", "", 0, 0);
+	Query("10.0.0.1", 1, 0);
+	Wait(0);
+	EXPECT_EQ(m_Cache.NumCached(), 0);
+	Query("10.0.0.1", 1, 0);
+	EXPECT_EQ(m_aLookups.size(), 2u);
+	Wait(0);
+}
@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+
+#include <game/server/score/file_score_index.h>
+
+#include <algorithm>
+
+static CFileScoreRecord Record(const char *pName, float Time)
+{
+	CFileScoreRecord Record;
+	mem_zero(&Record, sizeof(Record));
+	str_copy(Record.m_aName, pName, sizeof(Record.m_aName));
+	Record.m_Time = Time;
+	return Record;
+}
+
+TEST(FileScoreIndex, Empty)
+{
+	CFileScoreIndex Index;
+	EXPECT_EQ(Index.Num(), 0);
+	EXPECT_EQ(Index.Find("abc"), -1);
+	EXPECT_EQ(Index.Search("abc"), -1);
+	EXPECT_EQ(Index.Select(1), -1);
+}
+
+TEST(FileScoreIndex, Rank)
+{
+	CFileScoreIndex Index;
+	int B = Index.Set(Record("b", 20.0f));
+	int A = Index.Set(Record("a", 10.0f));
+	int C = Index.Set(Record("c", 30.0f));
+	EXPECT_EQ(Index.Rank(A), 1);
+	EXPECT_EQ(Index.Rank(B), 2);
+	EXPECT_EQ(Index.Rank(C), 3);
+	EXPECT_EQ(Index.Select(1), A);
+	EXPECT_EQ(Index.Select(3), C);
+	EXPECT_EQ(Index.Select(4), -1);
+
+	// improving keeps the id and moves the player
+	EXPECT_EQ(Index.Set(Record("c", 5.0f)), C);
+	EXPECT_EQ(Index.Num(), 3);
+	EXPECT_EQ(Index.Rank(C), 1);
+	EXPECT_EQ(Index.Rank(A), 2);
+	EXPECT_EQ(Index.Get(C)->m_Time, 5.0f);
+}
+
+TEST(FileScoreIndex, Many)
+{
+	CFileScoreIndex Index;
+	std::vector<float> aTimes;
+	unsigned Seed = 1;
+	for(int i = 0; i < 2000; i++)
+	{
+		char aName[16];
+		str_format(aName, sizeof(aName), "p%d", i % 700);
+		Seed = Seed * 1103515245 + 12345;
+		Index.Set(Record(aName, (Seed >> 16) % 5000 / 10.0f));
+	}
+	ASSERT_EQ(Index.Num(), 700);
+
+	for(int i = 0; i < Index.Num(); i++)
+		aTimes.push_back(Index.Get(i)->m_Time);
+	std::sort(aTimes.begin(), aTimes.end());
+	for(int Rank = 1; Rank <= Index.Num(); Rank++)
+	{
+		int ID = Index.Select(Rank);
+		ASSERT_GE(ID, 0);
+		EXPECT_EQ(Index.Get(ID)->m_Time, aTimes[Rank - 1]);
+		EXPECT_EQ(Index.Rank(ID), Rank);
+	}
+}
+
+TEST(FileScoreIndex, Search)
+{
+	CFileScoreIndex Index;
+	int Abc = Index.Set(Record("abc", 1.0f));
+	int Xabcx = Index.Set(Record("xABCx", 2.0f));
+	Index.Set(Record("def", 3.0f));
+	EXPECT_EQ(Index.Search("abc"), Abc);
+	EXPECT_EQ(Index.Search("BC"), -2);
+	EXPECT_EQ(Index.Search("x"), Xabcx);
+	EXPECT_EQ(Index.Search("ghi"), -1);
+	EXPECT_EQ(Index.Find("ABC"), -1);
+}
+
+struct CParsed
+{
+	std::vector<CFileScoreRecord> m_aRecords;
+
+	static void Callback(const CFileScoreRecord *pRecord, void *pUser)
+	{
+		((CParsed *)pUser)->m_aRecords.push_back(*pRecord);
+	}
+};
+
+TEST(FileScoreParser, Chunks)
+{
+	const char aData[] = "abc\n12.5\n\ndef\r\n7\r\nlast\n3";
+	// every split of the data gives the same records
+	for(unsigned Split = 0; Split <= sizeof(aData) - 1; Split++)
+	{
+		CParsed Parsed;
+		CFileScoreParser Parser(false, CParsed::Callback, &Parsed);
+		Parser.Feed(aData, Split);
+		Parser.Feed(aData + Split, sizeof(aData) - 1 - Split);
+		Parser.Finish();
+		EXPECT_FALSE(Parser.Clean());
+
+		ASSERT_EQ(Parsed.m_aRecords.size(), 3u);
+		EXPECT_STREQ(Parsed.m_aRecords[0].m_aName, "abc");
+		EXPECT_EQ(Parsed.m_aRecords[0].m_Time, 12.5f);
+		EXPECT_STREQ(Parsed.m_aRecords[1].m_aName, "def");
+		EXPECT_EQ(Parsed.m_aRecords[1].m_Time, 7.0f);
+		EXPECT_STREQ(Parsed.m_aRecords[2].m_aName, "last");
+		EXPECT_EQ(Parsed.m_aRecords[2].m_Time, 3.0f);
+	}
+}
+
+TEST(FileScoreParser, RoundTrip)
+{
+	CFileScoreRecord In = Record("nameless tee", 65.25f);
+	for(int i = 0; i < NUM_CHECKPOINTS; i++)
+		In.m_aCpTime[i] = i * 1.5f;
+
+	char aBuf[1024];
+	int Length = FileScoreFormatRecord(aBuf, sizeof(aBuf), &In, true);
+	EXPECT_EQ(Length, str_length(aBuf));
+
+	CParsed Parsed;
+	CFileScoreParser Parser(true, CParsed::Callback, &Parsed);
+	Parser.Feed(aBuf, Length);
+	Parser.Feed(aBuf, Length);
+	Parser.Finish();
+	EXPECT_TRUE(Parser.Clean());
+
+	ASSERT_EQ(Parsed.m_aRecords.size(), 2u);
+	EXPECT_STREQ(Parsed.m_aRecords[1].m_aName, In.m_aName);
+	EXPECT_EQ(Parsed.m_aRecords[1].m_Time, In.m_Time);
+	for(int i = 0; i < NUM_CHECKPOINTS; i++)
+		EXPECT_EQ(Parsed.m_aRecords[1].m_aCpTime[i], In.m_aCpTime[i]);
+}
@@ -58,3 +58,23 @@ TEST(Hash, Sha256FromStr)
 	EXPECT_TRUE(sha256_from_str(&Sha256, "012345678901234567890123456789012345678901234567890123456789012x"));
 	EXPECT_TRUE(sha256_from_str(&Sha256, "x123456789012345678901234567890123456789012345678901234567890123"));
 }
+
+TEST(Hash, Siphash24)
+{
+	// test vectors of the reference implementation, key 00 01 .. 0f and
+	// message 00 01 .. of increasing length
+	unsigned char aKey[SIPHASH_KEY_LENGTH];
+	unsigned char aMessage[16];
+	for(int i = 0; i < 16; i++)
+	{
+		aKey[i] = i;
+		aMessage[i] = i;
+	}
+	EXPECT_EQ(siphash24(aKey, aMessage, 0), 0x726fdb47dd0e0e31ULL);
+	EXPECT_EQ(siphash24(aKey, aMessage, 7), 0xab0200f58b01d137ULL);
+	EXPECT_EQ(siphash24(aKey, aMessage, 8), 0x93f5f5799a932462ULL);
+	EXPECT_EQ(siphash24(aKey, aMessage, 15), 0xa129ca6149be45e5ULL);
+
+	aKey[0] = 1;
+	EXPECT_NE(siphash24(aKey, aMessage, 15), 0xa129ca6149be45e5ULL);
+}
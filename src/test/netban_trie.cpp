@@ -0,0 +1,261 @@
+#include "test.h"
+#include <gtest/gtest.h>
+
+#include <engine/shared/netban_trie.h>
+
+#include <vector>
+
+static NETADDR Addr(const char *pStr)
+{
+	NETADDR Addr;
+	int Prefix;
+	EXPECT_EQ(CNetBanTrie::ParsePrefix(pStr, &Addr, &Prefix), 0);
+	return Addr;
+}
+
+static bool Add(CNetBanTrie *pTrie, const char *pStr, int Expires = CNetBanTrie::EXPIRES_NEVER, const char *pReason = "test")
+{
+	NETADDR Addr;
+	int Prefix;
+	return CNetBanTrie::ParsePrefix(pStr, &Addr, &Prefix) == 0 && pTrie->Add(&Addr, Prefix, Expires, pReason);
+}
+
+static bool Remove(CNetBanTrie *pTrie, const char *pStr)
+{
+	NETADDR Addr;
+	int Prefix;
+	return CNetBanTrie::ParsePrefix(pStr, &Addr, &Prefix) == 0 && pTrie->Remove(&Addr, Prefix);
+}
+
+static const CNetBanTrie::CEntry *Find(const CNetBanTrie *pTrie, const char *pStr)
+{
+	NETADDR Addr = ::Addr(pStr);
+	return pTrie->Find(&Addr);
+}
+
+static bool IsBanned(const CNetBanTrie *pTrie, const char *pStr)
+{
+	return Find(pTrie, pStr) != 0;
+}
+
+TEST(NetBanTrie, Parse)
+{
+	NETADDR Addr;
+	int Prefix;
+	char aBuf[NETADDR_MAXSTRSIZE+8];
+	EXPECT_EQ(CNetBanTrie::ParsePrefix("1.2.3.4", &Addr, &Prefix), 0);
+	EXPECT_EQ(Prefix, 32);
+	EXPECT_EQ(CNetBanTrie::ParsePrefix("10.0.0.0/8", &Addr, &Prefix), 0);
+	EXPECT_EQ(Prefix, 8);
+	CNetBanTrie::PrefixToString(&Addr, Prefix, aBuf, sizeof(aBuf));
+	EXPECT_STREQ(aBuf, "10.0.0.0/8");
+	EXPECT_EQ(CNetBanTrie::ParsePrefix("2001:db8::/32", &Addr, &Prefix), 0);
+	EXPECT_EQ(Addr.type, (unsigned)NETTYPE_IPV6);
+	EXPECT_EQ(Prefix, 32);
+	EXPECT_EQ(CNetBanTrie::ParsePrefix("[2001:db8::1]", &Addr, &Prefix), 0);
+	EXPECT_EQ(Prefix, 128);
+
+	EXPECT_NE(CNetBanTrie::ParsePrefix("1.2.3.4/33", &Addr, &Prefix), 0);
+	EXPECT_NE(CNetBanTrie::ParsePrefix("1.2.3.4/", &Addr, &Prefix), 0);
+	EXPECT_NE(CNetBanTrie::ParsePrefix("1.2.3/8", &Addr, &Prefix), 0);
+	EXPECT_NE(CNetBanTrie::ParsePrefix("", &Addr, &Prefix), 0);
+}
+
+TEST(NetBanTrie, Prefixes)
+{
+	CNetBanTrie Trie;
+	EXPECT_FALSE(IsBanned(&Trie, "1.2.3.4"));
+
+	EXPECT_TRUE(Add(&Trie, "1.2.3.4"));
+	EXPECT_TRUE(Add(&Trie, "10.20.0.0/16"));
+	EXPECT_TRUE(Add(&Trie, "10.20.30.0/24"));
+	EXPECT_TRUE(Add(&Trie, "192.168.1.129/25"));
+	EXPECT_TRUE(Add(&Trie, "2001:db8::/32"));
+	EXPECT_EQ(Trie.Num(), 5);
+
+	EXPECT_TRUE(IsBanned(&Trie, "1.2.3.4"));
+	EXPECT_FALSE(IsBanned(&Trie, "1.2.3.5"));
+	EXPECT_TRUE(IsBanned(&Trie, "10.20.255.1"));
+	EXPECT_TRUE(IsBanned(&Trie, "10.20.30.40"));
+	EXPECT_FALSE(IsBanned(&Trie, "10.21.0.1"));
+	EXPECT_TRUE(IsBanned(&Trie, "192.168.1.128"));
+	EXPECT_TRUE(IsBanned(&Trie, "192.168.1.255"));
+	EXPECT_FALSE(IsBanned(&Trie, "192.168.1.127"));
+	EXPECT_TRUE(IsBanned(&Trie, "[2001:db8:1234::1]"));
+	EXPECT_FALSE(IsBanned(&Trie, "[2001:db9::1]"));
+	// the families don't mix
+	EXPECT_FALSE(IsBanned(&Trie, "32.1.13.184"));
+
+	// the host bits of the prefix are ignored
+	const CNetBanTrie::CEntry *pEntry = Find(&Trie, "192.168.1.200");
+	ASSERT_TRUE(pEntry);
+	EXPECT_EQ(pEntry->m_Prefix, 25);
+	EXPECT_EQ(pEntry->m_Addr.ip[3], 128);
+	EXPECT_STREQ(Trie.Reason(pEntry), "test");
+
+	EXPECT_TRUE(Remove(&Trie, "10.20.0.0/16"));
+	EXPECT_FALSE(Remove(&Trie, "10.20.0.0/16"));
+	EXPECT_FALSE(Remove(&Trie, "10.20.30.0/25"));
+	EXPECT_FALSE(IsBanned(&Trie, "10.20.255.1"));
+	EXPECT_TRUE(IsBanned(&Trie, "10.20.30.40"));
+	EXPECT_EQ(Trie.Num(), 4);
+
+	// banning again only updates the entry
+	EXPECT_TRUE(Add(&Trie, "1.2.3.4", CNetBanTrie::EXPIRES_NEVER, "other"));
+	EXPECT_EQ(Trie.Num(), 4);
+	EXPECT_STREQ(Trie.Reason(Find(&Trie, "1.2.3.4")), "other");
+
+	EXPECT_TRUE(Add(&Trie, "0.0.0.0/0"));
+	EXPECT_TRUE(IsBanned(&Trie, "123.123.123.123"));
+	Trie.Clear();
+	EXPECT_EQ(Trie.Num(), 0);
+	EXPECT_FALSE(IsBanned(&Trie, "1.2.3.4"));
+}
+
+TEST(NetBanTrie, Expiry)
+{
+	CNetBanTrie Trie;
+	int Now = 1500000000;
+	Trie.Update(Now);
+	EXPECT_TRUE(Add(&Trie, "1.0.0.0/8", Now + 10));
+	EXPECT_TRUE(Add(&Trie, "1.2.0.0/16", Now + 10 + 4096));
+	EXPECT_TRUE(Add(&Trie, "2.0.0.0/8", Now + 20));
+	EXPECT_TRUE(Add(&Trie, "3.0.0.0/8"));
+
+	EXPECT_EQ(Trie.Update(Now + 10), 0);
+	EXPECT_EQ(Trie.Update(Now + 11), 1);
+	EXPECT_FALSE(IsBanned(&Trie, "1.1.1.1"));
+	EXPECT_TRUE(IsBanned(&Trie, "1.2.1.1"));
+
+	// a ban that gets extended moves to another slot
+	EXPECT_TRUE(Add(&Trie, "2.0.0.0/8", Now + 100));
+	EXPECT_EQ(Trie.Update(Now + 50), 0);
+	EXPECT_TRUE(IsBanned(&Trie, "2.1.1.1"));
+
+	// skipping more than a round of the wheel
+	EXPECT_EQ(Trie.Update(Now + 20000), 2);
+	EXPECT_EQ(Trie.Num(), 1);
+	EXPECT_TRUE(IsBanned(&Trie, "3.1.1.1"));
+}
+
+TEST(NetBanTrie, Random)
+{
+	CNetBanTrie Trie;
+	std::vector<NETADDR> aAddrs;
+	std::vector<int> aPrefixes;
+	unsigned Seed = 1;
+	for(int i = 0; i < 3000; i++)
+	{
+		NETADDR Addr = {0};
+		Addr.type = NETTYPE_IPV4;
+		Seed = Seed * 1103515245 + 12345;
+		// few leading bits so the prefixes overlap
+		Addr.ip[0] = (Seed >> 28) & 0x3;
+		Addr.ip[1] = Seed >> 16;
+		Seed = Seed * 1103515245 + 12345;
+		Addr.ip[2] = Seed >> 16;
+		Addr.ip[3] = Seed >> 24;
+		int Prefix = 8 + (Seed >> 8) % 25;
+		ASSERT_TRUE(Trie.Add(&Addr, Prefix, CNetBanTrie::EXPIRES_NEVER, "random"));
+		aAddrs.push_back(Addr);
+		aPrefixes.push_back(Prefix);
+	}
+	// remove every third, including duplicates of the same prefix
+	for(unsigned i = 0; i < aAddrs.size(); i += 3)
+	{
+		if(aPrefixes[i] < 0)
+			continue;
+		EXPECT_TRUE(Trie.Remove(&aAddrs[i], aPrefixes[i]));
+		int Prefix = aPrefixes[i];
+		for(unsigned j = 0; j < aAddrs.size(); j++)
+		{
+			if(aPrefixes[j] == Prefix && CNetBanTrie::Contains(&aAddrs[i], Prefix, &aAddrs[j]))
+				aPrefixes[j] = -1;
+		}
+	}
+
+	for(int i = 0; i < 3000; i++)
+	{
+		NETADDR Addr = aAddrs[(i * 7) % aAddrs.size()];
+		Addr.ip[3] ^= i;
+		bool Expected = false;
+		for(unsigned j = 0; j < aAddrs.size() && !Expected; j++)
+		{
+			if(aPrefixes[j] >= 0 && CNetBanTrie::Contains(&aAddrs[j], aPrefixes[j], &Addr))
+				Expected = true;
+		}
+		EXPECT_EQ(Trie.Find(&Addr) != 0, Expected);
+	}
+}
+
+TEST(NetBanTrie, SaveLoad)
+{
+	CTestInfo Info;
+	int Now = 1500000000;
+	CNetBanTrie Trie;
+	Trie.Update(Now);
+	EXPECT_TRUE(Add(&Trie, "1.2.3.4", CNetBanTrie::EXPIRES_NEVER, "first"));
+	EXPECT_TRUE(Add(&Trie, "10.0.0.0/8", Now + 60, "second"));
+	EXPECT_TRUE(Add(&Trie, "2001:db8::/32", Now + 120, "first"));
+
+	IOHANDLE File = io_open(Info.m_aFilename, IOFLAG_WRITE);
+	ASSERT_TRUE(File);
+	EXPECT_EQ(Trie.Save(File, Now), 3);
+	io_close(File);
+
+	CNetBanTrie Loaded;
+	File = io_open(Info.m_aFilename, IOFLAG_READ);
+	ASSERT_TRUE(File);
+	EXPECT_EQ(Loaded.Load(File, Now + 90), 2);
+	io_close(File);
+	EXPECT_EQ(Loaded.Num(), 2);
+	ASSERT_TRUE(Find(&Loaded, "1.2.3.4"));
+	EXPECT_STREQ(Loaded.Reason(Find(&Loaded, "1.2.3.4")), "first");
+	EXPECT_FALSE(Find(&Loaded, "10.1.1.1"));
+	ASSERT_TRUE(Find(&Loaded, "[2001:db8::5]"));
+	EXPECT_EQ(Find(&Loaded, "[2001:db8::5]")->m_Expires, Now + 120);
+
+	// truncated
+	File = io_open(Info.m_aFilename, IOFLAG_READ);
+	char aData[256];
+	int Size = io_read(File, aData, sizeof(aData));
+	io_close(File);
+	File = io_open(Info.m_aFilename, IOFLAG_WRITE);
+	io_write(File, aData, Size - 3);
+	io_close(File);
+	File = io_open(Info.m_aFilename, IOFLAG_READ);
+	EXPECT_EQ(Loaded.Load(File, Now), -1);
+	io_close(File);
+
+	fs_remove(Info.m_aFilename);
+}
+
+static bool FilterLocalhost(const NETADDR *pAddr, int Prefix, void *pUser)
+{
+	NETADDR Localhost = Addr("127.0.0.1");
+	return !CNetBanTrie::Contains(pAddr, Prefix, &Localhost);
+}
+
+TEST(NetBanTrie, LoadFilter)
+{
+	CTestInfo Info;
+	CNetBanTrie Trie;
+	EXPECT_TRUE(Add(&Trie, "127.0.0.0/8"));
+	EXPECT_TRUE(Add(&Trie, "127.0.0.1"));
+	EXPECT_TRUE(Add(&Trie, "1.2.3.4"));
+
+	IOHANDLE File = io_open(Info.m_aFilename, IOFLAG_WRITE);
+	ASSERT_TRUE(File);
+	EXPECT_EQ(Trie.Save(File, 0), 3);
+	io_close(File);
+
+	CNetBanTrie Loaded;
+	File = io_open(Info.m_aFilename, IOFLAG_READ);
+	ASSERT_TRUE(File);
+	EXPECT_EQ(Loaded.Load(File, 0, FilterLocalhost, 0), 1);
+	io_close(File);
+	EXPECT_FALSE(Find(&Loaded, "127.0.0.1"));
+	EXPECT_TRUE(Find(&Loaded, "1.2.3.4"));
+
+	fs_remove(Info.m_aFilename);
+}
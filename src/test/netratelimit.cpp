@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include <engine/shared/netratelimit.h>
+
+static NETADDR Addr(const char *pStr)
+{
+	NETADDR Addr;
+	EXPECT_EQ(net_addr_from_str(&Addr, pStr), 0);
+	return Addr;
+}
+
+static bool Allow(CNetRateLimit *pLimit, const char *pAddr, int64 Now)
+{
+	NETADDR Addr = ::Addr(pAddr);
+	return pLimit->Allow(&Addr, Now);
+}
+
+class NetRateLimit : public ::testing::Test
+{
+protected:
+	CNetRateLimit m_Limit;
+	int64 m_Freq;
+
+	NetRateLimit()
+	{
+		m_Limit.Init();
+		m_Freq = time_freq();
+	}
+};
+
+TEST_F(NetRateLimit, Burst)
+{
+	m_Limit.Configure(10, 5, 32, 64);
+	int64 Now = 1000 * m_Freq;
+	for(int i = 0; i < 5; i++)
+		EXPECT_TRUE(Allow(&m_Limit, "1.2.3.4:8303", Now));
+	EXPECT_FALSE(Allow(&m_Limit, "1.2.3.4:8303", Now));
+	// other sources aren't affected
+	EXPECT_TRUE(Allow(&m_Limit, "1.2.3.5:8303", Now));
+	EXPECT_EQ(m_Limit.NumTracked(Now), 2);
+
+	// a packet every 1/10 s is fine
+	for(int i = 1; i <= 20; i++)
+		EXPECT_TRUE(Allow(&m_Limit, "1.2.3.4:8303", Now + i * m_Freq / 10));
+	EXPECT_FALSE(Allow(&m_Limit, "1.2.3.4:8303", Now + 20 * m_Freq / 10));
+
+	// full again after the burst is paid back
+	Now += 3 * m_Freq;
+	EXPECT_EQ(m_Limit.NumTracked(Now), 0);
+	for(int i = 0; i < 5; i++)
+		EXPECT_TRUE(Allow(&m_Limit, "1.2.3.4:8303", Now));
+
+	EXPECT_EQ(m_Limit.Stats().m_Dropped, 2);
+	NETADDR Top;
+	int Prefix;
+	EXPECT_EQ(m_Limit.TopSource(&Top, &Prefix), 2);
+	EXPECT_EQ(Prefix, 32);
+	NETADDR Expected = Addr("1.2.3.4");
+	EXPECT_EQ(net_addr_comp(&Top, &Expected), 0);
+
+	m_Limit.ResetStats();
+	EXPECT_EQ(m_Limit.Stats().m_Passed, 0);
+}
+
+TEST_F(NetRateLimit, Prefix)
+{
+	m_Limit.Configure(1, 2, 24, 48);
+	int64 Now = 1000 * m_Freq;
+	EXPECT_TRUE(Allow(&m_Limit, "10.0.0.1", Now));
+	EXPECT_TRUE(Allow(&m_Limit, "10.0.0.2", Now));
+	EXPECT_FALSE(Allow(&m_Limit, "10.0.0.3", Now));
+	EXPECT_TRUE(Allow(&m_Limit, "10.0.1.1", Now));
+
+	EXPECT_TRUE(Allow(&m_Limit, "[2001:db8:1:1::1]", Now));
+	EXPECT_TRUE(Allow(&m_Limit, "[2001:db8:1:2::1]", Now));
+	EXPECT_FALSE(Allow(&m_Limit, "[2001:db8:1:3::1]:8303", Now));
+	EXPECT_TRUE(Allow(&m_Limit, "[2001:db8:2::1]", Now));
+
+	// changing the grouping starts over
+	m_Limit.Configure(1, 2, 32, 64);
+	EXPECT_TRUE(Allow(&m_Limit, "10.0.0.3", Now));
+}
+
+TEST_F(NetRateLimit, Disabled)
+{
+	m_Limit.Configure(0, 1, 32, 64);
+	for(int i = 0; i < 100; i++)
+		EXPECT_TRUE(Allow(&m_Limit, "1.2.3.4", 0));
+	EXPECT_EQ(m_Limit.Stats().m_Passed, 100);
+}
+
+TEST_F(NetRateLimit, Full)
+{
+	m_Limit.Configure(1, 1, 32, 64);
+	int64 Now = 1000 * m_Freq;
+	EXPECT_TRUE(Allow(&m_Limit, "1.2.3.4", Now));
+	EXPECT_FALSE(Allow(&m_Limit, "1.2.3.4", Now));
+
+	// many more sources than the table holds
+	NETADDR Addr = ::Addr("20.0.0.0");
+	int Sources = 8 * CNetRateLimit::NUM_SETS * CNetRateLimit::NUM_WAYS;
+	for(int i = 0; i < Sources; i++)
+	{
+		Addr.ip[1] = i >> 16;
+		Addr.ip[2] = i >> 8;
+		Addr.ip[3] = i;
+		EXPECT_TRUE(m_Limit.Allow(&Addr, Now));
+	}
+	EXPECT_EQ(m_Limit.NumTracked(Now), CNetRateLimit::NUM_SETS * CNetRateLimit::NUM_WAYS);
+	EXPECT_GE(m_Limit.Stats().m_Evicted, Sources - CNetRateLimit::NUM_SETS * CNetRateLimit::NUM_WAYS);
+
+	// a forgotten source starts with a full bucket
+	EXPECT_TRUE(Allow(&m_Limit, "1.2.3.4", Now + 1));
+}
@@ -0,0 +1,213 @@
+#include <gtest/gtest.h>
+
+#include <base/detect.h>
+#include <engine/shared/network.h>
+#include <engine/shared/config.h>
+
+#if defined(CONF_FAMILY_WINDOWS)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+static int NewClient(int ClientID, void *pUser) { (*(int *)pUser)++; return 0; }
+static int DelClient(int ClientID, const char *pReason, void *pUser) { return 0; }
+static int ClientRejoin(int ClientID, void *pUser) { (*(int *)pUser) += 100; return 0; }
+
+class NetServer : public ::testing::Test
+{
+protected:
+	CNetServer *m_pServer;
+	NETSOCKET m_Client;
+	NETADDR m_ServerAddr;
+	MMSGS m_Mmsgs;
+	int m_Events;
+	int m_ConnTimeout;
+
+	NetServer()
+	{
+		net_init();
+		CNetBase::Init();
+		m_pServer = new CNetServer;
+		m_Events = 0;
+		// the config isn't loaded, without a timeout updates drop everyone
+		m_ConnTimeout = g_Config.m_ConnTimeout;
+		g_Config.m_ConnTimeout = 100;
+
+		NETADDR BindAddr;
+		mem_zero(&BindAddr, sizeof(BindAddr));
+		BindAddr.type = NETTYPE_IPV4;
+		m_Client = net_udp_create(BindAddr);
+		// any free port, so parallel runs don't collide
+		net_addr_from_str(&BindAddr, "127.0.0.1:0");
+		m_ServerAddr = BindAddr;
+		EXPECT_TRUE(m_pServer->Open(BindAddr, 0, 4, 4, 0));
+		m_ServerAddr.port = BoundPort(m_pServer->Socket());
+		EXPECT_NE(m_ServerAddr.port, 0);
+		m_pServer->SetCallbacks(NewClient, NewClient, ClientRejoin, DelClient, &m_Events);
+		net_init_mmsgs(&m_Mmsgs);
+	}
+
+	~NetServer()
+	{
+		net_udp_close(m_pServer->Socket());
+		net_udp_close(m_Client);
+		delete m_pServer;
+		g_Config.m_ConnTimeout = m_ConnTimeout;
+	}
+
+	static int BoundPort(NETSOCKET Socket)
+	{
+		struct sockaddr_in Addr;
+		socklen_t Size = sizeof(Addr);
+		if(getsockname(Socket.ipv4sock, (struct sockaddr *)&Addr, &Size) != 0)
+			return 0;
+		return ntohs(Addr.sin_port);
+	}
+
+	// lets the server handle what the client sent, returns the chunk it got
+	bool ServerRecv(CNetChunk *pChunk)
+	{
+		for(int i = 0; i < 100; i++)
+		{
+			if(m_pServer->Recv(pChunk))
+				return true;
+			thread_sleep(1000);
+		}
+		return false;
+	}
+
+	// returns the token of the server's connect accept
+	SECURITY_TOKEN Connect()
+	{
+		CNetBase::SendControlMsg(m_Client, &m_ServerAddr, 0, NET_CTRLMSG_CONNECT, SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC), NET_SECURITY_TOKEN_UNKNOWN);
+		CNetChunk Chunk;
+		ServerRecv(&Chunk);
+
+		unsigned char aBuffer[NET_MAX_PACKETSIZE];
+		for(int i = 0; i < 100; i++)
+		{
+			NETADDR From;
+			unsigned char *pData;
+			int Bytes = net_udp_recv(m_Client, &From, aBuffer, sizeof(aBuffer), &m_Mmsgs, &pData);
+			CNetPacketConstruct Packet;
+			if(Bytes > 0 && CNetBase::UnpackPacket(pData, Bytes, &Packet) == 0 &&
+				Packet.m_Flags&NET_PACKETFLAG_CONTROL && Packet.m_aChunkData[0] == NET_CTRLMSG_CONNECTACCEPT &&
+				Packet.m_DataSize == 1 + (int)sizeof(SECURITY_TOKEN_MAGIC) + (int)sizeof(SECURITY_TOKEN))
+			{
+				return ToSecurityToken(&Packet.m_aChunkData[1 + sizeof(SECURITY_TOKEN_MAGIC)]);
+			}
+			thread_sleep(1000);
+		}
+		return NET_SECURITY_TOKEN_UNKNOWN;
+	}
+
+	void Accept(SECURITY_TOKEN Token)
+	{
+		CNetBase::SendControlMsg(m_Client, &m_ServerAddr, 0, NET_CTRLMSG_ACCEPT, 0, 0, Token);
+		CNetChunk Chunk;
+		ServerRecv(&Chunk);
+	}
+
+	// returns the first chunk of the next packet from the server with the
+	// given chunk flags, unflushed chunks go out after half a second
+	bool ClientRecvChunk(int Flags, CNetChunkHeader *pHeader, unsigned char **ppData, CNetPacketConstruct *pPacket)
+	{
+		unsigned char aBuffer[NET_MAX_PACKETSIZE];
+		for(int i = 0; i < 1000; i++)
+		{
+			m_pServer->Update();
+			NETADDR From;
+			unsigned char *pData;
+			int Bytes = net_udp_recv(m_Client, &From, aBuffer, sizeof(aBuffer), &m_Mmsgs, &pData);
+			if(Bytes > 0 && CNetBase::UnpackPacket(pData, Bytes, pPacket) == 0 && !(pPacket->m_Flags&NET_PACKETFLAG_CONTROL) && pPacket->m_NumChunks > 0)
+			{
+				*ppData = pHeader->Unpack(pPacket->m_aChunkData);
+				if((pHeader->m_Flags&Flags) == Flags)
+					return true;
+			}
+			thread_sleep(1000);
+		}
+		return false;
+	}
+
+	// sends a chunk with the token like a fresh session does
+	bool SendChunk(SECURITY_TOKEN Token)
+	{
+		CNetConnection Connection;
+		Connection.Init(m_Client, false);
+		Connection.DirectInit(m_ServerAddr, Token);
+		const char aData[] = "hello";
+		Connection.QueueChunk(NET_CHUNKFLAG_VITAL, sizeof(aData), aData);
+		Connection.Flush();
+
+		CNetChunk Chunk;
+		return ServerRecv(&Chunk) && Chunk.m_DataSize == sizeof(aData) && mem_comp(Chunk.m_pData, aData, sizeof(aData)) == 0;
+	}
+};
+
+TEST_F(NetServer, Connect)
+{
+	SECURITY_TOKEN Token = Connect();
+	ASSERT_NE(Token, NET_SECURITY_TOKEN_UNKNOWN);
+	Accept(Token);
+	EXPECT_EQ(m_Events, 1);
+	EXPECT_TRUE(SendChunk(Token));
+}
+
+TEST_F(NetServer, RejoinAfterSeedRotation)
+{
+	SECURITY_TOKEN Token = Connect();
+	Accept(Token);
+	ASSERT_EQ(m_Events, 1);
+
+	// the seed the session token was made with is gone
+	m_pServer->RotateSecurityTokenSeed();
+	m_pServer->RotateSecurityTokenSeed();
+
+	SECURITY_TOKEN RejoinToken = Connect();
+	ASSERT_NE(RejoinToken, NET_SECURITY_TOKEN_UNKNOWN);
+	Accept(RejoinToken);
+	EXPECT_EQ(m_Events, 101);
+	EXPECT_TRUE(SendChunk(RejoinToken));
+}
+
+TEST_F(NetServer, ResendSharedChunk)
+{
+	SECURITY_TOKEN Token = Connect();
+	Accept(Token);
+	ASSERT_EQ(m_Events, 1);
+
+	const char aData[] = "shared";
+	CNetChunkData *pSharedData = CNetChunkData::Create(aData, sizeof(aData));
+	CNetChunk Chunk;
+	mem_zero(&Chunk, sizeof(Chunk));
+	Chunk.m_ClientID = 0;
+	Chunk.m_Flags = NETSENDFLAG_VITAL|NETSENDFLAG_FLUSH;
+	Chunk.m_DataSize = sizeof(aData);
+	Chunk.m_pData = aData;
+	m_pServer->Send(&Chunk, pSharedData);
+	// only the resend buffer holds it now, and the pool must not hand it out
+	pSharedData->Release();
+	CNetChunkData *pOther = CNetChunkData::Create("other", 6);
+
+	CNetPacketConstruct Packet;
+	CNetChunkHeader Header;
+	unsigned char *pData;
+	ASSERT_TRUE(ClientRecvChunk(NET_CHUNKFLAG_VITAL, &Header, &pData, &Packet));
+	EXPECT_EQ(Header.m_Size, (int)sizeof(aData));
+
+	// ask for a resend without acking anything
+	Packet.Clear();
+	Packet.m_Flags = NET_PACKETFLAG_RESEND;
+	CNetBase::SendPacket(m_Client, &m_ServerAddr, &Packet, Token);
+	CNetChunk Received;
+	ServerRecv(&Received);
+
+	ASSERT_TRUE(ClientRecvChunk(NET_CHUNKFLAG_VITAL|NET_CHUNKFLAG_RESEND, &Header, &pData, &Packet));
+	ASSERT_EQ(Header.m_Size, (int)sizeof(aData));
+	EXPECT_EQ(mem_comp(pData, aData, sizeof(aData)), 0);
+	pOther->Release();
+}
@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+
+#include <game/server/score/score_cache.h>
+
+static CScoreCache::CWaiter Waiter(int ClientID)
+{
+	CScoreCache::CWaiter Waiter;
+	Waiter.m_ClientID = ClientID;
+	str_copy(Waiter.m_aRequestingPlayer, "nameless tee", sizeof(Waiter.m_aRequestingPlayer));
+	return Waiter;
+}
+
+static std::vector<CScoreCache::CRow> Top5(float FirstTime)
+{
+	std::vector<CScoreCache::CRow> aRows;
+	for(int i = 0; i < 5; i++)
+	{
+		CScoreCache::CRow Row;
+		Row.m_Rank = i + 1;
+		Row.m_Name = "player";
+		Row.m_Time = FirstTime + i;
+		aRows.push_back(Row);
+	}
+	return aRows;
+}
+
+static void Load(CScoreCache *pCache, const CScoreCache::CKey &Key, const std::vector<CScoreCache::CRow> &aRows)
+{
+	std::vector<CScoreCache::CWaiter> aWaiters;
+	ASSERT_TRUE(pCache->Request(Key, Waiter(0)));
+	pCache->Complete(Key, aRows, 0, &aWaiters);
+	ASSERT_EQ(aWaiters.size(), 1u);
+}
+
+TEST(ScoreCache, Coalesce)
+{
+	CScoreCache Cache;
+	CScoreCache::CKey Key(CScoreCache::RANK, 0, "abc");
+	EXPECT_FALSE(Cache.Find(Key, 0, 60));
+
+	EXPECT_TRUE(Cache.Request(Key, Waiter(1)));
+	EXPECT_FALSE(Cache.Request(Key, Waiter(2)));
+	EXPECT_FALSE(Cache.Find(Key, 0, 60));
+
+	std::vector<CScoreCache::CWaiter> aWaiters;
+	Cache.Complete(Key, Top5(10.0f), 0, &aWaiters);
+	ASSERT_EQ(aWaiters.size(), 2u);
+	EXPECT_EQ(aWaiters[0].m_ClientID, 1);
+	EXPECT_EQ(aWaiters[1].m_ClientID, 2);
+
+	const CScoreCache::CEntry *pEntry = Cache.Find(Key, 0, 60);
+	ASSERT_TRUE(pEntry);
+	EXPECT_EQ(pEntry->m_aRows.size(), 5u);
+}
+
+TEST(ScoreCache, Expire)
+{
+	CScoreCache Cache;
+	CScoreCache::CKey Key(CScoreCache::TOPPOINTS, 1, "");
+	Load(&Cache, Key, Top5(0.0f));
+	EXPECT_TRUE(Cache.Find(Key, 59 * time_freq(), 60));
+	EXPECT_FALSE(Cache.Find(Key, 60 * time_freq(), 60));
+	EXPECT_FALSE(Cache.Find(Key, 0, 0));
+}
+
+TEST(ScoreCache, Cancel)
+{
+	CScoreCache Cache;
+	CScoreCache::CKey Key(CScoreCache::POINTS, 0, "abc");
+	EXPECT_TRUE(Cache.Request(Key, Waiter(3)));
+
+	std::vector<CScoreCache::CWaiter> aWaiters;
+	Cache.Cancel(Key, &aWaiters);
+	ASSERT_EQ(aWaiters.size(), 1u);
+	EXPECT_EQ(aWaiters[0].m_ClientID, 3);
+	EXPECT_EQ(Cache.NumEntries(), 0);
+	EXPECT_TRUE(Cache.Request(Key, Waiter(3)));
+}
+
+TEST(ScoreCache, FinishInvalidatesSelectively)
+{
+	CScoreCache Cache;
+	CScoreCache::CKey Fast(CScoreCache::TOP5, 1, "");
+	CScoreCache::CKey Slow(CScoreCache::TOP5, 6, "");
+	CScoreCache::CKey Last(CScoreCache::TOP5, -1, "");
+	CScoreCache::CKey Own(CScoreCache::POINTS, 0, "abc");
+	CScoreCache::CKey Other(CScoreCache::POINTS, 0, "def");
+	CScoreCache::CKey Team(CScoreCache::TEAMTOP5, 1, "");
+	Load(&Cache, Fast, Top5(10.0f));
+	Load(&Cache, Slow, Top5(20.0f));
+	Load(&Cache, Last, Top5(30.0f));
+	Load(&Cache, Own, Top5(0.0f));
+	Load(&Cache, Other, Top5(0.0f));
+	Load(&Cache, Team, Top5(0.0f));
+
+	// too slow for the first page, but moves everyone on the second one down
+	Cache.OnFinish("abc", 17.0f);
+	EXPECT_TRUE(Cache.Find(Fast, 0, 60));
+	EXPECT_FALSE(Cache.Find(Slow, 0, 60));
+	EXPECT_FALSE(Cache.Find(Last, 0, 60));
+	EXPECT_FALSE(Cache.Find(Own, 0, 60));
+	// the points can change the rank of everyone else
+	EXPECT_FALSE(Cache.Find(Other, 0, 60));
+	EXPECT_TRUE(Cache.Find(Team, 0, 60));
+}
+
+TEST(ScoreCache, TeamFinish)
+{
+	CScoreCache Cache;
+	CScoreCache::CKey Member(CScoreCache::TEAMRANK, 0, "abc");
+	CScoreCache::CKey Faster(CScoreCache::TEAMRANK, 0, "def");
+	CScoreCache::CKey Slower(CScoreCache::TEAMRANK, 0, "ghi");
+	Load(&Cache, Member, Top5(50.0f));
+	Load(&Cache, Faster, Top5(5.0f));
+	Load(&Cache, Slower, Top5(50.0f));
+
+	const char *apNames[] = {"xyz", "abc"};
+	Cache.OnTeamFinish(apNames, 2, 30.0f);
+	EXPECT_FALSE(Cache.Find(Member, 0, 60));
+	EXPECT_TRUE(Cache.Find(Faster, 0, 60));
+	EXPECT_FALSE(Cache.Find(Slower, 0, 60));
+}
+
+TEST(ScoreCache, StaleResultNotStored)
+{
+	CScoreCache Cache;
+	CScoreCache::CKey Key(CScoreCache::TIMES, 1, "");
+	EXPECT_TRUE(Cache.Request(Key, Waiter(0)));
+	Cache.OnFinish("abc", 10.0f);
+
+	std::vector<CScoreCache::CWaiter> aWaiters;
+	Cache.Complete(Key, Top5(0.0f), 0, &aWaiters);
+	EXPECT_EQ(aWaiters.size(), 1u);
+	EXPECT_FALSE(Cache.Find(Key, 0, 60));
+
+	// nothing is stored until pending finishes are written
+	Cache.BeginWrite();
+	EXPECT_TRUE(Cache.Request(Key, Waiter(0)));
+	Cache.Complete(Key, Top5(0.0f), 0, &aWaiters);
+	EXPECT_FALSE(Cache.Find(Key, 0, 60));
+
+	Cache.EndWrite();
+	Load(&Cache, Key, Top5(0.0f));
+	EXPECT_TRUE(Cache.Find(Key, 0, 60));
+}
+
+TEST(ScoreCache, Prune)
+{
+	CScoreCache Cache;
+	for(int i = 0; i <= CScoreCache::MAX_ENTRIES; i++)
+		Load(&Cache, CScoreCache::CKey(CScoreCache::TOP5, i + 1, ""), Top5(0.0f));
+	EXPECT_LE(Cache.NumEntries(), (int)CScoreCache::MAX_ENTRIES);
+	EXPECT_TRUE(Cache.Find(CScoreCache::CKey(CScoreCache::TOP5, CScoreCache::MAX_ENTRIES + 1, ""), 0, 60));
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include <engine/shared/snapshot.h>
+#include <engine/shared/snapshot_simd.h>
+
+#include <vector>
+
+static unsigned Random(unsigned *pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	return (*pSeed >> 8) ^ (*pSeed << 20);
+}
+
+static int RandomValue(unsigned *pSeed)
+{
+	unsigned Value = Random(pSeed);
+	switch(Random(pSeed) % 4)
+	{
+	case 0: return 0;
+	case 1: return (int)(Value % 256) - 128;
+	case 2: return Value >> (Value % 32);
+	default: return Value;
+	}
+}
+
+class SnapshotSimd : public ::testing::Test
+{
+protected:
+	int m_Level;
+
+	SnapshotSimd() { m_Level = CSnapshotSimd::Level(); }
+	~SnapshotSimd() { CSnapshotSimd::SetLevel(m_Level); }
+};
+
+TEST_F(SnapshotSimd, Equivalence)
+{
+	unsigned Seed = 1;
+	int aPast[100], aCurrent[100];
+	int aExpected[100 + 1], aOut[100 + 1];
+	for(int Run = 0; Run < 300; Run++)
+	{
+		for(int Num = 0; Num <= 100; Num++)
+		{
+			int Changes = Random(&Seed) % 4;
+			for(int i = 0; i < Num; i++)
+			{
+				aPast[i] = RandomValue(&Seed);
+				aCurrent[i] = Changes == 0 || Random(&Seed) % Changes ? aPast[i] : RandomValue(&Seed);
+			}
+
+			CSnapshotSimd::SetLevel(CSnapshotSimd::LEVEL_SCALAR);
+			int Sum = CSnapshotSimd::Sum(aCurrent, Num);
+			aExpected[Num] = 0x12345678;
+			int Needed = CSnapshotSimd::Diff(aPast, aCurrent, aExpected, Num);
+			std::vector<int> aExpectedUndiff(Num + 1);
+			int Bits = CSnapshotSimd::Undiff(aPast, aExpected, &aExpectedUndiff[0], Num);
+
+			for(int Level = CSnapshotSimd::LEVEL_SSE2; Level <= CSnapshotSimd::SupportedLevel(); Level++)
+			{
+				CSnapshotSimd::SetLevel(Level);
+				ASSERT_EQ(CSnapshotSimd::Level(), Level);
+				EXPECT_EQ(CSnapshotSimd::Sum(aCurrent, Num), Sum);
+				aOut[Num] = 0x12345678;
+				ASSERT_EQ(CSnapshotSimd::Diff(aPast, aCurrent, aOut, Num), Needed);
+				ASSERT_EQ(mem_comp(aOut, aExpected, (Num + 1) * sizeof(int)), 0);
+				ASSERT_EQ(CSnapshotSimd::Undiff(aPast, aExpected, aOut, Num), Bits);
+				for(int i = 0; i < Num; i++)
+					ASSERT_EQ(aOut[i], aCurrent[i]);
+			}
+		}
+	}
+}
+
+TEST_F(SnapshotSimd, UndiffBits)
+{
+	// one bit for unchanged, otherwise the bytes CVariableInt::Pack takes
+	CSnapshotSimd::SetLevel(CSnapshotSimd::LEVEL_SCALAR);
+	int aPast[8] = {0};
+	int aDiff[8] = {0, 63, -64, 64, 8191, 8192, 0x7fffffff, (int)0x80000000};
+	int aOut[8];
+	EXPECT_EQ(CSnapshotSimd::Undiff(aPast, aDiff, aOut, 8), 1 + 8 + 8 + 16 + 16 + 24 + 40 + 40);
+}
+
+static int BuildSnapshot(void *pData, unsigned *pSeed, bool Aligned)
+{
+	CSnapshotBuilder Builder;
+	Builder.Init();
+	int NumItems = Random(pSeed) % 100;
+	for(int i = 0; i < NumItems; i++)
+	{
+		int Size = (Random(pSeed) % 30) * 4;
+		if(!Aligned && Random(pSeed) % 3 == 0)
+			Size += 1 + Random(pSeed) % 3;
+		unsigned char *pItem = (unsigned char *)Builder.NewItem(1 + Random(pSeed) % 20, i, Size);
+		for(int b = 0; b < Size; b++)
+			pItem[b] = Random(pSeed);
+	}
+	return Builder.Finish(pData);
+}
+
+TEST_F(SnapshotSimd, Crc)
+{
+	static char s_aData[CSnapshot::MAX_SIZE];
+	unsigned Seed = 2;
+	for(int Run = 0; Run < 200; Run++)
+	{
+		BuildSnapshot(s_aData, &Seed, Run % 2 == 0);
+		CSnapshot *pSnap = (CSnapshot *)s_aData;
+
+		// every int of every item, ignoring trailing bytes
+		unsigned Expected = 0;
+		for(int i = 0; i < pSnap->NumItems(); i++)
+		{
+			for(int b = 0; b < pSnap->GetItemSize(i) / 4; b++)
+				Expected += pSnap->GetItem(i)->Data()[b];
+		}
+		for(int Level = CSnapshotSimd::LEVEL_SCALAR; Level <= CSnapshotSimd::SupportedLevel(); Level++)
+		{
+			CSnapshotSimd::SetLevel(Level);
+			EXPECT_EQ(pSnap->Crc(), (int)Expected);
+		}
+	}
+}
+
+static int TotalDataRate(CSnapshotDelta *pDelta)
+{
+	int Rate = 0;
+	for(int Type = 0; Type <= 20; Type++)
+		Rate += pDelta->GetDataRate(Type);
+	return Rate;
+}
+
+TEST_F(SnapshotSimd, Delta)
+{
+	static char s_aFrom[CSnapshot::MAX_SIZE];
+	static char s_aTo[CSnapshot::MAX_SIZE];
+	static char s_aDelta[CSnapshot::MAX_SIZE];
+	static char s_aResult[CSnapshot::MAX_SIZE];
+	static CSnapshotDelta s_SnapshotDelta;
+	unsigned Seed = 3;
+	for(int Run = 0; Run < 100; Run++)
+	{
+		// the same items, some of them changed
+		unsigned FromSeed = Seed;
+		int FromSize = BuildSnapshot(s_aFrom, &Seed, true);
+		int ToSize = BuildSnapshot(s_aTo, &FromSeed, true);
+		ASSERT_EQ(FromSize, ToSize);
+		CSnapshot *pTo = (CSnapshot *)s_aTo;
+		for(int i = 0; i < pTo->NumItems(); i++)
+		{
+			if(Random(&Seed) % 3 == 0 && pTo->GetItemSize(i) > 0)
+				pTo->GetItem(i)->Data()[Random(&Seed) % (pTo->GetItemSize(i) / 4)] = RandomValue(&Seed);
+		}
+
+		int DeltaSize = -1;
+		int DataRate = -1;
+		for(int Level = CSnapshotSimd::LEVEL_SCALAR; Level <= CSnapshotSimd::SupportedLevel(); Level++)
+		{
+			CSnapshotSimd::SetLevel(Level);
+			int Size = s_SnapshotDelta.CreateDelta((CSnapshot *)s_aFrom, pTo, s_aDelta);
+			if(DeltaSize != -1)
+			{
+				EXPECT_EQ(Size, DeltaSize);
+			}
+			DeltaSize = Size;
+			if(Size == 0)
+				continue;
+
+			int Rate = TotalDataRate(&s_SnapshotDelta);
+			ASSERT_EQ(s_SnapshotDelta.UnpackDelta((CSnapshot *)s_aFrom, (CSnapshot *)s_aResult, s_aDelta, Size), ToSize);
+			EXPECT_EQ(mem_comp(s_aResult, s_aTo, ToSize), 0);
+			Rate = TotalDataRate(&s_SnapshotDelta) - Rate;
+			if(DataRate != -1)
+			{
+				EXPECT_EQ(Rate, DataRate);
+			}
+			DataRate = Rate;
+		}
+	}
+}
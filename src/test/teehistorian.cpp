@@ -359,3 +359,206 @@ TEST_F(TeeHistorian, Auth)
 	Finish();
 	Expect(EXPECTED, sizeof(EXPECTED));
 }
+
+struct CMemoryReader
+{
+	const unsigned char *m_pData;
+	int m_Size;
+	int m_Pos;
+
+	CMemoryReader(const unsigned char *pData, int Size, int Pos = 0) :
+		m_pData(pData), m_Size(Size), m_Pos(Pos)
+	{
+	}
+
+	static int Read(void *pData, int DataSize, void *pUser)
+	{
+		CMemoryReader *pThis = (CMemoryReader *)pUser;
+		// small reads to cross the buffer boundaries of the reader
+		int Size = min(min(DataSize, pThis->m_Size - pThis->m_Pos), 7);
+		mem_copy(pData, pThis->m_pData + pThis->m_Pos, Size);
+		pThis->m_Pos += Size;
+		return Size;
+	}
+};
+
+TEST_F(TeeHistorian, ReaderRoundTrip)
+{
+	CNetObj_PlayerInput Input;
+	mem_zero(&Input, sizeof(Input));
+	Input.m_Direction = -1;
+	Input.m_TargetX = 100;
+
+	Tick(1); Player(0, 1, 2); Player(5, 10, 20);
+	Inputs(); m_TH.RecordPlayerInput(5, &Input); m_TH.RecordPlayerJoin(7);
+	Tick(2); Player(0, 3, 2); Player(5, 10, 20);
+	Inputs(); Input.m_Jump = 1; m_TH.RecordPlayerInput(5, &Input);
+	Tick(10); DeadPlayer(0); Player(5, 11, 20);
+	Inputs(); m_TH.RecordPlayerMessage(5, "\x01\x02", 2); m_TH.RecordPlayerDrop(7, "timeout");
+	Finish();
+	ASSERT_FALSE(m_Buffer.Error());
+
+	CMemoryReader Memory(m_Buffer.Data(), m_Buffer.Size());
+	CTeeHistorianReader Reader(CMemoryReader::Read, &Memory);
+	ASSERT_TRUE(Reader.ReadHeader());
+	EXPECT_TRUE(str_startswith(Reader.HeaderJson(), "{\"comment\":\"teehistorian@ddnet.tw\""));
+
+	const int EXPECTED[] = {
+		CTeeHistorianReader::ITEM_TICK, CTeeHistorianReader::ITEM_PLAYER, CTeeHistorianReader::ITEM_PLAYER,
+		CTeeHistorianReader::ITEM_INPUT, CTeeHistorianReader::ITEM_JOIN,
+		CTeeHistorianReader::ITEM_TICK, CTeeHistorianReader::ITEM_PLAYER, CTeeHistorianReader::ITEM_INPUT,
+		CTeeHistorianReader::ITEM_TICK, CTeeHistorianReader::ITEM_PLAYER_DEAD, CTeeHistorianReader::ITEM_PLAYER,
+		CTeeHistorianReader::ITEM_MESSAGE, CTeeHistorianReader::ITEM_DROP,
+		CTeeHistorianReader::ITEM_FINISH,
+	};
+	const int EXPECTED_TICKS[] = {1, 1, 1, 1, 1, 2, 2, 2, 10, 10, 10, 10, 10, 10};
+	for(int i = 0; i < (int)(sizeof(EXPECTED) / sizeof(EXPECTED[0])); i++)
+	{
+		ASSERT_EQ(Reader.Next(), EXPECTED[i]) << "item " << i;
+		EXPECT_EQ(Reader.Tick(), EXPECTED_TICKS[i]) << "item " << i;
+	}
+	EXPECT_EQ(Reader.Next(), CTeeHistorianReader::ITEM_END);
+	EXPECT_EQ(Reader.Offset(), m_Buffer.Size());
+
+	EXPECT_FALSE(Reader.Player(0)->m_Alive);
+	EXPECT_TRUE(Reader.Player(5)->m_Alive);
+	EXPECT_EQ(Reader.Player(5)->m_X, 11);
+	EXPECT_EQ(Reader.Player(5)->m_Y, 20);
+	EXPECT_TRUE(mem_comp(&Reader.Player(5)->m_Input, &Input, sizeof(Input)) == 0);
+	EXPECT_EQ(Reader.ClientID(), 7);
+	EXPECT_STREQ(Reader.String(), "timeout");
+}
+
+TEST_F(TeeHistorian, ReaderTruncated)
+{
+	Tick(1); Player(0, 1000, 2000);
+	Finish();
+
+	// cut into the player data
+	CMemoryReader Memory(m_Buffer.Data(), m_Buffer.Size() - 3);
+	CTeeHistorianReader Reader(CMemoryReader::Read, &Memory);
+	ASSERT_TRUE(Reader.ReadHeader());
+	EXPECT_EQ(Reader.Next(), CTeeHistorianReader::ITEM_END);
+}
+
+static void WriteIndex(const void *pData, int DataSize, void *pUser)
+{
+	std::vector<unsigned char> *paIndex = (std::vector<unsigned char> *)pUser;
+	paIndex->insert(paIndex->end(), (const unsigned char *)pData, (const unsigned char *)pData + DataSize);
+}
+
+struct CReaderState
+{
+	int m_Tick;
+	CTeeHistorianReader::CPlayer m_aPlayers[MAX_CLIENTS];
+};
+
+// state after every tick, read up to the end of the data
+static std::vector<CReaderState> ReadStates(CTeeHistorianReader *pReader)
+{
+	std::vector<CReaderState> aStates;
+	while(true)
+	{
+		int Item = pReader->Next();
+		EXPECT_NE(Item, CTeeHistorianReader::ITEM_ERROR);
+		if(Item == CTeeHistorianReader::ITEM_TICK || Item == CTeeHistorianReader::ITEM_FINISH)
+		{
+			CReaderState State;
+			State.m_Tick = pReader->Tick();
+			for(int i = 0; i < MAX_CLIENTS; i++)
+			{
+				State.m_aPlayers[i] = *pReader->Player(i);
+			}
+			aStates.push_back(State);
+		}
+		if(Item != CTeeHistorianReader::ITEM_TICK && Item != CTeeHistorianReader::ITEM_PLAYER
+			&& Item != CTeeHistorianReader::ITEM_PLAYER_DEAD && Item != CTeeHistorianReader::ITEM_INPUT)
+		{
+			return aStates;
+		}
+	}
+}
+
+TEST_F(TeeHistorian, IndexSeek)
+{
+	std::vector<unsigned char> aIndex;
+	m_TH.EnableIndex(WriteIndex, &aIndex, 3);
+
+	CNetObj_PlayerInput Input;
+	mem_zero(&Input, sizeof(Input));
+	for(int i = 1; i <= 20; i++)
+	{
+		Tick(i);
+		if(i % 7 != 0)
+		{
+			// moves every other tick, so some ticks are implicit
+			Player(1, 10 + i / 2, 20);
+		}
+		else
+		{
+			DeadPlayer(1);
+		}
+		Player(3, 5, i);
+		Inputs();
+		if(i % 4 == 0)
+		{
+			Input.m_TargetX = i;
+			m_TH.RecordPlayerInput(3, &Input);
+		}
+	}
+	Finish();
+	ASSERT_FALSE(m_Buffer.Error());
+
+	CTeeHistorianIndex Index;
+	ASSERT_TRUE(Index.Load(&aIndex[0], aIndex.size()));
+	EXPECT_TRUE(Index.GameUuid() == m_GameInfo.m_GameUuid);
+	ASSERT_EQ(Index.NumKeyframes(), 7);
+	EXPECT_EQ(Index.Find(0), (const CTeeHistorianIndex::CKeyframe *)0);
+	EXPECT_EQ(Index.Find(1)->m_Tick, 1);
+	EXPECT_EQ(Index.Find(9)->m_Tick, 7);
+	EXPECT_EQ(Index.Find(1000)->m_Tick, 19);
+
+	CMemoryReader Memory(m_Buffer.Data(), m_Buffer.Size());
+	CTeeHistorianReader Reader(CMemoryReader::Read, &Memory);
+	ASSERT_TRUE(Reader.ReadHeader());
+	std::vector<CReaderState> aStates = ReadStates(&Reader);
+	ASSERT_EQ(aStates.back().m_Tick, 20);
+
+	for(int k = 0; k < Index.NumKeyframes(); k++)
+	{
+		const CTeeHistorianIndex::CKeyframe *pKeyframe = Index.Keyframe(k);
+		CMemoryReader SeekMemory(m_Buffer.Data(), m_Buffer.Size(), pKeyframe->m_Offset);
+		CTeeHistorianReader SeekReader(CMemoryReader::Read, &SeekMemory);
+		SeekReader.Seek(pKeyframe);
+		std::vector<CReaderState> aSeekStates = ReadStates(&SeekReader);
+		ASSERT_FALSE(aSeekStates.empty());
+
+		unsigned Start = 0;
+		while(aStates[Start].m_Tick != aSeekStates[0].m_Tick)
+		{
+			Start++;
+			ASSERT_LT(Start, aStates.size());
+		}
+		ASSERT_EQ(aSeekStates.size(), aStates.size() - Start) << "keyframe " << k;
+		for(unsigned i = 0; i < aSeekStates.size(); i++)
+		{
+			EXPECT_EQ(aSeekStates[i].m_Tick, aStates[Start + i].m_Tick);
+			for(int c = 0; c < MAX_CLIENTS; c++)
+			{
+				const CTeeHistorianReader::CPlayer *pA = &aStates[Start + i].m_aPlayers[c];
+				const CTeeHistorianReader::CPlayer *pB = &aSeekStates[i].m_aPlayers[c];
+				EXPECT_EQ(pA->m_Alive, pB->m_Alive);
+				EXPECT_EQ(pA->m_InputExists, pB->m_InputExists);
+				if(pA->m_Alive && pB->m_Alive)
+				{
+					EXPECT_EQ(pA->m_X, pB->m_X) << "keyframe " << k << " tick " << aStates[Start + i].m_Tick;
+					EXPECT_EQ(pA->m_Y, pB->m_Y);
+				}
+				if(pA->m_InputExists && pB->m_InputExists)
+				{
+					EXPECT_EQ(pA->m_Input.m_TargetX, pB->m_Input.m_TargetX);
+				}
+			}
+		}
+	}
+}
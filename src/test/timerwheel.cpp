@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include <engine/shared/timerwheel.h>
+
+TEST(TimerWheel, Simple)
+{
+	CTimerWheel Wheel;
+	Wheel.Init(1000, 10);
+	int aFired[CTimerWheel::MAX_TIMERS];
+
+	Wheel.Schedule(1, 1500);
+	Wheel.Schedule(2, 1005);
+	Wheel.Schedule(3, 900); // in the past, fires with the next tick
+	EXPECT_TRUE(Wheel.Scheduled(1));
+	EXPECT_FALSE(Wheel.Scheduled(0));
+
+	EXPECT_EQ(Wheel.Advance(1005, aFired), 0);
+	ASSERT_EQ(Wheel.Advance(1010, aFired), 2);
+	EXPECT_TRUE((aFired[0] == 2 && aFired[1] == 3) || (aFired[0] == 3 && aFired[1] == 2));
+	EXPECT_FALSE(Wheel.Scheduled(2));
+
+	// only moves the timer forward
+	Wheel.ScheduleEarlier(1, 2000);
+	Wheel.ScheduleEarlier(1, 1200);
+	EXPECT_EQ(Wheel.Advance(1199, aFired), 0);
+	ASSERT_EQ(Wheel.Advance(1200, aFired), 1);
+	EXPECT_EQ(aFired[0], 1);
+
+	Wheel.Schedule(4, 5000);
+	Wheel.Cancel(4);
+	EXPECT_EQ(Wheel.Advance(10000, aFired), 0);
+}
+
+TEST(TimerWheel, Zeroed)
+{
+	// a zeroed wheel has no timers
+	CTimerWheel Wheel;
+	mem_zero(&Wheel, sizeof(Wheel));
+	Wheel.Init(0, 1);
+	int aFired[CTimerWheel::MAX_TIMERS];
+	EXPECT_EQ(Wheel.Advance(100000, aFired), 0);
+}
+
+TEST(TimerWheel, Random)
+{
+	// compare with the plain list of times, all levels and big jumps
+	CTimerWheel Wheel;
+	int64 Now = 123456;
+	Wheel.Init(Now, 1);
+	int64 aTimes[CTimerWheel::MAX_TIMERS];
+	int aFired[CTimerWheel::MAX_TIMERS];
+	for(int i = 0; i < CTimerWheel::MAX_TIMERS; i++)
+		aTimes[i] = -1;
+
+	unsigned Seed = 7;
+	for(int Step = 0; Step < 20000; Step++)
+	{
+		Seed = Seed * 1103515245 + 12345;
+		int Timer = (Seed >> 8) % CTimerWheel::MAX_TIMERS;
+		Seed = Seed * 1103515245 + 12345;
+		static const int s_aRanges[] = {100, 300, 20000, 1000000};
+		int64 Delay = 1 + (Seed >> 4) % s_aRanges[(Seed >> 28) % 4];
+		if(Seed % 7 == 0)
+		{
+			Wheel.Cancel(Timer);
+			aTimes[Timer] = -1;
+		}
+		else if(Seed % 3 == 0)
+		{
+			Wheel.ScheduleEarlier(Timer, Now + Delay);
+			if(aTimes[Timer] < 0 || Now + Delay < aTimes[Timer])
+				aTimes[Timer] = Now + Delay;
+		}
+		else
+		{
+			Wheel.Schedule(Timer, Now + Delay);
+			aTimes[Timer] = Now + Delay;
+		}
+
+		Seed = Seed * 1103515245 + 12345;
+		Now += (Seed >> 8) % (Step % 100 == 0 ? 100000 : 200);
+		int NumFired = Wheel.Advance(Now, aFired);
+		int Expected = 0;
+		for(int i = 0; i < CTimerWheel::MAX_TIMERS; i++)
+		{
+			if(aTimes[i] >= 0 && aTimes[i] <= Now)
+				Expected++;
+		}
+		ASSERT_EQ(NumFired, Expected);
+		for(int i = 0; i < NumFired; i++)
+		{
+			ASSERT_GE(aTimes[aFired[i]], 0);
+			ASSERT_LE(aTimes[aFired[i]], Now);
+			aTimes[aFired[i]] = -1;
+		}
+	}
+}
@@ -0,0 +1,106 @@
+#include "test.h"
+#include <gtest/gtest.h>
+
+#include <base/math.h>
+#include <engine/shared/zframes.h>
+
+#include <algorithm>
+
+class ZFrames : public ::testing::Test
+{
+protected:
+	CTestInfo m_Info;
+	std::vector<unsigned char> m_aData;
+
+	ZFrames()
+	{
+		// compressible, but not trivially
+		unsigned Seed = 1;
+		for(int i = 0; i < 200000; i++)
+		{
+			Seed = Seed * 1103515245 + 12345;
+			m_aData.push_back('a' + (Seed >> 16) % 4);
+		}
+	}
+
+	~ZFrames()
+	{
+		fs_remove(m_Info.m_aFilename);
+	}
+
+	std::vector<unsigned char> ReadBack(int *pNumFrames)
+	{
+		std::vector<unsigned char> aResult;
+		std::vector<unsigned char> aFrame;
+		IOHANDLE File = io_open(m_Info.m_aFilename, IOFLAG_READ);
+		EXPECT_TRUE(File);
+		EXPECT_TRUE(CZFrameReader::CheckMagic(File));
+		*pNumFrames = 0;
+		while(CZFrameReader::ReadFrame(File, &aFrame))
+		{
+			aResult.insert(aResult.end(), aFrame.begin(), aFrame.end());
+			(*pNumFrames)++;
+		}
+		io_close(File);
+		return aResult;
+	}
+};
+
+TEST_F(ZFrames, RoundTrip)
+{
+	IOHANDLE File = io_open(m_Info.m_aFilename, IOFLAG_WRITE);
+	ASSERT_TRUE(File);
+	CZFrameWriter Writer(6, 1000);
+	for(unsigned Pos = 0; Pos < m_aData.size(); Pos += 777)
+		Writer.Write(File, &m_aData[Pos], min((unsigned)m_aData.size() - Pos, 777u), false);
+	Writer.Write(File, 0, 0, true);
+	int Size = io_tell(File);
+	io_close(File);
+	EXPECT_LT(Size, (int)m_aData.size() / 2);
+
+	int NumFrames;
+	EXPECT_EQ(ReadBack(&NumFrames), m_aData);
+	EXPECT_EQ(NumFrames, (int)(m_aData.size() + ZFRAMES_MAX_FRAME_SIZE - 1) / ZFRAMES_MAX_FRAME_SIZE);
+}
+
+TEST_F(ZFrames, Truncated)
+{
+	IOHANDLE File = io_open(m_Info.m_aFilename, IOFLAG_WRITE);
+	ASSERT_TRUE(File);
+	CZFrameWriter Writer(6, 1000);
+	Writer.Write(File, &m_aData[0], m_aData.size(), true);
+	int Size = io_tell(File);
+	io_close(File);
+
+	// cut into the last frame
+	std::vector<unsigned char> aFile(Size);
+	File = io_open(m_Info.m_aFilename, IOFLAG_READ);
+	io_read(File, &aFile[0], Size);
+	io_close(File);
+	File = io_open(m_Info.m_aFilename, IOFLAG_WRITE);
+	io_write(File, &aFile[0], Size - 10);
+	io_close(File);
+
+	int NumFrames;
+	std::vector<unsigned char> aRead = ReadBack(&NumFrames);
+	int Complete = m_aData.size() / ZFRAMES_MAX_FRAME_SIZE * ZFRAMES_MAX_FRAME_SIZE;
+	ASSERT_EQ((int)aRead.size(), Complete);
+	EXPECT_TRUE(std::equal(aRead.begin(), aRead.end(), m_aData.begin()));
+}
+
+TEST_F(ZFrames, Aio)
+{
+	IOHANDLE File = io_open(m_Info.m_aFilename, IOFLAG_WRITE);
+	ASSERT_TRUE(File);
+	CZFrameWriter Writer(1, 1000);
+	ASYNCIO *pAio = aio_new_filter(File, CZFrameWriter::AioFilter, &Writer);
+	for(unsigned Pos = 0; Pos < m_aData.size(); Pos += 1000)
+		aio_write(pAio, &m_aData[Pos], min((unsigned)m_aData.size() - Pos, 1000u));
+	aio_close(pAio);
+	aio_wait(pAio);
+	EXPECT_EQ(aio_error(pAio), 0);
+	aio_free(pAio);
+
+	int NumFrames;
+	EXPECT_EQ(ReadBack(&NumFrames), m_aData);
+}
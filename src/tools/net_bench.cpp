@@ -0,0 +1,430 @@
+#include <base/system.h>
+#include <engine/console.h>
+#include <engine/external/md5/md5.h>
+#include <engine/shared/compression.h>
+#include <engine/shared/config.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/network.h>
+#include <engine/shared/snapshot.h>
+#include <engine/shared/snapshot_simd.h>
+#include <engine/storage.h>
+#include <game/generated/protocol.h>
+
+#include <vector>
+
+// Times the hot paths of the network code on synthetic input, so changes to
+// them can be compared on the same machine.
+
+static const char *TOOL_NAME = "net_bench";
+
+static volatile unsigned gs_Sink;
+static const char *gs_pDemoFile = 0;
+
+static void Report(const char *pName, int Iterations, int64 Start)
+{
+	double Seconds = (time_get() - Start) / (double)time_freq();
+	dbg_msg(TOOL_NAME, "%-16s %10.1f ns/op", pName, Seconds * 1e9 / Iterations);
+}
+
+// the token as it was computed before
+static SECURITY_TOKEN Md5Token(const unsigned char *pSeed, const NETADDR &Addr)
+{
+	md5_state_t md5;
+	md5_byte_t digest[16];
+	md5_init(&md5);
+	md5_append(&md5, pSeed, 16);
+	md5_append(&md5, (const unsigned char *)&Addr, sizeof(Addr));
+	md5_finish(&md5, digest);
+	return (int)digest[0] | (digest[1] << 8) | (digest[2] << 16) | (digest[3] << 24);
+}
+
+static void BenchToken(int Iterations)
+{
+	unsigned char aSeed[SIPHASH_KEY_LENGTH];
+	for(unsigned i = 0; i < sizeof(aSeed); i++)
+		aSeed[i] = i * 37;
+	NETADDR Addr;
+	mem_zero(&Addr, sizeof(Addr));
+	Addr.type = NETTYPE_IPV4;
+
+	// a different spoofed address for every packet
+	unsigned Sum = 0;
+	int64 Start = time_get();
+	for(int i = 0; i < Iterations; i++)
+	{
+		mem_copy(Addr.ip, &i, sizeof(i));
+		Addr.port = i;
+		Sum += Md5Token(aSeed, Addr);
+	}
+	Report("token md5", Iterations, Start);
+
+	Start = time_get();
+	for(int i = 0; i < Iterations; i++)
+	{
+		mem_copy(Addr.ip, &i, sizeof(i));
+		Addr.port = i;
+		Sum += CNetServer::CalcToken(aSeed, Addr);
+	}
+	Report("token siphash", Iterations, Start);
+	gs_Sink = Sum;
+}
+
+static void BenchHuffman(int Iterations)
+{
+	// bytes that look like packet payload: mostly small numbers and zeros
+	enum { SIZE=1200, NUM_BUFFERS=16 };
+	static unsigned char s_aaData[NUM_BUFFERS][SIZE];
+	static unsigned char s_aaCompressed[NUM_BUFFERS][SIZE * 2];
+	static int s_aCompressedSize[NUM_BUFFERS];
+	unsigned Seed = 1;
+	for(int b = 0; b < NUM_BUFFERS; b++)
+	{
+		for(int i = 0; i < SIZE; i++)
+		{
+			Seed = Seed * 1103515245 + 12345;
+			unsigned Value = Seed >> 16;
+			s_aaData[b][i] = Value % 4 == 0 ? Value >> 8 : Value % 3 == 0 ? 0 : (Value >> 4) % 16;
+		}
+	}
+
+	CNetBase::Init();
+	int Total = 0;
+	int64 Start = time_get();
+	for(int i = 0; i < Iterations; i++)
+	{
+		int b = i % NUM_BUFFERS;
+		s_aCompressedSize[b] = CNetBase::Compress(s_aaData[b], SIZE, s_aaCompressed[b], sizeof(s_aaCompressed[b]));
+		Total += s_aCompressedSize[b];
+	}
+	Report("huffman compress", Iterations, Start);
+
+	unsigned char aOut[SIZE];
+	Start = time_get();
+	for(int i = 0; i < Iterations; i++)
+	{
+		int b = i % NUM_BUFFERS;
+		Total += CNetBase::Decompress(s_aaCompressed[b], s_aCompressedSize[b], aOut, sizeof(aOut));
+	}
+	Report("huffman decomp", Iterations, Start);
+	dbg_msg(TOOL_NAME, "huffman ratio %.3f for %d byte buffers", s_aCompressedSize[0] / (double)SIZE, (int)SIZE);
+	gs_Sink = Total;
+}
+
+// the snapshots of a demo and the deltas between consecutive ones, like
+// the server sends them to a client that acks every snapshot
+class CDeltaCollector : public CDemoPlayer::IListener
+{
+public:
+	CSnapshotDelta m_SnapshotDelta;
+	std::vector<std::vector<unsigned char> > m_aaSnaps;
+	std::vector<std::vector<int> > m_aaDeltas;
+
+	CDeltaCollector()
+	{
+		// the game's items have a fixed size that isn't sent
+		CNetObjHandler NetObjHandler;
+		for(int i = 0; i < NUM_NETOBJTYPES; i++)
+			m_SnapshotDelta.SetStaticsize(i, NetObjHandler.GetObjSize(i));
+	}
+
+	virtual void OnDemoPlayerSnapshot(void *pData, int Size)
+	{
+		static int s_aDelta[CSnapshot::MAX_SIZE / sizeof(int)];
+		CSnapshot EmptySnap;
+		EmptySnap.Clear();
+		CSnapshot *pBase = m_aaSnaps.empty() ? &EmptySnap : (CSnapshot *)&m_aaSnaps.back()[0];
+		int DeltaSize = m_SnapshotDelta.CreateDelta(pBase, (CSnapshot *)pData, s_aDelta);
+		if(DeltaSize > 0)
+			m_aaDeltas.push_back(std::vector<int>(s_aDelta, s_aDelta + DeltaSize / sizeof(int)));
+		m_aaSnaps.push_back(std::vector<unsigned char>((unsigned char *)pData, (unsigned char *)pData + Size));
+	}
+	virtual void OnDemoPlayerMessage(void *pData, int Size) {}
+};
+
+static bool LoadDemoDeltas(const char *pFilename, CDeltaCollector *pCollector)
+{
+	CNetBase::Init();
+	IStorage *pStorage = CreateLocalStorage();
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+	CDemoPlayer Player(&pCollector->m_SnapshotDelta);
+	Player.SetListener(pCollector);
+	bool Loaded = Player.Load(pStorage, pConsole, pFilename, IStorage::TYPE_ABSOLUTE) == 0;
+	if(Loaded)
+	{
+		Player.Play();
+		Player.Update(false);
+		Player.Stop();
+	}
+	delete pConsole;
+	delete pStorage;
+	return Loaded;
+}
+
+static bool CollectSnapshots(CDeltaCollector *pCollector)
+{
+	if(gs_pDemoFile)
+	{
+		if(!LoadDemoDeltas(gs_pDemoFile, pCollector))
+		{
+			dbg_msg(TOOL_NAME, "couldn't load demo '%s'", gs_pDemoFile);
+			return false;
+		}
+	}
+	else
+	{
+		// without a demo: characters moving around among mostly static items
+		for(int Tick = 0; Tick < 100; Tick++)
+		{
+			static unsigned char s_aSnap[CSnapshot::MAX_SIZE];
+			CSnapshotBuilder Builder;
+			Builder.Init();
+			for(int i = 0; i < 64; i++)
+			{
+				int *pItem = (int *)Builder.NewItem(9, i, 22 * sizeof(int));
+				for(int k = 0; k < 22; k++)
+					pItem[k] = k < 6 && i % 4 == 0 ? (Tick * (k + 3) * 37) % 2000 : k * 100 + i;
+			}
+			pCollector->OnDemoPlayerSnapshot(s_aSnap, Builder.Finish(s_aSnap));
+		}
+	}
+	if(pCollector->m_aaDeltas.empty())
+	{
+		dbg_msg(TOOL_NAME, "no snapshot deltas");
+		return false;
+	}
+	return true;
+}
+
+static void BenchVariableInt(int Iterations)
+{
+	CDeltaCollector Collector;
+	if(!CollectSnapshots(&Collector))
+		return;
+
+	int NumDeltas = Collector.m_aaDeltas.size();
+	int64 Ints = 0;
+	static unsigned char s_aCompressed[CSnapshot::MAX_SIZE * 2];
+	static int s_aDecompressed[CSnapshot::MAX_SIZE];
+	long Total = 0;
+	int64 Start = time_get();
+	for(int i = 0; i < Iterations; i++)
+	{
+		const std::vector<int> &Delta = Collector.m_aaDeltas[i % NumDeltas];
+		Total += CVariableInt::Compress(&Delta[0], Delta.size() * sizeof(int), s_aCompressed, sizeof(s_aCompressed));
+		Ints += Delta.size();
+	}
+	Report("varint compress", Iterations, Start);
+
+	std::vector<std::vector<unsigned char> > aaCompressed(NumDeltas);
+	int64 CompressedSize = 0;
+	for(int i = 0; i < NumDeltas; i++)
+	{
+		const std::vector<int> &Delta = Collector.m_aaDeltas[i];
+		long Size = CVariableInt::Compress(&Delta[0], Delta.size() * sizeof(int), s_aCompressed, sizeof(s_aCompressed));
+		aaCompressed[i].assign(s_aCompressed, s_aCompressed + Size);
+		CompressedSize += Size;
+	}
+
+	Start = time_get();
+	for(int i = 0; i < Iterations; i++)
+	{
+		const std::vector<unsigned char> &Compressed = aaCompressed[i % NumDeltas];
+		Total += CVariableInt::Decompress(&Compressed[0], Compressed.size(), s_aDecompressed, sizeof(s_aDecompressed));
+	}
+	Report("varint decomp", Iterations, Start);
+	dbg_msg(TOOL_NAME, "varint %d deltas, %.1f ints and %.1f bytes on average", NumDeltas, Ints / (double)Iterations, CompressedSize / (double)NumDeltas);
+	gs_Sink = Total;
+}
+
+static void BenchSnapshot(int Iterations)
+{
+	CDeltaCollector Collector;
+	if(!CollectSnapshots(&Collector))
+		return;
+
+	static const char *s_apLevels[] = {"scalar", "sse2", "avx2"};
+	int NumSnaps = Collector.m_aaSnaps.size();
+	static int s_aDelta[CSnapshot::MAX_SIZE / sizeof(int)];
+	char aName[32];
+	int Total = 0;
+	int Level = CSnapshotSimd::Level();
+	for(int l = CSnapshotSimd::SupportedLevel(); l >= CSnapshotSimd::LEVEL_SCALAR; l--)
+	{
+		CSnapshotSimd::SetLevel(l);
+		int64 Start = time_get();
+		for(int i = 0; i < Iterations; i++)
+		{
+			int Snap = 1 + i % (NumSnaps - 1);
+			Total += Collector.m_SnapshotDelta.CreateDelta((CSnapshot *)&Collector.m_aaSnaps[Snap - 1][0], (CSnapshot *)&Collector.m_aaSnaps[Snap][0], s_aDelta);
+		}
+		str_format(aName, sizeof(aName), "delta %s", s_apLevels[l]);
+		Report(aName, Iterations, Start);
+
+		// the server sums the snapshot it just built, that's in the cache
+		Start = time_get();
+		for(int i = 0; i < Iterations; i++)
+			Total += ((CSnapshot *)&Collector.m_aaSnaps[i / 64 % NumSnaps][0])->Crc();
+		str_format(aName, sizeof(aName), "crc %s", s_apLevels[l]);
+		Report(aName, Iterations, Start);
+	}
+	CSnapshotSimd::SetLevel(Level);
+
+	int64 Size = 0;
+	for(int i = 0; i < NumSnaps; i++)
+		Size += Collector.m_aaSnaps[i].size();
+	dbg_msg(TOOL_NAME, "snapshot %d snapshots, %d bytes on average", NumSnaps, (int)(Size / NumSnaps));
+	gs_Sink = Total;
+}
+
+static void BenchSend(int Iterations)
+{
+	// a connection to a socket on this machine that never reads, the
+	// kernel drops what doesn't fit
+	NETADDR BindAddr;
+	mem_zero(&BindAddr, sizeof(BindAddr));
+	BindAddr.type = NETTYPE_IPV4;
+	NETSOCKET Sender = net_udp_create(BindAddr);
+	BindAddr.port = 18311;
+	NETSOCKET Receiver = net_udp_create(BindAddr);
+	if(!Sender.type || !Receiver.type)
+	{
+		dbg_msg(TOOL_NAME, "couldn't open sockets");
+		return;
+	}
+	NETADDR PeerAddr;
+	net_addr_from_str(&PeerAddr, "127.0.0.1:18311");
+
+	CNetBase::Init();
+	static CNetConnection s_Connection;
+	s_Connection.Init(Sender, false);
+	s_Connection.DirectInit(PeerAddr, 0x12345678);
+
+	// snapshot chunks hardly compress, chat messages do
+	unsigned char aSnap[1000];
+	unsigned Seed = 3;
+	for(unsigned i = 0; i < sizeof(aSnap); i++)
+	{
+		Seed = Seed * 1103515245 + 12345;
+		aSnap[i] = Seed >> 16;
+	}
+	const char aChat[] = "the quick brown fox jumps over the lazy tee, again and again and again";
+
+	int64 Start = time_get();
+	for(int i = 0; i < Iterations; i++)
+	{
+		s_Connection.QueueChunk(0, sizeof(aSnap), aSnap);
+		s_Connection.Flush();
+	}
+	Report("send snapshot", Iterations, Start);
+
+	Start = time_get();
+	for(int i = 0; i < Iterations; i++)
+	{
+		for(int k = 0; k < 8; k++)
+			s_Connection.QueueChunk(0, sizeof(aChat), aChat);
+		s_Connection.Flush();
+	}
+	Report("send chat", Iterations, Start);
+
+	net_udp_close(Sender);
+	net_udp_close(Receiver);
+}
+
+static void BenchSendVital(int Iterations)
+{
+	// the same vital message to many connections, like a broadcast chat
+	// message; the peers have no address, so nothing hits the socket, and
+	// they ack every packet right away
+	enum
+	{
+		NUM_CONNECTIONS = 64,
+	};
+	NETSOCKET Socket;
+	mem_zero(&Socket, sizeof(Socket));
+	NETADDR PeerAddr;
+	mem_zero(&PeerAddr, sizeof(PeerAddr));
+	const SECURITY_TOKEN Token = 0x12345678;
+
+	CNetBase::Init();
+	static CNetConnection s_aConnections[NUM_CONNECTIONS];
+	for(int c = 0; c < NUM_CONNECTIONS; c++)
+	{
+		s_aConnections[c].Init(Socket, false);
+		s_aConnections[c].DirectInit(PeerAddr, Token);
+	}
+
+	// each connection with its own copy of the message, then with one
+	// shared by all
+	const char aChat[] = "the quick brown fox jumps over the lazy tee, again and again and again";
+	CNetPacketConstruct Ack;
+	int NumFailed = 0;
+	for(int Shared = 0; Shared < 2; Shared++)
+	{
+		int64 Start = time_get();
+		for(int i = 0; i < Iterations; i++)
+		{
+			CNetChunkData *pSharedData = Shared ? CNetChunkData::Create(aChat, sizeof(aChat)) : 0;
+			for(int c = 0; c < NUM_CONNECTIONS; c++)
+				NumFailed += s_aConnections[c].QueueChunk(NET_CHUNKFLAG_VITAL, sizeof(aChat), aChat, pSharedData) != 0;
+			if(pSharedData)
+				pSharedData->Release();
+			if(i % 8 != 7)
+				continue;
+			for(int c = 0; c < NUM_CONNECTIONS; c++)
+			{
+				s_aConnections[c].Flush();
+				Ack.Clear();
+				Ack.m_Ack = s_aConnections[c].SeqSequence();
+				mem_copy(Ack.m_aChunkData, &Token, sizeof(Token));
+				Ack.m_DataSize = sizeof(Token);
+				s_aConnections[c].Feed(&Ack, &PeerAddr);
+			}
+		}
+		Report(Shared ? "send vital shared" : "send vital", Iterations * NUM_CONNECTIONS, Start);
+	}
+	if(NumFailed)
+		dbg_msg(TOOL_NAME, "%d chunks didn't fit into the resend buffer", NumFailed);
+}
+
+struct CBenchmark
+{
+	const char *m_pName;
+	void (*m_pfnRun)(int Iterations);
+	int m_Iterations;
+};
+
+static const CBenchmark s_aBenchmarks[] = {
+	{"token", BenchToken, 10000000},
+	{"huffman", BenchHuffman, 200000},
+	{"varint", BenchVariableInt, 200000},
+	{"snapshot", BenchSnapshot, 20000},
+	{"send", BenchSend, 200000},
+	{"vital", BenchSendVital, 20000},
+};
+
+int main(int argc, const char **argv)
+{
+	dbg_logger_stdout();
+	if(argc > 3)
+	{
+		dbg_msg("usage", "%s [BENCHMARK] [DEMO]", TOOL_NAME);
+		return -1;
+	}
+	if(argc == 3)
+		gs_pDemoFile = argv[2];
+
+	bool Found = false;
+	for(unsigned i = 0; i < sizeof(s_aBenchmarks) / sizeof(s_aBenchmarks[0]); i++)
+	{
+		if(argc >= 2 && str_comp(argv[1], s_aBenchmarks[i].m_pName) != 0)
+			continue;
+		s_aBenchmarks[i].m_pfnRun(s_aBenchmarks[i].m_Iterations);
+		Found = true;
+	}
+	if(!Found)
+	{
+		dbg_msg(TOOL_NAME, "unknown benchmark '%s'", argv[1]);
+		return -1;
+	}
+	return 0;
+}
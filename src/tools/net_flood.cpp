@@ -0,0 +1,121 @@
+#include <base/system.h>
+#include <engine/shared/network.h>
+#include <mastersrv/mastersrv.h>
+
+// Sends a steady stream of packets that a server has to answer before a
+// connection exists, to check how it copes. Only use it against servers
+// you run yourself.
+
+static const char *TOOL_NAME = "net_flood";
+
+enum
+{
+	MAX_SOCKETS=64,
+};
+
+static void SendPacket(NETSOCKET Socket, NETADDR *pAddr, const char *pType, int Seq)
+{
+	if(str_comp(pType, "info") == 0)
+	{
+		unsigned char aData[sizeof(SERVERBROWSE_GETINFO) + 1];
+		mem_copy(aData, SERVERBROWSE_GETINFO, sizeof(SERVERBROWSE_GETINFO));
+		aData[sizeof(SERVERBROWSE_GETINFO)] = Seq;
+		CNetBase::SendPacketConnless(Socket, pAddr, aData, sizeof(aData), false, 0);
+	}
+	else if(str_comp(pType, "connect") == 0)
+	{
+		// ddnet clients ask for a security token
+		CNetBase::SendControlMsg(Socket, pAddr, 0, NET_CTRLMSG_CONNECT, SECURITY_TOKEN_MAGIC, sizeof(SECURITY_TOKEN_MAGIC), NET_SECURITY_TOKEN_UNKNOWN);
+	}
+	else
+	{
+		CNetBase::SendControlMsg(Socket, pAddr, 0, NET_CTRLMSG_CONNECT, 0, 0, NET_SECURITY_TOKEN_UNSUPPORTED);
+	}
+}
+
+int main(int argc, const char **argv)
+{
+	dbg_logger_stdout();
+	if(argc < 3 || argc > 6 || (str_comp(argv[2], "info") != 0 && str_comp(argv[2], "connect") != 0 && str_comp(argv[2], "vanilla") != 0))
+	{
+		dbg_msg("usage", "%s <server[:port]> <info|connect|vanilla> [packets per second = 1000] [seconds = 10] [sockets = 1]", TOOL_NAME);
+		return -1;
+	}
+
+	net_init();
+	CNetBase::Init();
+
+	NETADDR Addr;
+	if(net_host_lookup(argv[1], &Addr, NETTYPE_ALL))
+	{
+		dbg_msg(TOOL_NAME, "host lookup failed");
+		return -1;
+	}
+	if(Addr.port == 0)
+		Addr.port = 8303;
+
+	int Rate = argc > 3 ? max(str_toint(argv[3]), 1) : 1000;
+	int Seconds = argc > 4 ? max(str_toint(argv[4]), 1) : 10;
+	int NumSockets = argc > 5 ? clamp(str_toint(argv[5]), 1, (int)MAX_SOCKETS) : 1;
+
+	// several sockets look like several sources behind one address
+	NETSOCKET aSockets[MAX_SOCKETS];
+	NETADDR BindAddr;
+	mem_zero(&BindAddr, sizeof(BindAddr));
+	BindAddr.type = Addr.type;
+	for(int i = 0; i < NumSockets; i++)
+	{
+		aSockets[i] = net_udp_create(BindAddr);
+		if(!aSockets[i].type)
+		{
+			dbg_msg(TOOL_NAME, "couldn't open socket");
+			return -1;
+		}
+	}
+
+	MMSGS Mmsgs;
+	net_init_mmsgs(&Mmsgs);
+	unsigned char aBuffer[NET_MAX_PACKETSIZE];
+
+	int64 Freq = time_freq();
+	int64 Start = time_get();
+	int64 End = Start + Seconds * Freq;
+	int64 NextReport = Start + Freq;
+	int Sent = 0;
+	int Received = 0;
+	int ReportSent = 0;
+	int ReportReceived = 0;
+	while(true)
+	{
+		int64 Now = time_get();
+		if(Now >= End)
+			break;
+
+		// catch up with the rate in case the sleep overshot
+		int Due = (Now - Start) * Rate / Freq;
+		for(; Sent < Due; Sent++)
+			SendPacket(aSockets[Sent % NumSockets], &Addr, argv[2], Sent);
+
+		for(int i = 0; i < NumSockets; i++)
+		{
+			NETADDR From;
+			unsigned char *pData;
+			while(net_udp_recv(aSockets[i], &From, aBuffer, sizeof(aBuffer), &Mmsgs, &pData) > 0)
+				Received++;
+		}
+
+		if(Now >= NextReport)
+		{
+			dbg_msg(TOOL_NAME, "sent=%d/s answered=%d/s", Sent - ReportSent, Received - ReportReceived);
+			ReportSent = Sent;
+			ReportReceived = Received;
+			NextReport += Freq;
+		}
+		thread_sleep(1000);
+	}
+
+	dbg_msg(TOOL_NAME, "sent=%d answered=%d", Sent, Received);
+	for(int i = 0; i < NumSockets; i++)
+		net_udp_close(aSockets[i]);
+	return 0;
+}
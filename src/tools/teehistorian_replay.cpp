@@ -0,0 +1,426 @@
+#include <base/math.h>
+#include <base/system.h>
+#include <engine/external/json-parser/json.h>
+#include <engine/kernel.h>
+#include <engine/map.h>
+#include <engine/shared/datafile.h>
+#include <engine/shared/zframes.h>
+#include <engine/storage.h>
+#include <game/collision.h>
+#include <game/gamecore.h>
+#include <game/layers.h>
+#include <game/server/teehistorian.h>
+
+#include <vector>
+
+// Decodes a teehistorian file as fast as possible. With a map it also
+// checks the player movement: the recorded inputs drive the shared game
+// core (CCharacterCore on the map's collision) and its positions are
+// compared to the recorded ones. Nothing of CGameContext runs, so weapons,
+// game tiles and everything else handled by the server's game logic are
+// not replayed, and the speed says nothing about the load of a server.
+
+static const char *TOOL_NAME = "teehistorian_replay";
+
+// uncompressed data of a plain or zframes compressed teehistorian file
+class CSource
+{
+	IOHANDLE m_File;
+	bool m_Compressed;
+	std::vector<unsigned char> m_aFrame;
+	unsigned m_FramePos;
+	int64 m_Offset;
+
+public:
+	CSource(IOHANDLE File) :
+		m_File(File)
+	{
+		Rewind();
+	}
+
+	void Rewind()
+	{
+		io_seek(m_File, 0, IOSEEK_START);
+		m_Compressed = CZFrameReader::CheckMagic(m_File);
+		if(!m_Compressed)
+			io_seek(m_File, 0, IOSEEK_START);
+		m_aFrame.clear();
+		m_FramePos = 0;
+		m_Offset = 0;
+	}
+
+	bool Compressed() const { return m_Compressed; }
+
+	int Read(void *pData, int DataSize)
+	{
+		if(!m_Compressed)
+		{
+			int Size = io_read(m_File, pData, DataSize);
+			m_Offset += Size;
+			return Size;
+		}
+		if(m_FramePos == m_aFrame.size())
+		{
+			m_FramePos = 0;
+			if(!CZFrameReader::ReadFrame(m_File, &m_aFrame))
+			{
+				m_aFrame.clear();
+				return 0;
+			}
+		}
+		int Size = min(DataSize, (int)(m_aFrame.size() - m_FramePos));
+		mem_copy(pData, &m_aFrame[m_FramePos], Size);
+		m_FramePos += Size;
+		m_Offset += Size;
+		return Size;
+	}
+
+	bool Seek(int64 Offset)
+	{
+		if(!m_Compressed)
+		{
+			m_Offset = Offset;
+			return io_seek(m_File, Offset, IOSEEK_START) == 0;
+		}
+
+		// frames can't be entered in the middle, decompress up to the offset
+		if(Offset < m_Offset)
+			Rewind();
+		unsigned char aBuf[16 * 1024];
+		while(m_Offset < Offset)
+		{
+			if(Read(aBuf, min((int64)sizeof(aBuf), Offset - m_Offset)) <= 0)
+				return false;
+		}
+		return true;
+	}
+
+	static int ReadCallback(void *pData, int DataSize, void *pUser)
+	{
+		return ((CSource *)pUser)->Read(pData, DataSize);
+	}
+};
+
+class CReplayMap : public IMap
+{
+	CDataFileReader m_DataFile;
+
+public:
+	bool Load(IStorage *pStorage, const char *pFilename) { return m_DataFile.Open(pStorage, pFilename, IStorage::TYPE_ABSOLUTE); }
+
+	virtual void *GetData(int Index) { return m_DataFile.GetData(Index); }
+	virtual int GetDataSize(int Index) { return m_DataFile.GetDataSize(Index); }
+	virtual void *GetDataSwapped(int Index) { return m_DataFile.GetDataSwapped(Index); }
+	virtual void UnloadData(int Index) { m_DataFile.UnloadData(Index); }
+	virtual void *GetItem(int Index, int *pType, int *pID) { return m_DataFile.GetItem(Index, pType, pID); }
+	virtual int GetItemSize(int Index) { return m_DataFile.GetItemSize(Index); }
+	virtual void GetType(int Type, int *pStart, int *pNum) { m_DataFile.GetType(Type, pStart, pNum); }
+	virtual void *FindItem(int Type, int ID) { return m_DataFile.FindItem(Type, ID); }
+	virtual int NumItems() { return m_DataFile.NumItems(); }
+};
+
+class CReplay
+{
+	CTeeHistorianReader *m_pReader;
+	CCollision *m_pCollision;
+	CWorldCore m_World;
+	CTeamsCore m_Teams;
+	CCharacterCore m_aCores[MAX_CLIENTS];
+
+public:
+	int64 m_NumCompared;
+	int64 m_NumMatched;
+	double m_TotalError;
+	float m_MaxError;
+
+	CReplay(CTeeHistorianReader *pReader, CCollision *pCollision, const CTuningParams &Tuning) :
+		m_pReader(pReader),
+		m_pCollision(pCollision)
+	{
+		m_World.m_Tuning[0] = Tuning;
+		m_World.m_Tuning[1] = Tuning;
+		m_NumCompared = 0;
+		m_NumMatched = 0;
+		m_TotalError = 0;
+		m_MaxError = 0;
+	}
+
+	// compares the simulated positions to the recorded ones of the current
+	// tick and continues with the recorded ones
+	void Sync()
+	{
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			const CTeeHistorianReader::CPlayer *pPlayer = m_pReader->Player(i);
+			CCharacterCore *pCore = &m_aCores[i];
+			if(!pPlayer->m_Alive)
+			{
+				m_World.m_apCharacters[i] = 0;
+				continue;
+			}
+
+			vec2 Recorded(pPlayer->m_X, pPlayer->m_Y);
+			if(!m_World.m_apCharacters[i])
+			{
+				pCore->Reset();
+				pCore->Init(&m_World, m_pCollision, &m_Teams);
+				pCore->m_Id = i;
+				m_World.m_apCharacters[i] = pCore;
+			}
+			else
+			{
+				float Error = distance(pCore->m_Pos, Recorded);
+				m_NumCompared++;
+				m_NumMatched += Error < 0.5f;
+				m_TotalError += Error;
+				m_MaxError = max(m_MaxError, Error);
+			}
+			pCore->m_Pos = Recorded;
+		}
+	}
+
+	void Tick()
+	{
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			if(!m_World.m_apCharacters[i])
+				continue;
+			const CTeeHistorianReader::CPlayer *pPlayer = m_pReader->Player(i);
+			if(pPlayer->m_InputExists)
+				m_aCores[i].m_Input = pPlayer->m_Input;
+			m_aCores[i].Tick(true);
+		}
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			if(!m_World.m_apCharacters[i])
+				continue;
+			m_aCores[i].Move();
+			m_aCores[i].Quantize();
+		}
+	}
+};
+
+static void ParseTuning(const json_value *pTuning, CTuningParams *pParams)
+{
+	if(pTuning->type != json_object)
+		return;
+	for(unsigned i = 0; i < pTuning->u.object.length; i++)
+	{
+		const char *pName = pTuning->u.object.values[i].name;
+		const json_value *pValue = pTuning->u.object.values[i].value;
+		if(pValue->type != json_string)
+			continue;
+		// the header has the raw values, like `CTuneParam::Get`
+		#define MACRO_TUNING_PARAM(Name,ScriptName,Value,Description) \
+		if(str_comp(pName, #ScriptName) == 0) \
+			pParams->m_##Name.Set(str_toint(pValue->u.string.ptr));
+		#include <game/tuning.h>
+		#undef MACRO_TUNING_PARAM
+	}
+}
+
+static bool LoadIndex(const char *pFilename, CTeeHistorianIndex *pIndex)
+{
+	// the index belongs to the uncompressed name
+	char aIndexFilename[512];
+	str_copy(aIndexFilename, pFilename, sizeof(aIndexFilename));
+	int Length = str_length(aIndexFilename);
+	if(Length > 2 && str_comp(aIndexFilename + Length - 2, ".z") == 0)
+		aIndexFilename[Length - 2] = 0;
+	str_append(aIndexFilename, ".index", sizeof(aIndexFilename));
+
+	IOHANDLE File = io_open(aIndexFilename, IOFLAG_READ);
+	if(!File)
+	{
+		dbg_msg(TOOL_NAME, "couldn't open index '%s'", aIndexFilename);
+		return false;
+	}
+	std::vector<unsigned char> aData(io_length(File));
+	bool Result = !aData.empty() && io_read(File, &aData[0], aData.size()) == aData.size() && pIndex->Load(&aData[0], aData.size());
+	io_close(File);
+	if(!Result)
+		dbg_msg(TOOL_NAME, "invalid index '%s'", aIndexFilename);
+	return Result;
+}
+
+int main(int argc, const char **argv)
+{
+	dbg_logger_stdout();
+
+	const char *pFilename = 0;
+	const char *pMapFilename = 0;
+	int StartTick = 0;
+	int EndTick = -1;
+	bool Usage = false;
+	for(int i = 1; i < argc; i++)
+	{
+		if(str_comp(argv[i], "-m") == 0 && i + 1 < argc)
+			pMapFilename = argv[++i];
+		else if(str_comp(argv[i], "-s") == 0 && i + 1 < argc)
+			StartTick = str_toint(argv[++i]);
+		else if(str_comp(argv[i], "-e") == 0 && i + 1 < argc)
+			EndTick = str_toint(argv[++i]);
+		else if(!pFilename && argv[i][0] != '-')
+			pFilename = argv[i];
+		else
+			Usage = true;
+	}
+	if(!pFilename || Usage)
+	{
+		dbg_msg(TOOL_NAME, "usage: %s <teehistorian file> [-m <map file>] [-s <start tick>] [-e <end tick>]", TOOL_NAME);
+		return -1;
+	}
+
+	IOHANDLE File = io_open(pFilename, IOFLAG_READ);
+	if(!File)
+	{
+		dbg_msg(TOOL_NAME, "couldn't open '%s'", pFilename);
+		return -1;
+	}
+	CSource Source(File);
+	CTeeHistorianReader Reader(CSource::ReadCallback, &Source);
+	if(!Reader.ReadHeader())
+	{
+		dbg_msg(TOOL_NAME, "'%s' isn't a teehistorian file", pFilename);
+		io_close(File);
+		return -1;
+	}
+
+	CTuningParams Tuning;
+	json_value *pHeader = json_parse(Reader.HeaderJson(), str_length(Reader.HeaderJson()));
+	if(pHeader && pHeader->type == json_object)
+	{
+		const json_value &Header = *pHeader;
+		if(Header["game_uuid"].type == json_string && Header["map_name"].type == json_string && Header["server_version"].type == json_string)
+		{
+			dbg_msg(TOOL_NAME, "game %s on map '%s', %s%s",
+				(const char *)Header["game_uuid"], (const char *)Header["map_name"], (const char *)Header["server_version"],
+				Source.Compressed() ? ", compressed" : "");
+		}
+		ParseTuning(&Header["tuning"], &Tuning);
+	}
+	else
+	{
+		dbg_msg(TOOL_NAME, "invalid header, using default tuning");
+	}
+	if(pHeader)
+		json_value_free(pHeader);
+
+	if(StartTick > 0)
+	{
+		CTeeHistorianIndex Index;
+		const CTeeHistorianIndex::CKeyframe *pKeyframe = 0;
+		if(LoadIndex(pFilename, &Index))
+			pKeyframe = Index.Find(StartTick);
+		if(pKeyframe)
+		{
+			if(!Source.Seek(pKeyframe->m_Offset))
+			{
+				dbg_msg(TOOL_NAME, "couldn't seek to offset %lld", pKeyframe->m_Offset);
+				io_close(File);
+				return -1;
+			}
+			Reader.Seek(pKeyframe);
+			dbg_msg(TOOL_NAME, "starting at keyframe of tick %d", pKeyframe->m_Tick);
+		}
+		else
+		{
+			dbg_msg(TOOL_NAME, "no keyframe for tick %d, reading from the start", StartTick);
+		}
+	}
+
+	IKernel *pKernel = 0;
+	IStorage *pStorage = 0;
+	CReplayMap *pMap = 0;
+	CLayers Layers;
+	CCollision Collision;
+	if(pMapFilename)
+	{
+		pKernel = IKernel::Create();
+		pStorage = CreateLocalStorage();
+		pMap = new CReplayMap();
+		if(!pStorage || !pKernel->RegisterInterface(static_cast<IMap *>(pMap), false) || !pMap->Load(pStorage, pMapFilename))
+		{
+			dbg_msg(TOOL_NAME, "couldn't load map '%s'", pMapFilename);
+			delete pKernel;
+			delete pMap;
+			delete pStorage;
+			io_close(File);
+			return -1;
+		}
+		Layers.Init(pKernel);
+		Collision.Init(&Layers);
+	}
+
+	CReplay Replay(&Reader, &Collision, Tuning);
+	int64 NumItems = 0;
+	int NumTicks = 0;
+	int Result = CTeeHistorianReader::ITEM_END;
+	bool Started = false;
+	int64 StartTime = time_get();
+	while(true)
+	{
+		int LastTick = Reader.Tick();
+		Result = Reader.Next();
+		if(Result != CTeeHistorianReader::ITEM_TICK && Result != CTeeHistorianReader::ITEM_FINISH && Result != CTeeHistorianReader::ITEM_END)
+		{
+			NumItems++;
+			if(Result == CTeeHistorianReader::ITEM_ERROR)
+				break;
+			continue;
+		}
+
+		// everything of `LastTick` has been read
+		if(Started && pMapFilename)
+			Replay.Sync();
+		if(Result != CTeeHistorianReader::ITEM_TICK)
+			break;
+
+		int Tick = Reader.Tick();
+		if(EndTick >= 0 && Tick > EndTick)
+			break;
+		if(Tick < StartTick)
+			continue;
+		if(!Started)
+		{
+			Started = true;
+			if(pMapFilename)
+				Replay.Sync();
+			LastTick = Tick - 1;
+		}
+
+		// ticks without data changed nothing, the players stay at their
+		// recorded positions
+		for(int t = LastTick + 1; t <= Tick; t++)
+		{
+			if(pMapFilename)
+			{
+				if(t > LastTick + 1)
+					Replay.Sync();
+				Replay.Tick();
+			}
+			NumTicks++;
+		}
+	}
+	float Seconds = (time_get() - StartTime) / (float)time_freq();
+
+	if(Result == CTeeHistorianReader::ITEM_ERROR)
+		dbg_msg(TOOL_NAME, "damaged data at offset %lld, tick %d", Reader.Offset(), Reader.Tick());
+	else if(Result == CTeeHistorianReader::ITEM_END)
+		dbg_msg(TOOL_NAME, "file ends without finish, tick %d", Reader.Tick());
+
+	dbg_msg(TOOL_NAME, "replayed %d ticks with %lld items in %.3fs, %.0f ticks/s",
+		NumTicks, NumItems, Seconds, Seconds > 0 ? NumTicks / Seconds : 0.0f);
+	if(pMapFilename && Replay.m_NumCompared)
+	{
+		dbg_msg(TOOL_NAME, "%lld of %lld player positions matched (%.2f%%), mean error %.2f, max error %.2f",
+			Replay.m_NumMatched, Replay.m_NumCompared, 100.0 * Replay.m_NumMatched / Replay.m_NumCompared,
+			Replay.m_TotalError / Replay.m_NumCompared, Replay.m_MaxError);
+	}
+
+	delete pKernel;
+	delete pMap;
+	delete pStorage;
+	io_close(File);
+	return Result == CTeeHistorianReader::ITEM_ERROR ? -1 : 0;
+}